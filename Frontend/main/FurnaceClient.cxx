@@ -1,8 +1,10 @@
 #include "FurnaceClient.hxx"
-#include "Uart.hxx"
+#include "uart/Uart.hxx"
+#include <algorithm>
 #include <esp_log.h>
 #include <pl_modbus.h>
 #include <pl_uart.h>
+#include <string.h>
 
 const char *MODBUS_TAG = "ModbusServer";
 
@@ -11,58 +13,93 @@ FurnaceClient *FurnaceClient::myInstance = nullptr;
 FurnaceClient::FurnaceClient()
 {
 	myUart = UARTManager::GetInstance()->GetUart();
-	myClient = new PL::ModbusClient(myUart, PL::ModbusProtocol::rtu, 1);
+#if MODBUS_RS485
+	myUart->EnableRs485(MODBUS_DE_PIN);
+#endif
+#if TRAFFIC_RECORDER_SIZE > 0
+	myUart->EnableTrafficRecorder(TrafficRole::CLIENT, 0, TRAFFIC_RECORDER_SIZE, TRAFFIC_MERGE_GAP_US);
+#endif
 	myInstance = this;
-	myCoils = 0;
-	myDiscreteInputs = 0;
 
-	if (myClient->ReadHoldingRegisters(0, sizeof(myHeaterConfiguration) / sizeof(uint16_t), myHeaterConfiguration, NULL) == ESP_OK)
-	{
-		ESP_LOGI(MODBUS_TAG, "Holding registers read successfully");
-	}
-	else
-	{
-		ESP_LOGE(MODBUS_TAG, "Failed to read holding registers");
-	}
+	myStatsMutex = xSemaphoreCreateMutex();
+	assert(myStatsMutex != nullptr);
+	myHistoryMutex = xSemaphoreCreateMutex();
+	assert(myHistoryMutex != nullptr);
 
-	if (myClient->ReadCoils(0, 3, &myCoils, NULL) == ESP_OK)
+	// each furnace gets its own client for its unit id, they all share the UART and only the comms task uses them
+	static constexpr uint8_t unitIds[] = FURNACE_UNIT_IDS;
+	for (uint8_t id : unitIds)
 	{
-		ESP_LOGI(MODBUS_TAG, "Coils read successfully");
-	}
-	else
-	{
-		ESP_LOGE(MODBUS_TAG, "Failed to read coils");
-	}
+		if (!myScheduler.AddUnit(id))
+		{
+			ESP_LOGE(MODBUS_TAG, "Furnace unit %u is a duplicate or one too many, ignored", id);
+			continue;
+		}
 
-	if (myClient->ReadDiscreteInputs(0, 3, &myDiscreteInputs, NULL) == ESP_OK)
-	{
-		ESP_LOGI(MODBUS_TAG, "Discrete inputs read successfully");
-	}
-	else
-	{
-		ESP_LOGE(MODBUS_TAG, "Failed to read discrete inputs");
+		Unit &unit = myUnits[myUnitCount++];
+		unit.id = id;
+		unit.client = new PL::ModbusClient(myUart, PL::ModbusProtocol::rtu, id);
 	}
 
-	if (myClient->ReadInputRegisters(0, sizeof(myInputRegisters) / sizeof(uint16_t), myInputRegisters, NULL) == ESP_OK)
+	for (size_t i = 0; i < myUnitCount; i++)
 	{
-		ESP_LOGI(MODBUS_TAG, "Input registers read successfully");
-	}
-	else
-	{
-		ESP_LOGE(MODBUS_TAG, "Failed to read input registers");
+		Unit &unit = myUnits[i];
+
+		if (!ReadHoldingRegisters(unit))
+		{
+			ESP_LOGI(MODBUS_TAG, "Unit %u holding registers read successfully", unit.id);
+		}
+		else
+		{
+			ESP_LOGE(MODBUS_TAG, "Unit %u failed to read holding registers", unit.id);
+		}
+
+		if (!ReadCoils(unit))
+		{
+			ESP_LOGI(MODBUS_TAG, "Unit %u coils read successfully", unit.id);
+		}
+		else
+		{
+			ESP_LOGE(MODBUS_TAG, "Unit %u failed to read coils", unit.id);
+		}
+
+		if (!ReadDiscreteInputs(unit))
+		{
+			ESP_LOGI(MODBUS_TAG, "Unit %u discrete inputs read successfully", unit.id);
+		}
+		else
+		{
+			ESP_LOGE(MODBUS_TAG, "Unit %u failed to read discrete inputs", unit.id);
+		}
+
+		if (!ReadInputRegisters(unit))
+		{
+			ESP_LOGI(MODBUS_TAG, "Unit %u input registers read successfully", unit.id);
+		}
+		else
+		{
+			ESP_LOGE(MODBUS_TAG, "Unit %u failed to read input registers", unit.id);
+		}
 	}
 
-	ESP_LOGI(MODBUS_TAG, "Modbus server initialized");
+	ESP_LOGI(MODBUS_TAG, "Modbus client initialized for %u furnaces", myUnitCount);
+
+	xTaskCreate(&CommsTask, "modbus_comms_task", 2048 * 2, this, 5, &myCommsTask);
 }
 
 uint16_t FurnaceClient::GetHoldingRegister(HoldingRegister reg)
 {
-	return myHeaterConfiguration[static_cast<int>(reg)];
+	return selected().holding[static_cast<int>(reg)];
 }
 
 uint16_t FurnaceClient::GetInputRegister(InputRegister reg)
 {
-	return myInputRegisters[static_cast<int>(reg)];
+	return selected().inputs[static_cast<int>(reg)];
+}
+
+bool FurnaceClient::IsDiscreteInputSet(DiscreteInputMask mask)
+{
+	return (selected().discreteInputs & static_cast<uint8_t>(mask)) != 0;
 }
 
 uint16_t FurnaceClient::GetCurrentPWMDutyCycle()
@@ -114,75 +151,162 @@ FurnaceClient *FurnaceClient::GetInstance()
 	return myInstance;
 }
 
-bool FurnaceClient::SetCoil(CoilMask mask, bool value)
+void FurnaceClient::SelectUnit(size_t index)
 {
-	assert(myClient != nullptr);
+	if (index >= myUnitCount)
+	{
+		return;
+	}
 
-	PL::ModbusException err;
+	taskENTER_CRITICAL(&myQueueLock);
+	if (index != mySelected)
+	{
+		mySelected = index;
+		mySelectionChanged = true;
+		myScheduler.SetForeground(index);
+	}
+	taskEXIT_CRITICAL(&myQueueLock);
+
+	// the new foreground furnace is probably overdue at its new rate
+	wakeCommsTask();
+}
+
+void FurnaceClient::GetUnitInfo(size_t index, FurnaceUnitInfo &info)
+{
+	const Unit &unit = myUnits[index];
 
-	if (myClient->WriteSingleCoil(static_cast<uint16_t>(mask), value, &err) != ESP_OK)
+	taskENTER_CRITICAL(&myQueueLock);
+	info.selected = index == mySelected;
+	info.alarm = myScheduler.IsAlarmed(index);
+	info.pollPeriodMs = myScheduler.GetPeriodMs(index);
+	info.refreshIntervalMs = myScheduler.GetRefreshIntervalMs(index);
+	taskEXIT_CRITICAL(&myQueueLock);
+
+	info.unit = unit.id;
+	info.stale = IsDataStale(index);
+	info.currentTemp = unit.inputs[static_cast<int>(InputRegister::CURRENT_TEMP)];
+	info.errorCode = unit.inputs[static_cast<int>(InputRegister::ERROR_CODE)];
+}
+
+void FurnaceClient::QueueHoldingRegister(HoldingRegister reg, uint16_t value)
+{
+	taskENTER_CRITICAL(&myQueueLock);
+	Unit &unit = selected();
+	unit.pendingRegisters.Set(static_cast<uint16_t>(reg), value);
+	unit.holding[static_cast<int>(reg)] = value;
+	taskEXIT_CRITICAL(&myQueueLock);
+}
+
+void FurnaceClient::QueueCoil(CoilMask mask, bool value)
+{
+	// the mask is the bit in the coil byte, the coil's address is the bit's position
+	uint16_t address = __builtin_ctz(static_cast<uint8_t>(mask));
+
+	taskENTER_CRITICAL(&myQueueLock);
+	selected().pendingCoils.Set(address, value);
+	taskEXIT_CRITICAL(&myQueueLock);
+}
+
+bool FurnaceClient::SetConfig(uint16_t p, uint16_t i, uint16_t d, uint16_t period, uint16_t pidWindow, uint16_t reducedPwmValue, uint16_t reducedPwmUnder)
+{
+	ConfigStaging config;
+	config.values[static_cast<size_t>(HoldingRegister::HEATER_REDUCE_PWM_UNDER)] = reducedPwmUnder;
+	config.values[static_cast<size_t>(HoldingRegister::HEATER_REDUCED_PWM_VALUE)] = reducedPwmValue;
+	config.values[static_cast<size_t>(HoldingRegister::HEATER_PERIOD)] = period;
+	config.values[static_cast<size_t>(HoldingRegister::P)] = p;
+	config.values[static_cast<size_t>(HoldingRegister::I)] = i;
+	config.values[static_cast<size_t>(HoldingRegister::D)] = d;
+	config.values[static_cast<size_t>(HoldingRegister::TARGET_TEMP)] = CONFIG_UNCHANGED;
+	config.values[static_cast<size_t>(HoldingRegister::PID_WINDOW)] = pidWindow;
+
+	// a transaction that hasn't gone out yet is replaced, like a coalesced register write
+	taskENTER_CRITICAL(&myQueueLock);
+	config.TRANSACTION_ID = myNextConfigTransaction++;
+	if (myNextConfigTransaction == 0)
 	{
-		return false;
+		myNextConfigTransaction = 1; // 0 is what the Server reports for a plain holding register write
 	}
+	selected().queuedConfig = config;
+	selected().configQueued = true;
+	taskEXIT_CRITICAL(&myQueueLock);
 
+	wakeCommsTask();
 	return true;
 }
-bool FurnaceClient::SetConfig(uint16_t p, uint16_t i, uint16_t d, uint16_t period, uint16_t pidWindow, uint16_t reducedPwmValue, uint16_t reducedPwmUnder)
+
+bool FurnaceClient::UploadFile(FileId file, const uint16_t *content, uint16_t length, uint16_t baseVersion)
 {
-	assert(myClient != nullptr);
-	assert(myHeaterConfiguration != nullptr);
+	if (!IsWritableFile(file) || length > FileMaxLength(file))
+	{
+		return false;
+	}
 
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::P)] = p;
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::I)] = i;
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::D)] = d;
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::HEATER_PERIOD)] = period;
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::PID_WINDOW)] = pidWindow;
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::TARGET_TEMP)] = 0; // Set to 0 to disable PID
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::HEATER_REDUCED_PWM_VALUE)] = reducedPwmValue;
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::HEATER_REDUCE_PWM_UNDER)] = reducedPwmUnder;
+	taskENTER_CRITICAL(&myQueueLock);
+	memcpy(myQueuedUpload, content, length * sizeof(uint16_t));
+	myQueuedUploadLength = length;
+	myQueuedUploadBaseVersion = baseVersion;
+	myQueuedUploadFile = file;
+	myQueuedUploadUnit = mySelected;
+	myUploadQueued = true;
+	taskEXIT_CRITICAL(&myQueueLock);
 
-	return WriteHoldingRegisters();
+	wakeCommsTask();
+	return true;
 }
 
-bool FurnaceClient::SetTargetTemp(uint16_t targetTemp)
+bool FurnaceClient::DownloadFile(FileId file)
 {
-	assert(myClient != nullptr);
-	assert(myHeaterConfiguration != nullptr);
+	if (FileMaxLength(file) == 0)
+	{
+		return false;
+	}
+
+	taskENTER_CRITICAL(&myQueueLock);
+	myQueuedDownloadFile = file;
+	myQueuedDownloadUnit = mySelected;
+	myDownloadQueued = true;
+	taskEXIT_CRITICAL(&myQueueLock);
 
-	myHeaterConfiguration[static_cast<int>(HoldingRegister::TARGET_TEMP)] = targetTemp;
+	wakeCommsTask();
+	return true;
+}
 
-	auto result = myClient->WriteSingleHoldingRegister(static_cast<uint16_t>(HoldingRegister::TARGET_TEMP), targetTemp, NULL);
+bool FurnaceClient::SetTargetTemp(uint16_t targetTemp)
+{
+	QueueHoldingRegister(HoldingRegister::TARGET_TEMP, targetTemp);
 
-	return (result == ESP_OK);
+	wakeCommsTask();
+	return true;
 }
 
 bool FurnaceClient::EnableHeating()
 {
-	assert(myClient != nullptr);
+	QueueCoil(CoilMask::ENABLE, true);
 
-	auto res = myClient->WriteSingleCoil(static_cast<uint16_t>(CoilMask::ENABLE), true, NULL);
-	return (res == ESP_OK);
+	wakeCommsTask();
+	return true;
 }
 
 bool FurnaceClient::DisableHeating()
 {
-	assert(myClient != nullptr);
+	QueueCoil(CoilMask::ENABLE, false);
 
-	auto res = myClient->WriteSingleCoil(static_cast<uint16_t>(CoilMask::ENABLE), false, NULL);
-	return (res == ESP_OK);
+	wakeCommsTask();
+	return true;
 }
 
 bool FurnaceClient::IsHeatingEnabled()
 {
-	return (myCoils & static_cast<uint8_t>(CoilMask::ENABLE)) != 0;
+	return (selected().coils & static_cast<uint8_t>(CoilMask::ENABLE)) != 0;
 }
 
-bool FurnaceClient::ReadCoils()
+bool FurnaceClient::ReadCoils(Unit &unit)
 {
-	assert(myClient != nullptr);
+	assert(unit.client != nullptr);
 	bool readError = false;
 
-	if (myClient->ReadCoils(0, 3, &myCoils, NULL) != ESP_OK)
+	if (transact(ModbusFunction::READ_COILS, [&](PL::ModbusException *exception)
+				 { return unit.client->ReadCoils(0, 3, &unit.coils, exception); }) != ESP_OK)
 	{
 		readError = true;
 	}
@@ -190,14 +314,14 @@ bool FurnaceClient::ReadCoils()
 	return readError;
 }
 
-bool FurnaceClient::ReadHoldingRegisters()
+bool FurnaceClient::ReadHoldingRegisters(Unit &unit)
 {
-	assert(myClient != nullptr);
-	assert(myHeaterConfiguration != nullptr);
+	assert(unit.client != nullptr);
 
 	bool readError = false;
 
-	if (myClient->ReadHoldingRegisters(0, sizeof(myHeaterConfiguration) / sizeof(uint16_t), myHeaterConfiguration, NULL) != ESP_OK)
+	if (transact(ModbusFunction::READ_HOLDING_REGISTERS, [&](PL::ModbusException *exception)
+				 { return unit.client->ReadHoldingRegisters(0, sizeof(unit.holding) / sizeof(uint16_t), unit.holding, exception); }) != ESP_OK)
 	{
 		readError = true;
 	}
@@ -205,12 +329,13 @@ bool FurnaceClient::ReadHoldingRegisters()
 	return readError;
 }
 
-bool FurnaceClient::ReadDiscreteInputs()
+bool FurnaceClient::ReadDiscreteInputs(Unit &unit)
 {
-	assert(myClient != nullptr);
+	assert(unit.client != nullptr);
 	bool readError = false;
 
-	if (myClient->ReadDiscreteInputs(0, 3, &myDiscreteInputs, NULL) != ESP_OK)
+	if (transact(ModbusFunction::READ_DISCRETE_INPUTS, [&](PL::ModbusException *exception)
+				 { return unit.client->ReadDiscreteInputs(0, 3, &unit.discreteInputs, exception); }) != ESP_OK)
 	{
 		readError = true;
 	}
@@ -218,39 +343,387 @@ bool FurnaceClient::ReadDiscreteInputs()
 	return readError;
 }
 
-bool FurnaceClient::ReadInputRegisters()
+// While a config transaction is waiting for its outcome the read runs on over the config result registers,
+// so the status poll picks it up in the same request.
+bool FurnaceClient::ReadInputRegisters(Unit &unit)
 {
-	assert(myClient != nullptr);
-	assert(myInputRegisters != nullptr);
+	static_assert(CONFIG_RESULT_ADDRESS == static_cast<uint16_t>(InputRegister::NUM_INPUT_REGISTERS), "the config result follows the status registers");
+
+	assert(unit.client != nullptr);
 
 	bool readError = false;
+	bool withConfig = unit.awaitedConfig.TRANSACTION_ID != 0;
+	uint16_t registers[static_cast<size_t>(InputRegister::NUM_INPUT_REGISTERS) + ConfigResult::COUNT];
+	uint16_t count = sizeof(unit.inputs) / sizeof(uint16_t) + (withConfig ? ConfigResult::COUNT : 0);
 
-	if (myClient->ReadInputRegisters(0, sizeof(myInputRegisters) / sizeof(uint16_t), myInputRegisters, NULL) != ESP_OK)
+	if (transact(ModbusFunction::READ_INPUT_REGISTERS, [&](PL::ModbusException *exception)
+				 { return unit.client->ReadInputRegisters(0, count, registers, exception); }) != ESP_OK)
 	{
 		readError = true;
 	}
+	else
+	{
+		memcpy(unit.inputs, registers, sizeof(unit.inputs));
+		unit.lastStatusTick = xTaskGetTickCount();
+
+		if (withConfig)
+		{
+			ConfigResult result;
+			memcpy(&result, &registers[CONFIG_RESULT_ADDRESS], sizeof(result));
+			CheckConfigResult(unit, result);
+		}
+	}
+
+	if (unit.awaitedConfig.TRANSACTION_ID != 0 && xTaskGetTickCount() - unit.configSent >= pdMS_TO_TICKS(CONFIG_RESULT_TIMEOUT_MS))
+	{
+		ESP_LOGW(MODBUS_TAG, "No outcome for unit %u config transaction %u", unit.id, unit.awaitedConfig.TRANSACTION_ID);
+		FinishConfigTransaction(unit, unit.awaitedConfig.values, false);
+	}
 
 	return readError;
 }
 
-bool FurnaceClient::WriteHoldingRegisters()
+// The safety relevant status, the discrete inputs and the status registers. A furnace reporting an error or
+// not answering stays at the foreground rate until it's clear.
+void FurnaceClient::PollStatus(size_t index)
 {
-	assert(myClient != nullptr);
-	assert(myHeaterConfiguration != nullptr);
+	Unit &unit = myUnits[index];
+
+	bool success = !ReadDiscreteInputs(unit);
+	success = !ReadInputRegisters(unit) && success;
+
+	bool alarm = (unit.discreteInputs & static_cast<uint8_t>(DiscreteInputMask::ERROR)) != 0 ||
+				 unit.inputs[static_cast<int>(InputRegister::ERROR_CODE)] != 0;
 
-	bool writeError = false;
+	taskENTER_CRITICAL(&myQueueLock);
+	bool wasAlarmed = myScheduler.IsAlarmed(index);
+	myScheduler.Polled(index, static_cast<uint32_t>(esp_timer_get_time() / 1000), success, alarm);
+	taskEXIT_CRITICAL(&myQueueLock);
+
+	if ((alarm || !success) && !wasAlarmed)
+	{
+		ESP_LOGW(MODBUS_TAG, "Unit %u %s, polling it at the foreground rate", unit.id, success ? "reports an error" : "isn't answering");
+	}
+}
+
+bool FurnaceClient::WriteHoldingRegisterRun(Unit &unit, const RegisterCoalescer::Run &run)
+{
+	if (run.count == 1)
+	{
+		return transact(ModbusFunction::WRITE_SINGLE_REGISTER, [&](PL::ModbusException *exception)
+						{ return unit.client->WriteSingleHoldingRegister(run.start, run.values[0], exception); }) == ESP_OK;
+	}
+
+	return transact(ModbusFunction::WRITE_MULTIPLE_REGISTERS, [&](PL::ModbusException *exception)
+					{ return unit.client->WriteMultipleHoldingRegisters(run.start, run.count, run.values.data(), exception); }) == ESP_OK;
+}
+
+bool FurnaceClient::WriteCoilRun(Unit &unit, const WriteCoalescer<NUM_COILS>::Run &run)
+{
+	if (run.count == 1)
+	{
+		return transact(ModbusFunction::WRITE_SINGLE_COIL, [&](PL::ModbusException *exception)
+						{ return unit.client->WriteSingleCoil(run.start, run.values[0] != 0, exception); }) == ESP_OK;
+	}
+
+	uint8_t bits[(NUM_COILS + 7) / 8] = {};
+	for (uint16_t i = 0; i < run.count; i++)
+	{
+		if (run.values[i])
+		{
+			bits[i / 8] |= 1 << (i % 8);
+		}
+	}
+
+	return transact(ModbusFunction::WRITE_MULTIPLE_COILS, [&](PL::ModbusException *exception)
+					{ return unit.client->WriteMultipleCoils(run.start, run.count, bits, exception); }) == ESP_OK;
+}
+
+void FurnaceClient::ReportWrite(const Unit &unit, bool isCoil, uint16_t address, uint16_t value, bool success)
+{
+	if (myWriteCompleteCallback != nullptr)
+	{
+		myWriteCompleteCallback({.unit = unit.id, .isCoil = isCoil, .address = address, .value = value, .success = success});
+	}
+}
+
+// One function 16 write for the whole set. The Server answers with an exception if it rejected it, otherwise
+// the outcome turns up after the status registers once the control loop has applied it.
+void FurnaceClient::WriteConfigTransaction(Unit &unit, const ConfigStaging &config)
+{
+	bool success = transact(ModbusFunction::WRITE_MULTIPLE_REGISTERS, [&](PL::ModbusException *exception)
+							{ return unit.client->WriteMultipleHoldingRegisters(CONFIG_STAGING_ADDRESS, ConfigStaging::COUNT, &config, exception); }) == ESP_OK;
+
+	// a newer transaction replaces one still waiting, the Server only keeps the outcome of the latest
+	unit.awaitedConfig = config;
+	unit.configSent = xTaskGetTickCount();
+
+	if (!success)
+	{
+		FinishConfigTransaction(unit, config.values, false);
+	}
+}
+
+void FurnaceClient::CheckConfigResult(Unit &unit, const ConfigResult &result)
+{
+	if (result.TRANSACTION_ID != unit.awaitedConfig.TRANSACTION_ID)
+	{
+		// not applied yet, or replaced by someone else's before it was
+		return;
+	}
+
+	ConfigStatus status = static_cast<ConfigStatus>(result.STATUS);
+	if (status == ConfigStatus::APPLIED || status == ConfigStatus::REJECTED)
+	{
+		FinishConfigTransaction(unit, result.values, status == ConfigStatus::APPLIED);
+	}
+}
+
+// Reports every register the awaited transaction set, with the Server's effective value when it was applied
+void FurnaceClient::FinishConfigTransaction(Unit &unit, const uint16_t *values, bool success)
+{
+	for (uint16_t i = 0; i < CONFIG_REGISTER_COUNT; i++)
+	{
+		if (unit.awaitedConfig.values[i] == CONFIG_UNCHANGED)
+		{
+			continue;
+		}
+
+		if (success)
+		{
+			unit.holding[i] = values[i];
+		}
+		ReportWrite(unit, false, i, values[i], success);
+	}
+
+	unit.awaitedConfig.TRANSACTION_ID = 0;
+}
+
+void FurnaceClient::FlushWrites(Unit &unit)
+{
+	RegisterCoalescer::Run registers;
+	WriteCoalescer<NUM_COILS>::Run coils;
+
+	taskENTER_CRITICAL(&myQueueLock);
+	bool haveConfig = unit.configQueued;
+	ConfigStaging config = unit.queuedConfig;
+	unit.configQueued = false;
+	taskEXIT_CRITICAL(&myQueueLock);
+
+	if (haveConfig)
+	{
+		WriteConfigTransaction(unit, config);
+	}
+
+	while (true)
+	{
+		taskENTER_CRITICAL(&myQueueLock);
+		bool haveRegisters = unit.pendingRegisters.TakeRun(registers);
+		bool haveCoils = !haveRegisters && unit.pendingCoils.TakeRun(coils);
+		taskEXIT_CRITICAL(&myQueueLock);
+
+		if (haveRegisters)
+		{
+			bool success = WriteHoldingRegisterRun(unit, registers);
+			for (uint16_t i = 0; i < registers.count; i++)
+			{
+				ReportWrite(unit, false, registers.start + i, registers.values[i], success);
+			}
+		}
+		else if (haveCoils)
+		{
+			bool success = WriteCoilRun(unit, coils);
+			for (uint16_t i = 0; i < coils.count; i++)
+			{
+				uint8_t bit = 1 << (coils.start + i);
+				if (success)
+				{
+					unit.coils = coils.values[i] ? (unit.coils | bit) : (unit.coils & ~bit);
+				}
+				ReportWrite(unit, true, coils.start + i, coils.values[i], success);
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+// The whole block every time, so a Server that rebooted is supervising again after the next one
+void FurnaceClient::SendHeartbeat(Unit &unit)
+{
+	HeartbeatRegisters heartbeat = {
+		.COUNTER = ++unit.heartbeatCounter,
+		.PERIOD_MS = HEARTBEAT_PERIOD_MS,
+		.DEADLINE_MS = HEARTBEAT_DEADLINE_MS,
+		.POLICY = static_cast<uint16_t>(HEARTBEAT_POLICY),
+		.RAMP_DOWN_PER_MINUTE = HEARTBEAT_RAMP_DOWN_PER_MINUTE,
+	};
+
+	transact(ModbusFunction::WRITE_MULTIPLE_REGISTERS, [&](PL::ModbusException *exception)
+			 { return unit.client->WriteMultipleHoldingRegisters(HEARTBEAT_ADDRESS, HeartbeatRegisters::COUNT, &heartbeat, exception); });
+}
+
+void FurnaceClient::RunFileTransfers()
+{
+	taskENTER_CRITICAL(&myQueueLock);
+	bool upload = myUploadQueued;
+	FileId uploadFile = myQueuedUploadFile;
+	Unit &uploadUnit = myUnits[myQueuedUploadUnit];
+	uint16_t uploadLength = myQueuedUploadLength;
+	uint16_t baseVersion = myQueuedUploadBaseVersion;
+	if (upload)
+	{
+		memcpy(myUpload, myQueuedUpload, uploadLength * sizeof(uint16_t));
+	}
+	bool download = myDownloadQueued;
+	FileId downloadFile = myQueuedDownloadFile;
+	Unit &downloadUnit = myUnits[myQueuedDownloadUnit];
+	myUploadQueued = false;
+	myDownloadQueued = false;
+	taskEXIT_CRITICAL(&myQueueLock);
+
+	if (upload)
+	{
+		FileInfo info = {};
+		bool success = UploadQueuedFile(uploadUnit, uploadFile, uploadLength, baseVersion, info);
+		ESP_LOGI(MODBUS_TAG, "Upload of file %u to unit %u %s, version %u", static_cast<uint16_t>(uploadFile), uploadUnit.id, success ? "committed" : "failed", info.VERSION);
+
+		if (myFileTransferCallback != nullptr)
+		{
+			myFileTransferCallback({.unit = uploadUnit.id, .file = uploadFile, .upload = true, .success = success, .info = info, .content = nullptr});
+		}
+	}
+
+	if (download)
+	{
+		FileInfo info = {};
+		bool success = DownloadQueuedFile(downloadUnit, downloadFile, info);
+
+		if (myFileTransferCallback != nullptr)
+		{
+			myFileTransferCallback({.unit = downloadUnit.id, .file = downloadFile, .upload = false, .success = success, .info = info, .content = success ? &myDownload[FileInfo::COUNT] : nullptr});
+		}
+	}
+}
+
+// One function 16 write per FILE_RECORD_MAX_LENGTH registers, then the commit, then a read of the file's
+// info for the version the Server gave it
+bool FurnaceClient::UploadQueuedFile(Unit &unit, FileId file, uint16_t length, uint16_t baseVersion, FileInfo &info)
+{
+	uint16_t offset = 0;
+	do
+	{
+		uint16_t count = std::min<uint16_t>(FILE_RECORD_MAX_LENGTH, length - offset);
+		myFileRecord.header = {
+			.FILE = static_cast<uint16_t>(file),
+			.RECORD = offset,
+			.LENGTH = count,
+			.OPERATION = static_cast<uint16_t>(FileOperation::WRITE),
+		};
+		memcpy(myFileRecord.data, &myUpload[offset], count * sizeof(uint16_t));
+
+		if (transact(ModbusFunction::WRITE_MULTIPLE_REGISTERS, [&](PL::ModbusException *exception)
+					 { return unit.client->WriteMultipleHoldingRegisters(FILE_WRITE_ADDRESS, FileRecordHeader::COUNT + count, &myFileRecord, exception); }) != ESP_OK)
+		{
+			return false;
+		}
+		offset += count;
+	} while (offset < length);
+
+	FileCommit commit = {
+		.LENGTH = length,
+		.CRC = FileCrc(myUpload, length),
+		.BASE_VERSION = baseVersion,
+	};
+	myFileRecord.header = {
+		.FILE = static_cast<uint16_t>(file),
+		.RECORD = 0,
+		.LENGTH = FileCommit::COUNT,
+		.OPERATION = static_cast<uint16_t>(FileOperation::COMMIT),
+	};
+	memcpy(myFileRecord.data, &commit, sizeof(commit));
+
+	// an exception here is the Server rejecting the file, it still has the previous version
+	if (transact(ModbusFunction::WRITE_MULTIPLE_REGISTERS, [&](PL::ModbusException *exception)
+				 { return unit.client->WriteMultipleHoldingRegisters(FILE_WRITE_ADDRESS, FileRecordHeader::COUNT + FileCommit::COUNT, &myFileRecord, exception); }) != ESP_OK)
+	{
+		ReadFileInfo(unit, file, info);
+		return false;
+	}
+
+	return ReadFileInfo(unit, file, info) && info.CRC == commit.CRC;
+}
+
+// Reads the window in FILE_READ_MAX_LENGTH register pieces, the first brings the info along. The file can be
+// committed again between pieces, the CRC catches that and the whole read is repeated.
+bool FurnaceClient::DownloadQueuedFile(Unit &unit, FileId file, FileInfo &info)
+{
+	uint16_t address = FileReadAddress(file);
+	uint16_t maxLength = FileMaxLength(file);
+	uint16_t *content = &myDownload[FileInfo::COUNT];
 
-	if (myClient->WriteMultipleHoldingRegisters(0, sizeof(myHeaterConfiguration) / sizeof(uint16_t), myHeaterConfiguration, NULL) != ESP_OK)
+	for (int attempt = 0; attempt < FILE_DOWNLOAD_ATTEMPTS; attempt++)
 	{
-		writeError = true;
+		uint16_t first = std::min<uint16_t>(FILE_READ_MAX_LENGTH, FileInfo::COUNT + maxLength);
+		if (transact(ModbusFunction::READ_INPUT_REGISTERS, [&](PL::ModbusException *exception)
+					 { return unit.client->ReadInputRegisters(address, first, myDownload, exception); }) != ESP_OK)
+		{
+			return false;
+		}
+
+		memcpy(&info, myDownload, sizeof(info));
+		if (info.LENGTH > maxLength)
+		{
+			return false;
+		}
+
+		uint16_t total = FileInfo::COUNT + info.LENGTH;
+		for (uint16_t offset = first; offset < total;)
+		{
+			uint16_t count = std::min<uint16_t>(FILE_READ_MAX_LENGTH, total - offset);
+			if (transact(ModbusFunction::READ_INPUT_REGISTERS, [&](PL::ModbusException *exception)
+						 { return unit.client->ReadInputRegisters(address + offset, count, &myDownload[offset], exception); }) != ESP_OK)
+			{
+				return false;
+			}
+			offset += count;
+		}
+
+		if (FileCrc(content, info.LENGTH) == info.CRC)
+		{
+			return true;
+		}
+
+		ESP_LOGD(MODBUS_TAG, "File %u changed while it was read, reading it again", static_cast<uint16_t>(file));
 	}
 
-	return writeError;
+	return false;
+}
+
+bool FurnaceClient::ReadFileInfo(Unit &unit, FileId file, FileInfo &info)
+{
+	return transact(ModbusFunction::READ_INPUT_REGISTERS, [&](PL::ModbusException *exception)
+					{ return unit.client->ReadInputRegisters(FileReadAddress(file), FileInfo::COUNT, &info, exception); }) == ESP_OK;
 }
 
-void FurnaceClient::ReadTask(void *pvParameter)
+// Owns the serial link. Sleeps until either a write is queued or the next poll is due. Writes that keep
+// arriving (someone dragging the arc) are flushed at most once per MODBUS_WRITE_COALESCE_MS, everything
+// queued in between collapses into the latest values. Status polls go to whichever furnace the scheduler
+// says is most overdue, one per pass so queued writes never wait behind a round of every furnace.
+void FurnaceClient::CommsTask(void *pvParameter)
 {
 	FurnaceClient *instance = static_cast<FurnaceClient *>(pvParameter);
+	TickType_t lastStatsLog = xTaskGetTickCount();
+	TickType_t lastUtilization = xTaskGetTickCount();
+	TickType_t lastFlush = 0;
+	TickType_t lastHistoryDrain = 0;
+	TickType_t lastHeartbeat = 0;
+	TickType_t lastNegotiation = xTaskGetTickCount() - pdMS_TO_TICKS(LINK_RENEGOTIATE_MS);
+	const TickType_t coalescePeriod = pdMS_TO_TICKS(MODBUS_WRITE_COALESCE_MS);
+	const TickType_t heartbeatPeriod = pdMS_TO_TICKS(HEARTBEAT_PERIOD_MS);
+	const TickType_t utilizationWindow = pdMS_TO_TICKS(BUS_UTILIZATION_WINDOW_MS);
 
 	while (42)
 	{
@@ -261,16 +734,532 @@ void FurnaceClient::ReadTask(void *pvParameter)
 			continue;
 		}
 
-		if (instance->myClient == nullptr)
+		if (instance->myUnitCount == 0)
 		{
-			ESP_LOGE(MODBUS_TAG, "myClient is null");
+			ESP_LOGE(MODBUS_TAG, "no furnaces configured");
 			vTaskDelay(1000 / portTICK_PERIOD_MS);
 			continue;
 		}
 
-		ReadDiscreteInputs();
-		ReadInputRegisters();
+#if LINK_TELEMETRY_ENABLED
+		if (instance->myUnitCount == 1 && xTaskGetTickCount() - lastNegotiation >= pdMS_TO_TICKS(LINK_RENEGOTIATE_MS))
+		{
+			if (instance->NegotiateTelemetry())
+			{
+				instance->RunTelemetry();
+
+				// back on RTU, poll straight away
+				taskENTER_CRITICAL(&instance->myQueueLock);
+				instance->myScheduler.PollWithin(0, static_cast<uint32_t>(esp_timer_get_time() / 1000), 0);
+				taskEXIT_CRITICAL(&instance->myQueueLock);
+			}
+			lastNegotiation = xTaskGetTickCount();
+		}
+#endif
+
+		size_t next;
+		uint32_t untilPollMs;
+		taskENTER_CRITICAL(&instance->myQueueLock);
+		instance->myScheduler.Next(static_cast<uint32_t>(esp_timer_get_time() / 1000), next, untilPollMs);
+		taskEXIT_CRITICAL(&instance->myQueueLock);
+
+		TickType_t untilPoll = pdMS_TO_TICKS(untilPollMs);
+		TickType_t sinceHeartbeat = xTaskGetTickCount() - lastHeartbeat;
+		TickType_t untilHeartbeat = sinceHeartbeat < heartbeatPeriod ? heartbeatPeriod - sinceHeartbeat : 0;
+
+		if (ulTaskNotifyTake(pdTRUE, std::min(untilPoll, untilHeartbeat)) > 0)
+		{
+			TickType_t sinceFlush = xTaskGetTickCount() - lastFlush;
+			if (sinceFlush < coalescePeriod)
+			{
+				vTaskDelay(coalescePeriod - sinceFlush);
+			}
+		}
+
+		for (size_t i = 0; i < instance->myUnitCount; i++)
+		{
+			Unit &unit = instance->myUnits[i];
+
+			taskENTER_CRITICAL(&instance->myQueueLock);
+			bool pending = unit.HasPendingWrites();
+			taskEXIT_CRITICAL(&instance->myQueueLock);
+
+			if (!pending)
+			{
+				continue;
+			}
+
+			instance->FlushWrites(unit);
+			lastFlush = xTaskGetTickCount();
+
+			// bring the furnace's next status poll forward to pick up the config outcome once it has applied it
+			if (unit.awaitedConfig.TRANSACTION_ID != 0)
+			{
+				taskENTER_CRITICAL(&instance->myQueueLock);
+				instance->myScheduler.PollWithin(i, static_cast<uint32_t>(esp_timer_get_time() / 1000), CONFIG_RESULT_POLL_DELAY_MS);
+				taskEXIT_CRITICAL(&instance->myQueueLock);
+			}
+		}
+
+		taskENTER_CRITICAL(&instance->myQueueLock);
+		bool transfers = instance->myUploadQueued || instance->myDownloadQueued;
+		bool selectionChanged = instance->mySelectionChanged;
+		instance->mySelectionChanged = false;
+		taskEXIT_CRITICAL(&instance->myQueueLock);
+
+		if (transfers)
+		{
+			instance->RunFileTransfers();
+		}
+
+		if (instance->myTrafficDumpRequested)
+		{
+			instance->myTrafficDumpRequested = false;
+			instance->myUart->PrintTrafficDump();
+		}
+
+		if (xTaskGetTickCount() - lastHeartbeat >= heartbeatPeriod)
+		{
+			lastHeartbeat = xTaskGetTickCount();
+			for (size_t i = 0; i < instance->myUnitCount; i++)
+			{
+				instance->SendHeartbeat(instance->myUnits[i]);
+			}
+		}
+
+		if (selectionChanged)
+		{
+			// the history ring carries on with the new furnace from its oldest sample
+			instance->myHistorySynced = false;
+			instance->myHistoryTimeBased = false;
+			lastHistoryDrain = 0;
+		}
+
+		if (xTaskGetTickCount() - lastUtilization >= utilizationWindow)
+		{
+			instance->UpdateBusUtilization(xTaskGetTickCount() - lastUtilization);
+			lastUtilization = xTaskGetTickCount();
+		}
+
+		taskENTER_CRITICAL(&instance->myQueueLock);
+		bool due = instance->myScheduler.Next(static_cast<uint32_t>(esp_timer_get_time() / 1000), next, untilPollMs);
+		taskEXIT_CRITICAL(&instance->myQueueLock);
+
+		if (!due)
+		{
+			continue;
+		}
 
-		vTaskDelay(1000 / portTICK_PERIOD_MS);
+		instance->PollStatus(next);
+
+		if (next == instance->mySelected && xTaskGetTickCount() - lastHistoryDrain >= pdMS_TO_TICKS(HISTORY_DRAIN_PERIOD_MS))
+		{
+			lastHistoryDrain = xTaskGetTickCount();
+			instance->DrainHistory(instance->myUnits[next]);
+		}
+
+		if (xTaskGetTickCount() - lastStatsLog >= pdMS_TO_TICKS(LINK_STATS_LOG_PERIOD_MS))
+		{
+			lastStatsLog = xTaskGetTickCount();
+			instance->LogLinkStats();
+		}
+	}
+}
+
+void FurnaceClient::UpdateBusUtilization(TickType_t window)
+{
+	uint64_t windowUs = static_cast<uint64_t>(pdTICKS_TO_MS(window)) * 1000;
+
+	xSemaphoreTake(myStatsMutex, portMAX_DELAY);
+	uint32_t busyUs = myBusyUs;
+	myBusyUs = 0;
+	xSemaphoreGive(myStatsMutex);
+
+	myBusUtilization = std::min<uint64_t>(busyUs * 100 / windowUs, 100);
+}
+
+// Asks the Server to switch to telemetry mode. An older Server answers with an exception and we stay on RTU.
+bool FurnaceClient::NegotiateTelemetry()
+{
+	LinkModeRegisters request = {
+		.MODE = static_cast<uint16_t>(LinkMode::TELEMETRY),
+		.TELEMETRY_PERIOD_MS = LINK_TELEMETRY_PERIOD_MS,
+		.KEEPALIVE_TIMEOUT_MS = LINK_KEEPALIVE_TIMEOUT_MS,
+	};
+
+	return transact(ModbusFunction::WRITE_MULTIPLE_REGISTERS, [&](PL::ModbusException *exception)
+					{ return myUnits[0].client->WriteMultipleHoldingRegisters(LINK_MODE_ADDRESS, LinkModeRegisters::COUNT, &request, exception); }) == ESP_OK;
+}
+
+// Runs the Frontend end of the telemetry link until the Server has been quiet for LINK_KEEPALIVE_TIMEOUT_MS.
+// Only ever with a single furnace on the bus, so everything here is for myUnits[0].
+// Queued writes go out as one command per register, a batch at a time, and the next batch waits for the
+// previous one to be acknowledged so the coalescers keep collapsing writes in the meantime.
+void FurnaceClient::RunTelemetry()
+{
+	Unit &unit = myUnits[0];
+	const TickType_t timeout = pdMS_TO_TICKS(LINK_KEEPALIVE_TIMEOUT_MS);
+	const TickType_t keepalivePeriod = timeout / 4;
+
+	OutstandingCommand outstanding[MAX_OUTSTANDING_COMMANDS];
+	size_t outstandingCount = 0;
+	TickType_t commandsSent = 0;
+	TickType_t lastHeard = xTaskGetTickCount();
+	TickType_t lastSent = xTaskGetTickCount();
+	uint8_t buffer[64];
+
+	ESP_LOGI(MODBUS_TAG, "Link switched to telemetry");
+	myTelemetryActive = true;
+	myUart->PauseMonitoring(true);
+
+	while (xTaskGetTickCount() - lastHeard < timeout)
+	{
+		// Config transactions and file transfers have to go out over RTU. Going quiet lets the Server time out
+		// and fall back, then the loop ends once it has stopped sending too.
+		taskENTER_CRITICAL(&myQueueLock);
+		bool leaving = unit.configQueued || myUploadQueued || myDownloadQueued;
+		taskEXIT_CRITICAL(&myQueueLock);
+
+		if (outstandingCount > 0 && xTaskGetTickCount() - commandsSent >= timeout)
+		{
+			for (size_t i = 0; i < outstandingCount; i++)
+			{
+				ReportWrite(unit, outstanding[i].isCoil, outstanding[i].address, outstanding[i].value, false);
+			}
+			outstandingCount = 0;
+		}
+
+		if (outstandingCount == 0)
+		{
+			outstandingCount = SendCommands(outstanding);
+			if (outstandingCount > 0)
+			{
+				commandsSent = lastSent = xTaskGetTickCount();
+			}
+		}
+
+		if (!leaving && xTaskGetTickCount() - lastSent >= keepalivePeriod)
+		{
+			uint8_t frame[TELEMETRY_MAX_FRAME];
+			SendFrame(frame, EncodeFrame(PacketType::KEEPALIVE, nullptr, 0, frame, sizeof(frame)));
+			lastSent = xTaskGetTickCount();
+		}
+
+		size_t readable = myUart->GetReadableSize();
+		if (readable == 0)
+		{
+			// a queued write wakes us early
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LINK_TELEMETRY_POLL_MS));
+			continue;
+		}
+
+		size_t size = std::min(readable, sizeof(buffer));
+		if (myUart->Read(buffer, size) != ESP_OK)
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < size; i++)
+		{
+			if (!myTelemetryDecoder.Push(buffer[i]))
+			{
+				continue;
+			}
+			lastHeard = xTaskGetTickCount();
+
+			TelemetryPacket packet;
+			CommandAckPacket ack;
+			if (myTelemetryDecoder.GetType() == PacketType::TELEMETRY && myTelemetryDecoder.Get(packet))
+			{
+				ApplyTelemetry(packet);
+			}
+			else if (myTelemetryDecoder.GetType() == PacketType::COMMAND_ACK && myTelemetryDecoder.Get(ack))
+			{
+				for (size_t j = 0; j < outstandingCount; j++)
+				{
+					if (outstanding[j].sequence != ack.sequence)
+					{
+						continue;
+					}
+
+					const OutstandingCommand &command = outstanding[j];
+					bool success = ack.status == 0;
+					if (success && command.isCoil)
+					{
+						uint8_t bit = 1 << command.address;
+						unit.coils = command.value ? (unit.coils | bit) : (unit.coils & ~bit);
+					}
+					ReportWrite(unit, command.isCoil, command.address, command.value, success);
+
+					outstanding[j] = outstanding[--outstandingCount];
+					break;
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < outstandingCount; i++)
+	{
+		ReportWrite(unit, outstanding[i].isCoil, outstanding[i].address, outstanding[i].value, false);
+	}
+
+	myTelemetryActive = false;
+	myUart->PauseMonitoring(false);
+	ESP_LOGW(MODBUS_TAG, "Telemetry stopped, link back to RTU (%lu frames, %lu bad)", myTelemetryDecoder.GetFrames(), myTelemetryDecoder.GetErrors());
+}
+
+size_t FurnaceClient::SendCommands(OutstandingCommand *outstanding)
+{
+	Unit &unit = myUnits[0];
+	RegisterCoalescer::Run registers;
+	WriteCoalescer<NUM_COILS>::Run coils;
+	size_t count = 0;
+
+	auto send = [&](CommandTable table, uint16_t address, uint16_t value)
+	{
+		CommandPacket command = {
+			.sequence = myCommandSequence++,
+			.table = static_cast<uint8_t>(table),
+			.address = address,
+			.value = value,
+		};
+
+		uint8_t frame[TELEMETRY_MAX_FRAME];
+		SendFrame(frame, EncodeFrame(PacketType::COMMAND, command, frame, sizeof(frame)));
+		outstanding[count++] = {command.sequence, table == CommandTable::COIL, address, value};
+	};
+
+	// every dirty entry is taken at most once, so this can't overrun MAX_OUTSTANDING_COMMANDS
+	while (true)
+	{
+		taskENTER_CRITICAL(&myQueueLock);
+		bool haveRegisters = unit.pendingRegisters.TakeRun(registers);
+		bool haveCoils = !haveRegisters && unit.pendingCoils.TakeRun(coils);
+		taskEXIT_CRITICAL(&myQueueLock);
+
+		if (haveRegisters)
+		{
+			for (uint16_t i = 0; i < registers.count; i++)
+			{
+				send(CommandTable::HOLDING_REGISTER, registers.start + i, registers.values[i]);
+			}
+		}
+		else if (haveCoils)
+		{
+			for (uint16_t i = 0; i < coils.count; i++)
+			{
+				send(CommandTable::COIL, coils.start + i, coils.values[i]);
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	return count;
+}
+
+void FurnaceClient::ApplyTelemetry(const TelemetryPacket &packet)
+{
+	Unit &unit = myUnits[0];
+	unit.lastStatusTick = xTaskGetTickCount();
+	unit.inputs[static_cast<int>(InputRegister::CURRENT_TEMP)] = packet.tempDc / 10;
+	unit.inputs[static_cast<int>(InputRegister::HEATER_PWM_DUTY_CYCLE)] = packet.duty;
+	unit.inputs[static_cast<int>(InputRegister::ERROR_CODE)] = packet.errorCode;
+
+	uint8_t errorBit = static_cast<uint8_t>(DiscreteInputMask::ERROR);
+	unit.discreteInputs = (packet.flags & TELEMETRY_ERROR) ? (unit.discreteInputs | errorBit) : (unit.discreteInputs & ~errorBit);
+
+	uint8_t enableBit = static_cast<uint8_t>(CoilMask::ENABLE);
+	unit.coils = (packet.flags & TELEMETRY_ENABLED) ? (unit.coils | enableBit) : (unit.coils & ~enableBit);
+}
+
+void FurnaceClient::SendFrame(const uint8_t *frame, size_t size)
+{
+	if (size > 0)
+	{
+		myUart->Write(frame, size);
+	}
+}
+
+// Reads the FIFO header for the server's newest sequence, then everything we haven't seen yet straight out
+// of the ring in as few reads as possible: one read covers HISTORY_SAMPLES_PER_READ samples, and a window
+// is only split where it wraps around the end of the ring.
+bool FurnaceClient::DrainHistory(Unit &unit)
+{
+	HistoryHeader header;
+
+	if (transact(ModbusFunction::READ_INPUT_REGISTERS, [&](PL::ModbusException *exception)
+				 { return unit.client->ReadInputRegisters(HISTORY_ADDRESS, HistoryHeader::COUNT, &header, exception); }) != ESP_OK)
+	{
+		return false;
+	}
+
+	uint16_t available = header.NEXT_SEQUENCE - myServerHistoryNext;
+
+	// first drain, or the server restarted and its sequence went backwards
+	if (!myHistorySynced || available > 0x8000)
+	{
+		available = std::min<uint16_t>(header.NEXT_SEQUENCE, HISTORY_CAPACITY);
+		myServerHistoryNext = header.NEXT_SEQUENCE - available;
+		myHistorySynced = true;
+	}
+
+	// the oldest slot is the next one to be overwritten, anything further back is already gone
+	if (available > HISTORY_CAPACITY - 1)
+	{
+		uint16_t skipped = available - (HISTORY_CAPACITY - 1);
+		myHistoryLost += skipped;
+		myServerHistoryNext += skipped;
+		available -= skipped;
+	}
+
+	HistorySample samples[HISTORY_SAMPLES_PER_READ];
+
+	while (available > 0)
+	{
+		uint16_t slot = myServerHistoryNext % HISTORY_CAPACITY;
+		uint16_t count = std::min<uint16_t>({available, HISTORY_SAMPLES_PER_READ, static_cast<uint16_t>(HISTORY_CAPACITY - slot)});
+
+		if (transact(ModbusFunction::READ_INPUT_REGISTERS, [&](PL::ModbusException *exception)
+					 { return unit.client->ReadInputRegisters(HISTORY_SAMPLES_ADDRESS + slot * HistorySample::COUNT, count * HistorySample::COUNT, samples, exception); }) != ESP_OK)
+		{
+			// try again from the same place next time
+			return false;
+		}
+
+		for (uint16_t i = 0; i < count; i++)
+		{
+			// a different sequence means the sampler lapped us between the header read and this one
+			if (samples[i].SEQUENCE == myServerHistoryNext)
+			{
+				StoreHistorySample(samples[i]);
+			}
+			else
+			{
+				myHistoryLost++;
+			}
+			myServerHistoryNext++;
+		}
+		available -= count;
+	}
+
+	return true;
+}
+
+void FurnaceClient::StoreHistorySample(const HistorySample &sample)
+{
+	if (!myHistoryTimeBased)
+	{
+		myHistoryTimeMs = sample.TIME_DS * 100;
+		myHistoryTimeBased = true;
+	}
+	else
+	{
+		myHistoryTimeMs += static_cast<uint16_t>(sample.TIME_DS - myLastHistoryTimeDs) * 100;
+	}
+	myLastHistoryTimeDs = sample.TIME_DS;
+
+	xSemaphoreTake(myHistoryMutex, portMAX_DELAY);
+	myHistory[myHistoryNext % HISTORY_CAPACITY] = {
+		.sequence = myHistoryNext,
+		.timeMs = myHistoryTimeMs,
+		.tempC = sample.TEMP_DC / 10.0f,
+		.duty = sample.DUTY,
+	};
+	myHistoryNext++;
+	xSemaphoreGive(myHistoryMutex);
+}
+
+size_t FurnaceClient::GetHistory(uint32_t fromSequence, HistoryPoint *points, size_t maxPoints)
+{
+	size_t copied = 0;
+
+	xSemaphoreTake(myHistoryMutex, portMAX_DELAY);
+	uint32_t oldest = myHistoryNext > HISTORY_CAPACITY ? myHistoryNext - HISTORY_CAPACITY : 0;
+	for (uint32_t sequence = std::max(fromSequence, oldest); sequence < myHistoryNext && copied < maxPoints; sequence++)
+	{
+		points[copied++] = myHistory[sequence % HISTORY_CAPACITY];
+	}
+	xSemaphoreGive(myHistoryMutex);
+
+	return copied;
+}
+
+TransactionResult FurnaceClient::classify(esp_err_t result, PL::ModbusException exception)
+{
+	if (result == ESP_OK)
+	{
+		return TransactionResult::OK;
+	}
+
+	if (exception != PL::ModbusException::noException)
+	{
+		return TransactionResult::EXCEPTION;
+	}
+
+	switch (result)
+	{
+	case ESP_ERR_TIMEOUT:
+		return TransactionResult::TIMEOUT;
+	case ESP_ERR_INVALID_CRC:
+	case ESP_ERR_INVALID_RESPONSE:
+	case ESP_ERR_INVALID_SIZE:
+		return TransactionResult::CRC_ERROR;
+	default:
+		return TransactionResult::FAILURE;
+	}
+}
+
+uint32_t FurnaceClient::GetLinkLatencyUs()
+{
+	xSemaphoreTake(myStatsMutex, portMAX_DELAY);
+	uint32_t latency = myLinkStats.GetLatencyEwmaUs();
+	xSemaphoreGive(myStatsMutex);
+
+	return latency;
+}
+
+void FurnaceClient::GetLinkStats(LinkStats &stats)
+{
+	xSemaphoreTake(myStatsMutex, portMAX_DELAY);
+	stats = myLinkStats;
+	xSemaphoreGive(myStatsMutex);
+}
+
+void FurnaceClient::ResetLinkStats()
+{
+	xSemaphoreTake(myStatsMutex, portMAX_DELAY);
+	myLinkStats.Reset();
+	xSemaphoreGive(myStatsMutex);
+}
+
+void FurnaceClient::LogLinkStats()
+{
+	// logged under the lock rather than copied, the stats are a few KB and this runs on the poll task's stack
+	xSemaphoreTake(myStatsMutex, portMAX_DELAY);
+	const LinkStats &stats = myLinkStats;
+	const FunctionStats &totals = stats.GetTotals();
+
+	ESP_LOGI(MODBUS_TAG, "link quality %u%%, %lu requests, %lu timeouts, %lu crc, %lu exceptions, %lu failures",
+			 stats.GetQuality(), totals.requests, totals.timeouts, totals.crcErrors, totals.exceptions, totals.failures);
+
+	for (size_t i = 0; i < stats.GetFunctionCount(); i++)
+	{
+		const FunctionStats &function = stats.GetFunctionAt(i);
+		ESP_LOGI(MODBUS_TAG, "  fc %02x: %lu req, %lu to, %lu crc, %lu ex, latency us min %lu mean %lu p99 %lu max %lu",
+				 function.functionCode, function.requests, function.timeouts, function.crcErrors, function.exceptions,
+				 function.latency.GetMin(), function.latency.GetMean(), function.latency.GetPercentile(0.99f), function.latency.GetMax());
+	}
+	xSemaphoreGive(myStatsMutex);
+
+	// the request's share of each round trip, the rest is the Server turning around plus the reply
+	if (myUart->IsRs485())
+	{
+		LatencyHistogram drain;
+		myUart->GetTxDrain(drain);
+		ESP_LOGI(MODBUS_TAG, "  rs485: request on the wire and DE released us p50 %lu max %lu, %lu collisions",
+				 drain.GetPercentile(0.5f), drain.GetMax(), myUart->GetCollisions());
 	}
 }
\ No newline at end of file
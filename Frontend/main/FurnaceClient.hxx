@@ -1,14 +1,26 @@
 #pragma once
 
 #include "hardware.h"
+#include "modbus/ConfigTransaction.hxx"
+#include "modbus/FileRecords.hxx"
+#include "modbus/Heartbeat.hxx"
+#include "modbus/History.hxx"
+#include "modbus/LinkStats.hxx"
+#include "modbus/PollScheduler.hxx"
+#include "modbus/WriteCoalescer.hxx"
+#include "telemetry/Telemetry.hxx"
+#include "uart/LinkUart.hxx"
 #include <array>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <pl_modbus.h>
 #include <pl_uart.h>
 #include <utility>
 
 enum class CoilMask : uint8_t
 {
-	ENABLE = 0x01, // 0b00000010
+	ENABLE = 0x01, // 0b00000001
 };
 
 enum class DiscreteInputMask : uint8_t
@@ -45,6 +57,50 @@ using DiscreteInputs = uint8_t;
 using HoldingRegisters = uint16_t[static_cast<size_t>(HoldingRegister::NUM_HOLDING_REGISTERS)];
 using InputRegisters = uint16_t[static_cast<size_t>(InputRegister::NUM_INPUT_REGISTERS)];
 
+static constexpr size_t NUM_COILS = 1;
+
+struct HistoryPoint
+{
+	uint32_t sequence; // local and gap free, samples the server dropped before we got to them are counted in GetHistoryLost()
+	uint32_t timeMs;   // server uptime when the sample was taken
+	float tempC;
+	uint16_t duty;
+};
+
+struct WriteResult
+{
+	uint8_t unit;	  // the furnace written to
+	bool isCoil;	  // otherwise a holding register
+	uint16_t address; // coil or HoldingRegister index
+	uint16_t value;
+	bool success;
+};
+
+struct FileTransferResult
+{
+	uint8_t unit;
+	FileId file;
+	bool upload; // otherwise a download
+	bool success;
+	FileInfo info;			 // the file as the Server has it after the transfer
+	const uint16_t *content; // downloads only, valid for the duration of the callback
+};
+
+struct FurnaceUnitInfo
+{
+	uint8_t unit;
+	bool selected;
+	bool stale;
+	bool alarm;				   // raised an error or stopped answering, polled at the foreground rate
+	uint16_t currentTemp;
+	uint16_t errorCode;
+	uint32_t pollPeriodMs;	   // what it's scheduled at
+	uint32_t refreshIntervalMs; // what it's getting, mean time between answered polls, 0 until there have been two
+};
+
+// One Modbus client for every furnace on the bus, FURNACE_UNIT_IDS. The getters and writes are for the
+// selected furnace, the one on screen. Its status is polled every MODBUS_POLL_PERIOD_MS and the others'
+// every MODBUS_BACKGROUND_POLL_PERIOD_MS, see modbus/PollScheduler.hxx. Every furnace gets heartbeats.
 class FurnaceClient
 {
 
@@ -52,6 +108,28 @@ public:
 	FurnaceClient();
 	static FurnaceClient *GetInstance();
 
+	size_t GetUnitCount()
+	{
+		return myUnitCount;
+	}
+
+	size_t GetSelectedUnit()
+	{
+		return mySelected;
+	}
+
+	// Switches the getters and the writes queued from now on to another furnace. Writes already queued still
+	// go to the furnace they were meant for. The history starts again from the new furnace's oldest sample.
+	void SelectUnit(size_t index);
+
+	void GetUnitInfo(size_t index, FurnaceUnitInfo &info);
+
+	// percentage of the last BUS_UTILIZATION_WINDOW_MS spent in Modbus transactions
+	uint8_t GetBusUtilization()
+	{
+		return myBusUtilization;
+	}
+
 	uint16_t GetCurrentPWMDutyCycle(); // input register
 	uint16_t GetCurrentTemp();		   // input register
 	uint16_t GetTargetTemp();		   // holding register
@@ -60,30 +138,237 @@ public:
 	bool HasError();				   // discrete input
 	bool IsDoorOpen();				   // discrete input
 	bool IsEmergencyRelayActive();	   // discrete input
+
+	// Writes are queued and never touch the serial link from the calling task, so these are safe to call
+	// straight from an lvgl event. Repeated writes to the same register before the comms task gets to them
+	// collapse into the latest value. The outcome is reported through the WriteCompleteCallback.
+	// SetConfig goes out as one config transaction, see modbus/ConfigTransaction.hxx. The Server applies all
+	// of it or none of it, leaves the target temp alone, and the callback gets the values it actually applied.
 	bool SetConfig(uint16_t p, uint16_t i, uint16_t d, uint16_t period, uint16_t pidWindow, uint16_t reducedPwmValue, uint16_t reducedPwmUnder);
 	bool SetTargetTemp(uint16_t targetTemp);
 	bool EnableHeating();
 	bool DisableHeating();
 	bool IsHeatingEnabled();
 
+	// called from the comms task once per register/coil after its write was answered (or failed)
+	using WriteCompleteCallback = void (*)(const WriteResult &result);
+	void SetWriteCompleteCallback(WriteCompleteCallback callback)
+	{
+		myWriteCompleteCallback = callback;
+	}
+
+	// Bulk transfers through the Server's file record windows, see modbus/FileRecords.hxx. Queued for the comms
+	// task like the register writes, one upload and one download at a time with the latest request winning,
+	// and reported through the FileTransferCallback. An upload based on baseVersion fails rather than
+	// overwriting a file someone else has committed since.
+	bool UploadFile(FileId file, const uint16_t *content, uint16_t length, uint16_t baseVersion = FILE_ANY_VERSION);
+	bool DownloadFile(FileId file);
+
+	using FileTransferCallback = void (*)(const FileTransferResult &result);
+	void SetFileTransferCallback(FileTransferCallback callback)
+	{
+		myFileTransferCallback = callback;
+	}
+
+	// Copies up to maxPoints history samples with a sequence >= fromSequence, oldest first, and returns how
+	// many it copied. Pass the last returned sequence + 1 to pick up where you left off.
+	size_t GetHistory(uint32_t fromSequence, HistoryPoint *points, size_t maxPoints);
+	uint32_t GetHistoryLost()
+	{
+		return myHistoryLost;
+	}
+
+	// true while the Server is streaming telemetry instead of being polled over Modbus RTU. Only ever with
+	// a single furnace on the bus, telemetry mode is point to point.
+	bool IsTelemetryActive()
+	{
+		return myTelemetryActive;
+	}
+
+	// recent mean round trip of answered transactions
+	uint32_t GetLinkLatencyUs();
+
+	// true when the selected furnace's status hasn't been refreshed for LINK_STALE_MS, what's shown is old
+	bool IsDataStale()
+	{
+		return IsDataStale(mySelected);
+	}
+
+	// a background furnace is given an extra MODBUS_BACKGROUND_POLL_PERIOD_MS
+	bool IsDataStale(size_t index)
+	{
+		TickType_t limit = pdMS_TO_TICKS(LINK_STALE_MS + (index == mySelected ? 0 : MODBUS_BACKGROUND_POLL_PERIOD_MS));
+		return xTaskGetTickCount() - myUnits[index].lastStatusTick > limit;
+	}
+
+	// copies the transaction counters into stats, safe to call from any task
+	void GetLinkStats(LinkStats &stats);
+	void ResetLinkStats();
+
+	// Has the comms task print the traffic recording to the console between two transactions, see
+	// LinkUart::PrintTrafficDump(). Does nothing if TRAFFIC_RECORDER_SIZE is 0.
+	void RequestTrafficDump()
+	{
+		myTrafficDumpRequested = true;
+		wakeCommsTask();
+	}
+
 private:
-	bool SetCoil(CoilMask mask, bool value);
+	using RegisterCoalescer = WriteCoalescer<static_cast<size_t>(HoldingRegister::NUM_HOLDING_REGISTERS)>;
+
+	// Everything kept per furnace
+	struct Unit
+	{
+		uint8_t id = 0;
+		PL::ModbusClient *client = nullptr;
+		Coils coils = 0;
+		HoldingRegisters holding = {};
+		DiscreteInputs discreteInputs = 0;
+		InputRegisters inputs = {};
+		TickType_t lastStatusTick = 0;
+		uint16_t heartbeatCounter = 0;
+
+		// writes waiting for the comms task, guarded by myQueueLock
+		RegisterCoalescer pendingRegisters;
+		WriteCoalescer<NUM_COILS> pendingCoils;
+		ConfigStaging queuedConfig = {};
+		bool configQueued = false;
+
+		// comms task only, the config transaction waiting for its outcome, TRANSACTION_ID 0 when there isn't one
+		ConfigStaging awaitedConfig = {};
+		TickType_t configSent = 0;
+
+		bool HasPendingWrites() const
+		{
+			return pendingRegisters.HasPending() || pendingCoils.HasPending() || configQueued;
+		}
+	};
+
+	Unit &selected()
+	{
+		return myUnits[mySelected];
+	}
+
+	void QueueHoldingRegister(HoldingRegister reg, uint16_t value);
+	void QueueCoil(CoilMask mask, bool value);
+	void FlushWrites(Unit &unit);
+	bool WriteHoldingRegisterRun(Unit &unit, const RegisterCoalescer::Run &run);
+	bool WriteCoilRun(Unit &unit, const WriteCoalescer<NUM_COILS>::Run &run);
+	void ReportWrite(const Unit &unit, bool isCoil, uint16_t address, uint16_t value, bool success);
+	void WriteConfigTransaction(Unit &unit, const ConfigStaging &config);
+	void CheckConfigResult(Unit &unit, const ConfigResult &result);
+	void FinishConfigTransaction(Unit &unit, const uint16_t *values, bool success);
+	void SendHeartbeat(Unit &unit);
+	void RunFileTransfers();
+	bool UploadQueuedFile(Unit &unit, FileId file, uint16_t length, uint16_t baseVersion, FileInfo &info);
+	bool DownloadQueuedFile(Unit &unit, FileId file, FileInfo &info);
+	bool ReadFileInfo(Unit &unit, FileId file, FileInfo &info);
+
+	void wakeCommsTask()
+	{
+		if (myCommsTask != nullptr)
+		{
+			xTaskNotifyGive(myCommsTask);
+		}
+	}
 	bool IsDiscreteInputSet(DiscreteInputMask mask);
 	uint16_t GetInputRegister(InputRegister reg);
 	uint16_t GetHoldingRegister(HoldingRegister reg);
-	void ReadTask(void *pvParameter);
-	bool ReadCoils();
-	bool ReadHoldingRegisters();
-	bool ReadDiscreteInputs();
-	bool ReadInputRegisters();
-	bool WriteHoldingRegisters();
+	static void CommsTask(void *pvParameter);
+	bool ReadCoils(Unit &unit);
+	bool ReadHoldingRegisters(Unit &unit);
+	bool ReadDiscreteInputs(Unit &unit);
+	bool ReadInputRegisters(Unit &unit);
+	void PollStatus(size_t index);
+	void UpdateBusUtilization(TickType_t window);
+	void LogLinkStats();
+	bool DrainHistory(Unit &unit);
+	void StoreHistorySample(const HistorySample &sample);
+
+	struct OutstandingCommand
+	{
+		uint16_t sequence;
+		bool isCoil;
+		uint16_t address;
+		uint16_t value;
+	};
+	static constexpr size_t MAX_OUTSTANDING_COMMANDS = static_cast<size_t>(HoldingRegister::NUM_HOLDING_REGISTERS) + NUM_COILS;
+
+	bool NegotiateTelemetry();
+	void RunTelemetry();
+	size_t SendCommands(OutstandingCommand *outstanding);
+	void ApplyTelemetry(const TelemetryPacket &packet);
+	void SendFrame(const uint8_t *frame, size_t size);
+
+	// Runs one PL::ModbusClient call, timing it and recording the outcome against its function code
+	template <typename Request>
+	esp_err_t transact(ModbusFunction function, Request request)
+	{
+		PL::ModbusException exception = PL::ModbusException::noException;
+		int64_t start = esp_timer_get_time();
+		esp_err_t result = request(&exception);
+		uint32_t elapsedUs = static_cast<uint32_t>(esp_timer_get_time() - start);
+
+		xSemaphoreTake(myStatsMutex, portMAX_DELAY);
+		myLinkStats.Record(function, classify(result, exception), elapsedUs);
+		myBusyUs += elapsedUs;
+		xSemaphoreGive(myStatsMutex);
+
+		return result;
+	}
+
+	static TransactionResult classify(esp_err_t result, PL::ModbusException exception);
 
 	static FurnaceClient *myInstance;
-	std::shared_ptr<PL::Uart> myUart;
-	PL::ModbusClient *myClient;
-	Coils myCoils = 0;
-	HoldingRegisters myHeaterConfiguration;
-	DiscreteInputs myDiscreteInputs = 0;
-	InputRegisters myInputRegisters;
-	bool hasReadError = false;
+	std::shared_ptr<LinkUart> myUart;
+	std::array<Unit, PollScheduler::MAX_UNITS> myUnits;
+	size_t myUnitCount = 0;
+
+	// everything below is only ever touched by the comms task, except the queues, the selection and the
+	// scheduler which are guarded by myQueueLock
+	TaskHandle_t myCommsTask = nullptr;
+	portMUX_TYPE myQueueLock = portMUX_INITIALIZER_UNLOCKED;
+	size_t mySelected = 0;
+	bool mySelectionChanged = false;
+	PollScheduler myScheduler = PollScheduler(MODBUS_POLL_PERIOD_MS, MODBUS_BACKGROUND_POLL_PERIOD_MS);
+	WriteCompleteCallback myWriteCompleteCallback = nullptr;
+	uint16_t myNextConfigTransaction = 1;
+
+	// file transfers waiting for the comms task, guarded by myQueueLock, for the furnace selected when queued
+	uint16_t myQueuedUpload[FILE_MAX_WRITABLE_LENGTH] = {};
+	uint16_t myQueuedUploadLength = 0;
+	uint16_t myQueuedUploadBaseVersion = FILE_ANY_VERSION;
+	FileId myQueuedUploadFile = FileId::PROGRAM;
+	size_t myQueuedUploadUnit = 0;
+	bool myUploadQueued = false;
+	FileId myQueuedDownloadFile = FileId::PROGRAM;
+	size_t myQueuedDownloadUnit = 0;
+	bool myDownloadQueued = false;
+	FileTransferCallback myFileTransferCallback = nullptr;
+
+	// comms task only, too big for its stack
+	uint16_t myUpload[FILE_MAX_WRITABLE_LENGTH] = {};
+	FileRecordWindow myFileRecord = {};
+	uint16_t myDownload[FileInfo::COUNT + FILE_MAX_LENGTH] = {}; // a whole read window, info then content
+
+	// the selected furnace's history drained from its FIFO, myHistory is a ring indexed by local sequence
+	SemaphoreHandle_t myHistoryMutex = nullptr;
+	std::array<HistoryPoint, HISTORY_CAPACITY> myHistory{};
+	uint32_t myHistoryNext = 0;		 // local sequence the next stored sample gets
+	uint16_t myServerHistoryNext = 0; // server sequence we want next
+	bool myHistorySynced = false;
+	bool myHistoryTimeBased = false; // the first sample from a furnace sets the time base
+	uint16_t myLastHistoryTimeDs = 0;
+	uint32_t myHistoryTimeMs = 0;
+	uint32_t myHistoryLost = 0;
+
+	bool myTelemetryActive = false;
+	volatile bool myTrafficDumpRequested = false;
+	FrameDecoder myTelemetryDecoder;
+	uint16_t myCommandSequence = 0;
+
+	SemaphoreHandle_t myStatsMutex = nullptr;
+	LinkStats myLinkStats = LinkStats(LINK_LATENCY_BUDGET_US);
+	uint32_t myBusyUs = 0; // time in transactions since the utilization was last worked out, guarded by myStatsMutex
+	uint8_t myBusUtilization = 0;
 };
\ No newline at end of file
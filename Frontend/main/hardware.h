@@ -96,4 +96,35 @@ enum MCP23017_PINS
 #define MCP23017_DOOR_SW (int)4
 
 // SPI bus access synchronization
-#define SPI3_BUS_TIMEOUT_MS 1000
\ No newline at end of file
+#define SPI3_BUS_TIMEOUT_MS 1000
+
+// Modbus link to the Server
+#define FURNACE_UNIT_IDS {1}				   // Modbus unit ids of the furnaces on the bus, the first one is shown at startup
+#define MODBUS_POLL_PERIOD_MS 1000			   // status poll of the furnace on screen, and of any furnace in alarm or not answering
+#define MODBUS_BACKGROUND_POLL_PERIOD_MS 5000 // status poll of the other furnaces
+#define BUS_UTILIZATION_WINDOW_MS 5000		   // bus utilization is the share of this window spent in transactions
+#define LINK_STATS_LOG_PERIOD_MS 60000
+#define LINK_LATENCY_BUDGET_US 20000 // a healthy 115200 baud round trip, slower than this lowers the link quality score
+#define MODBUS_WRITE_COALESCE_MS 100 // queued writes go out at most this often, knob motion in between collapses into one write
+#define HISTORY_DRAIN_PERIOD_MS 10000 // how often the server's temperature history FIFO is drained, it holds 128 samples
+#define CONFIG_RESULT_POLL_DELAY_MS 300 // status poll after a config transaction, just over one of the Server's 250 ms control ticks
+#define CONFIG_RESULT_TIMEOUT_MS 3000	 // a config transaction with no outcome by then is reported as failed
+#define FILE_DOWNLOAD_ATTEMPTS 3		 // a file committed again mid download is read again, at most this many times
+
+#define HEARTBEAT_PERIOD_MS 500						 // how often the Server is sent a heartbeat
+#define HEARTBEAT_DEADLINE_MS 3000					 // the Server applies HEARTBEAT_POLICY after going this long without one
+#define HEARTBEAT_POLICY LinkLossPolicy::RAMP_DOWN	 // what the Server does then, hold the setpoint, ramp it down or shut off
+#define HEARTBEAT_RAMP_DOWN_PER_MINUTE 5			 // degrees C per minute for RAMP_DOWN
+#define LINK_STALE_MS 3000							 // status older than this is shown as stale
+
+#define LINK_TELEMETRY_ENABLED 0		 // ask the Server to stream telemetry instead of being polled, falls back to RTU if it can't
+#define LINK_TELEMETRY_PERIOD_MS 100	 // how often the Server sends a telemetry packet
+#define LINK_KEEPALIVE_TIMEOUT_MS 1000 // either end drops back to RTU after hearing nothing for this long
+#define LINK_TELEMETRY_POLL_MS 5		 // how often the UART is checked for incoming frames in telemetry mode
+#define LINK_RENEGOTIATE_MS 30000		 // how long to stay on RTU before asking for telemetry again
+
+#define MODBUS_RS485 0							 // half duplex RS-485 transceiver on the Modbus UART instead of a TTL link, for long cable runs
+#define MODBUS_DE_PIN (gpio_num_t) GPIO_NUM_22 // transceiver DE on CN1, driven by the UART's RTS when MODBUS_RS485 is set. Tie /RE low, collision detection reads back what's sent
+
+#define TRAFFIC_RECORDER_SIZE 8192	 // RAM kept for the last Modbus traffic, long press the diagnostics screen to dump it. 0 to leave it out
+#define TRAFFIC_MERGE_GAP_US 20000 // chunks of one response closer together than this share a record
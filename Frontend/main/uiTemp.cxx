@@ -181,8 +181,37 @@ TempUI::TempUI(SPIBusManager *aBusManager)
 	lv_label_set_text(ui_OnOffButtonLabel, " Start");
 	lv_obj_set_style_text_font(ui_OnOffButtonLabel, &lv_font_montserrat_32, LV_PART_MAIN);
 
+	ui_LinkStatus = lv_label_create(ui_Temp);
+	lv_obj_set_width(ui_LinkStatus, LV_SIZE_CONTENT);
+	lv_obj_set_height(ui_LinkStatus, LV_SIZE_CONTENT);
+	lv_obj_set_y(ui_LinkStatus, 4);
+	lv_obj_set_align(ui_LinkStatus, LV_ALIGN_TOP_MID);
+	lv_label_set_text(ui_LinkStatus, "");
+	lv_obj_set_style_text_font(ui_LinkStatus, &lv_font_montserrat_14, LV_PART_MAIN);
+
+	ui_Unit = lv_label_create(ui_Temp);
+	lv_obj_set_width(ui_Unit, LV_SIZE_CONTENT);
+	lv_obj_set_height(ui_Unit, LV_SIZE_CONTENT);
+	lv_obj_set_x(ui_Unit, 4);
+	lv_obj_set_y(ui_Unit, 4);
+	lv_obj_set_align(ui_Unit, LV_ALIGN_TOP_LEFT);
+	lv_label_set_text(ui_Unit, "");
+	lv_obj_set_style_text_font(ui_Unit, &lv_font_montserrat_14, LV_PART_MAIN);
+	lv_obj_add_flag(ui_Unit, LV_OBJ_FLAG_CLICKABLE);
+	if (FurnaceClient::GetInstance()->GetUnitCount() < 2)
+	{
+		lv_obj_add_flag(ui_Unit, LV_OBJ_FLAG_HIDDEN);
+	}
+	UpdateUnitLabel();
+
 	lv_obj_add_event_cb(ui_Arc1, ui_event_Arc1, LV_EVENT_ALL, NULL);
 	lv_obj_add_event_cb(ui_OnOff, ui_event_OnOff, LV_EVENT_CLICKED, NULL);
+	lv_obj_add_event_cb(ui_Temp, ui_event_Temp, LV_EVENT_LONG_PRESSED, NULL);
+	lv_obj_add_event_cb(ui_Unit, ui_event_Unit, LV_EVENT_CLICKED, NULL);
+
+	CreateDiagnosticsScreen();
+
+	FurnaceClient::GetInstance()->SetWriteCompleteCallback(OnWriteComplete);
 
 	SetCurrentTemp(currentTemp);
 	SetTargetTemp(setTemp);
@@ -249,6 +278,10 @@ void TempUI::ui_event_Arc1(lv_event_t *e)
 			}
 			tempUI->setTemp = temp;
 			tempUI->SetTargetTemp(tempUI->setTemp);
+
+			// only queues it, the comms task sends the latest value and reports back in OnWriteComplete
+			lv_obj_set_style_text_color(tempUI->ui_SetTemp, lv_color_hex(setTempPendingColor), LV_PART_MAIN);
+			FurnaceClient::GetInstance()->SetTargetTemp(temp);
 		}
 	}
 }
@@ -293,6 +326,41 @@ void TempUI::ui_event_OnOff(lv_event_t *e)
 	}
 }
 
+void TempUI::OnWriteComplete(const WriteResult &result)
+{
+	if (result.isCoil || result.address != static_cast<uint16_t>(HoldingRegister::TARGET_TEMP))
+	{
+		return;
+	}
+
+	// a write that was queued for the furnace we've since switched away from
+	FurnaceClient *client = FurnaceClient::GetInstance();
+	FurnaceUnitInfo info;
+	client->GetUnitInfo(client->GetSelectedUnit(), info);
+	if (result.unit != info.unit)
+	{
+		return;
+	}
+
+	TempUI *tempUI = TempUI::GetInstance();
+	if (tempUI == nullptr)
+	{
+		return;
+	}
+
+	lvgl_port_lock(0);
+	if (!result.success)
+	{
+		lv_obj_set_style_text_color(tempUI->ui_SetTemp, lv_color_hex(setTempFailedColor), LV_PART_MAIN);
+	}
+	else if (result.value == tempUI->setTemp)
+	{
+		// an older value being acknowledged while the knob is still moving leaves it pending
+		lv_obj_set_style_text_color(tempUI->ui_SetTemp, lv_color_hex(setTempConfirmedColor), LV_PART_MAIN);
+	}
+	lvgl_port_unlock();
+}
+
 void TempUI::Stop()
 {
 	lvgl_port_lock(0);
@@ -332,4 +400,157 @@ void TempUI::UpdateTouchTask(void *param)
 		//  Short delay
 		vTaskDelay(1000 / portTICK_PERIOD_MS);
 	}
-}
\ No newline at end of file
+}
+
+void TempUI::CreateDiagnosticsScreen()
+{
+	ui_Diagnostics = lv_obj_create(NULL);
+	lv_obj_set_style_bg_color(ui_Diagnostics, lv_color_hex(0x000000), LV_PART_MAIN);
+	lv_obj_set_style_bg_opa(ui_Diagnostics, 255, LV_PART_MAIN);
+
+	ui_DiagnosticsLabel = lv_label_create(ui_Diagnostics);
+	lv_obj_set_width(ui_DiagnosticsLabel, lv_pct(100));
+	lv_obj_set_align(ui_DiagnosticsLabel, LV_ALIGN_TOP_LEFT);
+	lv_label_set_long_mode(ui_DiagnosticsLabel, LV_LABEL_LONG_WRAP);
+	lv_obj_set_style_text_font(ui_DiagnosticsLabel, &lv_font_montserrat_14, LV_PART_MAIN);
+	lv_label_set_text(ui_DiagnosticsLabel, "Waiting for link stats...");
+
+	lv_obj_add_event_cb(ui_Diagnostics, ui_event_Diagnostics, LV_EVENT_CLICKED, NULL);
+	lv_obj_add_event_cb(ui_Diagnostics, ui_event_DiagnosticsDump, LV_EVENT_LONG_PRESSED, NULL);
+
+	// runs in the lvgl task, so it already holds the lvgl lock
+	myDiagnosticsTimer = lv_timer_create(DiagnosticsTimerCallback, 1000, this);
+}
+
+void TempUI::UpdateDiagnostics()
+{
+	FurnaceClient *client = FurnaceClient::GetInstance();
+	client->GetLinkStats(myDiagnosticsStats);
+
+	const FunctionStats &totals = myDiagnosticsStats.GetTotals();
+
+	char text[768];
+	int length = snprintf(text, sizeof(text), "Link quality: %u%%\nreq %lu  timeout %lu\ncrc %lu  exception %lu  fail %lu\n\n",
+						  myDiagnosticsStats.GetQuality(), totals.requests, totals.timeouts, totals.crcErrors, totals.exceptions, totals.failures);
+
+	for (size_t i = 0; i < myDiagnosticsStats.GetFunctionCount() && length < (int)sizeof(text); i++)
+	{
+		const FunctionStats &function = myDiagnosticsStats.GetFunctionAt(i);
+		const LatencyHistogram &latency = function.latency;
+
+		// min/mean/p99/max in tenths of a millisecond
+		length += snprintf(text + length, sizeof(text) - length, "FC%02X n%lu e%lu %lu/%lu/%lu/%lu\n",
+						   function.functionCode, function.requests,
+						   function.timeouts + function.crcErrors + function.exceptions + function.failures,
+						   latency.GetMin() / 100, latency.GetMean() / 100, latency.GetPercentile(0.99f) / 100, latency.GetMax() / 100);
+	}
+
+	if (length < (int)sizeof(text))
+	{
+		length += snprintf(text + length, sizeof(text) - length, "\nbus %u%%\n", client->GetBusUtilization());
+	}
+
+	// refresh interval seen against the one asked for, * for the furnace on screen
+	for (size_t i = 0; i < client->GetUnitCount() && length < (int)sizeof(text); i++)
+	{
+		FurnaceUnitInfo info;
+		client->GetUnitInfo(i, info);
+		length += snprintf(text + length, sizeof(text) - length, "%c%u %lu/%lums %s\n",
+						   info.selected ? '*' : ' ', info.unit, (unsigned long)info.refreshIntervalMs, (unsigned long)info.pollPeriodMs,
+						   info.stale ? "STALE" : (info.alarm ? "ALARM" : "ok"));
+	}
+
+	if (length < (int)sizeof(text))
+	{
+		snprintf(text + length, sizeof(text) - length, "\nlatency min/mean/p99/max x0.1ms\ntap to go back, hold to dump traffic");
+	}
+
+	lv_label_set_text(ui_DiagnosticsLabel, text);
+}
+
+void TempUI::ui_event_Temp(lv_event_t *e)
+{
+	TempUI *tempUI = TempUI::GetInstance();
+	tempUI->UpdateDiagnostics();
+	lv_disp_load_scr(tempUI->ui_Diagnostics);
+}
+
+void TempUI::ui_event_Diagnostics(lv_event_t *e)
+{
+	lv_disp_load_scr(TempUI::GetInstance()->ui_Temp);
+}
+
+void TempUI::ui_event_DiagnosticsDump(lv_event_t *e)
+{
+	FurnaceClient::GetInstance()->RequestTrafficDump();
+}
+
+void TempUI::DiagnosticsTimerCallback(lv_timer_t *timer)
+{
+	TempUI *tempUI = static_cast<TempUI *>(lv_timer_get_user_data(timer));
+
+	tempUI->UpdateLinkStatus();
+	tempUI->UpdateUnitLabel();
+
+	if (lv_screen_active() == tempUI->ui_Diagnostics)
+	{
+		tempUI->UpdateDiagnostics();
+	}
+}
+
+void TempUI::UpdateLinkStatus()
+{
+	FurnaceClient *client = FurnaceClient::GetInstance();
+
+	if (client->IsDataStale())
+	{
+		lv_label_set_text(ui_LinkStatus, "STALE");
+		lv_obj_set_style_text_color(ui_LinkStatus, lv_color_hex(linkStaleColor), LV_PART_MAIN);
+		return;
+	}
+
+	char text[16];
+	snprintf(text, sizeof(text), "%lu ms", (unsigned long)((client->GetLinkLatencyUs() + 500) / 1000));
+	lv_label_set_text(ui_LinkStatus, text);
+	lv_obj_set_style_text_color(ui_LinkStatus, lv_color_hex(linkOkColor), LV_PART_MAIN);
+}
+
+void TempUI::UpdateUnitLabel()
+{
+	FurnaceClient *client = FurnaceClient::GetInstance();
+	size_t count = client->GetUnitCount();
+	if (count < 2)
+	{
+		return;
+	}
+
+	bool othersAlarmed = false;
+	FurnaceUnitInfo shown = {};
+	for (size_t i = 0; i < count; i++)
+	{
+		FurnaceUnitInfo info;
+		client->GetUnitInfo(i, info);
+		if (info.selected)
+		{
+			shown = info;
+		}
+		else if (info.alarm || info.stale)
+		{
+			othersAlarmed = true;
+		}
+	}
+
+	char text[24];
+	snprintf(text, sizeof(text), "Furnace %u", shown.unit);
+	lv_label_set_text(ui_Unit, text);
+	lv_obj_set_style_text_color(ui_Unit, lv_color_hex(othersAlarmed ? unitAlarmColor : unitOkColor), LV_PART_MAIN);
+}
+
+void TempUI::ui_event_Unit(lv_event_t *e)
+{
+	FurnaceClient *client = FurnaceClient::GetInstance();
+	client->SelectUnit((client->GetSelectedUnit() + 1) % client->GetUnitCount());
+
+	// runs in the lvgl task, so it already holds the lvgl lock
+	TempUI::GetInstance()->UpdateUnitLabel();
+}
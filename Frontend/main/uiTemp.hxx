@@ -11,6 +11,8 @@
 #include "lvgl.h"
 // #include "touch.h"
 #include "hardware.h"
+#include "FurnaceClient.hxx"
+#include "modbus/LinkStats.hxx"
 
 // PCNT configurations
 #define PCNT_HIGH_LIMIT 100
@@ -148,6 +150,40 @@ private:
 	static void ui_event_Arc1(lv_event_t *e);
 	static void ui_event_OnOff(lv_event_t *e);
 
+	// the set temp label is grey until the server has acknowledged the value, red if the write failed
+	static constexpr int setTempConfirmedColor = 0xFFFFFF;
+	static constexpr int setTempPendingColor = 0x808080;
+	static constexpr int setTempFailedColor = 0xFF0000;
+	static void OnWriteComplete(const WriteResult &result);
+
+	// Link diagnostics screen, long press the main screen to open it and tap to go back. Holding it dumps the
+	// traffic recording to the console.
+	lv_obj_t *ui_Diagnostics = nullptr;
+	lv_obj_t *ui_DiagnosticsLabel = nullptr;
+	lv_timer_t *myDiagnosticsTimer = nullptr;
+	LinkStats myDiagnosticsStats;
+
+	void CreateDiagnosticsScreen();
+	void UpdateDiagnostics();
+	static void ui_event_Temp(lv_event_t *e);
+	static void ui_event_Diagnostics(lv_event_t *e);
+	static void ui_event_DiagnosticsDump(lv_event_t *e);
+	static void DiagnosticsTimerCallback(lv_timer_t *timer);
+
+	// link latency on the main screen, STALE when the status shown is older than LINK_STALE_MS
+	lv_obj_t *ui_LinkStatus = nullptr;
+	static constexpr int linkOkColor = 0x808080;
+	static constexpr int linkStaleColor = 0xFF0000;
+	void UpdateLinkStatus();
+
+	// which furnace is on screen when there is more than one on the bus, tap it for the next one. Red while
+	// any of the others is in alarm or not answering.
+	lv_obj_t *ui_Unit = nullptr;
+	static constexpr int unitOkColor = 0x808080;
+	static constexpr int unitAlarmColor = 0xFF0000;
+	void UpdateUnitLabel();
+	static void ui_event_Unit(lv_event_t *e);
+
 	int lowerLimit = 10.0;
 	int upperLimit = 1350.0;
 
@@ -0,0 +1,103 @@
+#include "PacedPort.hxx"
+
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+PacedPort::PacedPort(int aFd, int aBaud) : myFd(aFd)
+{
+	myCharUs = 1e6 * 11 / aBaud;
+	mySilenceUs = aBaud > 19200 ? 1750 : static_cast<int64_t>(3.5 * myCharUs);
+	myIdleUs = mySilenceUs;
+}
+
+bool PacedPort::MakeRaw(int fd)
+{
+	termios tio;
+	if (tcgetattr(fd, &tio) != 0)
+	{
+		return false;
+	}
+
+	cfmakeraw(&tio);
+	return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+int64_t PacedPort::NowUs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void PacedPort::sleepUntilUs(int64_t us)
+{
+	timespec ts = {
+		.tv_sec = static_cast<time_t>(us / 1000000),
+		.tv_nsec = static_cast<long>(us % 1000000) * 1000,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+	{
+	}
+}
+
+void PacedPort::WriteFrame(const uint8_t *frame, size_t length)
+{
+	// the last byte leaves the wire this long after the line is free, and the frame arrives all at once
+	int64_t start = NowUs() > myBusyUntilUs ? NowUs() : myBusyUntilUs;
+	myBusyUntilUs = start + static_cast<int64_t>(length * myCharUs);
+	sleepUntilUs(myBusyUntilUs);
+
+	size_t written = 0;
+	while (written < length)
+	{
+		ssize_t result = write(myFd, frame + written, length - written);
+		if (result < 0 && errno != EINTR)
+		{
+			return;
+		}
+		written += result > 0 ? result : 0;
+	}
+
+	// and the line has to stay quiet before the next frame
+	myBusyUntilUs += mySilenceUs;
+}
+
+bool PacedPort::waitReadable(int64_t timeoutUs)
+{
+	pollfd pfd = {.fd = myFd, .events = POLLIN, .revents = 0};
+	timespec ts = {
+		.tv_sec = static_cast<time_t>(timeoutUs / 1000000),
+		.tv_nsec = static_cast<long>(timeoutUs % 1000000) * 1000,
+	};
+
+	return ppoll(&pfd, 1, &ts, nullptr) > 0 && (pfd.revents & POLLIN);
+}
+
+size_t PacedPort::ReadFrame(uint8_t *frame, size_t maxLength, int64_t timeoutUs)
+{
+	if (!waitReadable(timeoutUs))
+	{
+		return 0;
+	}
+
+	size_t length = 0;
+	do
+	{
+		uint8_t discard[64];
+		uint8_t *destination = length < maxLength ? frame + length : discard;
+		size_t room = length < maxLength ? maxLength - length : sizeof(discard);
+
+		ssize_t result = read(myFd, destination, room);
+		if (result <= 0)
+		{
+			break;
+		}
+		length += length < maxLength ? result : 0;
+	} while (waitReadable(myIdleUs));
+
+	return length;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A file descriptor (one end of a pty pair) that behaves like a serial line at a given baud rate: a frame
+// only shows up at the other end after the time it would take on the wire, the line is busy while a frame
+// is "being sent", and the receiver delimits frames on the Modbus RTU inter-frame silence.
+class PacedPort
+{
+public:
+	PacedPort(int aFd, int aBaud);
+
+	// Sets up a pty end as a raw 8 bit line with no echo or line editing
+	static bool MakeRaw(int fd);
+
+	void WriteFrame(const uint8_t *frame, size_t length);
+
+	// Waits up to timeoutUs for the first byte, then collects bytes until the line has been quiet for the
+	// idle time, by default the inter-frame silence. Returns the frame length, or 0 on timeout.
+	size_t ReadFrame(uint8_t *frame, size_t maxLength, int64_t timeoutUs);
+
+	// 11 bits per character: start, 8 data, even parity, stop
+	double GetCharUs() const
+	{
+		return myCharUs;
+	}
+
+	// 3.5 characters, fixed at 1750 us above 19200 baud
+	int64_t GetSilenceUs() const
+	{
+		return mySilenceUs;
+	}
+
+	// Ends received frames after this many character times of idle line instead of the full inter-frame
+	// silence, the way a UART's hardware RX timeout does.
+	void SetIdleSymbols(double symbols)
+	{
+		myIdleUs = static_cast<int64_t>(symbols * myCharUs);
+	}
+
+	// how long the line must be idle before ReadFrame() decides a frame is over
+	int64_t GetIdleUs() const
+	{
+		return myIdleUs;
+	}
+
+	static int64_t NowUs();
+
+private:
+	int myFd;
+	double myCharUs;
+	int64_t mySilenceUs;
+	int64_t myIdleUs;
+	int64_t myBusyUntilUs = 0;
+
+	static void sleepUntilUs(int64_t us);
+	bool waitReadable(int64_t timeoutUs);
+};
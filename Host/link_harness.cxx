@@ -0,0 +1,599 @@
+// End to end Modbus RTU link harness: forks a process that serves the Server's register map (modbus/Proto.hxx
+// and the history window from modbus/History.hxx, backed by a crude furnace simulation) and drives it from
+// this process with the Frontend's polling mixes, over a pty pair paced to a real baud rate.
+//
+// Usage: link_harness [--baud N] [--seconds S] [--turnaround-us N] [--sample-ms N] [--rx-idle-symbols N] [--mix NAME]
+//
+// --rx-idle-symbols ends frames after N character times of idle line, like the UART's hardware RX timeout
+// (uart/LinkUart.hxx uses 3), instead of waiting out the full 3.5 character / 1750 us inter-frame silence.
+// Run with and without it to see what the hardware frame boundary saves on every round trip.
+//
+// For each mix it reports refreshes per second, transactions per second, round trip latency (request start
+// to last response byte, wire time included) and how busy the line was.
+
+#include "PacedPort.hxx"
+#include "modbus/History.hxx"
+#include "modbus/LinkStats.hxx"
+#include "modbus/Proto.hxx"
+#include "modbus/Rtu.hxx"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <pty.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr uint8_t UNIT = 1;
+static constexpr int64_t RESPONSE_TIMEOUT_US = 100000;
+
+static constexpr uint8_t ILLEGAL_FUNCTION = 0x01;
+static constexpr uint8_t ILLEGAL_DATA_ADDRESS = 0x02;
+
+struct Options
+{
+	int baud = 115200;
+	int seconds = 3;
+	int turnaroundUs = 500; // stands in for the Server's OnRead() work and task wakeup
+	int sampleMs = 100;		// history sample period, faster than the firmware so the ring moves during a run
+	double rxIdleSymbols = 0; // 0 to delimit frames on the full inter-frame silence
+	const char *mix = nullptr;
+};
+
+// ---------------------------------------------------------------------------------------------------------
+// Server process
+
+class SimulatedServer
+{
+public:
+	SimulatedServer(int fd, const Options &options) : myPort(fd, options.baud), myOptions(options)
+	{
+		if (options.rxIdleSymbols > 0)
+		{
+			myPort.SetIdleSymbols(options.rxIdleSymbols);
+		}
+		myHolding.HEATER_PERIOD = 166;
+		myHolding.PID_WINDOW = 50;
+	}
+
+	void Run()
+	{
+		uint8_t request[RTU_MAX_FRAME];
+		uint8_t response[RTU_MAX_FRAME];
+
+		while (true)
+		{
+			size_t length = myPort.ReadFrame(request, sizeof(request), 1000000);
+			simulate();
+
+			// like any RTU server, stay silent on anything that isn't a good frame for us
+			if (length < 4 || !CheckModbusCrc(request, length) || request[0] != UNIT)
+			{
+				continue;
+			}
+
+			size_t responseLength = handle(request, length, response);
+
+			int64_t reply = PacedPort::NowUs() + myOptions.turnaroundUs;
+			while (PacedPort::NowUs() < reply)
+			{
+			}
+			myPort.WriteFrame(response, responseLength);
+		}
+	}
+
+private:
+	PacedPort myPort;
+	Options myOptions;
+
+	Coils myCoils = {};
+	HoldingRegisters myHolding = {};
+	InputRegisters myInputs = {};
+	HistoryRegisters myHistory = {};
+	float myTemp = 25.0f;
+	int64_t myLastSimulateUs = PacedPort::NowUs();
+	int64_t myNextSampleUs = PacedPort::NowUs();
+
+	void simulate()
+	{
+		int64_t now = PacedPort::NowUs();
+		float seconds = (now - myLastSimulateUs) / 1e6f;
+		myLastSimulateUs = now;
+
+		float target = myCoils.ENABLE ? myHolding.TARGET_TEMP : 25.0f;
+		float duty = myCoils.ENABLE && myTemp < target ? 100.0f : 0.0f;
+		myTemp += (duty > 0 ? 1.5f : -0.7f) * seconds;
+		myTemp = myTemp < 25.0f ? 25.0f : myTemp;
+
+		myInputs.CURRENT_TEMP = static_cast<uint16_t>(myTemp);
+		myInputs.HEATER_PWM_DUTY_CYCLE = static_cast<uint16_t>(duty);
+
+		while (now >= myNextSampleUs)
+		{
+			uint16_t sequence = myHistory.header.NEXT_SEQUENCE++;
+			myHistory.samples[sequence % HISTORY_CAPACITY] = {
+				.SEQUENCE = sequence,
+				.TIME_DS = static_cast<uint16_t>(myNextSampleUs / 100000),
+				.TEMP_DC = static_cast<int16_t>(myTemp * 10),
+				.DUTY = static_cast<uint16_t>(duty),
+			};
+			myNextSampleUs += myOptions.sampleMs * 1000;
+		}
+		myHistory.header.CAPACITY = HISTORY_CAPACITY;
+		myHistory.header.SAMPLE_PERIOD_MS = myOptions.sampleMs;
+	}
+
+	bool readRegister(ModbusFunction function, uint16_t address, uint16_t &value)
+	{
+		if (function == ModbusFunction::READ_HOLDING_REGISTERS)
+		{
+			if (address < HoldingRegisters::COUNT)
+			{
+				value = reinterpret_cast<uint16_t *>(&myHolding)[address];
+				return true;
+			}
+			return false;
+		}
+
+		if (address < InputRegisters::COUNT)
+		{
+			value = reinterpret_cast<uint16_t *>(&myInputs)[address];
+			return true;
+		}
+
+		if (address >= HISTORY_ADDRESS && address < HISTORY_ADDRESS + HistoryRegisters::COUNT)
+		{
+			value = reinterpret_cast<uint16_t *>(&myHistory)[address - HISTORY_ADDRESS];
+			return true;
+		}
+
+		return false;
+	}
+
+	size_t exception(const uint8_t *request, uint8_t code, uint8_t *response)
+	{
+		response[0] = request[0];
+		response[1] = request[1] | MODBUS_EXCEPTION_FLAG;
+		response[2] = code;
+		return AppendModbusCrc(response, 3);
+	}
+
+	size_t handle(const uint8_t *request, size_t length, uint8_t *response)
+	{
+		ModbusFunction function = static_cast<ModbusFunction>(request[1]);
+		uint16_t address = GetBe16(request + 2);
+		uint16_t count = GetBe16(request + 4);
+
+		response[0] = request[0];
+		response[1] = request[1];
+
+		switch (function)
+		{
+		case ModbusFunction::READ_COILS:
+		case ModbusFunction::READ_DISCRETE_INPUTS:
+		{
+			if (address + count > 8)
+			{
+				return exception(request, ILLEGAL_DATA_ADDRESS, response);
+			}
+			uint8_t bits = function == ModbusFunction::READ_COILS ? myCoils.ENABLE : (myInputs.ERROR_CODE != 0);
+			response[2] = 1;
+			response[3] = (bits >> address) & ((1 << count) - 1);
+			return AppendModbusCrc(response, 4);
+		}
+		case ModbusFunction::READ_HOLDING_REGISTERS:
+		case ModbusFunction::READ_INPUT_REGISTERS:
+		{
+			if (count == 0 || count > 125)
+			{
+				return exception(request, ILLEGAL_DATA_ADDRESS, response);
+			}
+			response[2] = count * 2;
+			for (uint16_t i = 0; i < count; i++)
+			{
+				uint16_t value;
+				if (!readRegister(function, address + i, value))
+				{
+					return exception(request, ILLEGAL_DATA_ADDRESS, response);
+				}
+				PutBe16(response + 3 + i * 2, value);
+			}
+			return AppendModbusCrc(response, 3 + count * 2);
+		}
+		case ModbusFunction::WRITE_SINGLE_COIL:
+			if (address != 0)
+			{
+				return exception(request, ILLEGAL_DATA_ADDRESS, response);
+			}
+			myCoils.ENABLE = count == 0xFF00;
+			memcpy(response, request, 6);
+			return AppendModbusCrc(response, 6);
+		case ModbusFunction::WRITE_SINGLE_REGISTER:
+			if (address >= HoldingRegisters::COUNT)
+			{
+				return exception(request, ILLEGAL_DATA_ADDRESS, response);
+			}
+			reinterpret_cast<uint16_t *>(&myHolding)[address] = count;
+			memcpy(response, request, 6);
+			return AppendModbusCrc(response, 6);
+		case ModbusFunction::WRITE_MULTIPLE_REGISTERS:
+			if (address + count > HoldingRegisters::COUNT || length < 9u + count * 2)
+			{
+				return exception(request, ILLEGAL_DATA_ADDRESS, response);
+			}
+			for (uint16_t i = 0; i < count; i++)
+			{
+				reinterpret_cast<uint16_t *>(&myHolding)[address + i] = GetBe16(request + 7 + i * 2);
+			}
+			memcpy(response, request, 6);
+			return AppendModbusCrc(response, 6);
+		default:
+			return exception(request, ILLEGAL_FUNCTION, response);
+		}
+	}
+};
+
+// ---------------------------------------------------------------------------------------------------------
+// Client side, the same transactions FurnaceClient makes
+
+class HarnessClient
+{
+public:
+	HarnessClient(int fd, const Options &options) : myPort(fd, options.baud)
+	{
+		if (options.rxIdleSymbols > 0)
+		{
+			myPort.SetIdleSymbols(options.rxIdleSymbols);
+		}
+	}
+
+	bool ReadBits(ModbusFunction function, uint16_t address, uint16_t count, uint8_t &bits)
+	{
+		uint8_t request[8];
+		uint8_t response[RTU_MAX_FRAME];
+		size_t length = transact(function, request, BuildReadRequest(UNIT, function, address, count, request), response);
+
+		if (length < 6 || (response[1] & MODBUS_EXCEPTION_FLAG))
+		{
+			return false;
+		}
+		bits = response[3];
+		return true;
+	}
+
+	bool ReadRegisters(ModbusFunction function, uint16_t address, uint16_t count, uint16_t *values)
+	{
+		uint8_t request[8];
+		uint8_t response[RTU_MAX_FRAME];
+		size_t length = transact(function, request, BuildReadRequest(UNIT, function, address, count, request), response);
+
+		if (length != 5u + count * 2 || (response[1] & MODBUS_EXCEPTION_FLAG))
+		{
+			return false;
+		}
+		for (uint16_t i = 0; i < count; i++)
+		{
+			values[i] = GetBe16(response + 3 + i * 2);
+		}
+		return true;
+	}
+
+	bool WriteRegister(uint16_t address, uint16_t value)
+	{
+		uint8_t request[8];
+		uint8_t response[RTU_MAX_FRAME];
+		return transact(ModbusFunction::WRITE_SINGLE_REGISTER, request, BuildWriteSingleRequest(UNIT, ModbusFunction::WRITE_SINGLE_REGISTER, address, value, request), response) == 8;
+	}
+
+	bool WriteRegisters(uint16_t address, uint16_t count, const uint16_t *values)
+	{
+		uint8_t request[RTU_MAX_FRAME];
+		uint8_t response[RTU_MAX_FRAME];
+		return transact(ModbusFunction::WRITE_MULTIPLE_REGISTERS, request, BuildWriteMultipleRegistersRequest(UNIT, address, count, values, request), response) == 8;
+	}
+
+	bool WriteCoil(uint16_t address, bool value)
+	{
+		uint8_t request[8];
+		uint8_t response[RTU_MAX_FRAME];
+		return transact(ModbusFunction::WRITE_SINGLE_COIL, request, BuildWriteSingleRequest(UNIT, ModbusFunction::WRITE_SINGLE_COIL, address, value ? 0xFF00 : 0, request), response) == 8;
+	}
+
+	void ResetStats()
+	{
+		myStats.Reset();
+		myWireBytes = 0;
+	}
+
+	LinkStats &GetStats()
+	{
+		return myStats;
+	}
+
+	double GetWireUs() const
+	{
+		return myWireBytes * myPort.GetCharUs();
+	}
+
+	double GetIdleUs() const
+	{
+		return myPort.GetIdleUs();
+	}
+
+private:
+	PacedPort myPort;
+	LinkStats myStats = LinkStats(20000);
+	uint64_t myWireBytes = 0;
+
+	size_t transact(ModbusFunction function, const uint8_t *request, size_t requestLength, uint8_t *response)
+	{
+		int64_t start = PacedPort::NowUs();
+		myPort.WriteFrame(request, requestLength);
+		size_t length = myPort.ReadFrame(response, RTU_MAX_FRAME, RESPONSE_TIMEOUT_US);
+		uint32_t elapsed = static_cast<uint32_t>(PacedPort::NowUs() - start);
+
+		// our own end of frame detection isn't part of the round trip, the server's is
+		elapsed -= length > 0 ? static_cast<uint32_t>(myPort.GetIdleUs()) : 0;
+
+		myWireBytes += requestLength + length;
+
+		TransactionResult result = TransactionResult::OK;
+		if (length == 0)
+		{
+			result = TransactionResult::TIMEOUT;
+		}
+		else if (!CheckModbusCrc(response, length))
+		{
+			result = TransactionResult::CRC_ERROR;
+			length = 0;
+		}
+		else if (response[1] & MODBUS_EXCEPTION_FLAG)
+		{
+			result = TransactionResult::EXCEPTION;
+		}
+
+		myStats.Record(function, result, elapsed);
+		return length;
+	}
+};
+
+// ---------------------------------------------------------------------------------------------------------
+// Polling mixes
+
+struct Mix
+{
+	const char *name;
+	const char *description;
+	std::function<bool(HarnessClient &)> cycle; // one refresh, false if any transaction in it failed
+};
+
+static uint16_t historyNext = 0;
+static bool historySynced = false;
+static uint64_t historySamples = 0;
+
+// FurnaceClient::DrainHistory() without the bookkeeping
+static bool drainHistory(HarnessClient &client)
+{
+	uint16_t header[HistoryHeader::COUNT];
+	if (!client.ReadRegisters(ModbusFunction::READ_INPUT_REGISTERS, HISTORY_ADDRESS, HistoryHeader::COUNT, header))
+	{
+		return false;
+	}
+
+	uint16_t next = header[0];
+	uint16_t available = next - historyNext;
+	if (!historySynced || available > HISTORY_CAPACITY - 1)
+	{
+		available = next < HISTORY_CAPACITY - 1 ? next : HISTORY_CAPACITY - 1;
+		historyNext = next - available;
+		historySynced = true;
+	}
+
+	uint16_t samples[HISTORY_SAMPLES_PER_READ * HistorySample::COUNT];
+	while (available > 0)
+	{
+		uint16_t slot = historyNext % HISTORY_CAPACITY;
+		uint16_t count = available;
+		count = count < HISTORY_SAMPLES_PER_READ ? count : HISTORY_SAMPLES_PER_READ;
+		count = count < HISTORY_CAPACITY - slot ? count : HISTORY_CAPACITY - slot;
+
+		if (!client.ReadRegisters(ModbusFunction::READ_INPUT_REGISTERS, HISTORY_SAMPLES_ADDRESS + slot * HistorySample::COUNT, count * HistorySample::COUNT, samples))
+		{
+			return false;
+		}
+
+		historyNext += count;
+		historySamples += count;
+		available -= count;
+	}
+
+	return true;
+}
+
+static bool pollStatus(HarnessClient &client)
+{
+	uint8_t bits;
+	uint16_t inputs[InputRegisters::COUNT];
+	bool ok = client.ReadBits(ModbusFunction::READ_DISCRETE_INPUTS, 0, 1, bits);
+	return client.ReadRegisters(ModbusFunction::READ_INPUT_REGISTERS, 0, InputRegisters::COUNT, inputs) && ok;
+}
+
+static const Mix MIXES[] = {
+	{"status", "FurnaceClient's periodic poll: discrete inputs + input registers", pollStatus},
+	{"knob", "status poll plus a TARGET_TEMP write every refresh, someone dragging the arc",
+	 [](HarnessClient &client)
+	 {
+		 static uint16_t target = 100;
+		 target = target >= 1200 ? 100 : target + 5;
+		 bool ok = client.WriteRegister(6, target);
+		 return pollStatus(client) && ok;
+	 }},
+	{"config", "status poll plus the full 8 register config block written with one function 16",
+	 [](HarnessClient &client)
+	 {
+		 uint16_t config[HoldingRegisters::COUNT] = {500, 50, 166, 10, 1, 5, 900, 50};
+		 bool ok = client.WriteRegisters(0, HoldingRegisters::COUNT, config);
+		 return pollStatus(client) && ok;
+	 }},
+	{"history", "status poll plus a history FIFO drain every refresh",
+	 [](HarnessClient &client)
+	 {
+		 bool ok = drainHistory(client);
+		 return pollStatus(client) && ok;
+	 }},
+	{"scada", "everything a PC would poll: coils, discrete inputs, holding and input registers",
+	 [](HarnessClient &client)
+	 {
+		 uint8_t bits;
+		 uint16_t holding[HoldingRegisters::COUNT];
+		 bool ok = client.ReadBits(ModbusFunction::READ_COILS, 0, 1, bits);
+		 ok = client.ReadRegisters(ModbusFunction::READ_HOLDING_REGISTERS, 0, HoldingRegisters::COUNT, holding) && ok;
+		 return pollStatus(client) && ok;
+	 }},
+};
+
+static void runMix(HarnessClient &client, const Mix &mix, const Options &options)
+{
+	client.ResetStats();
+	historySamples = 0;
+
+	uint32_t cycles = 0;
+	uint32_t failedCycles = 0;
+	int64_t start = PacedPort::NowUs();
+	int64_t end = start + static_cast<int64_t>(options.seconds) * 1000000;
+
+	while (PacedPort::NowUs() < end)
+	{
+		cycles++;
+		if (!mix.cycle(client))
+		{
+			failedCycles++;
+		}
+	}
+
+	double elapsed = (PacedPort::NowUs() - start) / 1e6;
+	const FunctionStats &totals = client.GetStats().GetTotals();
+	const LatencyHistogram &latency = totals.latency;
+
+	printf("%-8s %s\n", mix.name, mix.description);
+	printf("         %.1f refresh/s (%u failed), %.1f transactions/s, line busy %.0f%%\n", cycles / elapsed, failedCycles, totals.requests / elapsed,
+		   100.0 * (client.GetWireUs() + totals.requests * 2 * client.GetIdleUs()) / (elapsed * 1e6));
+	printf("         round trip us: min %u  p50 %u  p90 %u  p99 %u  max %u\n", latency.GetMin(), latency.GetPercentile(0.5f), latency.GetPercentile(0.9f),
+		   latency.GetPercentile(0.99f), latency.GetMax());
+	printf("         timeouts %u  crc %u  exceptions %u\n", totals.timeouts, totals.crcErrors, totals.exceptions);
+
+	if (historySamples > 0)
+	{
+		printf("         %.1f history samples/s drained\n", historySamples / elapsed);
+	}
+
+	for (size_t i = 0; i < client.GetStats().GetFunctionCount(); i++)
+	{
+		const FunctionStats &function = client.GetStats().GetFunctionAt(i);
+		printf("         fc%02X  %6u requests  p50 %u us\n", function.functionCode, function.requests, function.latency.GetPercentile(0.5f));
+	}
+	printf("\n");
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--baud") && hasValue)
+		{
+			options.baud = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--seconds") && hasValue)
+		{
+			options.seconds = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--turnaround-us") && hasValue)
+		{
+			options.turnaroundUs = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--sample-ms") && hasValue)
+		{
+			options.sampleMs = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--rx-idle-symbols") && hasValue)
+		{
+			options.rxIdleSymbols = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--mix") && hasValue)
+		{
+			options.mix = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [--baud N] [--seconds S] [--turnaround-us N] [--sample-ms N] [--rx-idle-symbols N] [--mix NAME]\nmixes:", argv[0]);
+			for (const Mix &mix : MIXES)
+			{
+				fprintf(stderr, " %s", mix.name);
+			}
+			fprintf(stderr, "\n");
+			return false;
+		}
+	}
+
+	return options.baud > 0 && options.seconds > 0 && options.sampleMs > 0;
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		return 2;
+	}
+
+	int clientFd;
+	int serverFd;
+	if (openpty(&clientFd, &serverFd, nullptr, nullptr, nullptr) != 0 || !PacedPort::MakeRaw(serverFd))
+	{
+		perror("openpty");
+		return 1;
+	}
+
+	pid_t server = fork();
+	if (server < 0)
+	{
+		perror("fork");
+		return 1;
+	}
+
+	if (server == 0)
+	{
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		close(clientFd);
+		SimulatedServer(serverFd, options).Run();
+		_exit(0);
+	}
+
+	printf("%d baud, %d s per mix, %d us server turnaround, frames end after %s, pid %d serving\n\n", options.baud, options.seconds, options.turnaroundUs,
+		   options.rxIdleSymbols > 0 ? "the RX idle timeout" : "the inter-frame silence", server);
+
+	HarnessClient client(clientFd, options);
+	bool ran = false;
+	for (const Mix &mix : MIXES)
+	{
+		if (options.mix == nullptr || !strcmp(options.mix, mix.name))
+		{
+			runMix(client, mix, options);
+			ran = true;
+		}
+	}
+
+	kill(server, SIGTERM);
+	waitpid(server, nullptr, 0);
+
+	if (!ran)
+	{
+		fprintf(stderr, "unknown mix %s\n", options.mix);
+		return 2;
+	}
+	return 0;
+}
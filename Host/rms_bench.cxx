@@ -0,0 +1,120 @@
+// Checks the fixed point RMS kernel in lib/power against a double precision reference on synthetic current
+// transformer waveforms, and times it. The waveforms are what the Server's DMA frames hold: one half mains
+// cycle of 12 bit samples around a mid rail bias, with the ADC channel in the top bits, plus noise and
+// harmonics, at every phase.
+//
+// Usage: rms_bench [samples_per_half_cycle]
+
+#include "power/Rms.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static constexpr uint16_t CHANNEL_BITS = 6 << 12; // ADC1 channel 6, GPIO34
+static constexpr double BIAS = 2048.3;
+
+// one half cycle, returns the true RMS of what was quantised, around BIAS
+static double synthesize(std::vector<uint16_t> &frame, double amplitude, double phase, double thirdHarmonic, double noise, std::mt19937 &rng)
+{
+	std::normal_distribution<double> gaussian(0, noise);
+	double squares = 0;
+
+	for (size_t i = 0; i < frame.size(); i++)
+	{
+		double angle = phase + M_PI * i / frame.size();
+		double value = BIAS + amplitude * (sin(angle) + thirdHarmonic * sin(3 * angle)) + gaussian(rng);
+		long quantised = std::lround(value);
+		quantised = std::clamp(quantised, 0L, 4095L);
+		frame[i] = static_cast<uint16_t>(quantised) | CHANNEL_BITS;
+		squares += (quantised - BIAS) * (quantised - BIAS);
+	}
+	return sqrt(squares / frame.size());
+}
+
+static float referenceRms(const std::vector<uint16_t> &frame, double bias)
+{
+	double squares = 0;
+	for (uint16_t word : frame)
+	{
+		double value = (word & RMS_SAMPLE_MASK) - bias;
+		squares += value * value;
+	}
+	return static_cast<float>(sqrt(squares / frame.size()));
+}
+
+int main(int argc, char **argv)
+{
+	size_t samples = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+	std::mt19937 rng(42);
+	std::vector<uint16_t> frame(samples);
+	uint32_t biasQ4 = static_cast<uint32_t>(std::lround(BIAS * 16));
+
+	printf("Accuracy, %zu samples per half cycle, bias %.1f counts\n", samples, BIAS);
+	printf("amplitude  harmonic  noise   true rms  kernel rms  worst error\n");
+	const double amplitudes[] = {0, 2, 20, 200, 2000};
+	for (double amplitude : amplitudes)
+	{
+		for (double harmonic : {0.0, 0.2})
+		{
+			double worst = 0;
+			double trueRms = 0;
+			float kernelRms = 0;
+			for (int phase = 0; phase < 64; phase++)
+			{
+				trueRms = synthesize(frame, amplitude, 2 * M_PI * phase / 64, harmonic, 1.5, rng);
+				RmsSums sums = {};
+				RmsAccumulate(frame.data(), frame.size(), sums);
+				kernelRms = RmsAroundBias(sums, biasQ4);
+				worst = std::max(worst, fabs(kernelRms - trueRms));
+			}
+			printf("%9.0f %9.1f %6.1f %10.3f %11.3f %12.4f\n", amplitude, harmonic, 1.5, trueRms, kernelRms, worst);
+		}
+	}
+
+	// the bias the Server uses comes from the mean over whole cycles
+	synthesize(frame, 1000, 0.3, 0, 0, rng);
+	std::vector<uint16_t> cycle(frame);
+	for (uint16_t &word : cycle)
+	{
+		word = static_cast<uint16_t>(std::lround(2 * BIAS - (word & RMS_SAMPLE_MASK))) | CHANNEL_BITS;
+	}
+	RmsSums wholeCycle = {};
+	RmsAccumulate(frame.data(), frame.size(), wholeCycle);
+	RmsAccumulate(cycle.data(), cycle.size(), wholeCycle);
+	double mean = 0;
+	for (size_t i = 0; i < samples; i++)
+	{
+		mean += (frame[i] & RMS_SAMPLE_MASK) + (cycle[i] & RMS_SAMPLE_MASK);
+	}
+	mean /= 2 * samples;
+	printf("Bias from a whole cycle: %.4f counts, mean of the samples %.4f\n\n", RmsMeanQ4(wholeCycle) / 16.0, mean);
+
+	const int rounds = 200000;
+	synthesize(frame, 1500, 0.5, 0.1, 1.5, rng);
+	volatile float sink = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++)
+	{
+		RmsSums sums = {};
+		RmsAccumulate(frame.data(), frame.size(), sums);
+		sink = sink + RmsAroundBias(sums, biasQ4);
+	}
+	double kernelNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++)
+	{
+		sink = sink + referenceRms(frame, BIAS);
+	}
+	double referenceNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+	printf("Per half cycle: kernel %.0f ns (%.2f ns a sample), double reference %.0f ns (%.2f ns a sample)\n", kernelNs,
+		   kernelNs / samples, referenceNs, referenceNs / samples);
+	return 0;
+}
@@ -0,0 +1,153 @@
+// Compares how many temperature samples per second reach the Frontend with Modbus RTU polling against the
+// COBS telemetry stream, for the same serial line. The wire times come from a model of the line (frame
+// bytes, inter-frame silence and server turnaround), the telemetry frame sizes from the real encoder.
+// Also checks the framing round trips and that the CRC catches corruption.
+//
+// Usage: telemetry_bench [turnaround_us]
+
+#include "telemetry/Telemetry.hxx"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static constexpr int BITS_PER_CHAR = 11; // start, 8 data, even parity, stop
+
+static double charUs(int baud)
+{
+	return 1e6 * BITS_PER_CHAR / baud;
+}
+
+// Modbus RTU needs 3.5 characters of silence between frames, fixed at 1750 us above 19200 baud
+static double silenceUs(int baud)
+{
+	return baud > 19200 ? 1750.0 : 3.5 * charUs(baud);
+}
+
+static double transactionUs(int baud, int requestBytes, int responseBytes, double turnaroundUs)
+{
+	return (requestBytes + responseBytes) * charUs(baud) + 2 * silenceUs(baud) + turnaroundUs;
+}
+
+// One sample as the Frontend polls it today: read discrete inputs (1 bit) and read input registers (3)
+static double rtuSampleUs(int baud, double turnaroundUs)
+{
+	// request: address, function, start, count, crc = 8 bytes
+	// response: address, function, byte count, data, crc
+	double discreteInputs = transactionUs(baud, 8, 3 + 1 + 2, turnaroundUs);
+	double inputRegisters = transactionUs(baud, 8, 3 + 3 * 2 + 2, turnaroundUs);
+	return discreteInputs + inputRegisters;
+}
+
+static TelemetryPacket randomPacket(std::mt19937 &rng, uint16_t sequence)
+{
+	return {
+		.sequence = sequence,
+		.timeMs = static_cast<uint32_t>(rng()),
+		.tempDc = static_cast<int16_t>(rng() % 13500),
+		.targetDc = static_cast<int16_t>(rng() % 13500),
+		.duty = static_cast<uint16_t>(rng() % 1001),
+		.errorCode = static_cast<uint16_t>(rng() & 0x0F),
+		.flags = static_cast<uint8_t>(rng() & 0x03),
+	};
+}
+
+int main(int argc, char **argv)
+{
+	double turnaroundUs = argc > 1 ? atof(argv[1]) : 1000.0;
+	std::mt19937 rng(42);
+
+	// frame sizes vary a little with the data because of the COBS overhead, use the largest seen
+	size_t maxFrame = 0;
+	size_t totalFrame = 0;
+	const int frames = 100000;
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+
+	for (int i = 0; i < frames; i++)
+	{
+		TelemetryPacket packet = randomPacket(rng, i);
+		size_t size = EncodeFrame(PacketType::TELEMETRY, packet, frame, sizeof(frame));
+		maxFrame = size > maxFrame ? size : maxFrame;
+		totalFrame += size;
+	}
+
+	printf("telemetry payload %zu bytes, frame %.1f bytes average, %zu worst case\n", sizeof(TelemetryPacket), static_cast<double>(totalFrame) / frames, maxFrame);
+	printf("RTU turnaround %.0f us\n\n", turnaroundUs);
+	printf("%8s  %12s  %12s  %14s  %8s\n", "baud", "rtu samp/s", "cobs samp/s", "cobs frame us", "speedup");
+
+	for (int baud : {9600, 19200, 38400, 115200, 460800})
+	{
+		double rtu = 1e6 / rtuSampleUs(baud, turnaroundUs);
+		double cobsFrameUs = maxFrame * charUs(baud);
+		double cobs = 1e6 / cobsFrameUs;
+		printf("%8d  %12.1f  %12.1f  %14.1f  %7.1fx\n", baud, rtu, cobs, cobsFrameUs, cobs / rtu);
+	}
+
+	// round trip through the decoder, with garbage (what RTU traffic looks like to it) between frames
+	FrameDecoder decoder;
+	int decoded = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < frames; i++)
+	{
+		TelemetryPacket packet = randomPacket(rng, i);
+		size_t size = EncodeFrame(PacketType::TELEMETRY, packet, frame, sizeof(frame));
+
+		if (i % 10 == 0)
+		{
+			for (int j = 0; j < 8; j++)
+			{
+				decoder.Push(rng() & 0xFF);
+			}
+			decoder.Push(0);
+		}
+
+		for (size_t j = 0; j < size; j++)
+		{
+			if (decoder.Push(frame[j]))
+			{
+				TelemetryPacket received;
+				if (decoder.GetType() == PacketType::TELEMETRY && decoder.Get(received) && received.sequence == packet.sequence && received.tempDc == packet.tempDc)
+				{
+					decoded++;
+				}
+			}
+		}
+	}
+
+	double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	printf("\nround trip: %d/%d frames decoded intact, %.3f us per encode+decode on this host\n", decoded, frames, elapsedUs / frames);
+
+	// single and double bit flips inside a frame must never come out as a good frame
+	int accepted = 0;
+	const int corruptions = 100000;
+	for (int i = 0; i < corruptions; i++)
+	{
+		TelemetryPacket packet = randomPacket(rng, i);
+		size_t size = EncodeFrame(PacketType::TELEMETRY, packet, frame, sizeof(frame));
+
+		// one or two distinct bits, anywhere but the delimiter
+		size_t bits = (size - 1) * 8;
+		size_t first = rng() % bits;
+		frame[first / 8] ^= 1 << (first % 8);
+		if (i % 2)
+		{
+			size_t second = (first + 1 + rng() % (bits - 1)) % bits;
+			frame[second / 8] ^= 1 << (second % 8);
+		}
+
+		FrameDecoder corrupted;
+		for (size_t j = 0; j < size; j++)
+		{
+			// a flip that makes a 0x00 splits the frame, either half must still be rejected
+			if (corrupted.Push(frame[j]))
+			{
+				accepted++;
+			}
+		}
+	}
+	printf("corruption: %d of %d corrupted frames accepted\n", accepted, corruptions);
+
+	return decoded == frames && accepted == 0 ? 0 : 1;
+}
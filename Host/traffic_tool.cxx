@@ -0,0 +1,996 @@
+// Offline decoder for the Modbus traffic recordings (modbus/TrafficRecorder.hxx) the Server prints with
+// 'traffic dump' and the Frontend prints when its diagnostics screen is held.
+//
+// Usage: traffic_tool decode FILE [--hex]     every frame, oldest first
+//        traffic_tool stats FILE              error counts and latency distribution per function code
+//        traffic_tool replay FILE [--verbose] the requests replayed against the Server's register map
+//        traffic_tool compare SERVER CLIENT   what the Server sent against what the Frontend received
+// Any of them takes --gap-us N, how long a partial frame waits for the rest before it's cut short.
+//
+// FILE is a console capture with the BEGIN/END lines in it, the last dump in it is used, or a raw export.
+//
+// Latency is what the recording end can see. On the Server that's the turnaround, from reading the last
+// chunk of a request to starting the response. On the Frontend it's the round trip, from starting the
+// request to reading the last chunk of the response, wire time included.
+//
+// replay can't run the Server's own handlers, they live on the ESP-IDF side of pl_modbus. It runs every
+// recorded request through a model of the areas the Server registers (keep serverAreas in step with
+// Server::Server()), works out whether it had to be refused and what a normal answer looks like, and checks
+// the recorded answer against that. Holding registers and coils written are shadowed, a later read that
+// returns something else is listed too: the Server does change some of them itself (a link loss ramp
+// down, a config transaction), so those are notes rather than faults.
+//
+// compare lines two recordings of the same traffic up by their request bytes and time, the first request
+// that only appears once in each sets the offset between the two clocks. A response that differs means the
+// Server sent one thing and the Frontend received another.
+
+#include "modbus/ConfigTransaction.hxx"
+#include "modbus/Diagnostics.hxx"
+#include "modbus/FileRecords.hxx"
+#include "modbus/Heartbeat.hxx"
+#include "modbus/History.hxx"
+#include "modbus/LinkStats.hxx"
+#include "modbus/Proto.hxx"
+#include "modbus/Rtu.hxx"
+#include "modbus/TrafficRecorder.hxx"
+#include "telemetry/Telemetry.hxx"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+static const char *BEGIN_MARKER = "-----BEGIN MODBUS TRAFFIC-----";
+static const char *END_MARKER = "-----END MODBUS TRAFFIC-----";
+
+static constexpr uint8_t ILLEGAL_FUNCTION = 0x01;
+static constexpr uint8_t ILLEGAL_DATA_ADDRESS = 0x02;
+static constexpr uint8_t BROADCAST_UNIT = 0;
+
+struct Options
+{
+	const char *command = nullptr;
+	const char *files[2] = {};
+	size_t fileCount = 0;
+	int64_t gapUs = 20000;
+	bool hex = false;
+	bool verbose = false;
+};
+
+// ---------------------------------------------------------------------------------------------------------
+// Loading and framing
+
+struct Frame
+{
+	bool written;
+	bool request;
+	bool foreign;  // another unit's request or response, seen on a shared bus
+	bool complete; // false when it was cut short
+	bool crcOk;
+	int64_t startUs; // the record the first byte came in
+	int64_t endUs;	 // the last chunk of that record
+	std::vector<uint8_t> bytes;
+	RtuFrameInfo info;
+};
+
+struct Transaction
+{
+	const Frame *request;
+	const Frame *response; // nullptr when it was never answered
+	uint32_t latencyUs;
+};
+
+struct Recording
+{
+	std::string name;
+	std::vector<uint8_t> dump;
+	TrafficDumpHeader header;
+	size_t records = 0;
+	std::vector<Frame> frames;
+	std::vector<Transaction> transactions;
+	size_t unanswered = 0;
+};
+
+static bool loadFile(const char *path, std::vector<uint8_t> &dump)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		fprintf(stderr, "Can't open %s\n", path);
+		return false;
+	}
+	std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	size_t begin = content.rfind(BEGIN_MARKER);
+	if (begin == std::string::npos)
+	{
+		dump.assign(content.begin(), content.end());
+		return true;
+	}
+
+	begin += strlen(BEGIN_MARKER);
+	size_t end = content.find(END_MARKER, begin);
+	if (end == std::string::npos)
+	{
+		fprintf(stderr, "%s: the dump has no END line, the capture was cut short\n", path);
+		return false;
+	}
+
+	dump.resize(3 * (end - begin) / 4 + 3);
+	dump.resize(TrafficBase64Decode(content.data() + begin, end - begin, dump.data()));
+	return true;
+}
+
+// Splits one direction of the recording into frames. The requests direction holds requests, and on a shared
+// bus the other units' responses. The other direction only ever holds responses.
+class Splitter
+{
+public:
+	Splitter(bool written, bool requests, uint8_t unit, int64_t gapUs) : myWritten(written), myRequests(requests), myUnit(unit), myGapUs(gapUs) {}
+
+	void Feed(const TrafficChunk &chunk, std::vector<Frame> &frames)
+	{
+		if (!myBuffer.empty() && chunk.startUs - myEndUs > myGapUs)
+		{
+			emit(myBuffer.size(), false, frames);
+		}
+
+		if (myBuffer.empty())
+		{
+			myStartUs = chunk.startUs;
+		}
+		myEndUs = chunk.startUs + chunk.spanUs;
+		myBuffer.insert(myBuffer.end(), chunk.data, chunk.data + chunk.length);
+
+		while (!myBuffer.empty())
+		{
+			size_t length = expectingRequest() ? RequestFrameLength(myBuffer.data(), myBuffer.size()) : ResponseFrameLength(myBuffer.data(), myBuffer.size());
+
+			if (length == 0)
+			{
+				break;
+			}
+
+			// a function we can't delimit, chunk boundaries are the best guess
+			if (length == SIZE_MAX)
+			{
+				emit(myBuffer.size(), true, frames);
+				break;
+			}
+
+			if (length > RTU_MAX_FRAME)
+			{
+				emit(myBuffer.size(), false, frames);
+				break;
+			}
+
+			if (length > myBuffer.size())
+			{
+				break;
+			}
+
+			emit(length, true, frames);
+		}
+	}
+
+	void Flush(std::vector<Frame> &frames)
+	{
+		if (!myBuffer.empty())
+		{
+			emit(myBuffer.size(), false, frames);
+		}
+	}
+
+private:
+	bool myWritten;
+	bool myRequests;
+	uint8_t myUnit; // 0 on the client, which addresses everyone
+	int64_t myGapUs;
+
+	std::vector<uint8_t> myBuffer;
+	int64_t myStartUs = 0;
+	int64_t myEndUs = 0;
+	bool myExpectForeignResponse = false;
+
+	bool expectingRequest() const
+	{
+		return myRequests && !myExpectForeignResponse;
+	}
+
+	void emit(size_t length, bool complete, std::vector<Frame> &frames)
+	{
+		Frame frame;
+		frame.written = myWritten;
+		frame.request = expectingRequest();
+		frame.complete = complete;
+		frame.startUs = myStartUs;
+		frame.endUs = myEndUs;
+		frame.bytes.assign(myBuffer.begin(), myBuffer.begin() + length);
+		frame.crcOk = complete && CheckModbusCrc(frame.bytes.data(), length);
+		frame.foreign = myRequests && myExpectForeignResponse;
+		if (!frame.crcOk || !ParseRtuFrame(frame.bytes.data(), length, frame.request, frame.info))
+		{
+			frame.info = RtuFrameInfo();
+		}
+
+		myExpectForeignResponse = false;
+		if (frame.crcOk && frame.request && myUnit != 0 && frame.info.unit != myUnit && frame.info.unit != BROADCAST_UNIT)
+		{
+			frame.foreign = true;
+			myExpectForeignResponse = true;
+		}
+
+		frames.push_back(std::move(frame));
+		myBuffer.erase(myBuffer.begin(), myBuffer.begin() + length);
+	}
+};
+
+static bool loadRecording(const char *path, const Options &options, Recording &recording)
+{
+	recording.name = path;
+	if (!loadFile(path, recording.dump))
+	{
+		return false;
+	}
+
+	TrafficReader reader;
+	if (!reader.Open(recording.dump.data(), recording.dump.size()))
+	{
+		fprintf(stderr, "%s isn't a traffic recording this tool understands\n", path);
+		return false;
+	}
+	recording.header = reader.GetHeader();
+
+	bool server = recording.header.role == TrafficRole::SERVER;
+	uint8_t unit = server ? recording.header.unit : 0;
+	Splitter received(false, server, unit, options.gapUs);
+	Splitter written(true, !server, unit, options.gapUs);
+
+	TrafficChunk chunk;
+	while (reader.Next(chunk))
+	{
+		recording.records++;
+		(chunk.written ? written : received).Feed(chunk, recording.frames);
+	}
+	received.Flush(recording.frames);
+	written.Flush(recording.frames);
+
+	// a request is answered by the next response that isn't someone else's
+	const Frame *pending = nullptr;
+	for (const Frame &frame : recording.frames)
+	{
+		if (frame.foreign)
+		{
+			continue;
+		}
+
+		if (frame.request)
+		{
+			if (pending != nullptr)
+			{
+				recording.transactions.push_back({pending, nullptr, 0});
+				recording.unanswered++;
+			}
+			pending = frame.crcOk && frame.info.unit != BROADCAST_UNIT ? &frame : nullptr;
+			continue;
+		}
+
+		if (pending == nullptr)
+		{
+			continue;
+		}
+
+		int64_t latency = server ? frame.startUs - pending->endUs : frame.endUs - pending->startUs;
+		recording.transactions.push_back({pending, &frame, static_cast<uint32_t>(latency < 0 ? 0 : latency)});
+		pending = nullptr;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// The Server's register map
+
+enum class AreaType
+{
+	COILS,
+	DISCRETE_INPUTS,
+	HOLDING_REGISTERS,
+	INPUT_REGISTERS,
+};
+
+struct Area
+{
+	const char *name;
+	AreaType type;
+	uint16_t address;
+	uint16_t count; // bits for coils and discrete inputs
+};
+
+static const Area serverAreas[] = {
+	{"coils", AreaType::COILS, 0, sizeof(Coils) * 8},
+	{"discretes", AreaType::DISCRETE_INPUTS, 0, sizeof(DiscreteInputs) * 8},
+	{"holding", AreaType::HOLDING_REGISTERS, 0, HoldingRegisters::COUNT},
+	{"status", AreaType::INPUT_REGISTERS, 0, StatusRegisters::COUNT},
+	{"history", AreaType::INPUT_REGISTERS, HISTORY_ADDRESS, HistoryRegisters::COUNT},
+	{"config", AreaType::HOLDING_REGISTERS, CONFIG_STAGING_ADDRESS, ConfigStaging::COUNT},
+	{"file write", AreaType::HOLDING_REGISTERS, FILE_WRITE_ADDRESS, FileRecordHeader::COUNT + FILE_RECORD_MAX_LENGTH},
+	{"program", AreaType::INPUT_REGISTERS, FileReadAddress(FileId::PROGRAM), FileInfo::COUNT + ProgramFile::COUNT},
+	{"gains", AreaType::INPUT_REGISTERS, FileReadAddress(FileId::GAIN_SCHEDULE), FileInfo::COUNT + GainScheduleFile::COUNT},
+	{"history file", AreaType::INPUT_REGISTERS, FileReadAddress(FileId::HISTORY), FileInfo::COUNT + HistoryRegisters::COUNT},
+	{"heartbeat", AreaType::HOLDING_REGISTERS, HEARTBEAT_ADDRESS, HeartbeatRegisters::COUNT},
+	{"heartbeat st", AreaType::INPUT_REGISTERS, HEARTBEAT_ADDRESS, HeartbeatStatus::COUNT},
+	{"diagnostics", AreaType::INPUT_REGISTERS, DIAGNOSTICS_ADDRESS, DiagnosticsCounters::COUNT},
+	{"diag command", AreaType::HOLDING_REGISTERS, DIAGNOSTICS_ADDRESS, DiagnosticsCommand::COUNT},
+	{"link mode", AreaType::HOLDING_REGISTERS, LINK_MODE_ADDRESS, LinkModeRegisters::COUNT},
+};
+
+static bool areaTypeFor(uint8_t function, AreaType &type)
+{
+	switch (static_cast<ModbusFunction>(function))
+	{
+	case ModbusFunction::READ_COILS:
+	case ModbusFunction::WRITE_SINGLE_COIL:
+	case ModbusFunction::WRITE_MULTIPLE_COILS:
+		type = AreaType::COILS;
+		return true;
+	case ModbusFunction::READ_DISCRETE_INPUTS:
+		type = AreaType::DISCRETE_INPUTS;
+		return true;
+	case ModbusFunction::READ_HOLDING_REGISTERS:
+	case ModbusFunction::WRITE_SINGLE_REGISTER:
+	case ModbusFunction::WRITE_MULTIPLE_REGISTERS:
+		type = AreaType::HOLDING_REGISTERS;
+		return true;
+	case ModbusFunction::READ_INPUT_REGISTERS:
+		type = AreaType::INPUT_REGISTERS;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// the area holding the whole of a request, pl_modbus refuses one that spans two
+static const Area *findArea(const RtuFrameInfo &request)
+{
+	AreaType type;
+	if (!areaTypeFor(request.function, type))
+	{
+		return nullptr;
+	}
+
+	for (const Area &area : serverAreas)
+	{
+		if (area.type == type && request.address >= area.address && request.address + request.count <= area.address + area.count)
+		{
+			return &area;
+		}
+	}
+	return nullptr;
+}
+
+static const char *areaName(const RtuFrameInfo &request)
+{
+	const Area *area = findArea(request);
+	return area != nullptr ? area->name : "?";
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// decode
+
+static void describe(const Frame &frame, char *text, size_t size)
+{
+	const RtuFrameInfo &info = frame.info;
+
+	if (!frame.complete)
+	{
+		snprintf(text, size, "cut short");
+	}
+	else if (!frame.crcOk)
+	{
+		snprintf(text, size, "bad crc");
+	}
+	else if (info.IsException())
+	{
+		snprintf(text, size, "unit %u fc %02X exception %u", info.unit, info.function & ~MODBUS_EXCEPTION_FLAG, info.exceptionCode);
+	}
+	else if (frame.request && (info.count > 0 || info.address > 0))
+	{
+		snprintf(text, size, "unit %u fc %02X %04X x%u %s", info.unit, info.function, info.address, info.count, areaName(info));
+	}
+	else
+	{
+		snprintf(text, size, "unit %u fc %02X", info.unit, info.function);
+	}
+}
+
+static void printHex(const std::vector<uint8_t> &bytes, bool all)
+{
+	size_t shown = all || bytes.size() <= 16 ? bytes.size() : 16;
+	for (size_t i = 0; i < shown; i++)
+	{
+		printf(" %02X", bytes[i]);
+	}
+	if (shown < bytes.size())
+	{
+		printf(" ... (%zu bytes)", bytes.size());
+	}
+}
+
+static void printSummary(const Recording &recording)
+{
+	const TrafficDumpHeader &header = recording.header;
+	int64_t lengthUs = recording.frames.empty() ? 0 : recording.frames.back().endUs - header.startUs;
+
+	if (header.role == TrafficRole::SERVER)
+	{
+		printf("%s: Server unit %u", recording.name.c_str(), header.unit);
+	}
+	else
+	{
+		printf("%s: Frontend", recording.name.c_str());
+	}
+	printf(", %zu records over %.3f s starting at %.3f s uptime, %u older records overwritten\n", recording.records, lengthUs / 1e6,
+		   header.startUs / 1e6, header.dropped);
+}
+
+static int decode(const Options &options)
+{
+	Recording recording;
+	if (!loadRecording(options.files[0], options, recording))
+	{
+		return 1;
+	}
+
+	printSummary(recording);
+	printf("\n     time (s)  dir\n");
+
+	for (const Frame &frame : recording.frames)
+	{
+		char text[80];
+		describe(frame, text, sizeof(text));
+
+		const char *kind = frame.foreign ? "bus" : (frame.request ? "req" : "rsp");
+		printf("%13.6f  %s %s  %-40s", (frame.startUs - recording.header.startUs) / 1e6, frame.written ? "TX" : "RX", kind, text);
+		printHex(frame.bytes, options.hex);
+		printf("\n");
+	}
+
+	return 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// stats
+
+static int stats(const Options &options)
+{
+	Recording recording;
+	if (!loadRecording(options.files[0], options, recording))
+	{
+		return 1;
+	}
+
+	size_t requests = 0, responses = 0, foreign = 0, badCrc = 0, cutShort = 0;
+	for (const Frame &frame : recording.frames)
+	{
+		if (frame.foreign)
+		{
+			foreign++;
+		}
+		else if (frame.request)
+		{
+			requests++;
+		}
+		else
+		{
+			responses++;
+		}
+
+		if (!frame.complete)
+		{
+			cutShort++;
+		}
+		else if (!frame.crcOk)
+		{
+			badCrc++;
+		}
+	}
+
+	LinkStats functions;
+	for (const Transaction &transaction : recording.transactions)
+	{
+		ModbusFunction function = static_cast<ModbusFunction>(transaction.request->info.function);
+		if (transaction.response == nullptr)
+		{
+			functions.Record(function, TransactionResult::TIMEOUT, 0);
+		}
+		else if (!transaction.response->crcOk)
+		{
+			functions.Record(function, TransactionResult::CRC_ERROR, 0);
+		}
+		else
+		{
+			functions.Record(function, transaction.response->info.IsException() ? TransactionResult::EXCEPTION : TransactionResult::OK,
+							 transaction.latencyUs);
+		}
+	}
+
+	printSummary(recording);
+	printf("%zu requests, %zu responses, %zu other units' frames, %zu bad CRC, %zu cut short, %zu requests unanswered\n\n", requests,
+		   responses, foreign, badCrc, cutShort, recording.unanswered);
+
+	const char *latency = recording.header.role == TrafficRole::SERVER ? "turnaround" : "round trip";
+	printf("FC  requests unanswered bad exceptions  %s (us) min/mean/p50/p90/p99/max\n", latency);
+	for (size_t i = 0; i < functions.GetFunctionCount(); i++)
+	{
+		const FunctionStats &function = functions.GetFunctionAt(i);
+		const LatencyHistogram &histogram = function.latency;
+		printf("%02X  %8u %10u %3u %10u  %u/%u/%u/%u/%u/%u\n", function.functionCode, function.requests, function.timeouts,
+			   function.crcErrors, function.exceptions, histogram.GetMin(), histogram.GetMean(), histogram.GetPercentile(0.5f),
+			   histogram.GetPercentile(0.9f), histogram.GetPercentile(0.99f), histogram.GetMax());
+	}
+
+	// the whole distribution, one row per histogram bucket that saw anything
+	const LatencyHistogram &totals = functions.GetTotals().latency;
+	if (totals.GetCount() == 0)
+	{
+		return 0;
+	}
+
+	printf("\n%s (us)  answered\n", latency);
+	std::map<size_t, uint32_t> buckets;
+	for (const Transaction &transaction : recording.transactions)
+	{
+		if (transaction.response != nullptr && transaction.response->crcOk)
+		{
+			buckets[LatencyHistogram::BucketFor(transaction.latencyUs)]++;
+		}
+	}
+
+	uint32_t most = 0;
+	for (const auto &[bucket, count] : buckets)
+	{
+		most = count > most ? count : most;
+	}
+	for (const auto &[bucket, count] : buckets)
+	{
+		printf(">= %9u  %8u ", LatencyHistogram::BucketLowerBound(bucket), count);
+		for (uint32_t i = 0; i < (count * 50 + most - 1) / most; i++)
+		{
+			printf("#");
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// replay
+
+class ServerModel
+{
+public:
+	// Returns an empty string when the recorded response is what a Server with this register map answers,
+	// otherwise what's wrong with it. Notes are things worth a look that aren't necessarily wrong.
+	std::string Check(const Frame &request, const Frame &response, std::string &note)
+	{
+		const RtuFrameInfo &info = request.info;
+		const RtuFrameInfo &answer = response.info;
+
+		if (!response.crcOk)
+		{
+			return "response with a bad CRC";
+		}
+		if (answer.unit != info.unit || (answer.function & ~MODBUS_EXCEPTION_FLAG) != info.function)
+		{
+			return "response is for another unit or function";
+		}
+
+		AreaType type;
+		uint8_t expected = 0;
+		if (!areaTypeFor(info.function, type))
+		{
+			expected = ILLEGAL_FUNCTION;
+		}
+		else if (info.count == 0 || findArea(info) == nullptr)
+		{
+			expected = ILLEGAL_DATA_ADDRESS;
+		}
+
+		if (expected != 0)
+		{
+			if (!answer.IsException())
+			{
+				return "answered a request the register map has to refuse";
+			}
+			if (answer.exceptionCode != expected)
+			{
+				return "refused with exception " + std::to_string(answer.exceptionCode) + " instead of " + std::to_string(expected);
+			}
+			return "";
+		}
+
+		if (answer.IsException())
+		{
+			if (isWrite(info.function))
+			{
+				// a handler turning down what it was given, a config transaction out of range for one
+				note = "write refused by the handler, exception " + std::to_string(answer.exceptionCode);
+				return "";
+			}
+			return "read inside " + std::string(findArea(info)->name) + " refused with exception " + std::to_string(answer.exceptionCode);
+		}
+
+		const std::vector<uint8_t> &bytes = response.bytes;
+		switch (static_cast<ModbusFunction>(info.function))
+		{
+		case ModbusFunction::READ_COILS:
+		case ModbusFunction::READ_DISCRETE_INPUTS:
+		{
+			size_t byteCount = (info.count + 7) / 8;
+			if (bytes.size() != 5 + byteCount || bytes[2] != byteCount)
+			{
+				return "wrong length for " + std::to_string(info.count) + " bits";
+			}
+			if (type == AreaType::COILS)
+			{
+				checkShadow(myCoils, info.address, info.count, [&](uint16_t i)
+							{ return static_cast<uint16_t>((bytes[3 + i / 8] >> (i % 8)) & 1); }, "coil", note);
+			}
+			return "";
+		}
+		case ModbusFunction::READ_HOLDING_REGISTERS:
+		case ModbusFunction::READ_INPUT_REGISTERS:
+			if (bytes.size() != 5u + info.count * 2 || bytes[2] != info.count * 2)
+			{
+				return "wrong length for " + std::to_string(info.count) + " registers";
+			}
+			if (type == AreaType::HOLDING_REGISTERS)
+			{
+				checkShadow(myHolding, info.address, info.count, [&](uint16_t i)
+							{ return GetBe16(bytes.data() + 3 + i * 2); }, "register", note);
+			}
+			return "";
+		case ModbusFunction::WRITE_SINGLE_COIL:
+		case ModbusFunction::WRITE_SINGLE_REGISTER:
+			if (bytes != request.bytes)
+			{
+				return "write not echoed back";
+			}
+			if (type == AreaType::COILS)
+			{
+				myCoils[info.address] = GetBe16(request.bytes.data() + 4) == 0xFF00;
+			}
+			else
+			{
+				myHolding[info.address] = GetBe16(request.bytes.data() + 4);
+			}
+			return "";
+		case ModbusFunction::WRITE_MULTIPLE_COILS:
+		case ModbusFunction::WRITE_MULTIPLE_REGISTERS:
+			if (bytes.size() != 8 || memcmp(bytes.data(), request.bytes.data(), 6) != 0)
+			{
+				return "address and count not echoed back";
+			}
+			for (uint16_t i = 0; i < info.count; i++)
+			{
+				if (type == AreaType::COILS)
+				{
+					myCoils[info.address + i] = (request.bytes[7 + i / 8] >> (i % 8)) & 1;
+				}
+				else
+				{
+					myHolding[info.address + i] = GetBe16(request.bytes.data() + 7 + i * 2);
+				}
+			}
+			return "";
+		default:
+			return "";
+		}
+	}
+
+private:
+	// the last value written, for what has been written at all
+	std::map<uint16_t, uint16_t> myHolding;
+	std::map<uint16_t, uint16_t> myCoils;
+
+	static bool isWrite(uint8_t function)
+	{
+		switch (static_cast<ModbusFunction>(function))
+		{
+		case ModbusFunction::WRITE_SINGLE_COIL:
+		case ModbusFunction::WRITE_SINGLE_REGISTER:
+		case ModbusFunction::WRITE_MULTIPLE_COILS:
+		case ModbusFunction::WRITE_MULTIPLE_REGISTERS:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	template <typename Value>
+	static void checkShadow(std::map<uint16_t, uint16_t> &shadow, uint16_t address, uint16_t count, Value value, const char *what, std::string &note)
+	{
+		for (uint16_t i = 0; i < count; i++)
+		{
+			auto written = shadow.find(address + i);
+			uint16_t served = value(i);
+			if (written != shadow.end() && written->second != served)
+			{
+				note += std::string(note.empty() ? "" : ", ") + what + " " + std::to_string(address + i) + " written " +
+						std::to_string(written->second) + " served " + std::to_string(served);
+				// the Server's value from here on, so one change is listed once
+				written->second = served;
+			}
+		}
+	}
+};
+
+static int replay(const Options &options)
+{
+	Recording recording;
+	if (!loadRecording(options.files[0], options, recording))
+	{
+		return 1;
+	}
+
+	printSummary(recording);
+
+	ServerModel model;
+	size_t checked = 0, faults = 0, notes = 0;
+	for (const Transaction &transaction : recording.transactions)
+	{
+		if (transaction.response == nullptr)
+		{
+			continue;
+		}
+
+		std::string note;
+		std::string fault = model.Check(*transaction.request, *transaction.response, note);
+		checked++;
+
+		double time = (transaction.request->startUs - recording.header.startUs) / 1e6;
+		if (!fault.empty())
+		{
+			faults++;
+			printf("%13.6f  FAULT %s\n              ", time, fault.c_str());
+			printHex(transaction.request->bytes, true);
+			printf("\n           ->");
+			printHex(transaction.response->bytes, true);
+			printf("\n");
+		}
+		if (!note.empty())
+		{
+			notes++;
+			if (options.verbose)
+			{
+				printf("%13.6f  note  %s\n", time, note.c_str());
+			}
+		}
+	}
+
+	printf("%zu answered requests replayed, %zu faults, %zu notes%s\n", checked, faults, notes,
+		   notes > 0 && !options.verbose ? " (--verbose lists them)" : "");
+	return faults > 0 ? 2 : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// compare
+
+static int compare(const Options &options)
+{
+	Recording server, client;
+	if (!loadRecording(options.files[0], options, server) || !loadRecording(options.files[1], options, client))
+	{
+		return 1;
+	}
+	if (server.header.role != TrafficRole::SERVER || client.header.role != TrafficRole::CLIENT)
+	{
+		fprintf(stderr, "compare takes a Server recording then a Frontend recording\n");
+		return 1;
+	}
+
+	printSummary(server);
+	printSummary(client);
+
+	// only the client's requests for this Server
+	std::vector<const Transaction *> clientTransactions;
+	for (const Transaction &transaction : client.transactions)
+	{
+		if (transaction.request->info.unit == server.header.unit)
+		{
+			clientTransactions.push_back(&transaction);
+		}
+	}
+
+	// request bytes to how often they were sent
+	auto key = [](const Frame *frame)
+	{ return std::string(frame->bytes.begin(), frame->bytes.end()); };
+	std::map<std::string, int> serverCount, clientCount;
+	for (const Transaction &transaction : server.transactions)
+	{
+		serverCount[key(transaction.request)]++;
+	}
+	for (const Transaction *transaction : clientTransactions)
+	{
+		clientCount[key(transaction->request)]++;
+	}
+
+	// the first request only sent once lines the two clocks up, a heartbeat carries a counter so there's one
+	bool aligned = false;
+	int64_t offsetUs = 0;
+	for (const Transaction *transaction : clientTransactions)
+	{
+		const std::string bytes = key(transaction->request);
+		if (clientCount[bytes] != 1 || serverCount[bytes] != 1)
+		{
+			continue;
+		}
+		for (const Transaction &match : server.transactions)
+		{
+			if (key(match.request) == bytes)
+			{
+				offsetUs = match.request->startUs - transaction->request->startUs;
+				aligned = true;
+				break;
+			}
+		}
+		break;
+	}
+
+	if (!aligned)
+	{
+		fprintf(stderr, "No request appears exactly once in both recordings, they can't be lined up\n");
+		return 1;
+	}
+
+	// the request reaches the Server within a frame time or two of the client sending it
+	const int64_t toleranceUs = options.gapUs;
+
+	size_t matched = 0, differing = 0, lostResponses = 0, notAtServer = 0;
+	size_t next = 0;
+	for (const Transaction *transaction : clientTransactions)
+	{
+		int64_t atServer = transaction->request->startUs + offsetUs;
+
+		// outside the Server's recording
+		if (atServer < server.header.startUs || server.frames.empty() || atServer > server.frames.back().endUs)
+		{
+			continue;
+		}
+
+		while (next < server.transactions.size() && server.transactions[next].request->startUs < atServer - toleranceUs)
+		{
+			next++;
+		}
+
+		const Transaction *match = nullptr;
+		for (size_t i = next; i < server.transactions.size() && server.transactions[i].request->startUs <= atServer + toleranceUs; i++)
+		{
+			if (server.transactions[i].request->bytes == transaction->request->bytes)
+			{
+				match = &server.transactions[i];
+				next = i + 1;
+				break;
+			}
+		}
+
+		double time = (transaction->request->startUs - client.header.startUs) / 1e6;
+		if (match == nullptr)
+		{
+			notAtServer++;
+			printf("%13.6f  request never reached the Server intact:", time);
+			printHex(transaction->request->bytes, false);
+			printf("\n");
+			continue;
+		}
+
+		if (match->response == nullptr)
+		{
+			continue; // the Server didn't answer, the client timing out is expected
+		}
+
+		if (transaction->response == nullptr)
+		{
+			lostResponses++;
+			printf("%13.6f  response sent but never received:", time);
+			printHex(match->response->bytes, false);
+			printf("\n");
+			continue;
+		}
+
+		matched++;
+		if (transaction->response->bytes != match->response->bytes)
+		{
+			differing++;
+			printf("%13.6f  response differs\n         sent", time);
+			printHex(match->response->bytes, options.hex);
+			printf("\n     received");
+			printHex(transaction->response->bytes, options.hex);
+			printf("\n");
+		}
+	}
+
+	printf("Clocks %+.6f s apart. %zu transactions in both, %zu responses differ, %zu responses lost, %zu requests not seen by the Server\n",
+		   offsetUs / 1e6, matched, differing, lostResponses, notAtServer);
+	return differing + lostResponses + notAtServer > 0 ? 2 : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--gap-us") == 0 && i + 1 < argc)
+		{
+			options.gapUs = atoll(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--hex") == 0)
+		{
+			options.hex = true;
+		}
+		else if (strcmp(argv[i], "--verbose") == 0)
+		{
+			options.verbose = true;
+		}
+		else if (argv[i][0] == '-')
+		{
+			return false;
+		}
+		else if (options.command == nullptr)
+		{
+			options.command = argv[i];
+		}
+		else if (options.fileCount < 2)
+		{
+			options.files[options.fileCount++] = argv[i];
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	if (options.command == nullptr)
+	{
+		return false;
+	}
+	return options.fileCount == (strcmp(options.command, "compare") == 0 ? 2u : 1u);
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		fprintf(stderr, "Usage: traffic_tool <decode|stats|replay> FILE [--hex] [--verbose] [--gap-us N]\n"
+						"       traffic_tool compare SERVER_FILE FRONTEND_FILE [--hex] [--gap-us N]\n");
+		return 1;
+	}
+
+	if (strcmp(options.command, "decode") == 0)
+	{
+		return decode(options);
+	}
+	if (strcmp(options.command, "stats") == 0)
+	{
+		return stats(options);
+	}
+	if (strcmp(options.command, "replay") == 0)
+	{
+		return replay(options);
+	}
+	if (strcmp(options.command, "compare") == 0)
+	{
+		return compare(options);
+	}
+
+	fprintf(stderr, "Unknown command %s\n", options.command);
+	return 1;
+}
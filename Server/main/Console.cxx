@@ -1,4 +1,12 @@
 #include "Console.hxx"
+#include "CurrentMonitor.hxx"
+#include "EnergyMeter.hxx"
+#include "ErrorJournal.hxx"
+#include "EventBus.hxx"
+#include "FileStore.hxx"
+#include "GPIO.hxx"
+#include "Interlock.hxx"
+#include "LinkSupervisor.hxx"
 
 #include "argtable3/argtable3.h"
 #include "driver/uart.h"
@@ -13,6 +21,8 @@
 #include "sdkconfig.h"
 #include "soc/soc_caps.h"
 #include <fcntl.h>
+#include <memory>
+#include <new>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -20,7 +30,9 @@
 #include "cmd_system.h"
 #include "cmd_wifi.h"
 
+#include "Server.hxx"
 #include "State.hxx"
+#include "TaskSupervisor.hxx"
 #include "TempController.hxx"
 #include "hardware.h"
 
@@ -131,7 +143,8 @@ Console::Console()
 	// register_system_common();
 
 #if SOC_WIFI_SUPPORTED
-	// register_wifi();
+	// also brings up the network stack the Modbus TCP server needs
+	register_wifi();
 #endif
 
 	const esp_console_cmd_t cmd3 = {
@@ -170,6 +183,86 @@ Console::Console()
 	};
 	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd6));
 
+	const esp_console_cmd_t cmd7 = {
+		.command = "modbus",
+		.help = "Modbus bus counters, time to answer by function code and time spent in each area's callbacks\n"
+				"Usage: modbus [clear]\n"
+				"clear - Zero the counters and timings, same as the Clear Counters diagnostics command",
+		.hint = NULL,
+		.func = &Modbus,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd7));
+
+	const esp_console_cmd_t cmd8 = {
+		.command = "traffic",
+		.help = "Recorded RTU traffic, decode it on a PC with Host/traffic_tool\n"
+				"Usage: traffic <dump|clear>\n"
+				"dump - Print the recording as base64, copy everything from the BEGIN line to the END line into a file\n"
+				"clear - Start the recording afresh",
+		.hint = NULL,
+		.func = &Traffic,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd8));
+
+	const esp_console_cmd_t cmd9 = {
+		.command = "events",
+		.help = "Event bus counters per subscriber\n"
+				"Usage: events [clear]\n"
+				"clear - Zero the counters and latencies",
+		.hint = NULL,
+		.func = &Events,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd9));
+
+	const esp_console_cmd_t cmd10 = {
+		.command = "interlock",
+		.help = "What has tripped the heater interlock and how fast it cut the heater",
+		.hint = NULL,
+		.func = &InterlockStatus,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd10));
+
+	const esp_console_cmd_t cmd11 = {
+		.command = "faults",
+		.help = "The fault journal, every error that set or cleared, oldest first. It survives a warm reset\n"
+				"Usage: faults [clear|reset]\n"
+				"clear - Empty the journal\n"
+				"reset - Operator reset, clears the latched errors whose condition has gone",
+		.hint = NULL,
+		.func = &Faults,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd11));
+
+	const esp_console_cmd_t cmd12 = {
+		.command = "tasks",
+		.help = "Supervised tasks, their deadline misses and period jitter\n"
+				"Usage: tasks [clear]\n"
+				"clear - Zero the misses, intervals and jitter",
+		.hint = NULL,
+		.func = &Tasks,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd12));
+
+	const esp_console_cmd_t cmd13 = {
+		.command = "switches",
+		.help = "Door and enable switch levels, their bounces and how long a clean edge takes to publish\n"
+				"Usage: switches [clear]\n"
+				"clear - Zero the counters and latencies",
+		.hint = NULL,
+		.func = &Switches,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd13));
+
+	const esp_console_cmd_t cmd14 = {
+		.command = "energy",
+		.help = "Energy delivered to the heater, for the lifetime of the furnace, the running or last melt and its segments\n"
+				"Usage: energy [charge <kg>]\n"
+				"charge - Set the metal in the melt, for the energy per kg. It carries over to the next melt",
+		.hint = NULL,
+		.func = &Energy,
+	};
+	ESP_ERROR_CHECK(esp_console_cmd_register(&cmd14));
+
 	const esp_console_cmd_t defaultCmd = {
 		.command = "s",
 		.help = "Get the current status of the system",
@@ -206,7 +299,8 @@ Console::Console()
 		linenoiseSetDumbMode(1);
 	}
 
-	xTaskCreate(ConsoleTask, "ConsoleTask", 4096, this, 10, NULL);
+	EventBus::GetInstance()->Subscribe(Subscriber::CONSOLE, ALL_EVENTS);
+	xTaskCreate(ConsoleTask, "ConsoleTask", CONSOLE_TASK_STACK_SIZE, this, 10, NULL);
 	xTaskCreate(StatusOverlayTask, "StatusOverlayTask", 4096, this, 10, NULL);
 }
 
@@ -303,7 +397,8 @@ int Console::Temp(int argc, char **argv)
 				temp = MAX_TEMP;
 			}
 
-			controller->SetTargetTemp(temp);
+			// State applies it, like a setpoint from anywhere else
+			EventBus::GetInstance()->Publish(SetTempEvent{static_cast<float>(temp)});
 			printf("Set target temperature: %.2f\n", temp);
 		}
 
@@ -325,7 +420,9 @@ int Console::Temp(int argc, char **argv)
 				return 1;
 			}
 
-			int ratePerMinute = int((controller->GetTargetTemp() - controller->GetCurrentTemp()) / time);
+			// the new target may not have reached the controller yet
+			double target = setTemp ? temp : controller->GetTargetTemp();
+			int ratePerMinute = int((target - controller->GetCurrentTemp()) / time);
 
 			controller->SetHeatingRate(ratePerMinute / 60.0f);
 
@@ -366,6 +463,366 @@ int Console::Status(int argc, char **argv)
 	printf("PWM duty cycle: %d\n", controller->GetPwmDutyCycle());
 	printf("Heating rate: %.2f\n", controller->GetConfig().HEATING_RATE_PER_SECOND);
 	printf("Internal Target Temp: %.2f\n", controller->GetInternalSetTemp());
+
+	ThermalMonitorStatus thermal;
+	controller->GetThermalStatus(thermal);
+	printf("Thermal model evidence: heating uncommanded %.0f%%, heating failed %.0f%%, sensor detached %.0f%%\n",
+		   thermal.uncommandedHeating * 100, thermal.heatingFailed * 100, thermal.sensorDetached * 100);
+
+	if (CURRENT_SENSOR_FITTED)
+	{
+		CurrentStatus current;
+		CurrentMonitor::GetInstance()->GetStatus(current);
+		printf("Heater current: %.2f A, %.0f VA over the last second, %.2f A last half cycle with the SSR %s\n", current.amps,
+			   current.voltAmps, current.halfCycleAmps, current.ssrOn ? "on" : "off");
+		printf("Half cycles: %lu, %lu checked, %lu skipped as the SSR switched, %lu overruns, RMS kernel (us) p50/p99/max %lu/%lu/%lu\n",
+			   current.halfCycles, current.checks, current.skipped, current.overruns, current.kernel.GetPercentile(0.5f),
+			   current.kernel.GetPercentile(0.99f), current.kernel.GetMax());
+	}
+
+	DiagnosticsCounters bus;
+	Server::GetInstance()->GetLinkUart().GetBusCounters(bus);
+	printf("Modbus: %u requests, %u bus errors, %u exceptions, %u unanswered (details with 'modbus')\n",
+		   bus.SERVER_MESSAGES, bus.BUS_COMMUNICATION_ERRORS, bus.BUS_EXCEPTION_ERRORS, bus.SERVER_NO_RESPONSE);
+
+	FileInfo program = FileStore::GetInstance()->GetInfo(FileId::PROGRAM);
+	FileInfo gains = FileStore::GetInstance()->GetInfo(FileId::GAIN_SCHEDULE);
+	printf("Program file: version %u, %u registers, crc %04x. Gain schedule: version %u, %u registers, crc %04x\n",
+		   program.VERSION, program.LENGTH, program.CRC, gains.VERSION, gains.LENGTH, gains.CRC);
+
+	static const char *linkStates[] = {"unsupervised", "ok", "LOST"};
+	HeartbeatStatus heartbeat;
+	LinkSupervisor::GetInstance()->GetStatus(heartbeat);
+	printf("Frontend link %s: heartbeat last %u ms, p99 %u ms, max %u ms, jitter %u ms, %u ms ago, %u skipped, %u deadlines missed\n",
+		   linkStates[heartbeat.STATE], heartbeat.LAST_INTERVAL_MS, heartbeat.P99_INTERVAL_MS, heartbeat.MAX_INTERVAL_MS,
+		   heartbeat.JITTER_MS, heartbeat.SINCE_LAST_MS, heartbeat.SKIPPED, heartbeat.MISSES);
+
+	LinkUart &uart = Server::GetInstance()->GetLinkUart();
+	LatencyHistogram turnaround;
+	uart.GetTurnaround(turnaround);
+	printf("Modbus turnaround (us): p50 %lu, p99 %lu, max %lu over %lu requests\n", turnaround.GetPercentile(0.5f),
+		   turnaround.GetPercentile(0.99f), turnaround.GetMax(), turnaround.GetCount());
+	if (uart.IsRs485())
+	{
+		LatencyHistogram drain;
+		uart.GetTxDrain(drain);
+		printf("RS-485 reply on the wire and DE released (us): p50 %lu, max %lu, collisions %lu\n", drain.GetPercentile(0.5f),
+			   drain.GetMax(), uart.GetCollisions());
+	}
+	return 0;
+}
+
+int Console::Modbus(int argc, char **argv)
+{
+	Server *server = Server::GetInstance();
+
+	if (argc == 2 && strcmp(argv[1], "clear") == 0)
+	{
+		server->ClearModbusStats();
+		printf("Modbus counters cleared\n");
+		return 0;
+	}
+	else if (argc != 1)
+	{
+		printf("Usage: modbus [clear]\n");
+		return 1;
+	}
+
+	// a copy of the monitor is a few kB, more than the console task needs for anything else
+	std::unique_ptr<BusMonitor> copy(new (std::nothrow) BusMonitor(0, 0));
+	if (!copy)
+	{
+		printf("No memory for a copy of the bus monitor\n");
+		return 1;
+	}
+	BusMonitor &monitor = *copy;
+	if (!server->GetLinkUart().GetBusMonitor(monitor))
+	{
+		printf("The RTU bus isn't monitored\n");
+		return 1;
+	}
+
+	const DiagnosticsCounters &bus = monitor.GetCounters();
+	printf("RTU bus: %u messages, %u communication errors, %u exceptions sent\n", bus.BUS_MESSAGES,
+		   bus.BUS_COMMUNICATION_ERRORS, bus.BUS_EXCEPTION_ERRORS);
+	printf("This unit: %u requests, %u unanswered (broadcasts included)\n", bus.SERVER_MESSAGES, bus.SERVER_NO_RESPONSE);
+
+	const LinkStats &functions = monitor.GetFunctions();
+	printf("\nFC  requests exceptions  request to response (us) p50/p99/max\n");
+	for (size_t i = 0; i < functions.GetFunctionCount(); i++)
+	{
+		const FunctionStats &function = functions.GetFunctionAt(i);
+		printf("%02X  %8lu %10lu  %lu/%lu/%lu\n", function.functionCode, function.requests, function.exceptions,
+			   function.latency.GetPercentile(0.5f), function.latency.GetPercentile(0.99f), function.latency.GetMax());
+	}
+
+	printf("\nArea         OnRead n p50/p99/max (us)     OnWrite n p50/p99/max (us), RTU and TCP\n");
+	for (size_t i = 0; i < static_cast<size_t>(ServedArea::COUNT); i++)
+	{
+		ServedArea area = static_cast<ServedArea>(i);
+		AreaStats stats;
+		Server::GetAreaStats(area, stats);
+
+		printf("%-12s %8lu %lu/%lu/%lu", Server::GetAreaName(area), stats.onRead.GetCount(), stats.onRead.GetPercentile(0.5f),
+			   stats.onRead.GetPercentile(0.99f), stats.onRead.GetMax());
+		printf("    %8lu %lu/%lu/%lu\n", stats.onWrite.GetCount(), stats.onWrite.GetPercentile(0.5f),
+			   stats.onWrite.GetPercentile(0.99f), stats.onWrite.GetMax());
+	}
+	return 0;
+}
+
+int Console::Traffic(int argc, char **argv)
+{
+	LinkUart &uart = Server::GetInstance()->GetLinkUart();
+
+	if (argc == 2 && strcmp(argv[1], "dump") == 0)
+	{
+		if (!uart.PrintTrafficDump())
+		{
+			printf("No traffic recording, TRAFFIC_RECORDER_SIZE is 0\n");
+			return 1;
+		}
+		return 0;
+	}
+	else if (argc == 2 && strcmp(argv[1], "clear") == 0)
+	{
+		uart.ClearTrafficRecorder();
+		printf("Traffic recording cleared\n");
+		return 0;
+	}
+
+	printf("Usage: traffic <dump|clear>\n");
+	return 1;
+}
+
+int Console::Events(int argc, char **argv)
+{
+	EventBus *bus = EventBus::GetInstance();
+
+	if (argc == 2 && strcmp(argv[1], "clear") == 0)
+	{
+		bus->ClearStats();
+		printf("Event counters cleared\n");
+		return 0;
+	}
+	else if (argc != 1)
+	{
+		printf("Usage: events [clear]\n");
+		return 1;
+	}
+
+	SubscriberStats stats;
+	printf("Subscriber   delivered  dropped  high water/%zu  publish to receive (us) p50/p99/max\n", EVENT_QUEUE_DEPTH);
+	for (size_t i = 0; i < static_cast<size_t>(Subscriber::COUNT); i++)
+	{
+		Subscriber subscriber = static_cast<Subscriber>(i);
+		bus->GetStats(subscriber, stats);
+		printf("%-12s %9lu %8lu %10lu      %lu/%lu/%lu\n", EventBus::GetName(subscriber), stats.delivered, stats.dropped,
+			   stats.highWater, stats.latency.GetPercentile(0.5f), stats.latency.GetPercentile(0.99f), stats.latency.GetMax());
+	}
+	return 0;
+}
+
+int Console::InterlockStatus(int argc, char **argv)
+{
+	Interlock *interlock = Interlock::GetInstance();
+
+	InterlockStats stats;
+	printf("Interlock %s\n", interlock->IsTripped() ? "TRIPPED, heater off" : "clear");
+	printf("Cause         state    trips  detection to heater off (us) last p50/p99/max\n");
+	for (size_t i = 0; i < static_cast<size_t>(InterlockCause::COUNT); i++)
+	{
+		InterlockCause cause = static_cast<InterlockCause>(i);
+		interlock->GetStats(cause, stats);
+		printf("%-13s %-7s %6lu  %lu %lu/%lu/%lu\n", Interlock::GetName(cause), stats.tripped ? "TRIPPED" : "ok", stats.trips,
+			   stats.lastLatencyUs, stats.latency.GetPercentile(0.5f), stats.latency.GetPercentile(0.99f), stats.latency.GetMax());
+	}
+	return 0;
+}
+
+int Console::Faults(int argc, char **argv)
+{
+	ErrorJournal *journal = ErrorJournal::GetInstance();
+
+	if (argc == 2 && strcmp(argv[1], "clear") == 0)
+	{
+		journal->Clear();
+		printf("Fault journal cleared\n");
+		return 0;
+	}
+	else if (argc == 2 && strcmp(argv[1], "reset") == 0)
+	{
+		ErrorCode cleared = State::GetInstance()->ResetErrors();
+		ErrorCode remaining = State::GetInstance()->GetError();
+		printf("Reset cleared 0x%02lX, 0x%02lX still set\n", static_cast<uint32_t>(cleared), static_cast<uint32_t>(remaining));
+		return 0;
+	}
+	else if (argc != 1)
+	{
+		printf("Usage: faults [clear|reset]\n");
+		return 1;
+	}
+
+	// by ErrorCode bit number
+	static const char *errorNames[] = {"thermocouple", "temp high", "temp low", "door open", "task stalled", "estop", "no current",
+								 "heating uncommanded", "heating failed", "sensor detached", "ssr welded"};
+	static const char *policies[] = {"self clearing", "latched until reset", "latched until power cycle"};
+
+	State *state = State::GetInstance();
+	uint32_t errors = static_cast<uint32_t>(state->GetError());
+	uint32_t conditions = static_cast<uint32_t>(state->GetConditions());
+	for (uint8_t bit = 0; bit < ERROR_CODE_BITS; bit++)
+	{
+		if (errors & (1u << bit))
+		{
+			ErrorCode error = static_cast<ErrorCode>(1u << bit);
+			printf("Set: %s, %s, %s\n", bit < sizeof(errorNames) / sizeof(errorNames[0]) ? errorNames[bit] : "?",
+				   policies[static_cast<size_t>(GetFaultPolicy(error))], (conditions & (1u << bit)) ? "still present" : "condition gone");
+		}
+	}
+
+	FaultJournalRegisters registers;
+	journal->CopyTo(registers);
+
+	uint16_t next = registers.header.NEXT_SEQUENCE;
+	uint16_t count = next < FAULT_JOURNAL_CAPACITY ? next : FAULT_JOURNAL_CAPACITY;
+	printf("Boot %u, reset reason %u, %u entries\n", registers.header.BOOT, registers.header.RESET_REASON, count);
+	printf("  seq boot      time (s)  error         set/clear  errors  temp (C)  duty\n");
+
+	for (uint16_t sequence = next - count; sequence != next; sequence++)
+	{
+		const FaultJournalEntry &entry = registers.entries[sequence % FAULT_JOURNAL_CAPACITY];
+		uint16_t bit = entry.EVENT & ~FAULT_JOURNAL_SET;
+		uint32_t timeMs = static_cast<uint32_t>(entry.TIME_MS_HI) << 16 | entry.TIME_MS_LO;
+
+		printf("%5u %4u %13.3f  %-13s %-9s  0x%02X  %8.1f  %4u\n", entry.SEQUENCE, entry.BOOT, timeMs / 1000.0,
+			   bit < sizeof(errorNames) / sizeof(errorNames[0]) ? errorNames[bit] : "?", (entry.EVENT & FAULT_JOURNAL_SET) ? "set" : "clear",
+			   entry.ERROR, entry.TEMP_DC / 10.0, entry.DUTY);
+	}
+	return 0;
+}
+
+int Console::Tasks(int argc, char **argv)
+{
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+
+	if (argc == 2 && strcmp(argv[1], "clear") == 0)
+	{
+		supervisor->ClearStats();
+		printf("Task statistics cleared\n");
+		return 0;
+	}
+	else if (argc != 1)
+	{
+		printf("Usage: tasks [clear]\n");
+		return 1;
+	}
+
+	static const char *states[] = {"-", "ok", "LATE", "STALLED"};
+
+	TaskHealthRegisters registers;
+	LatencyHistogram jitter;
+	supervisor->GetStatus(registers);
+
+	printf("Task             state    period/deadline (ms)  misses  interval last/max (ms)  jitter p50/p99/max (us)\n");
+	for (size_t i = 0; i < static_cast<size_t>(SupervisedTask::COUNT); i++)
+	{
+		SupervisedTask task = static_cast<SupervisedTask>(i);
+		const TaskHealthEntry &entry = registers.entries[i];
+		supervisor->GetJitter(task, jitter);
+
+		printf("%-16s %-8s %6u/%-6u %14u  %10u/%-10u  %lu/%lu/%lu\n", TaskSupervisor::GetName(task), states[entry.STATE], entry.PERIOD_MS,
+			   entry.DEADLINE_MS, entry.MISSES, entry.LAST_INTERVAL_MS, entry.MAX_INTERVAL_MS, jitter.GetPercentile(0.5f),
+			   jitter.GetPercentile(0.99f), jitter.GetMax());
+	}
+	return 0;
+}
+
+int Console::Switches(int argc, char **argv)
+{
+	GPIOManager *gpio = GPIOManager::GetInstance();
+
+	if (argc == 2 && strcmp(argv[1], "clear") == 0)
+	{
+		gpio->ClearStats();
+		printf("Switch counters cleared\n");
+		return 0;
+	}
+	else if (argc != 1)
+	{
+		printf("Usage: switches [clear]\n");
+		return 1;
+	}
+
+	static const struct
+	{
+		const char *name;
+		gpio_num_t pin;
+	} switches[] = {{"door", DOOR_SWITCH_PIN}, {"enable", ENABLE_SWITCH_PIN}};
+
+	SwitchStats stats;
+	printf("Switch  level     edges  changes\n");
+	for (const auto &sw : switches)
+	{
+		gpio->GetSwitchStats(sw.pin, stats);
+		printf("%-7s %5s %9lu %8lu\n", sw.name, stats.level ? "high" : "low", stats.edges, stats.changes);
+	}
+
+	DebounceStats debounce;
+	gpio->GetDebounceStats(debounce);
+	printf("First edge to published (us) p50/p99/max %lu/%lu/%lu over %lu, debounce %lu ms\n", debounce.latency.GetPercentile(0.5f),
+		   debounce.latency.GetPercentile(0.99f), debounce.latency.GetMax(), debounce.latency.GetCount(), DEBOUNCE_DELAY_MS);
+	printf("Longest edge interrupt %lu us\n", debounce.isrMaxUs);
+	return 0;
+}
+
+int Console::Energy(int argc, char **argv)
+{
+	EnergyMeter *meter = EnergyMeter::GetInstance();
+
+	if (argc == 3 && strcmp(argv[1], "charge") == 0)
+	{
+		double kg = atof(argv[2]);
+		if (kg < 0 || kg > UINT32_MAX / 1000.0)
+		{
+			printf("Invalid charge\n");
+			return 1;
+		}
+		meter->SetCharge(static_cast<uint32_t>(kg * 1000 + 0.5));
+		printf("Charge set to %.3f kg\n", kg);
+		return 0;
+	}
+	else if (argc != 1)
+	{
+		printf("Usage: energy [charge <kg>]\n");
+		return 1;
+	}
+
+	EnergyStatus status;
+	meter->GetStatus(status);
+
+	printf("Source: %s\n", status.source == EnergySource::MEASURED_CURRENT ? "measured current" : "SSR on time");
+	printf("Lifetime: %.2f kWh over %lu melts\n", status.lifetimeWh / 1000, status.melts);
+	if (status.melts == 0)
+	{
+		return 0;
+	}
+
+	printf("Melt %lu %s: %.0f Wh", status.melts, status.meltActive ? "running" : "ended", status.meltWh);
+	if (status.chargeG > 0)
+	{
+		printf(", charge %.3f kg, %.0f Wh/kg\n", status.chargeG / 1000.0f, status.meltWh * 1000 / status.chargeG);
+	}
+	else
+	{
+		printf(", no charge set\n");
+	}
+
+	for (uint16_t i = 0; i < status.segments; i++)
+	{
+		printf("  segment %2u: %.0f Wh\n", i + 1, status.segmentWh[i]);
+	}
+	printf("Saved %lu times since boot, %lu failed\n", status.saves, status.saveFailures);
 	return 0;
 }
 
@@ -494,7 +951,7 @@ void Console::IncrementTemp(int increment)
 		newTarget = MAX_TEMP;
 	}
 
-	controller->SetTargetTemp(newTarget);
+	EventBus::GetInstance()->Publish(SetTempEvent{newTarget});
 	printf("\nTemperature %s to %.1f°C\n",
 		   (increment > 0) ? "increased" : "decreased",
 		   newTarget);
@@ -509,9 +966,15 @@ void Console::SetHeating(bool enabled)
 
 void Console::StatusOverlayTask(void *arg)
 {
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::STATUS_OVERLAY, 500, 2000, false);
+	EventBus *bus = EventBus::GetInstance();
+	char lastEvent[32] = "none";
 
 	while (42)
 	{
+		supervisor->CheckIn(SupervisedTask::STATUS_OVERLAY);
+
 		printf("\n\n");
 		printf("Keyboard Controls:\n");
 		printf("UP ARROW    - Increase temperature by 25°C\n");
@@ -550,6 +1013,25 @@ void Console::StatusOverlayTask(void *arg)
 		printf("Rate: %.2f°C/s        ", controller->GetConfig().HEATING_RATE_PER_SECOND);
 		printf("\033[6;%dH", 80 - 30);
 		printf("Internal Setpoint : %.2f°C      ", controller->GetInternalSetTemp());
+
+		Event event;
+		while (bus->Receive(Subscriber::CONSOLE, event, 0))
+		{
+			if (const DoorEvent *door = std::get_if<DoorEvent>(&event))
+			{
+				snprintf(lastEvent, sizeof(lastEvent), "door %s", door->open ? "opened" : "closed");
+			}
+			else if (const EnableEvent *enable = std::get_if<EnableEvent>(&event))
+			{
+				snprintf(lastEvent, sizeof(lastEvent), "enable %s", enable->enabled ? "on" : "off");
+			}
+			else if (const SetTempEvent *setTemp = std::get_if<SetTempEvent>(&event))
+			{
+				snprintf(lastEvent, sizeof(lastEvent), "set %.1f°C", setTemp->temperature);
+			}
+		}
+		printf("\033[7;%dH", 80 - 30);
+		printf("Event: %-20s", lastEvent);
 		// Restore cursor position
 		printf("\033[u");
 
@@ -43,6 +43,14 @@ private:
 	static int GetPwmDutyCycle(int argc, char **argv);
 	static int Heating(int argc, char **argv);
 	static int Status(int argc, char **argv);
+	static int Modbus(int argc, char **argv);
+	static int Traffic(int argc, char **argv);
+	static int Events(int argc, char **argv);
+	static int InterlockStatus(int argc, char **argv);
+	static int Faults(int argc, char **argv);
+	static int Tasks(int argc, char **argv);
+	static int Switches(int argc, char **argv);
+	static int Energy(int argc, char **argv);
 	static void StatusOverlayTask(void *arg);
 
 #if SIMULATED_TEMP_DEVICE
@@ -0,0 +1,334 @@
+#include "CurrentMonitor.hxx"
+#include "Interlock.hxx"
+#include "TaskSupervisor.hxx"
+
+#include <esp_adc/adc_cali.h>
+#include <esp_adc/adc_cali_scheme.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <soc/soc_caps.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const char *CMTAG = "CurrentMonitor";
+
+static constexpr uint32_t HALF_CYCLE_US = 1000000 / (2 * LINE_FREQ);
+static constexpr uint32_t HALF_CYCLES_PER_SECOND = 2 * LINE_FREQ;
+static constexpr float BIAS_SMOOTHING = 1.0f / 16; // of each whole cycle's mean taken into the bias
+
+static_assert(CURRENT_SAMPLES_PER_HALF_CYCLE * HALF_CYCLES_PER_SECOND >= SOC_ADC_SAMPLE_FREQ_THRES_LOW, "the ADC can't sample that slowly");
+
+// the kernel sums the DMA words where they lie, the classic ESP32's are 16 bits with the value in the low 12
+static_assert(SOC_ADC_DIGI_RESULT_BYTES == sizeof(uint16_t), "the RMS kernel expects 16 bit ADC DMA words");
+
+CurrentMonitor *CurrentMonitor::myInstance = nullptr;
+std::atomic<uint32_t> CurrentMonitor::mySsr{0};
+portMUX_TYPE CurrentMonitor::mySsrLock = portMUX_INITIALIZER_UNLOCKED;
+int64_t CurrentMonitor::mySsrOnUs = 0;
+int64_t CurrentMonitor::mySsrOnSinceUs = 0;
+
+static uint16_t saturate16(uint32_t value)
+{
+	return value > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(value);
+}
+
+CurrentMonitor::CurrentMonitor()
+{
+	myInstance = this;
+	ESP_LOGI(CMTAG, "Initializing current monitor");
+
+	adc_unit_t unit;
+	adc_channel_t channel;
+	ESP_ERROR_CHECK(adc_continuous_io_to_channel(CURRENT_SENSOR_PIN, &unit, &channel));
+
+	// the driver's pool is flushed when full, the callback has already copied every frame out
+	adc_continuous_handle_cfg_t handleConf = {
+		.max_store_buf_size = 4 * CURRENT_SAMPLES_PER_HALF_CYCLE * SOC_ADC_DIGI_RESULT_BYTES,
+		.conv_frame_size = CURRENT_SAMPLES_PER_HALF_CYCLE * SOC_ADC_DIGI_RESULT_BYTES,
+		.flags = {
+			.flush_pool = 1,
+		},
+	};
+	ESP_ERROR_CHECK(adc_continuous_new_handle(&handleConf, &myAdc));
+
+	adc_digi_pattern_config_t pattern = {
+		.atten = ADC_ATTEN_DB_12,
+		.channel = static_cast<uint8_t>(channel),
+		.unit = static_cast<uint8_t>(unit),
+		.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+	};
+	adc_continuous_config_t adcConf = {
+		.pattern_num = 1,
+		.adc_pattern = &pattern,
+		.sample_freq_hz = CURRENT_SAMPLES_PER_HALF_CYCLE * HALF_CYCLES_PER_SECOND,
+		.conv_mode = ADC_CONV_SINGLE_UNIT_1,
+		.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+	};
+	ESP_ERROR_CHECK(adc_continuous_config(myAdc, &adcConf));
+
+	// both calibrations are linear, two points give the scale
+	myVoltsPerCount = 3.1f / 4095;
+#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+	adc_cali_handle_t cali = nullptr;
+	adc_cali_line_fitting_config_t caliConf = {
+		.unit_id = unit,
+		.atten = ADC_ATTEN_DB_12,
+		.bitwidth = ADC_BITWIDTH_12,
+	};
+	int low = 0;
+	int high = 0;
+	if (adc_cali_create_scheme_line_fitting(&caliConf, &cali) == ESP_OK && adc_cali_raw_to_voltage(cali, 1000, &low) == ESP_OK &&
+		adc_cali_raw_to_voltage(cali, 3000, &high) == ESP_OK)
+	{
+		myVoltsPerCount = (high - low) / 2000.0f / 1000.0f;
+	}
+	else
+	{
+		ESP_LOGW(CMTAG, "No ADC calibration, the current reading is approximate");
+	}
+#endif
+
+	// above the console, Modbus and the other control plane tasks, a burst of their work mustn't stall it
+	xTaskCreate(&monitorTask, "currentMonitorTask", 3072, this, 12, &myTask);
+
+	adc_continuous_evt_cbs_t callbacks = {
+		.on_conv_done = convDone,
+	};
+	ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(myAdc, &callbacks, this));
+	ESP_ERROR_CHECK(adc_continuous_start(myAdc));
+}
+
+void CurrentMonitor::SsrSwitched(bool on)
+{
+	int64_t now = esp_timer_get_time();
+	uint32_t stamp = (static_cast<uint32_t>(now) & ~1u) | (on ? 1 : 0);
+
+	// the soft PWM and the interlock both drive the pin, whichever gets there first stamps the change. The
+	// interlock can get here from an ISR.
+	portENTER_CRITICAL_SAFE(&mySsrLock);
+	bool wasOn = (mySsr.load(std::memory_order_relaxed) & 1) != 0;
+	if (wasOn != on)
+	{
+		if (wasOn)
+		{
+			mySsrOnUs += now - mySsrOnSinceUs;
+		}
+		else
+		{
+			mySsrOnSinceUs = now;
+		}
+		mySsr.store(stamp, std::memory_order_release);
+	}
+	portEXIT_CRITICAL_SAFE(&mySsrLock);
+}
+
+int64_t CurrentMonitor::GetSsrOnTimeUs()
+{
+	int64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL_SAFE(&mySsrLock);
+	int64_t onUs = mySsrOnUs;
+	if ((mySsr.load(std::memory_order_relaxed) & 1) != 0)
+	{
+		onUs += now - mySsrOnSinceUs;
+	}
+	portEXIT_CRITICAL_SAFE(&mySsrLock);
+
+	return onUs;
+}
+
+bool IRAM_ATTR CurrentMonitor::convDone(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *data, void *arg)
+{
+	CurrentMonitor *monitor = static_cast<CurrentMonitor *>(arg);
+	Frame &frame = monitor->myFrames[monitor->myFilling];
+
+	if (frame.full.load(std::memory_order_acquire))
+	{
+		monitor->myOverruns.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	frame.count = std::min<uint32_t>(data->size / SOC_ADC_DIGI_RESULT_BYTES, CURRENT_SAMPLES_PER_HALF_CYCLE);
+	memcpy(frame.samples, data->conv_frame_buffer, frame.count * SOC_ADC_DIGI_RESULT_BYTES);
+	frame.endUs = esp_timer_get_time();
+	frame.ssr = mySsr.load(std::memory_order_acquire);
+	frame.full.store(true, std::memory_order_release);
+	monitor->myFilling ^= 1;
+
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+	vTaskNotifyGiveFromISR(monitor->myTask, &higherPriorityTaskWoken);
+	return higherPriorityTaskWoken == pdTRUE;
+}
+
+void CurrentMonitor::process(const Frame &frame)
+{
+	int64_t start = esp_timer_get_time();
+
+	RmsSums sums = {};
+	RmsAccumulate(frame.samples, frame.count, sums);
+
+	// a half cycle's own mean is off by however much of the wave it caught, a whole cycle's isn't
+	RmsSums cycle = {sums.count + myPrevious.count, sums.sum + myPrevious.sum, sums.sumSquares + myPrevious.sumSquares};
+	bool firstCycle = myPrevious.count == 0;
+	myPrevious = sums;
+	if (firstCycle)
+	{
+		return;
+	}
+	float meanQ4 = RmsMeanQ4(cycle);
+	myBiasQ4 = myBiasQ4 == 0 ? meanQ4 : myBiasQ4 + (meanQ4 - myBiasQ4) * BIAS_SMOOTHING;
+
+	float counts = RmsAroundBias(sums, static_cast<uint32_t>(lroundf(myBiasQ4)));
+	float amps = counts * myVoltsPerCount * CURRENT_SENSOR_AMPS_PER_VOLT;
+	uint32_t kernelUs = static_cast<uint32_t>(esp_timer_get_time() - start);
+
+	bool on = (frame.ssr & 1) != 0;
+	bool settled = static_cast<uint32_t>(frame.endUs) - (frame.ssr & ~1u) >= HALF_CYCLE_US + CURRENT_SSR_SETTLE_MS * 1000;
+
+	mySecondSquares += amps * amps;
+	mySecondHalfCycles++;
+	bool secondDone = mySecondHalfCycles >= HALF_CYCLES_PER_SECOND;
+	float secondAmps = secondDone ? sqrtf(mySecondSquares / mySecondHalfCycles) : 0;
+	if (secondDone)
+	{
+		mySecondSquares = 0;
+		mySecondHalfCycles = 0;
+	}
+
+	myJoules += amps * MAINS_VOLTAGE_RMS * HALF_CYCLE_US / 1e6;
+
+	taskENTER_CRITICAL(&myLock);
+	myStatus.halfCycleAmps = amps;
+	myStatus.joules = myJoules;
+	myStatus.ssrOn = on;
+	myStatus.halfCycles++;
+	if (!settled)
+	{
+		myStatus.skipped++;
+	}
+	if (secondDone)
+	{
+		myStatus.amps = secondAmps;
+		myStatus.voltAmps = secondAmps * MAINS_VOLTAGE_RMS;
+	}
+	myStatus.kernel.Record(kernelUs);
+	taskEXIT_CRITICAL(&myLock);
+
+	if (settled)
+	{
+		check(amps, on, frame.endUs);
+	}
+}
+
+void CurrentMonitor::check(float amps, bool on, int64_t detectedUs)
+{
+	bool flowing = amps >= CURRENT_ON_THRESHOLD_A;
+	bool welded = !on && flowing;
+	bool open = on && !flowing;
+
+	// Only a half cycle in the same SSR state that agrees clears a count, the other state says nothing about
+	// it. At high duty the few checked off half cycles of each period add up towards a weld, at low duty the
+	// on ones towards an open element, instead of every switch starting the count again.
+	taskENTER_CRITICAL(&myLock);
+	myStatus.checks++;
+	if (welded)
+	{
+		myStatus.welded = std::min<uint16_t>(myStatus.welded + 1, UINT16_MAX);
+	}
+	else if (!on)
+	{
+		myStatus.welded = 0;
+	}
+	if (open)
+	{
+		myStatus.open = std::min<uint16_t>(myStatus.open + 1, UINT16_MAX);
+	}
+	else if (on)
+	{
+		myStatus.open = 0;
+	}
+	uint16_t weldedHalfCycles = myStatus.welded;
+	uint16_t openHalfCycles = myStatus.open;
+	taskEXIT_CRITICAL(&myLock);
+
+	Interlock *interlock = Interlock::GetInstance();
+
+	if (weldedHalfCycles >= CURRENT_FAULT_HALF_CYCLES)
+	{
+		interlock->Trip(InterlockCause::SSR_WELDED, detectedUs);
+	}
+	else if (!welded)
+	{
+		interlock->Release(InterlockCause::SSR_WELDED);
+	}
+
+	// with the SSR off there's nothing to say the element is still open, the error stays latched until a reset
+	// and the next time it's commanded on will tell
+	if (openHalfCycles >= CURRENT_FAULT_HALF_CYCLES)
+	{
+		interlock->Trip(InterlockCause::NO_CURRENT, detectedUs);
+	}
+	else if (!open)
+	{
+		interlock->Release(InterlockCause::NO_CURRENT);
+	}
+}
+
+void CurrentMonitor::GetStatus(CurrentStatus &status)
+{
+	taskENTER_CRITICAL(&myLock);
+	status = myStatus;
+	taskEXIT_CRITICAL(&myLock);
+	status.overruns = myOverruns.load(std::memory_order_relaxed);
+}
+
+double CurrentMonitor::GetJoules()
+{
+	taskENTER_CRITICAL(&myLock);
+	double joules = myStatus.joules;
+	taskEXIT_CRITICAL(&myLock);
+	return joules;
+}
+
+void CurrentMonitor::GetRegisters(HeaterPowerRegisters &registers)
+{
+	taskENTER_CRITICAL(&myLock);
+	registers.FITTED = 1;
+	registers.CURRENT_CA = saturate16(static_cast<uint32_t>(myStatus.amps * 100));
+	registers.APPARENT_POWER_VA = saturate16(static_cast<uint32_t>(myStatus.voltAmps));
+	registers.HALF_CYCLE_CURRENT_CA = saturate16(static_cast<uint32_t>(myStatus.halfCycleAmps * 100));
+	registers.SSR_ON = myStatus.ssrOn;
+	registers.SKIPPED = saturate16(myStatus.skipped);
+	registers.KERNEL_P99_US = saturate16(myStatus.kernel.GetPercentile(0.99f));
+	taskEXIT_CRITICAL(&myLock);
+	registers.OVERRUNS = saturate16(myOverruns.load(std::memory_order_relaxed));
+}
+
+void CurrentMonitor::monitorTask(void *pvParameter)
+{
+	CurrentMonitor *monitor = static_cast<CurrentMonitor *>(pvParameter);
+
+	// a frame every half cycle, going CURRENT_MONITOR_DEADLINE_MS without one means the ADC or this task has
+	// stopped. A stall latches until a power cycle, so the deadline covers the flash erases an NVS write makes.
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::CURRENT, HALF_CYCLE_US / 1000, CURRENT_MONITOR_DEADLINE_MS, true);
+
+	while (42)
+	{
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+		Frame *frame = &monitor->myFrames[monitor->myDraining];
+		while (frame->full.load(std::memory_order_acquire))
+		{
+			monitor->process(*frame);
+			frame->full.store(false, std::memory_order_release);
+			monitor->myDraining ^= 1;
+			frame = &monitor->myFrames[monitor->myDraining];
+
+			supervisor->CheckIn(SupervisedTask::CURRENT);
+		}
+	}
+}
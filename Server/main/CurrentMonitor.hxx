@@ -0,0 +1,113 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <esp_adc/adc_continuous.h>
+
+#include "hardware.h"
+#include "modbus/HeaterPower.hxx"
+#include "modbus/LinkStats.hxx"
+#include "power/Rms.hxx"
+
+#include <atomic>
+#include <cstdint>
+
+struct CurrentStatus
+{
+	float amps;			  // RMS over the last second
+	float voltAmps;		  // apparent power over the last second
+	float halfCycleAmps;  // RMS over the last half cycle
+	bool ssrOn;			  // what the SSR was commanded to during it
+	uint32_t halfCycles;  // worked out since boot
+	uint32_t checks;	  // compared against the SSR
+	uint32_t skipped;	  // the SSR switched in, or had only just switched before
+	uint32_t overruns;	  // dropped, the task still had both buffers
+	uint16_t welded;	  // SSR off half cycles with current since the last one without
+	uint16_t open;		  // SSR on half cycles without current since the last one with
+	double joules;		  // apparent energy delivered since boot, from the half cycles worked out
+	LatencyHistogram kernel; // microseconds to work out one half cycle
+};
+
+// Samples the heater current transformer on CURRENT_SENSOR_PIN continuously. The ADC's DMA hands over a
+// half mains cycle at a time, the conversion done callback copies it into whichever of two buffers is free and
+// a task above the console and Modbus ones works out its true RMS with the fixed point kernel in power/Rms.hxx.
+//
+// Each half cycle is held against what the SSR was commanded to do. Current with the SSR off (welded SSR) or
+// none with it on (open element, tripped breaker) for CURRENT_FAULT_HALF_CYCLES trips the interlock. The
+// half cycles needn't be in a row, only one in the same SSR state that agrees starts the count again, so a
+// PWM period with just a few checked off (or on) half cycles still gets there over several periods.
+// A half cycle only counts if the SSR has been in the same state since CURRENT_SSR_SETTLE_MS before it
+// started, a zero crossing SSR takes up to half a cycle to follow its input. So an on or off time shorter
+// than the settle time plus a half cycle, about 18 ms at 60 Hz, is never checked: at a duty that close to
+// 0 an open element isn't noticed, that close to full a welded SSR isn't.
+class CurrentMonitor
+{
+public:
+	CurrentMonitor();
+
+	static CurrentMonitor *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new CurrentMonitor();
+		}
+		return myInstance;
+	}
+
+	// Everything that drives HEATER_SSR_PIN calls this, from a task or an ISR. Only a change of state is noted.
+	static void SsrSwitched(bool on);
+
+	// microseconds the SSR has been commanded on since boot, up to now. Kept whether or not a sensor is fitted.
+	static int64_t GetSsrOnTimeUs();
+
+	double GetJoules();
+
+	void GetStatus(CurrentStatus &status);
+	void GetRegisters(HeaterPowerRegisters &registers);
+
+private:
+	static CurrentMonitor *myInstance;
+	static void monitorTask(void *pvParameter);
+	static bool convDone(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *data, void *arg);
+
+	struct Frame
+	{
+		uint16_t samples[CURRENT_SAMPLES_PER_HALF_CYCLE];
+		uint32_t count;
+		int64_t endUs;				// when the DMA finished it
+		uint32_t ssr;				// mySsr then
+		std::atomic<bool> full{false}; // the callback filled it and the task hasn't finished with it
+	};
+
+	void process(const Frame &frame);
+	void check(float amps, bool on, int64_t detectedUs);
+
+	// esp_timer time of the last switch in microseconds, wrapping, with whether it switched on in bit 0
+	static std::atomic<uint32_t> mySsr;
+
+	// the on time, changed with mySsr under mySsrLock
+	static portMUX_TYPE mySsrLock;
+	static int64_t mySsrOnUs;	   // finished on periods
+	static int64_t mySsrOnSinceUs; // start of the running one
+
+	adc_continuous_handle_t myAdc = nullptr;
+	TaskHandle_t myTask = nullptr;
+	float myVoltsPerCount;
+
+	// the ping-pong pair, the callback fills one while the task works on the other
+	Frame myFrames[2];
+	uint8_t myFilling = 0;	// callback only
+	uint8_t myDraining = 0; // task only
+	std::atomic<uint32_t> myOverruns{0};
+
+	// task only
+	float myBiasQ4 = 0; // the burden's mid rail bias in sixteenths of a count, from whole cycle means
+	RmsSums myPrevious = {}; // the last half cycle's, with the next one's they span a whole cycle
+	float mySecondSquares = 0;
+	uint32_t mySecondHalfCycles = 0;
+	double myJoules = 0;
+
+	portMUX_TYPE myLock = portMUX_INITIALIZER_UNLOCKED;
+	CurrentStatus myStatus = {};
+};
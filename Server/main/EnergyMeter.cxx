@@ -0,0 +1,290 @@
+#include "EnergyMeter.hxx"
+#include "CurrentMonitor.hxx"
+#include "State.hxx"
+#include "TempController.hxx"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+static const char *EMTAG = "EnergyMeter";
+
+static const char *NVS_NAMESPACE = "energy";
+static const char *NVS_KEY = "meter";
+static constexpr uint32_t RECORD_VERSION = 1;
+
+static constexpr double JOULES_PER_WH = 3600;
+
+EnergyMeter *EnergyMeter::myInstance = nullptr;
+
+static uint32_t saturate32(double value)
+{
+	return value >= UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(lround(value));
+}
+
+EnergyMeter::EnergyMeter()
+{
+	myInstance = this;
+	ESP_LOGI(EMTAG, "Initializing energy meter");
+
+	esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &myNvs);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(EMTAG, "Can't open NVS, the energy counters won't be kept: %s", esp_err_to_name(err));
+		myNvs = 0;
+	}
+	load();
+
+	xTaskCreate(&meterTask, "energyMeterTask", 3072, this, 4, NULL);
+}
+
+void EnergyMeter::load()
+{
+	myRecord = {};
+	myRecord.version = RECORD_VERSION;
+
+	if (myNvs == 0)
+	{
+		return;
+	}
+
+	Record record;
+	size_t size = sizeof(record);
+	esp_err_t err = nvs_get_blob(myNvs, NVS_KEY, &record, &size);
+	if (err == ESP_ERR_NVS_NOT_FOUND)
+	{
+		ESP_LOGI(EMTAG, "No energy counters saved yet, starting from 0");
+		return;
+	}
+	if (err != ESP_OK || size != sizeof(record) || record.version != RECORD_VERSION)
+	{
+		ESP_LOGW(EMTAG, "Saved energy counters unreadable, starting from 0");
+		return;
+	}
+
+	myRecord = record;
+	if (myRecord.meltActive)
+	{
+		// the furnace always comes up disabled
+		ESP_LOGW(EMTAG, "Melt %lu was cut short by a reset", myRecord.melts);
+		myRecord.meltActive = false;
+		myUnsaved = true;
+		mySaveSoon = true;
+	}
+
+	ESP_LOGI(EMTAG, "Lifetime %.1f kWh over %lu melts", myRecord.lifetimeJ / JOULES_PER_WH / 1000, myRecord.melts);
+}
+
+void EnergyMeter::save()
+{
+	taskENTER_CRITICAL(&myLock);
+	Record record = myRecord;
+	myUnsaved = false;
+	mySaveSoon = false;
+	taskEXIT_CRITICAL(&myLock);
+
+	esp_err_t err = nvs_set_blob(myNvs, NVS_KEY, &record, sizeof(record));
+	if (err == ESP_OK)
+	{
+		err = nvs_commit(myNvs);
+	}
+
+	taskENTER_CRITICAL(&myLock);
+	mySaves++;
+	if (err != ESP_OK)
+	{
+		// try again at the next chance
+		mySaveFailures++;
+		myUnsaved = true;
+	}
+	taskEXIT_CRITICAL(&myLock);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(EMTAG, "Saving the energy counters failed: %s", esp_err_to_name(err));
+	}
+}
+
+void EnergyMeter::SetCharge(uint32_t grams)
+{
+	taskENTER_CRITICAL(&myLock);
+	if (myRecord.chargeG != grams)
+	{
+		myRecord.chargeG = grams;
+		myUnsaved = true;
+		mySaveSoon = true;
+	}
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void EnergyMeter::GetStatus(EnergyStatus &status)
+{
+	taskENTER_CRITICAL(&myLock);
+	status.lifetimeWh = myRecord.lifetimeJ / JOULES_PER_WH;
+	status.melts = myRecord.melts;
+	status.meltActive = myRecord.meltActive;
+	status.meltWh = myRecord.meltJ / JOULES_PER_WH;
+	status.chargeG = myRecord.chargeG;
+	status.segments = myRecord.segments;
+	for (size_t i = 0; i < PROGRAM_MAX_SEGMENTS; i++)
+	{
+		status.segmentWh[i] = myRecord.segmentJ[i] / JOULES_PER_WH;
+	}
+	status.saves = mySaves;
+	status.saveFailures = mySaveFailures;
+	taskEXIT_CRITICAL(&myLock);
+
+	status.source = CURRENT_SENSOR_FITTED ? EnergySource::MEASURED_CURRENT : EnergySource::SSR_ON_TIME;
+}
+
+void EnergyMeter::GetRegisters(EnergyRegisters &registers)
+{
+	static EnergyStatus status; // only the Server's area calls this, under its lock
+	GetStatus(status);
+
+	EnergyHeader &header = registers.header;
+	uint32_t lifetimeWh = saturate32(status.lifetimeWh);
+	uint32_t meltWh = saturate32(status.meltWh);
+	uint32_t whPerKg = status.chargeG == 0 ? 0 : saturate32(status.meltWh * 1000 / status.chargeG);
+
+	header.SOURCE = static_cast<uint16_t>(status.source);
+	header.LIFETIME_WH_HI = lifetimeWh >> 16;
+	header.LIFETIME_WH_LO = lifetimeWh & 0xFFFF;
+	header.MELTS = static_cast<uint16_t>(status.melts);
+	header.MELT_ACTIVE = status.meltActive;
+	header.MELT_WH_HI = meltWh >> 16;
+	header.MELT_WH_LO = meltWh & 0xFFFF;
+	header.MELT_CHARGE_G_HI = status.chargeG >> 16;
+	header.MELT_CHARGE_G_LO = status.chargeG & 0xFFFF;
+	header.MELT_WH_PER_KG = static_cast<uint16_t>(std::min<uint32_t>(whPerKg, UINT16_MAX));
+	header.SEGMENTS = status.segments;
+	header.SAVES = static_cast<uint16_t>(status.saves);
+
+	for (size_t i = 0; i < PROGRAM_MAX_SEGMENTS; i++)
+	{
+		uint32_t segmentWh = saturate32(status.segmentWh[i]);
+		registers.segments[i].WH_HI = segmentWh >> 16;
+		registers.segments[i].WH_LO = segmentWh & 0xFFFF;
+	}
+}
+
+void EnergyMeter::GetSettings(EnergySettings &settings)
+{
+	taskENTER_CRITICAL(&myLock);
+	uint32_t chargeG = myRecord.chargeG;
+	taskEXIT_CRITICAL(&myLock);
+
+	settings.CHARGE_G_HI = chargeG >> 16;
+	settings.CHARGE_G_LO = chargeG & 0xFFFF;
+}
+
+void EnergyMeter::meterTask(void *pvParameter)
+{
+	EnergyMeter *meter = static_cast<EnergyMeter *>(pvParameter);
+	CurrentMonitor *monitor = CURRENT_SENSOR_FITTED ? CurrentMonitor::GetInstance() : nullptr;
+
+	// the totals the last period was measured up to
+	double lastJoules = monitor != nullptr ? monitor->GetJoules() : 0;
+	int64_t lastOnUs = CurrentMonitor::GetSsrOnTimeUs();
+
+	int64_t lastSaveUs = esp_timer_get_time();
+	int64_t segmentStartUs = 0;
+	float target = 0;
+
+	TickType_t lastWake = xTaskGetTickCount();
+	while (42)
+	{
+		vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(ENERGY_METER_PERIOD_MS));
+
+		double joules;
+		if (monitor != nullptr)
+		{
+			double total = monitor->GetJoules();
+			joules = total - lastJoules;
+			lastJoules = total;
+		}
+		else
+		{
+			int64_t onUs = CurrentMonitor::GetSsrOnTimeUs();
+			joules = (onUs - lastOnUs) / 1e6 * HEATER_ELEMENT_POWER_W;
+			lastOnUs = onUs;
+		}
+
+		bool enabled = State::GetInstance()->IsEnabled();
+		TempController *controller = TempController::GetInstance();
+		float newTarget = controller != nullptr ? controller->GetTargetTemp() : target;
+		int64_t now = esp_timer_get_time();
+		bool started = false;
+		bool ended = false;
+
+		taskENTER_CRITICAL(&meter->myLock);
+		Record &record = meter->myRecord;
+
+		// the period's energy goes to the melt it was delivered in, none was when it has only just started
+		record.lifetimeJ += joules;
+		if (record.meltActive)
+		{
+			record.meltJ += joules;
+			record.segmentJ[record.segments - 1] += joules;
+		}
+
+		if (enabled && !record.meltActive)
+		{
+			record.melts++;
+			record.meltActive = true;
+			record.meltJ = 0;
+			record.segments = 1;
+			std::fill(std::begin(record.segmentJ), std::end(record.segmentJ), 0.0f);
+			segmentStartUs = now;
+			started = true;
+		}
+		else if (!enabled && record.meltActive)
+		{
+			record.meltActive = false;
+			ended = true;
+		}
+		else if (record.meltActive && newTarget != target && now - segmentStartUs >= ENERGY_SEGMENT_MIN_S * 1000000ll &&
+				 record.segments < PROGRAM_MAX_SEGMENTS)
+		{
+			record.segments++;
+			segmentStartUs = now;
+		}
+		target = newTarget;
+
+		meter->myUnsaved |= joules > 0 || started || ended;
+		meter->mySaveSoon |= started || ended;
+		uint32_t melt = record.melts;
+		double meltWh = record.meltJ / JOULES_PER_WH;
+		uint32_t chargeG = record.chargeG;
+		bool unsaved = meter->myUnsaved;
+		bool saveSoon = meter->mySaveSoon;
+		taskEXIT_CRITICAL(&meter->myLock);
+
+		if (started)
+		{
+			ESP_LOGI(EMTAG, "Melt %lu started", melt);
+		}
+		if (ended)
+		{
+			if (chargeG > 0)
+			{
+				ESP_LOGI(EMTAG, "Melt %lu ended, %.0f Wh, %.0f Wh/kg", melt, meltWh, meltWh * 1000 / chargeG);
+			}
+			else
+			{
+				ESP_LOGI(EMTAG, "Melt %lu ended, %.0f Wh", melt, meltWh);
+			}
+		}
+
+		int64_t sinceSaveUs = now - lastSaveUs;
+		bool due = saveSoon || sinceSaveUs >= ENERGY_SAVE_PERIOD_S * 1000000ll;
+		if (meter->myNvs != 0 && unsaved && due && sinceSaveUs >= ENERGY_SAVE_MIN_INTERVAL_S * 1000000ll)
+		{
+			meter->save();
+			lastSaveUs = now;
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <nvs.h>
+
+#include "hardware.h"
+#include "modbus/Energy.hxx"
+
+#include <cstdint>
+
+struct EnergyStatus
+{
+	EnergySource source;
+	double lifetimeWh;
+	uint32_t melts;
+	bool meltActive;
+	float meltWh;	  // the running melt, or the last one
+	uint32_t chargeG; // what it's melting, 0 if nobody said
+	uint16_t segments;
+	float segmentWh[PROGRAM_MAX_SEGMENTS];
+	uint32_t saves;		   // NVS writes since boot
+	uint32_t saveFailures; // of those
+};
+
+// Adds up the energy delivered to the heater, for the lifetime of the furnace, per melt and per segment of a
+// melt. Energy per kg of charge is how efficient a melt was. A melt starts when the furnace is enabled and
+// ends when it's disabled. There's no program runner, so a segment is the time spent at one setpoint, a
+// change of setpoint starts the next one.
+//
+// With CURRENT_SENSOR_FITTED the energy is the CurrentMonitor's, otherwise it's the SSR on time at
+// HEATER_ELEMENT_POWER_W. The counters are kept in NVS, written at most every ENERGY_SAVE_PERIOD_S while
+// they're changing and soon after a melt starts or ends, never more often than ENERGY_SAVE_MIN_INTERVAL_S.
+// A reset loses the energy since the last save, and ends a running melt.
+class EnergyMeter
+{
+public:
+	EnergyMeter();
+
+	static EnergyMeter *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new EnergyMeter();
+		}
+		return myInstance;
+	}
+
+	// grams in the running melt, or the last one, carried over to the next melt
+	void SetCharge(uint32_t grams);
+
+	void GetStatus(EnergyStatus &status);
+	void GetRegisters(EnergyRegisters &registers);
+	void GetSettings(EnergySettings &settings);
+
+private:
+	static EnergyMeter *myInstance;
+	static void meterTask(void *pvParameter);
+
+	// what's kept in NVS, bump RECORD_VERSION when it changes
+	struct Record
+	{
+		uint32_t version;
+		uint32_t melts;
+		double lifetimeJ;
+		double meltJ;
+		float segmentJ[PROGRAM_MAX_SEGMENTS];
+		uint32_t chargeG;
+		uint16_t segments;
+		bool meltActive;
+	};
+
+	void load();
+	void save();
+
+	nvs_handle_t myNvs = 0; // 0 if NVS couldn't be opened, the counters start from nothing every boot
+
+	portMUX_TYPE myLock = portMUX_INITIALIZER_UNLOCKED;
+	Record myRecord = {};
+	bool myUnsaved = false;	// changed since the last save
+	bool mySaveSoon = false; // a melt started or ended, or the charge changed, don't wait ENERGY_SAVE_PERIOD_S
+	uint32_t mySaves = 0;
+	uint32_t mySaveFailures = 0;
+};
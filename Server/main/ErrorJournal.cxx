@@ -0,0 +1,110 @@
+#include "ErrorJournal.hxx"
+#include "TempController.hxx"
+#include "modbus/Rtu.hxx"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#include <cstddef>
+#include <string.h>
+
+static const char *JOURNALTAG = "ErrorJournal";
+
+static constexpr uint32_t RTC_JOURNAL_MAGIC = 0x4A524E4C; // JRNL
+
+// the copy in RTC memory, left alone by a warm reset and garbage after a power cycle
+struct RtcJournal
+{
+	uint32_t magic;
+	uint16_t nextSequence;
+	uint16_t boot;
+	FaultJournalEntry entries[FAULT_JOURNAL_CAPACITY];
+	uint16_t crc; // of everything above
+};
+
+static RTC_NOINIT_ATTR RtcJournal rtcJournal;
+
+static uint16_t journalCrc()
+{
+	return ModbusCrc16(reinterpret_cast<const uint8_t *>(&rtcJournal), offsetof(RtcJournal, crc));
+}
+
+ErrorJournal *ErrorJournal::myInstance = nullptr;
+
+ErrorJournal::ErrorJournal()
+{
+	myInstance = this;
+
+	myMutex = xSemaphoreCreateMutex();
+	if (myMutex == nullptr)
+	{
+		ESP_LOGE(JOURNALTAG, "Failed to create journal mutex");
+		assert(false);
+	}
+
+	myResetReason = static_cast<uint16_t>(esp_reset_reason());
+
+	if (rtcJournal.magic == RTC_JOURNAL_MAGIC && rtcJournal.crc == journalCrc())
+	{
+		rtcJournal.boot++;
+		rtcJournal.crc = journalCrc();
+		ESP_LOGI(JOURNALTAG, "Kept %u entries through reset reason %u", rtcJournal.nextSequence < FAULT_JOURNAL_CAPACITY ? rtcJournal.nextSequence : FAULT_JOURNAL_CAPACITY, myResetReason);
+	}
+	else
+	{
+		memset(&rtcJournal, 0, sizeof(rtcJournal));
+		rtcJournal.magic = RTC_JOURNAL_MAGIC;
+		rtcJournal.crc = journalCrc();
+	}
+}
+
+void ErrorJournal::Record(uint8_t bit, bool set, ErrorCode errors)
+{
+	int64_t nowMs = esp_timer_get_time() / 1000;
+	float temp = 0;
+	int duty = 0;
+
+	TempController *controller = TempController::GetInstance();
+	if (controller != nullptr)
+	{
+		temp = controller->GetCurrentTemp();
+		duty = controller->GetPwmDutyCycle();
+	}
+
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	FaultJournalEntry &entry = rtcJournal.entries[rtcJournal.nextSequence % FAULT_JOURNAL_CAPACITY];
+	entry.SEQUENCE = rtcJournal.nextSequence;
+	entry.EVENT = bit | (set ? FAULT_JOURNAL_SET : 0);
+	entry.ERROR = static_cast<uint16_t>(errors);
+	entry.BOOT = rtcJournal.boot;
+	entry.TIME_MS_HI = static_cast<uint16_t>(nowMs >> 16);
+	entry.TIME_MS_LO = static_cast<uint16_t>(nowMs);
+	entry.TEMP_DC = static_cast<int16_t>(temp * 10.0f);
+	entry.DUTY = static_cast<uint16_t>(duty);
+	rtcJournal.nextSequence++;
+	rtcJournal.crc = journalCrc();
+	xSemaphoreGive(myMutex);
+}
+
+void ErrorJournal::CopyTo(FaultJournalRegisters &registers)
+{
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	registers.header.NEXT_SEQUENCE = rtcJournal.nextSequence;
+	registers.header.BOOT = rtcJournal.boot;
+	memcpy(registers.entries, rtcJournal.entries, sizeof(rtcJournal.entries));
+	xSemaphoreGive(myMutex);
+
+	registers.header.CAPACITY = FAULT_JOURNAL_CAPACITY;
+	registers.header.RESET_REASON = myResetReason;
+}
+
+void ErrorJournal::Clear()
+{
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	memset(rtcJournal.entries, 0, sizeof(rtcJournal.entries));
+	rtcJournal.nextSequence = 0;
+	rtcJournal.crc = journalCrc();
+	xSemaphoreGive(myMutex);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "Errors.hxx"
+#include "modbus/FaultJournal.hxx"
+
+// Keeps the fault journal described in modbus/FaultJournal.hxx. State adds an entry for every ErrorCode
+// bit that sets or clears. The entries are kept in RTC memory, checked against a CRC at boot, so the lead up
+// to a watchdog or panic reset is still there to read afterwards. A power cycle starts it afresh.
+class ErrorJournal
+{
+public:
+	ErrorJournal();
+
+	static ErrorJournal *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new ErrorJournal();
+		}
+		return myInstance;
+	}
+
+	// bit is the number of the ErrorCode bit that changed, errors the whole code after the change
+	void Record(uint8_t bit, bool set, ErrorCode errors);
+
+	// snapshot of the whole journal in register layout
+	void CopyTo(FaultJournalRegisters &registers);
+
+	void Clear();
+
+private:
+	static ErrorJournal *myInstance;
+
+	SemaphoreHandle_t myMutex;
+	uint16_t myResetReason;
+};
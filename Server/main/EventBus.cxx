@@ -0,0 +1,174 @@
+#include "EventBus.hxx"
+
+#include "freertos/task.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *EBTAG = "EventBus";
+
+EventBus *EventBus::myInstance = nullptr;
+
+EventBus::EventBus()
+{
+	myInstance = this;
+
+	for (Slot &slot : mySlots)
+	{
+		slot.queue = xQueueCreateStatic(EVENT_QUEUE_DEPTH, sizeof(Envelope), slot.storage, &slot.queueBuffer);
+	}
+
+	Subscribe(Subscriber::LOGGER, ALL_EVENTS);
+	xTaskCreate(loggerTask, "eventLoggerTask", 2048, this, 2, nullptr);
+}
+
+void EventBus::Subscribe(Subscriber subscriber, uint32_t mask)
+{
+	taskENTER_CRITICAL(&myStatsLock);
+	mySlots[static_cast<size_t>(subscriber)].mask = mask;
+	taskEXIT_CRITICAL(&myStatsLock);
+}
+
+void EventBus::Publish(const Event &event)
+{
+	Envelope envelope = {event, esp_timer_get_time()};
+	uint32_t bit = 1u << event.index();
+
+	for (Slot &slot : mySlots)
+	{
+		if ((slot.mask & bit) == 0)
+		{
+			continue;
+		}
+
+		bool sent = xQueueSend(slot.queue, &envelope, 0) == pdTRUE;
+		uint32_t waiting = uxQueueMessagesWaiting(slot.queue);
+
+		taskENTER_CRITICAL(&myStatsLock);
+		if (!sent)
+		{
+			slot.dropped++;
+		}
+		if (waiting > slot.highWater)
+		{
+			slot.highWater = waiting;
+		}
+		taskEXIT_CRITICAL(&myStatsLock);
+	}
+}
+
+void EventBus::PublishFromISR(const Event &event, BaseType_t *higherPriorityTaskWoken)
+{
+	Envelope envelope = {event, esp_timer_get_time()};
+	uint32_t bit = 1u << event.index();
+
+	for (Slot &slot : mySlots)
+	{
+		if ((slot.mask & bit) == 0)
+		{
+			continue;
+		}
+
+		bool sent = xQueueSendFromISR(slot.queue, &envelope, higherPriorityTaskWoken) == pdTRUE;
+		uint32_t waiting = uxQueueMessagesWaitingFromISR(slot.queue);
+
+		taskENTER_CRITICAL_ISR(&myStatsLock);
+		if (!sent)
+		{
+			slot.dropped++;
+		}
+		if (waiting > slot.highWater)
+		{
+			slot.highWater = waiting;
+		}
+		taskEXIT_CRITICAL_ISR(&myStatsLock);
+	}
+}
+
+bool EventBus::Receive(Subscriber subscriber, Event &event, TickType_t wait)
+{
+	Slot &slot = mySlots[static_cast<size_t>(subscriber)];
+	Envelope envelope;
+
+	if (xQueueReceive(slot.queue, &envelope, wait) != pdTRUE)
+	{
+		return false;
+	}
+
+	int64_t latency = esp_timer_get_time() - envelope.postedUs;
+
+	taskENTER_CRITICAL(&myStatsLock);
+	slot.delivered++;
+	slot.latency.Record(latency > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(latency));
+	taskEXIT_CRITICAL(&myStatsLock);
+
+	event = envelope.event;
+	return true;
+}
+
+void EventBus::GetStats(Subscriber subscriber, SubscriberStats &stats)
+{
+	Slot &slot = mySlots[static_cast<size_t>(subscriber)];
+
+	taskENTER_CRITICAL(&myStatsLock);
+	stats.delivered = slot.delivered;
+	stats.dropped = slot.dropped;
+	stats.highWater = slot.highWater;
+	stats.latency = slot.latency;
+	taskEXIT_CRITICAL(&myStatsLock);
+}
+
+void EventBus::ClearStats()
+{
+	taskENTER_CRITICAL(&myStatsLock);
+	for (Slot &slot : mySlots)
+	{
+		slot.delivered = 0;
+		slot.dropped = 0;
+		slot.highWater = 0;
+		slot.latency.Reset();
+	}
+	taskEXIT_CRITICAL(&myStatsLock);
+}
+
+const char *EventBus::GetName(Subscriber subscriber)
+{
+	switch (subscriber)
+	{
+	case Subscriber::CONTROLLER:
+		return "controller";
+	case Subscriber::LOGGER:
+		return "logger";
+	case Subscriber::CONSOLE:
+		return "console";
+	default:
+		return "?";
+	}
+}
+
+void EventBus::loggerTask(void *pvParameter)
+{
+	EventBus *bus = static_cast<EventBus *>(pvParameter);
+	Event event;
+
+	while (42)
+	{
+		if (!bus->Receive(Subscriber::LOGGER, event, portMAX_DELAY))
+		{
+			continue;
+		}
+
+		if (const DoorEvent *door = std::get_if<DoorEvent>(&event))
+		{
+			ESP_LOGI(EBTAG, "Door %s", door->open ? "opened" : "closed");
+		}
+		else if (const EnableEvent *enable = std::get_if<EnableEvent>(&event))
+		{
+			ESP_LOGI(EBTAG, "Enable switch %s", enable->enabled ? "on" : "off");
+		}
+		else if (const SetTempEvent *setTemp = std::get_if<SetTempEvent>(&event))
+		{
+			ESP_LOGI(EBTAG, "Set temperature %.1f", setTemp->temperature);
+		}
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "hardware.h"
+#include "modbus/LinkStats.hxx"
+
+#include <cstdint>
+#include <type_traits>
+#include <variant>
+
+struct DoorEvent
+{
+	bool open;
+};
+
+struct EnableEvent
+{
+	bool enabled;
+};
+
+struct SetTempEvent
+{
+	float temperature;
+};
+
+// Everything that can be published. Add new events at the end, a subscriber's mask is by index.
+using Event = std::variant<DoorEvent, EnableEvent, SetTempEvent>;
+
+// the queues copy events bytewise
+static_assert(std::is_trivially_copyable_v<Event>);
+
+template <typename T>
+constexpr uint32_t EventBit()
+{
+	return 1u << Event(T{}).index();
+}
+
+static constexpr uint32_t ALL_EVENTS = 0xFFFFFFFF;
+
+enum class Subscriber : uint8_t
+{
+	CONTROLLER, // State, applies door, enable and setpoint changes
+	LOGGER,		// logs every event
+	CONSOLE,	// the status overlay shows the latest event
+	COUNT,
+};
+
+struct SubscriberStats
+{
+	uint32_t delivered; // taken off the queue by the subscriber
+	uint32_t dropped;	// didn't fit in the queue
+	uint32_t highWater; // most events waiting at once
+	LatencyHistogram latency; // publish to receive, microseconds
+};
+
+// Delivers events to a fixed set of subscribers, each with its own bounded queue so a slow subscriber only
+// ever loses its own events. Publishing never blocks and never allocates, it's fine from a timer callback or
+// an ISR. The queues and their storage are part of the bus, nothing is allocated after construction.
+class EventBus
+{
+public:
+	EventBus();
+
+	static EventBus *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new EventBus();
+		}
+		return myInstance;
+	}
+
+	// which events subscriber gets, EventBit<T>() ored together. Nothing is delivered to it until this is called.
+	void Subscribe(Subscriber subscriber, uint32_t mask);
+
+	void Publish(const Event &event);
+	void PublishFromISR(const Event &event, BaseType_t *higherPriorityTaskWoken);
+
+	// the next event for subscriber, false if none arrived within wait
+	bool Receive(Subscriber subscriber, Event &event, TickType_t wait);
+
+	void GetStats(Subscriber subscriber, SubscriberStats &stats);
+	void ClearStats();
+
+	static const char *GetName(Subscriber subscriber);
+
+private:
+	static EventBus *myInstance;
+	static void loggerTask(void *pvParameter);
+
+	struct Envelope
+	{
+		Event event;
+		int64_t postedUs;
+	};
+
+	struct Slot
+	{
+		QueueHandle_t queue;
+		StaticQueue_t queueBuffer;
+		uint8_t storage[EVENT_QUEUE_DEPTH * sizeof(Envelope)];
+		uint32_t mask;
+		uint32_t delivered;
+		uint32_t dropped;
+		uint32_t highWater;
+		LatencyHistogram latency;
+	};
+
+	Slot mySlots[static_cast<size_t>(Subscriber::COUNT)] = {};
+	portMUX_TYPE myStatsLock = portMUX_INITIALIZER_UNLOCKED;
+};
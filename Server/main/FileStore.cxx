@@ -0,0 +1,192 @@
+#include "FileStore.hxx"
+#include "TempHistory.hxx"
+#include "hardware.h"
+
+#include <algorithm>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *FILESTAG = "FileStore";
+
+FileStore *FileStore::myInstance = nullptr;
+
+FileStore::FileStore()
+{
+	myInstance = this;
+
+	myMutex = xSemaphoreCreateMutex();
+	if (myMutex == nullptr)
+	{
+		ESP_LOGE(FILESTAG, "Failed to create file store mutex");
+		assert(false);
+	}
+
+	// an empty file is still well formed, a header with no entries
+	infoOf(FileId::PROGRAM).LENGTH = ProgramFile::HEADER_COUNT;
+	infoOf(FileId::PROGRAM).CRC = FileCrc(contentOf(FileId::PROGRAM), ProgramFile::HEADER_COUNT);
+	infoOf(FileId::GAIN_SCHEDULE).LENGTH = GainScheduleFile::HEADER_COUNT;
+	infoOf(FileId::GAIN_SCHEDULE).CRC = FileCrc(contentOf(FileId::GAIN_SCHEDULE), GainScheduleFile::HEADER_COUNT);
+}
+
+uint16_t *FileStore::contentOf(FileId file)
+{
+	switch (file)
+	{
+	case FileId::PROGRAM:
+		return reinterpret_cast<uint16_t *>(&myProgram);
+	case FileId::GAIN_SCHEDULE:
+		return reinterpret_cast<uint16_t *>(&myGainSchedule);
+	default:
+		return nullptr;
+	}
+}
+
+esp_err_t FileStore::WriteRecord(const FileRecordWindow &record)
+{
+	FileId file = static_cast<FileId>(record.header.FILE);
+	if (!IsWritableFile(file) || record.header.LENGTH > FILE_RECORD_MAX_LENGTH)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	esp_err_t result = ESP_ERR_INVALID_ARG;
+
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	switch (static_cast<FileOperation>(record.header.OPERATION))
+	{
+	case FileOperation::WRITE:
+		result = myUpload.Write(record.header, record.data) ? ESP_OK : ESP_ERR_INVALID_ARG;
+		break;
+	case FileOperation::COMMIT:
+		if (record.header.LENGTH >= FileCommit::COUNT)
+		{
+			FileCommit fileCommit;
+			memcpy(&fileCommit, record.data, sizeof(fileCommit));
+			result = commit(file, fileCommit);
+		}
+		break;
+	default:
+		break;
+	}
+	xSemaphoreGive(myMutex);
+
+	return result;
+}
+
+// called with myMutex held
+esp_err_t FileStore::commit(FileId file, const FileCommit &commit)
+{
+	FileInfo &info = infoOf(file);
+
+	if (!myUpload.Matches(file, commit))
+	{
+		ESP_LOGW(FILESTAG, "Commit of file %u doesn't match the upload", static_cast<uint16_t>(file));
+		return ESP_ERR_INVALID_CRC;
+	}
+
+	if (commit.BASE_VERSION != FILE_ANY_VERSION && commit.BASE_VERSION != info.VERSION)
+	{
+		ESP_LOGW(FILESTAG, "Commit of file %u is based on version %u, it's at %u now", static_cast<uint16_t>(file), commit.BASE_VERSION, info.VERSION);
+		return ESP_ERR_INVALID_VERSION;
+	}
+
+	const uint16_t *content = myUpload.GetContent();
+	if (!IsWellFormedFile(file, content, commit.LENGTH) || !isWithinLimits(file, content))
+	{
+		ESP_LOGW(FILESTAG, "Rejected file %u, the content isn't valid", static_cast<uint16_t>(file));
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	uint16_t *live = contentOf(file);
+	memset(live, 0, FileMaxLength(file) * sizeof(uint16_t));
+	memcpy(live, content, commit.LENGTH * sizeof(uint16_t));
+
+	info.VERSION = info.VERSION + 1 == FILE_ANY_VERSION ? 1 : info.VERSION + 1;
+	info.LENGTH = commit.LENGTH;
+	info.CRC = commit.CRC;
+	myUpload.Reset();
+
+	ESP_LOGI(FILESTAG, "File %u is now version %u, %u registers", static_cast<uint16_t>(file), info.VERSION, info.LENGTH);
+	return ESP_OK;
+}
+
+bool FileStore::isWithinLimits(FileId file, const uint16_t *content)
+{
+	if (file == FileId::PROGRAM)
+	{
+		const ProgramFile &program = *reinterpret_cast<const ProgramFile *>(content);
+		for (uint16_t i = 0; i < program.SEGMENT_COUNT; i++)
+		{
+			if (program.segments[i].TARGET_TEMP > MAX_TEMP)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void FileStore::Read(FileId file, FileInfo &info, uint16_t *content, uint16_t maxLength)
+{
+	memset(content, 0, maxLength * sizeof(uint16_t));
+
+	if (file == FileId::HISTORY)
+	{
+		// assembled on every read, the version is the history's next sequence so a change between reads shows
+		static_assert(sizeof(HistoryRegisters) == HistoryRegisters::COUNT * sizeof(uint16_t), "history must be plain registers");
+		if (maxLength < HistoryRegisters::COUNT)
+		{
+			info = {};
+			return;
+		}
+
+		HistoryRegisters &history = *reinterpret_cast<HistoryRegisters *>(content);
+		TempHistory::GetInstance()->CopyTo(history);
+		info.VERSION = history.header.NEXT_SEQUENCE;
+		info.LENGTH = HistoryRegisters::COUNT;
+		info.CRC = FileCrc(content, info.LENGTH);
+		info.RESERVED = 0;
+		return;
+	}
+
+	const uint16_t *live = contentOf(file);
+	if (live == nullptr)
+	{
+		info = {};
+		return;
+	}
+
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	info = infoOf(file);
+	memcpy(content, live, std::min(info.LENGTH, maxLength) * sizeof(uint16_t));
+	xSemaphoreGive(myMutex);
+}
+
+FileInfo FileStore::GetInfo(FileId file)
+{
+	if (!IsWritableFile(file))
+	{
+		return {};
+	}
+
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	FileInfo info = infoOf(file);
+	xSemaphoreGive(myMutex);
+
+	return info;
+}
+
+void FileStore::GetProgram(ProgramFile &program)
+{
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	program = myProgram;
+	xSemaphoreGive(myMutex);
+}
+
+void FileStore::GetGainSchedule(GainScheduleFile &schedule)
+{
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	schedule = myGainSchedule;
+	xSemaphoreGive(myMutex);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "modbus/FileRecords.hxx"
+#include <esp_err.h>
+
+// The files served through the file record windows described in modbus/FileRecords.hxx: the ramp/soak
+// program and gain schedule, which are uploaded whole and swapped in on commit, and the history export.
+// Kept in RAM, a reboot leaves the writable files empty at version 0.
+class FileStore
+{
+public:
+	FileStore();
+
+	static FileStore *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new FileStore();
+		}
+		return myInstance;
+	}
+
+	// Applies a record written to the upload window. ESP_ERR_INVALID_ARG for a record that doesn't fit the
+	// upload or content that isn't valid, ESP_ERR_INVALID_CRC if the commit doesn't match what was uploaded and
+	// ESP_ERR_INVALID_VERSION if the file was committed by someone else since the upload's base version.
+	esp_err_t WriteRecord(const FileRecordWindow &record);
+
+	// info and content for a file's read window, content past info.LENGTH is zeroed
+	void Read(FileId file, FileInfo &info, uint16_t *content, uint16_t maxLength);
+
+	FileInfo GetInfo(FileId file);
+	void GetProgram(ProgramFile &program);
+	void GetGainSchedule(GainScheduleFile &schedule);
+
+private:
+	static FileStore *myInstance;
+
+	SemaphoreHandle_t myMutex;
+	FileUpload myUpload;
+	ProgramFile myProgram = {};
+	GainScheduleFile myGainSchedule = {};
+	FileInfo myInfo[FILE_COUNT] = {};
+
+	esp_err_t commit(FileId file, const FileCommit &commit);
+	bool isWithinLimits(FileId file, const uint16_t *content);
+	uint16_t *contentOf(FileId file);
+	FileInfo &infoOf(FileId file)
+	{
+		return myInfo[static_cast<uint16_t>(file) - 1];
+	}
+};
@@ -4,7 +4,14 @@
 
 #include "hardware.h"
 
-#include "State.hxx"
+#include "EventBus.hxx"
+#include "Interlock.hxx"
+#include <esp_timer.h>
+#include <soc/soc_caps.h>
+
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+#include <driver/gpio_filter.h>
+#endif
 
 static const char *GPIOTAG = "GPIO";
 
@@ -43,73 +50,179 @@ GPIOManager::GPIOManager()
 	};
 	gpio_config(&enableConf);
 
+	watch(DOOR_SWITCH_PIN);
+	watch(ENABLE_SWITCH_PIN);
+
 	gpio_install_isr_service(0);
 	gpio_isr_handler_add(DOOR_SWITCH_PIN, processSwitch, (void *)DOOR_SWITCH_PIN);
 	gpio_isr_handler_add(ENABLE_SWITCH_PIN, processSwitch, (void *)ENABLE_SWITCH_PIN);
+
+	mySampler = xTimerCreate("DebounceSampler", pdMS_TO_TICKS(DEBOUNCE_SAMPLE_PERIOD_MS), pdTRUE, this, sampleSwitches);
+	xTimerStart(mySampler, portMAX_DELAY);
+
+	// no edge will tell us about a door that was already open
+	if (gpio_get_level(DOOR_SWITCH_PIN))
+	{
+		Interlock::GetInstance()->Trip(InterlockCause::DOOR, esp_timer_get_time());
+	}
+}
+
+void GPIOManager::watch(gpio_num_t pin)
+{
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+	// only swallows nanosecond spikes, the contact bounce is still ours to deal with
+	gpio_pin_glitch_filter_config_t filterConf = {
+		.clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT,
+		.gpio_num = pin,
+	};
+	gpio_glitch_filter_handle_t filter;
+	if (gpio_new_pin_glitch_filter(&filterConf, &filter) == ESP_OK)
+	{
+		gpio_glitch_filter_enable(filter);
+	}
+#endif
+
+	Switch &sw = mySwitches[pin];
+	sw.watched = true;
+	sw.level = gpio_get_level(pin);
 }
 
 void GPIOManager::processSwitch(void *arg)
 {
-	GPIOManager *gpio = GPIOManager::GetInstance();
+	int64_t now = esp_timer_get_time();
+	GPIOManager *gpio = myInstance;
 
 	gpio_num_t pin = static_cast<gpio_num_t>(reinterpret_cast<uintptr_t>(arg));
 
-	gpio->mySwitchState[pin].second = gpio_get_level(pin);
-
-	if (gpio->mySwitchState[pin].first == nullptr)
+	// the first bounce of a door opening cuts the heater, only closing it again waits for the debounce
+	if (pin == DOOR_SWITCH_PIN && gpio_get_level(pin))
 	{
-		gpio->mySwitchState[pin].first = xTimerCreate("DebounceTimer", pdMS_TO_TICKS(DEBOUNCE_DELAY_MS), pdFALSE, (void *)pin, debounceSwitchCallback);
+		Interlock::GetInstance()->TripFromISR(InterlockCause::DOOR, now);
 	}
-	else
+
+	Switch &sw = gpio->mySwitches[pin];
+
+	taskENTER_CRITICAL_ISR(&gpio->myLock);
+	if (!sw.bouncing)
 	{
-		xTimerChangePeriod(gpio->mySwitchState[pin].first, pdMS_TO_TICKS(DEBOUNCE_DELAY_MS), 0);
+		sw.bouncing = true;
+		sw.firstEdgeUs = now;
 	}
+	sw.lastEdgeUs = now;
+	sw.edges++;
 
-	if (!xTimerIsTimerActive(gpio->mySwitchState[pin].first))
+	uint32_t took = static_cast<uint32_t>(esp_timer_get_time() - now);
+	if (took > gpio->myIsrMaxUs)
 	{
-		xTimerStart(gpio->mySwitchState[pin].first, 0);
+		gpio->myIsrMaxUs = took;
 	}
+	taskEXIT_CRITICAL_ISR(&gpio->myLock);
 }
 
-void GPIOManager::debounceSwitchCallback(TimerHandle_t xTimer)
+void GPIOManager::sampleSwitches(TimerHandle_t xTimer)
 {
-	gpio_num_t pin = static_cast<gpio_num_t>(reinterpret_cast<uintptr_t>(pvTimerGetTimerID(xTimer)));
+	GPIOManager *gpio = static_cast<GPIOManager *>(pvTimerGetTimerID(xTimer));
+	EventBus *bus = EventBus::GetInstance();
 
-	GPIOManager *gpio = GPIOManager::GetInstance();
-
-	bool level = gpio_get_level(pin);
-	if (level != gpio->mySwitchState[pin].second)
+	for (int i = 0; i < GPIO_NUM_MAX; i++)
 	{
-		gpio->mySwitchState[pin].second = level;
-		State *state = State::GetInstance();
-
-		switch (pin)
+		Switch &sw = gpio->mySwitches[i];
+		if (!sw.watched)
 		{
-		case DOOR_SWITCH_PIN:
+			continue;
+		}
 
-			if (level)
-			{
-				state->QueueEvent(EventType::DOOR_OPEN);
-			}
-			else
+		gpio_num_t pin = static_cast<gpio_num_t>(i);
+
+		// now before the level, an edge after the read makes it look too recent to settle
+		int64_t now = esp_timer_get_time();
+		bool level = gpio_get_level(pin);
+		bool changed = false;
+		bool settled = false;
+		int64_t firstEdgeUs = 0;
+
+		taskENTER_CRITICAL(&gpio->myLock);
+		if (!sw.bouncing && level != sw.level)
+		{
+			// the interrupt missed it, debounce it all the same
+			sw.bouncing = true;
+			sw.firstEdgeUs = now;
+			sw.lastEdgeUs = now;
+		}
+		else if (sw.bouncing && now - sw.lastEdgeUs >= DEBOUNCE_DELAY_MS * 1000)
+		{
+			sw.bouncing = false;
+			settled = true;
+			if (level != sw.level)
 			{
-				state->QueueEvent(EventType::DOOR_CLOSED);
+				sw.level = level;
+				sw.changes++;
+				changed = true;
+				firstEdgeUs = sw.firstEdgeUs;
 			}
+		}
+		taskEXIT_CRITICAL(&gpio->myLock);
+
+		// A glitch on a closed door trips the interlock from the interrupt but settles back where it was, so
+		// there's no DoorEvent to release it. Nothing to do if it never tripped.
+		if (settled && !changed && pin == DOOR_SWITCH_PIN && !level)
+		{
+			Interlock::GetInstance()->Release(InterlockCause::DOOR);
+		}
+
+		if (!changed)
+		{
+			continue;
+		}
+
+		switch (pin)
+		{
+		case DOOR_SWITCH_PIN:
+			bus->Publish(DoorEvent{level});
 			break;
 		case ENABLE_SWITCH_PIN:
-			if (level)
-			{
-				state->QueueEvent(EventType::ENABLE);
-			}
-			else
-			{
-				state->QueueEvent(EventType::DISABLE);
-			}
+			bus->Publish(EnableEvent{level});
 			break;
 		default:
 			break;
 		}
+
+		int64_t latency = esp_timer_get_time() - firstEdgeUs;
+
+		taskENTER_CRITICAL(&gpio->myLock);
+		gpio->myLatency.Record(latency > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(latency));
+		taskEXIT_CRITICAL(&gpio->myLock);
+	}
+}
+
+void GPIOManager::GetSwitchStats(gpio_num_t pin, SwitchStats &stats)
+{
+	taskENTER_CRITICAL(&myLock);
+	stats.level = mySwitches[pin].level;
+	stats.edges = mySwitches[pin].edges;
+	stats.changes = mySwitches[pin].changes;
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void GPIOManager::GetDebounceStats(DebounceStats &stats)
+{
+	taskENTER_CRITICAL(&myLock);
+	stats.isrMaxUs = myIsrMaxUs;
+	stats.latency = myLatency;
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void GPIOManager::ClearStats()
+{
+	taskENTER_CRITICAL(&myLock);
+	for (Switch &sw : mySwitches)
+	{
+		sw.edges = 0;
+		sw.changes = 0;
 	}
+	myIsrMaxUs = 0;
+	myLatency.Reset();
+	taskEXIT_CRITICAL(&myLock);
 }
 
 void GPIOManager::setEmergencyRelay(bool value)
@@ -1,12 +1,26 @@
 #pragma once
 
 #include "hardware.h"
+#include "modbus/LinkStats.hxx"
 #include <driver/gpio.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/task.h>
-#include <unordered_map>
+#include <freertos/timers.h>
+
+struct SwitchStats
+{
+	bool level;		  // debounced
+	uint32_t edges;	  // every interrupt, bounces included
+	uint32_t changes; // clean edges published
+};
+
+struct DebounceStats
+{
+	uint32_t isrMaxUs;		  // longest the edge interrupt took
+	LatencyHistogram latency; // first edge to the clean edge being published, microseconds, the debounce delay included
+};
 
 class GPIOManager
 {
@@ -25,17 +39,37 @@ public:
 	void setEmergencyRelay(bool value);
 	bool isDoorOpen()
 	{
-		return myIsDoorOpen;
+		return mySwitches[DOOR_SWITCH_PIN].level;
 	};
 
+	void GetSwitchStats(gpio_num_t pin, SwitchStats &stats);
+	void GetDebounceStats(DebounceStats &stats);
+	void ClearStats();
+
 private:
 	static GPIOManager *myInstance;
 
-	bool myIsDoorOpen = true;
+	// The interrupt only timestamps the edge, the sampler publishes the level once the switch has been quiet
+	// for DEBOUNCE_DELAY_MS. Indexed by pin, so the interrupt never searches or allocates.
+	struct Switch
+	{
+		bool watched;
+		bool level;			 // debounced
+		bool bouncing;		 // edges since the last clean one
+		int64_t firstEdgeUs; // of the current bounce
+		int64_t lastEdgeUs;
+		uint32_t edges;
+		uint32_t changes;
+	};
+
+	Switch mySwitches[GPIO_NUM_MAX] = {};
+	portMUX_TYPE myLock = portMUX_INITIALIZER_UNLOCKED;
+	TimerHandle_t mySampler = nullptr;
+	uint32_t myIsrMaxUs = 0;
+	LatencyHistogram myLatency;
 
-	// pair of the timer and the previously valid state of the switch
-	std::unordered_map<gpio_num_t, std::pair<TimerHandle_t, bool>> mySwitchState;
+	void watch(gpio_num_t pin);
 
 	static void processSwitch(void *arg);
-	static void debounceSwitchCallback(TimerHandle_t xTimer);
-};
\ No newline at end of file
+	static void sampleSwitches(TimerHandle_t xTimer);
+};
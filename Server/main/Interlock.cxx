@@ -0,0 +1,215 @@
+#include "Interlock.hxx"
+#include "CurrentMonitor.hxx"
+#include "State.hxx"
+#include "hardware.h"
+
+#include <driver/gpio.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *ILTAG = "Interlock";
+
+Interlock *Interlock::myInstance = nullptr;
+
+// the error State shows for each cause, the interlock task sets and clears its condition with the trips. A
+// latched one stays set after the release, see FaultPolicy.
+static const ErrorCode CAUSE_ERRORS[] = {ErrorCode::DOOR_OPEN, ErrorCode::THERMOCOUPLE_ERROR, ErrorCode::TEMP_RANGE_HIGH, ErrorCode::TASK_STALLED,
+									   ErrorCode::SSR_WELDED, ErrorCode::NO_CURRENT};
+static_assert(sizeof(CAUSE_ERRORS) / sizeof(CAUSE_ERRORS[0]) == static_cast<size_t>(InterlockCause::COUNT));
+
+Interlock::Interlock()
+{
+	myInstance = this;
+	ESP_LOGI(ILTAG, "Initializing interlock");
+
+	xTaskCreate(&interlockTask, "interlockTask", 3072, this, configMAX_PRIORITIES - 1, &myTask);
+
+	if (MAX31856_FAULT_PIN != GPIO_NUM_NC)
+	{
+		gpio_config_t faultConf = {
+			.pin_bit_mask = (1ULL << MAX31856_FAULT_PIN),
+			.mode = GPIO_MODE_INPUT,
+			.pull_up_en = GPIO_PULLUP_ENABLE, // open drain output
+			.pull_down_en = GPIO_PULLDOWN_DISABLE,
+			.intr_type = GPIO_INTR_LOW_LEVEL,
+		};
+		gpio_config(&faultConf);
+
+		gpio_install_isr_service(0); // harmless if GPIOManager got there first
+		gpio_isr_handler_add(MAX31856_FAULT_PIN, faultPinIsr, this);
+
+		if (gpio_get_level(MAX31856_FAULT_PIN) == 0)
+		{
+			Trip(InterlockCause::THERMOCOUPLE_FAULT, esp_timer_get_time());
+		}
+	}
+}
+
+void Interlock::cut(InterlockCause cause, int64_t detectedUs)
+{
+	gpio_set_level(HEATER_SSR_PIN, 0);
+	gpio_set_level(EMERGENCY_RELAY_PIN, EMERGENCY_RELAY_ON);
+	int64_t cutUs = esp_timer_get_time();
+	CurrentMonitor::SsrSwitched(false);
+
+	uint32_t bit = 1u << static_cast<uint32_t>(cause);
+	if ((myTripped & bit) == 0)
+	{
+		myTripped |= bit;
+		myTrips[static_cast<size_t>(cause)] = {detectedUs, cutUs, true};
+	}
+}
+
+void Interlock::Trip(InterlockCause cause, int64_t detectedUs)
+{
+	taskENTER_CRITICAL(&myLock);
+	cut(cause, detectedUs);
+	taskEXIT_CRITICAL(&myLock);
+
+	xTaskNotifyGive(myTask);
+}
+
+void Interlock::TripFromISR(InterlockCause cause, int64_t detectedUs)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	taskENTER_CRITICAL_ISR(&myLock);
+	cut(cause, detectedUs);
+	taskEXIT_CRITICAL_ISR(&myLock);
+
+	vTaskNotifyGiveFromISR(myTask, &higherPriorityTaskWoken);
+	portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+bool Interlock::SwitchHeaterOn()
+{
+	taskENTER_CRITICAL(&myLock);
+	bool on = myTripped == 0;
+	if (on)
+	{
+		gpio_set_level(HEATER_SSR_PIN, 1);
+		CurrentMonitor::SsrSwitched(true);
+	}
+	taskEXIT_CRITICAL(&myLock);
+
+	return on;
+}
+
+void Interlock::Release(InterlockCause cause)
+{
+	if (cause == InterlockCause::THERMOCOUPLE_FAULT && MAX31856_FAULT_PIN != GPIO_NUM_NC && gpio_get_level(MAX31856_FAULT_PIN) == 0)
+	{
+		return;
+	}
+
+	uint32_t bit = 1u << static_cast<uint32_t>(cause);
+	if ((myTripped & bit) == 0)
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL(&myLock);
+	myTripped &= ~bit;
+	taskEXIT_CRITICAL(&myLock);
+
+	if (cause == InterlockCause::THERMOCOUPLE_FAULT && MAX31856_FAULT_PIN != GPIO_NUM_NC)
+	{
+		gpio_intr_enable(MAX31856_FAULT_PIN);
+	}
+
+	xTaskNotifyGive(myTask);
+}
+
+void Interlock::GetStats(InterlockCause cause, InterlockStats &stats)
+{
+	size_t index = static_cast<size_t>(cause);
+
+	taskENTER_CRITICAL(&myLock);
+	stats.tripped = (myTripped & (1u << index)) != 0;
+	stats.trips = myTripCounts[index];
+	stats.lastLatencyUs = myLastLatencyUs[index];
+	stats.latency = myLatency[index];
+	taskEXIT_CRITICAL(&myLock);
+}
+
+const char *Interlock::GetName(InterlockCause cause)
+{
+	switch (cause)
+	{
+	case InterlockCause::DOOR:
+		return "door";
+	case InterlockCause::THERMOCOUPLE_FAULT:
+		return "thermocouple";
+	case InterlockCause::OVER_TEMP:
+		return "over temp";
+	case InterlockCause::TASK_STALL:
+		return "task stall";
+	case InterlockCause::SSR_WELDED:
+		return "ssr welded";
+	case InterlockCause::NO_CURRENT:
+		return "no current";
+	default:
+		return "?";
+	}
+}
+
+void Interlock::faultPinIsr(void *arg)
+{
+	Interlock *interlock = static_cast<Interlock *>(arg);
+	int64_t now = esp_timer_get_time();
+
+	// level triggered, so it stays quiet until Release() finds the pin released
+	gpio_intr_disable(MAX31856_FAULT_PIN);
+	interlock->TripFromISR(InterlockCause::THERMOCOUPLE_FAULT, now);
+}
+
+void Interlock::interlockTask(void *pvParameter)
+{
+	Interlock *interlock = static_cast<Interlock *>(pvParameter);
+	uint32_t reported = 0; // causes State has been told about
+
+	while (42)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		State *state = State::GetInstance();
+
+		for (size_t i = 0; i < static_cast<size_t>(InterlockCause::COUNT); i++)
+		{
+			InterlockCause cause = static_cast<InterlockCause>(i);
+			TripRecord trip = {};
+
+			taskENTER_CRITICAL(&interlock->myLock);
+			bool tripped = (interlock->myTripped & (1u << i)) != 0;
+			if (interlock->myTrips[i].pending)
+			{
+				trip = interlock->myTrips[i];
+				interlock->myTrips[i].pending = false;
+
+				uint32_t latency = trip.cutUs > trip.detectedUs ? static_cast<uint32_t>(trip.cutUs - trip.detectedUs) : 0;
+				interlock->myTripCounts[i]++;
+				interlock->myLastLatencyUs[i] = latency;
+				interlock->myLatency[i].Record(latency);
+			}
+			taskEXIT_CRITICAL(&interlock->myLock);
+
+			if (trip.pending)
+			{
+				ESP_LOGW(ILTAG, "Tripped by %s, heater cut %lld us after detection", GetName(cause), trip.cutUs - trip.detectedUs);
+			}
+
+			// a trip that was released again before we got here still sets, and latches, its error
+			uint32_t bit = 1u << i;
+			if ((tripped || trip.pending) && (reported & bit) == 0)
+			{
+				state->SetError(CAUSE_ERRORS[i]);
+				reported |= bit;
+			}
+			if (!tripped && (reported & bit) != 0)
+			{
+				state->ClearError(CAUSE_ERRORS[i]);
+				reported &= ~bit;
+				ESP_LOGI(ILTAG, "Released by %s", GetName(cause));
+			}
+		}
+	}
+}
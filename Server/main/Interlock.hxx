@@ -0,0 +1,89 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modbus/LinkStats.hxx"
+
+#include <cstdint>
+
+enum class InterlockCause : uint8_t
+{
+	DOOR,
+	THERMOCOUPLE_FAULT, // the MAX31856 reports a fault, or pulls its FAULT pin
+	OVER_TEMP,
+	TASK_STALL, // the TaskSupervisor found a critical task missing its deadlines
+	SSR_WELDED, // the CurrentMonitor sees heater current with the SSR off
+	NO_CURRENT, // or none with it on
+	COUNT,
+};
+
+struct InterlockStats
+{
+	bool tripped;
+	uint32_t trips;
+	uint32_t lastLatencyUs;
+	LatencyHistogram latency; // detection to both outputs off, microseconds
+};
+
+// Cuts the heater the moment something unsafe is seen, without waiting for any control loop. A trip drives
+// HEATER_SSR_PIN low and the emergency relay off right there in the caller, ISR or task, then leaves the
+// bookkeeping (State's error code, the log, the statistics) to a high priority task. The heater stays off
+// until every cause that tripped it has been released.
+class Interlock
+{
+public:
+	Interlock();
+
+	static Interlock *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new Interlock();
+		}
+		return myInstance;
+	}
+
+	// detectedUs is when the condition was seen, esp_timer time, the reaction time is measured from it
+	void Trip(InterlockCause cause, int64_t detectedUs);
+	void TripFromISR(InterlockCause cause, int64_t detectedUs);
+
+	// the condition has gone, a thermocouple fault stays tripped while the FAULT pin is still asserted
+	void Release(InterlockCause cause);
+
+	bool IsTripped()
+	{
+		return myTripped != 0;
+	}
+
+	// drives HEATER_SSR_PIN high unless tripped, checked under the same lock a trip cuts under so one can't
+	// land between the check and the switch. Returns whether the heater is on.
+	bool SwitchHeaterOn();
+
+	void GetStats(InterlockCause cause, InterlockStats &stats);
+
+	static const char *GetName(InterlockCause cause);
+
+private:
+	static Interlock *myInstance;
+	static void interlockTask(void *pvParameter);
+	static void faultPinIsr(void *arg);
+
+	// caller holds myLock
+	void cut(InterlockCause cause, int64_t detectedUs);
+
+	struct TripRecord
+	{
+		int64_t detectedUs;
+		int64_t cutUs;
+		bool pending; // not yet counted by the task
+	};
+
+	portMUX_TYPE myLock = portMUX_INITIALIZER_UNLOCKED;
+	TaskHandle_t myTask = nullptr;
+	volatile uint32_t myTripped = 0; // a bit per cause
+	TripRecord myTrips[static_cast<size_t>(InterlockCause::COUNT)] = {};
+	uint32_t myTripCounts[static_cast<size_t>(InterlockCause::COUNT)] = {};
+	uint32_t myLastLatencyUs[static_cast<size_t>(InterlockCause::COUNT)] = {};
+	LatencyHistogram myLatency[static_cast<size_t>(InterlockCause::COUNT)];
+};
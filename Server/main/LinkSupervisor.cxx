@@ -0,0 +1,155 @@
+#include "LinkSupervisor.hxx"
+#include "State.hxx"
+#include "TaskSupervisor.hxx"
+#include "TempController.hxx"
+#include "hardware.h"
+
+#include <algorithm>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *LINKTAG = "LinkSupervisor";
+
+LinkSupervisor *LinkSupervisor::myInstance = nullptr;
+
+LinkSupervisor::LinkSupervisor()
+{
+	myInstance = this;
+	xTaskCreate(&supervisorTask, "linkSupervisor", 2048 * 2, this, 8, NULL);
+}
+
+void LinkSupervisor::Heartbeat(const HeartbeatRegisters &heartbeat)
+{
+	int64_t now = esp_timer_get_time();
+
+	taskENTER_CRITICAL(&myLock);
+	if (mySeen)
+	{
+		uint32_t interval = static_cast<uint32_t>(now - myLastUs);
+		myIntervals.Record(interval);
+		myLastIntervalUs = interval;
+
+		int32_t error = static_cast<int32_t>(interval) - heartbeat.PERIOD_MS * 1000;
+		uint32_t jitter = error < 0 ? -error : error;
+		myJitterEwmaUs = myJitterEwmaUs - (myJitterEwmaUs >> 4) + (jitter >> 4);
+
+		uint16_t skipped = heartbeat.COUNTER - mySettings.COUNTER - 1;
+		if (skipped != 0 && skipped < 0x8000) // a backwards step is the Frontend restarting its counter
+		{
+			mySkipped += skipped;
+		}
+	}
+	mySettings = heartbeat;
+	mySeen = true;
+	myLastUs = now;
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void LinkSupervisor::Alive()
+{
+	taskENTER_CRITICAL(&myLock);
+	if (mySeen)
+	{
+		myLastUs = esp_timer_get_time();
+	}
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void LinkSupervisor::GetStatus(HeartbeatStatus &status)
+{
+	int64_t now = esp_timer_get_time();
+
+	taskENTER_CRITICAL(&myLock);
+	status.STATE = static_cast<uint16_t>(myState);
+	status.MISSES = myMisses;
+	status.LAST_INTERVAL_MS = std::min<uint32_t>(myLastIntervalUs / 1000, UINT16_MAX);
+	status.P99_INTERVAL_MS = std::min<uint32_t>(myIntervals.GetPercentile(0.99f) / 1000, UINT16_MAX);
+	status.MAX_INTERVAL_MS = std::min<uint32_t>(myIntervals.GetMax() / 1000, UINT16_MAX);
+	status.JITTER_MS = std::min<uint32_t>(myJitterEwmaUs / 1000, UINT16_MAX);
+	status.SINCE_LAST_MS = mySeen ? std::min<int64_t>((now - myLastUs) / 1000, UINT16_MAX) : UINT16_MAX;
+	status.SKIPPED = mySkipped;
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void LinkSupervisor::GetIntervals(LatencyHistogram &intervals)
+{
+	taskENTER_CRITICAL(&myLock);
+	intervals = myIntervals;
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void LinkSupervisor::supervisorTask(void *pvParameter)
+{
+	LinkSupervisor *instance = static_cast<LinkSupervisor *>(pvParameter);
+	TickType_t lastWake = xTaskGetTickCount();
+
+	// the link loss policy is only applied from here
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::LINK_SUPERVISOR, LINK_SUPERVISOR_PERIOD_MS, 5 * LINK_SUPERVISOR_PERIOD_MS, true);
+
+	while (42)
+	{
+		supervisor->CheckIn(SupervisedTask::LINK_SUPERVISOR);
+		vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(LINK_SUPERVISOR_PERIOD_MS));
+		instance->check();
+	}
+}
+
+void LinkSupervisor::check()
+{
+	int64_t now = esp_timer_get_time();
+
+	taskENTER_CRITICAL(&myLock);
+	HeartbeatRegisters settings = mySettings;
+	bool supervised = mySeen && settings.DEADLINE_MS != 0;
+	bool late = supervised && now - myLastUs > static_cast<int64_t>(settings.DEADLINE_MS) * 1000;
+	LinkState previous = myState;
+	myState = !supervised ? LinkState::UNSUPERVISED : (late ? LinkState::LOST : LinkState::OK);
+	if (late && previous != LinkState::LOST)
+	{
+		myMisses++;
+	}
+	taskEXIT_CRITICAL(&myLock);
+
+	TempController *controller = TempController::GetInstance();
+	State *state = State::GetInstance();
+	LinkLossPolicy policy = static_cast<LinkLossPolicy>(settings.POLICY);
+
+	if (late && previous != LinkState::LOST)
+	{
+		ESP_LOGW(LINKTAG, "No heartbeat for %u ms, link lost", settings.DEADLINE_MS);
+		myLostUs = now;
+		myRampFrom = controller->GetTargetTemp();
+
+		if (policy == LinkLossPolicy::SHUT_OFF && state->IsEnabled())
+		{
+			ESP_LOGW(LINKTAG, "Heating disabled until the link is back and it is enabled again");
+			state->SetEnabled(false);
+			controller->PublishRegisterImage();
+		}
+	}
+	else if (!late && previous == LinkState::LOST)
+	{
+		ESP_LOGI(LINKTAG, "Link back after %lld ms", (now - myLostUs) / 1000);
+	}
+
+	if (late && policy == LinkLossPolicy::RAMP_DOWN)
+	{
+		rampDown(now, settings.RAMP_DOWN_PER_MINUTE);
+	}
+}
+
+// steps the target down from where it was when the link was lost, the link coming back leaves it where it got to
+void LinkSupervisor::rampDown(int64_t now, uint16_t degreesPerMinute)
+{
+	TempController *controller = TempController::GetInstance();
+
+	float minutes = (now - myLostUs) / 60e6f;
+	float target = std::max(0.0f, myRampFrom - degreesPerMinute * minutes);
+
+	if (target < controller->GetTargetTemp())
+	{
+		controller->SetTargetTemp(target);
+		controller->CapInternalSetTemp(target);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modbus/Heartbeat.hxx"
+#include "modbus/LinkStats.hxx"
+
+// Watches the heartbeats the Frontend writes, see modbus/Heartbeat.hxx, and applies the link loss policy
+// when one is late.
+class LinkSupervisor
+{
+public:
+	LinkSupervisor();
+
+	static LinkSupervisor *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new LinkSupervisor();
+		}
+		return myInstance;
+	}
+
+	// a heartbeat write arrived, its settings replace the previous ones
+	void Heartbeat(const HeartbeatRegisters &heartbeat);
+
+	// the Frontend was heard some other way (telemetry mode), counts towards the deadline but not the statistics
+	void Alive();
+
+	void GetStatus(HeartbeatStatus &status);
+
+	// inter-arrival times in microseconds
+	void GetIntervals(LatencyHistogram &intervals);
+
+private:
+	static LinkSupervisor *myInstance;
+	static void supervisorTask(void *pvParameter);
+
+	void check();
+	void rampDown(int64_t now, uint16_t degreesPerMinute);
+
+	portMUX_TYPE myLock = portMUX_INITIALIZER_UNLOCKED;
+	HeartbeatRegisters mySettings = {};
+	bool mySeen = false;
+	int64_t myLastUs = 0;
+	uint32_t myLastIntervalUs = 0;
+	uint32_t myJitterEwmaUs = 0;
+	uint16_t myMisses = 0;
+	uint16_t mySkipped = 0;
+	LatencyHistogram myIntervals;
+	LinkState myState = LinkState::UNSUPERVISED;
+
+	// only touched by the supervisor task
+	int64_t myLostUs = 0;
+	float myRampFrom = 0;
+};
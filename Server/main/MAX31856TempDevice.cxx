@@ -1,4 +1,6 @@
+#include "TaskSupervisor.hxx"
 #include "TempDevice.hxx"
+#include "hardware.h"
 
 static constexpr const char *TCTAG = "MAX31856TempDevice";
 
@@ -38,8 +40,14 @@ void MAX31856TempDevice::thermocoupleTask(void *pvParameter)
 		.fault = 0,
 	};
 
+	// a read can wait up to SPI3_BUS_TIMEOUT_MS for the bus
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::THERMOCOUPLE, 600, 600 + 2 * SPI3_BUS_TIMEOUT_MS, true);
+
 	while (42)
 	{
+		supervisor->CheckIn(SupervisedTask::THERMOCOUPLE);
+
 		instance->mySpiBusManager->lock();
 		instance->myThermocouple->read(result, 0);
 		instance->mySpiBusManager->unlock();
@@ -1,6 +1,14 @@
 #include "Server.hxx"
+#include "CurrentMonitor.hxx"
+#include "EnergyMeter.hxx"
+#include "ErrorJournal.hxx"
+#include "FileStore.hxx"
+#include "LinkSupervisor.hxx"
 #include "State.hxx"
 #include "TempController.hxx"
+#include "TaskSupervisor.hxx"
+#include "TelemetryLink.hxx"
+#include "TempHistory.hxx"
 #include "hardware.h"
 #include "modbus/Proto.hxx"
 #include "uart/Uart.hxx"
@@ -9,106 +17,611 @@
 #include "pl_uart.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <memory>
+#include <string.h>
 
 Server *Server::myInstance = nullptr;
+AreaStats Server::myAreaStats[static_cast<size_t>(ServedArea::COUNT)];
+portMUX_TYPE Server::myAreaStatsLock = portMUX_INITIALIZER_UNLOCKED;
 
 static const char *ServerTAG = "Server";
 
+// Times an OnRead() or OnWrite() into Server::RecordOnRead() or RecordOnWrite()
+class AreaTimer
+{
+public:
+	AreaTimer(ServedArea area, bool read = true) : myArea(area), myRead(read), myStart(esp_timer_get_time()) {}
+	~AreaTimer()
+	{
+		uint32_t us = static_cast<uint32_t>(esp_timer_get_time() - myStart);
+		if (myRead)
+		{
+			Server::RecordOnRead(myArea, us);
+		}
+		else
+		{
+			Server::RecordOnWrite(myArea, us);
+		}
+	}
+
+private:
+	ServedArea myArea;
+	bool myRead;
+	int64_t myStart;
+};
+
 Server::Server()
 {
-	myUart = std::make_shared<PL::Uart>(MODBUS_UART_PORT, SOC_UART_FIFO_LEN + 4, SOC_UART_FIFO_LEN + 4, MODBUS_TX, MODBUS_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+	myUart = std::make_shared<LinkUart>(MODBUS_UART_PORT, RTU_RX_BUFFER_SIZE, RTU_TX_BUFFER_SIZE, MODBUS_TX, MODBUS_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
 	myUart->Initialize();
-	myUart->SetBaudRate(115200);
+	myUart->ConfigureFrameTiming(RTU_RX_TIMEOUT_SYMBOLS, RTU_RX_FULL_THRESHOLD);
+	if (MODBUS_RS485)
+	{
+		myUart->EnableRs485(MODBUS_DE_PIN);
+	}
+	myUart->SetBaudRate(MODBUS_BAUD_RATE);
 	myUart->SetDataBits(8);
 	myUart->SetParity(PL::UartParity::even);
 	myUart->SetStopBits(PL::UartStopBits::one);
 	myUart->SetFlowControl(PL::UartFlowControl::none);
 	myUart->Enable();
 
-	myModbusServer = std::make_shared<PL::ModbusServer>(myUart, PL::ModbusProtocol::rtu, 1);
+	// A partial frame has to wait for the UART to hand over its next chunk, RTU_RX_FULL_THRESHOLD bytes at
+	// 11 bits each, plus the read timeout and some scheduling slack, before it counts as cut short.
+	static constexpr uint32_t frameTimeoutUs = (RTU_RX_FULL_THRESHOLD + 2 * RTU_RX_TIMEOUT_SYMBOLS) * 11 * 1000000ull / MODBUS_BAUD_RATE + 10000;
+	myUart->EnableBusMonitor(MODBUS_UNIT_ID, frameTimeoutUs);
+	if (TRAFFIC_RECORDER_SIZE > 0)
+	{
+		// the same allowance keeps the chunks of one frame in one record
+		myUart->EnableTrafficRecorder(TrafficRole::SERVER, MODBUS_UNIT_ID, TRAFFIC_RECORDER_SIZE, frameTimeoutUs);
+	}
 
-	myHoldingRegisters = std::make_shared<DynamicHoldingRegisters>(PL::ModbusMemoryType::holdingRegisters, 0, sizeof(DynamicHoldingRegisters));
-	myCoils = std::make_shared<DynamicCoils>(PL::ModbusMemoryType::coils, 0, sizeof(DynamicHoldingRegisters));
-	myDiscreteInputs = std::make_shared<DynamicDiscreteInputs>(PL::ModbusMemoryType::discreteInputs, 0, sizeof(DynamicHoldingRegisters));
-	myInputRegisters = std::make_shared<DynamicInputRegisters>(PL::ModbusMemoryType::inputRegisters, 0, sizeof(DynamicHoldingRegisters));
+	myModbusServer = std::make_shared<PL::ModbusServer>(myUart, PL::ModbusProtocol::rtu, MODBUS_UNIT_ID);
+
+	myHoldingRegisters = std::make_shared<DynamicHoldingRegisters>(0);
+	myCoils = std::make_shared<DynamicCoils>(0);
+	myDiscreteInputs = std::make_shared<DynamicDiscreteInputs>(0);
+	myInputRegisters = std::make_shared<DynamicInputRegisters>(0);
 
 	myModbusServer->AddMemoryArea(myCoils);
 	myModbusServer->AddMemoryArea(myDiscreteInputs);
 	myModbusServer->AddMemoryArea(myHoldingRegisters);
 	myModbusServer->AddMemoryArea(myInputRegisters);
+
+	myHistoryRegisters = std::make_shared<DynamicHistoryRegisters>(HISTORY_ADDRESS);
+	myModbusServer->AddMemoryArea(myHistoryRegisters);
+
+	myFaultJournalRegisters = std::make_shared<DynamicFaultJournalRegisters>(FAULT_JOURNAL_ADDRESS);
+	myModbusServer->AddMemoryArea(myFaultJournalRegisters);
+
+	myTaskHealthRegisters = std::make_shared<DynamicTaskHealthRegisters>(TASK_HEALTH_ADDRESS);
+	myModbusServer->AddMemoryArea(myTaskHealthRegisters);
+
+	myHeaterPowerRegisters = std::make_shared<DynamicHeaterPowerRegisters>(HEATER_POWER_ADDRESS);
+	myModbusServer->AddMemoryArea(myHeaterPowerRegisters);
+
+	myEnergySettings = std::make_shared<DynamicEnergySettings>(ENERGY_ADDRESS);
+	myEnergyRegisters = std::make_shared<DynamicEnergyRegisters>(ENERGY_ADDRESS);
+	myModbusServer->AddMemoryArea(myEnergySettings);
+	myModbusServer->AddMemoryArea(myEnergyRegisters);
+
+	myConfigStaging = std::make_shared<DynamicConfigStaging>(CONFIG_STAGING_ADDRESS);
+	myModbusServer->AddMemoryArea(myConfigStaging);
+
+	myFileRecordWindow = std::make_shared<DynamicFileRecordWindow>(FILE_WRITE_ADDRESS);
+	myProgramFile = std::make_shared<DynamicFileRegisters<ProgramFile::COUNT>>(FileId::PROGRAM);
+	myGainScheduleFile = std::make_shared<DynamicFileRegisters<GainScheduleFile::COUNT>>(FileId::GAIN_SCHEDULE);
+	myHistoryFile = std::make_shared<DynamicFileRegisters<HistoryRegisters::COUNT>>(FileId::HISTORY);
+	myModbusServer->AddMemoryArea(myFileRecordWindow);
+	myModbusServer->AddMemoryArea(myProgramFile);
+	myModbusServer->AddMemoryArea(myGainScheduleFile);
+	myModbusServer->AddMemoryArea(myHistoryFile);
+
+	// the heartbeat is the Frontend's, so only the RTU server takes it. Anyone can read how it's doing.
+	myHeartbeatRegisters = std::make_shared<DynamicHeartbeatRegisters>(HEARTBEAT_ADDRESS);
+	myHeartbeatStatus = std::make_shared<DynamicHeartbeatStatus>(HEARTBEAT_ADDRESS);
+	myModbusServer->AddMemoryArea(myHeartbeatRegisters);
+	myModbusServer->AddMemoryArea(myHeartbeatStatus);
+
+	myDiagnosticsCounters = std::make_shared<DynamicDiagnosticsCounters>(DIAGNOSTICS_ADDRESS);
+	myDiagnosticsCommand = std::make_shared<DynamicDiagnosticsCommand>(DIAGNOSTICS_ADDRESS);
+	myModbusServer->AddMemoryArea(myDiagnosticsCounters);
+	myModbusServer->AddMemoryArea(myDiagnosticsCommand);
+
+	myLinkModeRegisters = std::make_shared<DynamicLinkModeRegisters>(LINK_MODE_ADDRESS);
+	myModbusServer->AddMemoryArea(myLinkModeRegisters);
+	myTelemetryLink = new TelemetryLink(myUart);
+	xTaskCreate(&linkModeTask, "linkModeTask", 4096, this, 5, &myLinkModeTask);
+
 	myModbusServer->Enable();
+
+	// Modbus TCP for a PC or SCADA system so it doesn't compete with the Frontend for the serial line.
+	// It shares the memory area objects with the RTU server, and each area is locked for the whole of a
+	// request, so a read from either transport sees one consistent OnRead() snapshot. It's a second way to
+	// watch the furnace, not to control it: anyone on the network can reach the socket, so unless
+	// MODBUS_TCP_WRITES_ENABLED the writable areas are served as read only copies of their own and the write
+	// only windows are left out.
+	myModbusTcpServer = std::make_shared<PL::ModbusServer>(MODBUS_TCP_PORT, MODBUS_TCP_MAX_CLIENTS);
+	if (MODBUS_TCP_WRITES_ENABLED)
+	{
+		myModbusTcpServer->AddMemoryArea(myCoils);
+		myModbusTcpServer->AddMemoryArea(myHoldingRegisters);
+		myModbusTcpServer->AddMemoryArea(myEnergySettings);
+		myModbusTcpServer->AddMemoryArea(myConfigStaging);
+		myModbusTcpServer->AddMemoryArea(myFileRecordWindow);
+		myModbusTcpServer->AddMemoryArea(myDiagnosticsCommand);
+	}
+	else
+	{
+		myModbusTcpServer->AddMemoryArea(std::make_shared<ReadOnlyArea<DynamicCoils>>(0));
+		myModbusTcpServer->AddMemoryArea(std::make_shared<ReadOnlyArea<DynamicHoldingRegisters>>(0));
+		myModbusTcpServer->AddMemoryArea(std::make_shared<ReadOnlyArea<DynamicEnergySettings>>(ENERGY_ADDRESS));
+	}
+	myModbusTcpServer->AddMemoryArea(myDiscreteInputs);
+	myModbusTcpServer->AddMemoryArea(myInputRegisters);
+	myModbusTcpServer->AddMemoryArea(myHistoryRegisters);
+	myModbusTcpServer->AddMemoryArea(myFaultJournalRegisters);
+	myModbusTcpServer->AddMemoryArea(myTaskHealthRegisters);
+	myModbusTcpServer->AddMemoryArea(myHeaterPowerRegisters);
+	myModbusTcpServer->AddMemoryArea(myEnergyRegisters);
+	myModbusTcpServer->AddMemoryArea(myProgramFile);
+	myModbusTcpServer->AddMemoryArea(myGainScheduleFile);
+	myModbusTcpServer->AddMemoryArea(myHistoryFile);
+	myModbusTcpServer->AddMemoryArea(myHeartbeatStatus);
+	myModbusTcpServer->AddMemoryArea(myDiagnosticsCounters);
+
+	xTaskCreate(&tcpEnableTask, "modbusTcpEnable", 2048, this, 5, NULL);
+}
+
+// The network stack comes up with the console's wifi commands, after the Server is constructed, so keep
+// trying until the TCP server can open its socket.
+void Server::tcpEnableTask(void *pvParameter)
+{
+	Server *instance = static_cast<Server *>(pvParameter);
+
+	while (42)
+	{
+		esp_err_t err = instance->myModbusTcpServer->Enable();
+		if (err == ESP_OK)
+		{
+			ESP_LOGI(ServerTAG, "Modbus TCP server listening on port %u", MODBUS_TCP_PORT);
+			break;
+		}
+
+		ESP_LOGD(ServerTAG, "Modbus TCP server not started yet: %s", esp_err_to_name(err));
+		vTaskDelay(MODBUS_TCP_RETRY_MS / portTICK_PERIOD_MS);
+	}
+
+	vTaskDelete(NULL);
+}
+
+void Server::RequestLinkMode(const LinkModeRegisters &request)
+{
+	myRequestedLinkMode = request;
+	if (myLinkModeTask != nullptr)
+	{
+		xTaskNotifyGive(myLinkModeTask);
+	}
+}
+
+// Switching is done here rather than in OnWrite() so the Modbus server gets to send its response first.
+// The telemetry link then has the UART to itself until the Frontend goes quiet.
+void Server::linkModeTask(void *pvParameter)
+{
+	Server *instance = static_cast<Server *>(pvParameter);
+
+	while (42)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		LinkModeRegisters request = instance->myRequestedLinkMode;
+		if (request.MODE != static_cast<uint16_t>(LinkMode::TELEMETRY))
+		{
+			continue;
+		}
+
+		vTaskDelay(pdMS_TO_TICKS(LINK_SWITCH_DELAY_MS));
+		instance->myModbusServer->Disable();
+
+		instance->myUart->PauseMonitoring(true);
+		instance->myTelemetryLink->Run(request.TELEMETRY_PERIOD_MS, request.KEEPALIVE_TIMEOUT_MS);
+		instance->myUart->PauseMonitoring(false);
+
+		instance->myLinkModeRegisters->Lock();
+		instance->myLinkModeRegisters->SetMode(LinkMode::RTU);
+		instance->myLinkModeRegisters->Unlock();
+		instance->myModbusServer->Enable();
+	}
+}
+
+uint8_t Server::ApplyCommand(const CommandPacket &command)
+{
+	static constexpr uint8_t ILLEGAL_DATA_ADDRESS = 0x02;
+	static constexpr uint8_t SERVER_DEVICE_FAILURE = 0x04;
+
+	esp_err_t result;
+
+	switch (static_cast<CommandTable>(command.table))
+	{
+	case CommandTable::COIL:
+		if (command.address >= 2)
+		{
+			return ILLEGAL_DATA_ADDRESS;
+		}
+		result = myCoils->WriteCoil(command.address, command.value != 0);
+		break;
+	case CommandTable::HOLDING_REGISTER:
+		if (command.address >= HoldingRegisters::COUNT)
+		{
+			return ILLEGAL_DATA_ADDRESS;
+		}
+		result = myHoldingRegisters->WriteRegister(command.address, command.value);
+		break;
+	default:
+		return ILLEGAL_DATA_ADDRESS;
+	}
+
+	return result == ESP_OK ? 0 : SERVER_DEVICE_FAILURE;
+}
+
+esp_err_t DynamicLinkModeRegisters::OnWrite()
+{
+	AreaTimer timer(ServedArea::LINK_MODE, false);
+	if (data.MODE > static_cast<uint16_t>(LinkMode::TELEMETRY))
+	{
+		data.MODE = static_cast<uint16_t>(LinkMode::RTU);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	Server::GetInstance()->RequestLinkMode(data);
+	return ESP_OK;
+}
+
+esp_err_t DynamicHoldingRegisters::WriteRegister(uint16_t index, uint16_t value)
+{
+	Lock();
+	OnRead();
+	reinterpret_cast<uint16_t *>(&data)[index] = value;
+	esp_err_t result = OnWrite();
+	Unlock();
+
+	return result;
+}
+
+esp_err_t DynamicCoils::WriteCoil(uint16_t index, bool value)
+{
+	Lock();
+	OnRead();
+	if (index == 0)
+	{
+		data.ENABLE = value;
+	}
+	else if (index == 1)
+	{
+		data.FAULT_RESET = value;
+	}
+	esp_err_t result = OnWrite();
+	Unlock();
+
+	return result;
+}
+
+void Server::RecordOnRead(ServedArea area, uint32_t us)
+{
+	taskENTER_CRITICAL(&myAreaStatsLock);
+	myAreaStats[static_cast<size_t>(area)].onRead.Record(us);
+	taskEXIT_CRITICAL(&myAreaStatsLock);
+}
+
+void Server::RecordOnWrite(ServedArea area, uint32_t us)
+{
+	taskENTER_CRITICAL(&myAreaStatsLock);
+	myAreaStats[static_cast<size_t>(area)].onWrite.Record(us);
+	taskEXIT_CRITICAL(&myAreaStatsLock);
+}
+
+void Server::GetAreaStats(ServedArea area, AreaStats &stats)
+{
+	taskENTER_CRITICAL(&myAreaStatsLock);
+	stats = myAreaStats[static_cast<size_t>(area)];
+	taskEXIT_CRITICAL(&myAreaStatsLock);
+}
+
+const char *Server::GetAreaName(ServedArea area)
+{
+	static const char *names[] = {"coils", "discrete", "holding", "input", "history", "files", "config", "heartbeat", "link mode", "diagnostics", "faults", "tasks", "power", "energy"};
+	static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(ServedArea::COUNT), "a ServedArea without a name");
+
+	return names[static_cast<size_t>(area)];
+}
+
+void Server::ClearModbusStats()
+{
+	myUart->ClearBusMonitor();
+	myUart->ResetTurnaround();
+
+	taskENTER_CRITICAL(&myAreaStatsLock);
+	for (AreaStats &stats : myAreaStats)
+	{
+		stats.onRead.Reset();
+		stats.onWrite.Reset();
+	}
+	taskEXIT_CRITICAL(&myAreaStatsLock);
+}
+
+void Server::ReadFile(FileId file, FileInfo &info, uint16_t *content, uint16_t maxLength)
+{
+	AreaTimer timer(ServedArea::FILES);
+	FileStore::GetInstance()->Read(file, info, content, maxLength);
+}
+
+esp_err_t DynamicDiagnosticsCounters::OnRead()
+{
+	AreaTimer timer(ServedArea::DIAGNOSTICS);
+	Server::GetInstance()->GetLinkUart().GetBusCounters(data);
+	return ESP_OK;
+}
+
+esp_err_t DynamicDiagnosticsCommand::OnWrite()
+{
+	AreaTimer timer(ServedArea::DIAGNOSTICS, false);
+
+	if (data.SUB_FUNCTION != static_cast<uint16_t>(DiagnosticsSubFunction::CLEAR_COUNTERS))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	Server::GetInstance()->ClearModbusStats();
+	return ESP_OK;
+}
+
+esp_err_t DynamicHeartbeatRegisters::OnWrite()
+{
+	AreaTimer timer(ServedArea::HEARTBEAT, false);
+
+	if (data.POLICY > static_cast<uint16_t>(LinkLossPolicy::SHUT_OFF))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	LinkSupervisor::GetInstance()->Heartbeat(data);
+	return ESP_OK;
+}
+
+esp_err_t DynamicHeartbeatStatus::OnRead()
+{
+	AreaTimer timer(ServedArea::HEARTBEAT);
+	LinkSupervisor::GetInstance()->GetStatus(data);
+	return ESP_OK;
+}
+
+esp_err_t DynamicFileRecordWindow::OnWrite()
+{
+	AreaTimer timer(ServedArea::FILES, false);
+	return FileStore::GetInstance()->WriteRecord(data);
+}
+
+static ServerRegisters readImage()
+{
+	ServerRegisters image;
+	TempController::GetInstance()->GetRegisterImage().Read(image);
+	return image;
 }
 
 esp_err_t DynamicDiscreteInputs::OnRead()
 {
-	State *state = State::GetInstance();
-	data.ERROR = state->HasError();
+	AreaTimer timer(ServedArea::DISCRETE_INPUTS);
+	data = readImage().discreteInputs;
 	return ESP_OK;
 }
 
 esp_err_t DynamicInputRegisters::OnRead()
 {
-	State *state = State::GetInstance();
-	TempController *controller = TempController::GetInstance();
-	data.CURRENT_TEMP = controller->GetCurrentTemp();
-	data.ERROR_CODE = static_cast<uint16_t>(state->GetError());
-	data.HEATER_PWM_DUTY_CYCLE = controller->GetPwmDutyCycle();
+	AreaTimer timer(ServedArea::INPUT_REGISTERS);
+	ServerRegisters image = readImage();
+	data.inputs = image.inputs;
+	data.config = image.configResult;
+	return ESP_OK;
+}
 
+esp_err_t DynamicHistoryRegisters::OnRead()
+{
+	AreaTimer timer(ServedArea::HISTORY);
+	TempHistory::GetInstance()->CopyTo(data);
 	return ESP_OK;
 }
 
-esp_err_t DynamicHoldingRegisters::OnRead()
+esp_err_t DynamicFaultJournalRegisters::OnRead()
 {
-	State::GetInstance();
-	TempController *controller = TempController::GetInstance();
-	TempController::Config config = controller->GetConfig();
+	AreaTimer timer(ServedArea::FAULT_JOURNAL);
+	ErrorJournal::GetInstance()->CopyTo(data);
+	return ESP_OK;
+}
 
-	data.HEATER_REDUCE_PWM_UNDER = config.SSR_REDUCED_PWM_UNDER;
-	data.HEATER_REDUCED_PWM_VALUE = (config.SSR_REDUCED_PWM_VALUE / config.SSR_FULL_PWM) * 100;
-	data.HEATER_PERIOD = config.PWM_PERIOD_MS;
-	data.P = config.P;
-	data.I = config.I;
-	data.D = config.D;
-	data.PID_WINDOW = config.SSR_BANG_BANG_WINDOW;
-	data.TARGET_TEMP = controller->GetTargetTemp();
+esp_err_t DynamicTaskHealthRegisters::OnRead()
+{
+	AreaTimer timer(ServedArea::TASK_HEALTH);
+	TaskSupervisor::GetInstance()->GetStatus(data);
+	return ESP_OK;
+}
 
+esp_err_t DynamicHeaterPowerRegisters::OnRead()
+{
+	AreaTimer timer(ServedArea::HEATER_POWER);
+	if (CURRENT_SENSOR_FITTED)
+	{
+		CurrentMonitor::GetInstance()->GetRegisters(data);
+	}
 	return ESP_OK;
 }
 
+DynamicEnergySettings::DynamicEnergySettings(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::holdingRegisters, address, &data, sizeof(data))
+{
+	// a write of one half of the charge needs the other half around it
+	EnergyMeter::GetInstance()->GetSettings(data);
+}
+
+esp_err_t DynamicEnergySettings::OnRead()
+{
+	AreaTimer timer(ServedArea::ENERGY);
+	EnergyMeter::GetInstance()->GetSettings(data);
+	return ESP_OK;
+}
+
+esp_err_t DynamicEnergySettings::OnWrite()
+{
+	AreaTimer timer(ServedArea::ENERGY, false);
+	EnergyMeter::GetInstance()->SetCharge(static_cast<uint32_t>(data.CHARGE_G_HI) << 16 | data.CHARGE_G_LO);
+	return ESP_OK;
+}
+
+esp_err_t DynamicEnergyRegisters::OnRead()
+{
+	AreaTimer timer(ServedArea::ENERGY);
+	EnergyMeter::GetInstance()->GetRegisters(data);
+	return ESP_OK;
+}
+
+DynamicHoldingRegisters::DynamicHoldingRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::holdingRegisters, address, &data, sizeof(data))
+{
+	// a write can land before anyone has read, it still has to have the real values around it
+	data = served = readImage().holding;
+}
+
+esp_err_t DynamicHoldingRegisters::OnRead()
+{
+	AreaTimer timer(ServedArea::HOLDING_REGISTERS);
+	data = served = readImage().holding;
+	return ESP_OK;
+}
+
+// The client only sent some of the registers, the rest of data is whatever it last read. Only the ones that
+// differ from that are applied, so a stale neighbour can't undo a change made from the console in between.
+// The result is staged like a config transaction, so a write that covers several registers takes effect at
+// once on the next control tick.
 esp_err_t DynamicHoldingRegisters::OnWrite()
 {
+	AreaTimer timer(ServedArea::HOLDING_REGISTERS, false);
 	TempController *controller = TempController::GetInstance();
-	TempController::Config config = controller->GetConfig();
-	config.SSR_REDUCED_PWM_UNDER = data.HEATER_REDUCE_PWM_UNDER;
-	config.SSR_REDUCED_PWM_VALUE = data.HEATER_REDUCED_PWM_VALUE;
-	config.PWM_PERIOD_MS = data.HEATER_PERIOD;
-	config.P = data.P;
-	config.I = data.I;
-	config.D = data.D;
-	config.SSR_BANG_BANG_WINDOW = data.PID_WINDOW;
-	controller->SetConfig(config);
-	controller->SetTargetTemp(data.TARGET_TEMP);
+	double targetTemp;
+	TempController::Config config = controller->GetLatestConfig(targetTemp);
 
-	return ESP_OK;
+	if (data.HEATER_REDUCE_PWM_UNDER != served.HEATER_REDUCE_PWM_UNDER)
+	{
+		config.SSR_REDUCED_PWM_UNDER = data.HEATER_REDUCE_PWM_UNDER;
+	}
+	if (data.HEATER_REDUCED_PWM_VALUE != served.HEATER_REDUCED_PWM_VALUE)
+	{
+		// served as a percentage of full power
+		config.SSR_REDUCED_PWM_VALUE = data.HEATER_REDUCED_PWM_VALUE * config.SSR_FULL_PWM / 100;
+	}
+	if (data.HEATER_PERIOD != served.HEATER_PERIOD)
+	{
+		config.PWM_PERIOD_MS = data.HEATER_PERIOD;
+	}
+	if (data.P != served.P)
+	{
+		config.P = data.P;
+	}
+	if (data.I != served.I)
+	{
+		config.I = data.I;
+	}
+	if (data.D != served.D)
+	{
+		config.D = data.D;
+	}
+	if (data.PID_WINDOW != served.PID_WINDOW)
+	{
+		config.SSR_BANG_BANG_WINDOW = data.PID_WINDOW;
+	}
+	if (data.TARGET_TEMP != served.TARGET_TEMP)
+	{
+		targetTemp = data.TARGET_TEMP;
+	}
+
+	bool staged = controller->StageConfig(config, targetTemp, 0);
+	data = served = readImage().holding;
+
+	return staged ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t DynamicConfigStaging::OnWrite()
+{
+	AreaTimer timer(ServedArea::CONFIG_STAGING, false);
+	TempController *controller = TempController::GetInstance();
+	double targetTemp;
+	TempController::Config config = controller->GetLatestConfig(targetTemp);
+
+	// fields the client left as CONFIG_UNCHANGED keep their current value
+	HoldingRegisters values;
+	memcpy(&values, data.values, sizeof(values));
+
+	if (values.HEATER_REDUCE_PWM_UNDER != CONFIG_UNCHANGED)
+	{
+		config.SSR_REDUCED_PWM_UNDER = values.HEATER_REDUCE_PWM_UNDER;
+	}
+	if (values.HEATER_REDUCED_PWM_VALUE != CONFIG_UNCHANGED)
+	{
+		config.SSR_REDUCED_PWM_VALUE = values.HEATER_REDUCED_PWM_VALUE * config.SSR_FULL_PWM / 100;
+	}
+	if (values.HEATER_PERIOD != CONFIG_UNCHANGED)
+	{
+		config.PWM_PERIOD_MS = values.HEATER_PERIOD;
+	}
+	if (values.P != CONFIG_UNCHANGED)
+	{
+		config.P = values.P;
+	}
+	if (values.I != CONFIG_UNCHANGED)
+	{
+		config.I = values.I;
+	}
+	if (values.D != CONFIG_UNCHANGED)
+	{
+		config.D = values.D;
+	}
+	if (values.TARGET_TEMP != CONFIG_UNCHANGED)
+	{
+		targetTemp = values.TARGET_TEMP;
+	}
+	if (values.PID_WINDOW != CONFIG_UNCHANGED)
+	{
+		config.SSR_BANG_BANG_WINDOW = values.PID_WINDOW;
+	}
+
+	return controller->StageConfig(config, targetTemp, data.TRANSACTION_ID) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+DynamicCoils::DynamicCoils(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::coils, address, &data, sizeof(data))
+{
+	// a fault reset can land before anyone has read, it mustn't carry a stale ENABLE with it
+	data = served = readImage().coils;
 }
 
 esp_err_t DynamicCoils::OnRead()
 {
-	State *state = State::GetInstance();
-	data.ENABLE = state->IsEnabled();
+	AreaTimer timer(ServedArea::COILS);
+	data = served = readImage().coils;
 	return ESP_OK;
 }
+
 esp_err_t DynamicCoils::OnWrite()
 {
-	State *state = State::GetInstance();
-	if (data.ENABLE)
+	AreaTimer timer(ServedArea::COILS, false);
+	// the furnace may have been disabled since the client last read, only a write of ENABLE itself changes it
+	if (data.ENABLE != served.ENABLE)
 	{
-		state->SetEnabled(true);
+		State::GetInstance()->SetEnabled(data.ENABLE);
 	}
-	else
+	if (data.FAULT_RESET)
 	{
-		state->SetEnabled(false);
+		State::GetInstance()->ResetErrors();
 	}
+	TempController::GetInstance()->PublishRegisterImage();
+	data = served = readImage().coils;
 	return ESP_OK;
-}
\ No newline at end of file
+}
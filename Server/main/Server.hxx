@@ -1,51 +1,281 @@
 #pragma once
 
+#include "modbus/Diagnostics.hxx"
+#include "modbus/Energy.hxx"
+#include "modbus/FaultJournal.hxx"
+#include "modbus/FileRecords.hxx"
+#include "modbus/Heartbeat.hxx"
+#include "modbus/History.hxx"
+#include "modbus/LinkStats.hxx"
 #include "modbus/Proto.hxx"
+#include "modbus/HeaterPower.hxx"
+#include "modbus/TaskHealth.hxx"
+#include "telemetry/Telemetry.hxx"
+#include "uart/LinkUart.hxx"
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <pl_modbus.h>
 #include <pl_uart.h>
 
-// this should be kept up to date with modbus/Proto.hxx so the client has the same structure
+class TelemetryLink;
+
+// Which area an OnRead() or OnWrite() timing belongs to
+enum class ServedArea : uint8_t
+{
+	COILS,
+	DISCRETE_INPUTS,
+	HOLDING_REGISTERS,
+	INPUT_REGISTERS,
+	HISTORY,
+	FILES,
+	CONFIG_STAGING,
+	HEARTBEAT,
+	LINK_MODE,
+	DIAGNOSTICS,
+	FAULT_JOURNAL,
+	TASK_HEALTH,
+	HEATER_POWER,
+	ENERGY,
+	COUNT,
+};
+
+// Time spent in an area's callbacks, from either transport
+struct AreaStats
+{
+	LatencyHistogram onRead;  // microseconds
+	LatencyHistogram onWrite; // microseconds, rejected writes included
+};
+
+// These serve their own data member, filled from TempController's register image in OnRead(). Keep them
+// up to date with modbus/Proto.hxx so the client has the same structure.
 class DynamicDiscreteInputs : public PL::ModbusMemoryArea
 {
 public:
-	using PL::ModbusMemoryArea::ModbusMemoryArea;
+	DynamicDiscreteInputs(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::discreteInputs, address, &data, sizeof(data)) {}
 	esp_err_t OnRead() override;
 
 private:
-	DiscreteInputs data;
+	DiscreteInputs data = {};
 };
 
 class DynamicCoils : public PL::ModbusMemoryArea
 {
 public:
-	using PL::ModbusMemoryArea::ModbusMemoryArea;
+	DynamicCoils(uint16_t address);
 	esp_err_t OnRead() override;
 	esp_err_t OnWrite() override;
 
+	// applies a single coil write from outside the Modbus server, the same way a Modbus write would
+	esp_err_t WriteCoil(uint16_t index, bool value);
+
 private:
-	Coils data;
+	Coils data = {};
+	Coils served = {}; // what the client last saw, ENABLE only applies when a write changed it
 };
 
 class DynamicHoldingRegisters : public PL::ModbusMemoryArea
 {
 public:
-	using PL::ModbusMemoryArea::ModbusMemoryArea;
+	DynamicHoldingRegisters(uint16_t address);
 	esp_err_t OnRead() override;
 	esp_err_t OnWrite() override;
 
+	// applies a single register write from outside the Modbus server, the same way a Modbus write would
+	esp_err_t WriteRegister(uint16_t index, uint16_t value);
+
 private:
-	HoldingRegisters data;
+	HoldingRegisters data = {};
+	HoldingRegisters served = {}; // what the client last saw, a write only applies the registers that differ from it
 };
 
 class DynamicInputRegisters : public PL::ModbusMemoryArea
 {
 public:
-	using PL::ModbusMemoryArea::ModbusMemoryArea;
+	DynamicInputRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnRead() override;
+
+private:
+	StatusRegisters data = {};
+};
+
+// The config transaction staging window, see modbus/ConfigTransaction.hxx. A write is validated here and
+// answered with an exception if it is rejected, the outcome is served after the input registers.
+class DynamicConfigStaging : public PL::ModbusMemoryArea
+{
+public:
+	DynamicConfigStaging(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::holdingRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnWrite() override;
+
+private:
+	ConfigStaging data = {};
+};
+
+// The temperature history FIFO, layout in modbus/History.hxx. Each read snapshots the whole ring into data.
+class DynamicHistoryRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicHistoryRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
 	esp_err_t OnRead() override;
 
 private:
-	InputRegisters data;
+	HistoryRegisters data;
+};
+
+// The fault journal, layout in modbus/FaultJournal.hxx. Each read snapshots the whole journal into data.
+class DynamicFaultJournalRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicFaultJournalRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnRead() override;
+
+private:
+	FaultJournalRegisters data;
+};
+
+// Task supervision, see modbus/TaskHealth.hxx
+class DynamicTaskHealthRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicTaskHealthRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnRead() override;
+
+private:
+	TaskHealthRegisters data = {};
+};
+
+// Heater current and power, see modbus/HeaterPower.hxx
+class DynamicHeaterPowerRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicHeaterPowerRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnRead() override;
+
+private:
+	HeaterPowerRegisters data = {};
+};
+
+// Energy metering, see modbus/Energy.hxx. The charge mass is written here, the counters are read beside it.
+class DynamicEnergySettings : public PL::ModbusMemoryArea
+{
+public:
+	DynamicEnergySettings(uint16_t address);
+	esp_err_t OnRead() override;
+	esp_err_t OnWrite() override;
+
+private:
+	EnergySettings data = {};
+};
+
+class DynamicEnergyRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicEnergyRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnRead() override;
+
+private:
+	EnergyRegisters data = {};
+};
+
+// The file upload window, a FileRecordHeader and its data, see modbus/FileRecords.hxx
+class DynamicFileRecordWindow : public PL::ModbusMemoryArea
+{
+public:
+	DynamicFileRecordWindow(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::holdingRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnWrite() override;
+
+private:
+	FileRecordWindow data = {};
+};
+
+// A file's read window, its FileInfo followed by up to Length registers of content
+template <uint16_t Length>
+class DynamicFileRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicFileRegisters(FileId file) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, FileReadAddress(file), &data, sizeof(data)), myFile(file) {}
+	esp_err_t OnRead() override;
+
+private:
+	struct
+	{
+		FileInfo info;
+		uint16_t content[Length];
+	} data = {};
+	FileId myFile;
+};
+
+// Link supervision, see modbus/Heartbeat.hxx. Every write is a heartbeat.
+class DynamicHeartbeatRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicHeartbeatRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::holdingRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnWrite() override;
+
+private:
+	HeartbeatRegisters data = {};
+};
+
+class DynamicHeartbeatStatus : public PL::ModbusMemoryArea
+{
+public:
+	DynamicHeartbeatStatus(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnRead() override;
+
+private:
+	HeartbeatStatus data = {};
+};
+
+// The Diagnostics function counters, see modbus/Diagnostics.hxx. Only the RTU link is counted.
+class DynamicDiagnosticsCounters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicDiagnosticsCounters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnRead() override;
+
+private:
+	DiagnosticsCounters data = {};
+};
+
+class DynamicDiagnosticsCommand : public PL::ModbusMemoryArea
+{
+public:
+	DynamicDiagnosticsCommand(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::holdingRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnWrite() override;
+
+private:
+	DiagnosticsCommand data = {};
+};
+
+// Written by the Frontend to switch the link into telemetry mode, see telemetry/Telemetry.hxx
+class DynamicLinkModeRegisters : public PL::ModbusMemoryArea
+{
+public:
+	DynamicLinkModeRegisters(uint16_t address) : PL::ModbusMemoryArea(PL::ModbusMemoryType::holdingRegisters, address, &data, sizeof(data)) {}
+	esp_err_t OnWrite() override;
+
+	void SetMode(LinkMode mode)
+	{
+		data.MODE = static_cast<uint16_t>(mode);
+	}
+
+private:
+	LinkModeRegisters data = {};
+};
+
+// A writable area served where writes aren't allowed. Reads are the area's own, a write is put back from its
+// source and answered with an exception.
+template <typename Area>
+class ReadOnlyArea : public Area
+{
+public:
+	using Area::Area;
+
+	esp_err_t OnWrite() override
+	{
+		this->OnRead();
+		return ESP_ERR_NOT_SUPPORTED;
+	}
 };
 
 class Server
@@ -61,12 +291,68 @@ public:
 		return myInstance;
 	}
 
+	// Applies a register or coil write that arrived over the telemetry link. Returns 0 or the Modbus
+	// exception code.
+	uint8_t ApplyCommand(const CommandPacket &command);
+
+	void RequestLinkMode(const LinkModeRegisters &request);
+
+	static void RecordOnRead(ServedArea area, uint32_t us);
+	static void RecordOnWrite(ServedArea area, uint32_t us);
+
+	// fills a file read window from the FileStore, timed as ServedArea::FILES
+	static void ReadFile(FileId file, FileInfo &info, uint16_t *content, uint16_t maxLength);
+
+	LinkUart &GetLinkUart()
+	{
+		return *myUart;
+	}
+
+	static void GetAreaStats(ServedArea area, AreaStats &stats);
+	static const char *GetAreaName(ServedArea area);
+
+	// the bus counters, the area timings and the UART's turnaround
+	void ClearModbusStats();
+
 private:
 	static Server *myInstance;
-	std::shared_ptr<PL::Uart> myUart;
+	static AreaStats myAreaStats[static_cast<size_t>(ServedArea::COUNT)];
+	static portMUX_TYPE myAreaStatsLock;
+	static void tcpEnableTask(void *pvParameter);
+	static void linkModeTask(void *pvParameter);
+
+	std::shared_ptr<LinkUart> myUart;
 	std::shared_ptr<PL::ModbusServer> myModbusServer;
+	std::shared_ptr<PL::ModbusServer> myModbusTcpServer; // serves the same memory areas as myModbusServer, read only unless MODBUS_TCP_WRITES_ENABLED
 	std::shared_ptr<DynamicHoldingRegisters> myHoldingRegisters;
 	std::shared_ptr<DynamicInputRegisters> myInputRegisters;
 	std::shared_ptr<DynamicCoils> myCoils;					 // sent as a single byte as a bitmask
 	std::shared_ptr<DynamicDiscreteInputs> myDiscreteInputs; // sent as a single byte as a bitmask
-};
\ No newline at end of file
+	std::shared_ptr<DynamicHistoryRegisters> myHistoryRegisters;
+	std::shared_ptr<DynamicFaultJournalRegisters> myFaultJournalRegisters;
+	std::shared_ptr<DynamicTaskHealthRegisters> myTaskHealthRegisters;
+	std::shared_ptr<DynamicHeaterPowerRegisters> myHeaterPowerRegisters;
+	std::shared_ptr<DynamicEnergySettings> myEnergySettings;
+	std::shared_ptr<DynamicEnergyRegisters> myEnergyRegisters;
+	std::shared_ptr<DynamicConfigStaging> myConfigStaging;
+	std::shared_ptr<DynamicFileRecordWindow> myFileRecordWindow;
+	std::shared_ptr<DynamicFileRegisters<ProgramFile::COUNT>> myProgramFile;
+	std::shared_ptr<DynamicFileRegisters<GainScheduleFile::COUNT>> myGainScheduleFile;
+	std::shared_ptr<DynamicFileRegisters<HistoryRegisters::COUNT>> myHistoryFile;
+	std::shared_ptr<DynamicHeartbeatRegisters> myHeartbeatRegisters;
+	std::shared_ptr<DynamicHeartbeatStatus> myHeartbeatStatus;
+	std::shared_ptr<DynamicLinkModeRegisters> myLinkModeRegisters;
+	std::shared_ptr<DynamicDiagnosticsCounters> myDiagnosticsCounters;
+	std::shared_ptr<DynamicDiagnosticsCommand> myDiagnosticsCommand;
+
+	TelemetryLink *myTelemetryLink = nullptr;
+	TaskHandle_t myLinkModeTask = nullptr;
+	LinkModeRegisters myRequestedLinkMode = {};
+};
+
+template <uint16_t Length>
+esp_err_t DynamicFileRegisters<Length>::OnRead()
+{
+	Server::ReadFile(myFile, data.info, data.content, Length);
+	return ESP_OK;
+}
@@ -1,3 +1,4 @@
+#include "TaskSupervisor.hxx"
 #include "TempController.hxx"
 #include "TempDevice.hxx"
 #include "hardware.h"
@@ -85,8 +86,13 @@ void SimulatedTempDevice::TempTask(void *pvParameter)
 
 	TempController::Config config;
 
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::THERMOCOUPLE, 1000, 2500, true);
+
 	while (42)
 	{
+		supervisor->CheckIn(SupervisedTask::THERMOCOUPLE);
+
 		if (instance == nullptr)
 		{
 			ESP_LOGE("Cooling Task", "instance is null");
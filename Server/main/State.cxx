@@ -2,72 +2,154 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "ErrorJournal.hxx"
+#include "EventBus.hxx"
 #include "GPIO.hxx"
+#include "Interlock.hxx"
 #include "State.hxx"
+#include "TaskSupervisor.hxx"
 #include "TempController.hxx"
 
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
 State *State::myInstance = nullptr;
 
+static constexpr uint32_t POWER_CYCLE_LATCHED = FaultPolicyMask(FaultPolicy::LATCHED_UNTIL_POWER_CYCLE);
+
+// the errors latched until a power cycle, kept through a warm reset. Garbage after a power cycle, which the
+// check catches.
+static RTC_NOINIT_ATTR uint32_t rtcLatched;
+static RTC_NOINIT_ATTR uint32_t rtcLatchedCheck;
+
 State::State()
 {
 	myInstance = this;
 	ESP_LOGI("State", "Initializing State Manager");
 
-	myEventQueue = xQueueCreate(100, sizeof(Event));
-	if (myEventQueue == nullptr)
+	if (rtcLatchedCheck == ~rtcLatched && (rtcLatched & ~POWER_CYCLE_LATCHED) == 0 && esp_reset_reason() != ESP_RST_POWERON)
 	{
-		ESP_LOGE("State", "Failed to create event queue");
-		return;
+		if (rtcLatched != 0)
+		{
+			ESP_LOGW("State", "Errors 0x%02lX are latched until a power cycle", rtcLatched);
+			changed(myErrors.Restore(static_cast<ErrorCode>(rtcLatched)));
+		}
 	}
+	else
+	{
+		rtcLatched = 0;
+		rtcLatchedCheck = ~rtcLatched;
+	}
+
+	EventBus::GetInstance()->Subscribe(Subscriber::CONTROLLER, EventBit<DoorEvent>() | EventBit<EnableEvent>() | EventBit<SetTempEvent>());
 
 	xTaskCreate(checkForErrorTask, "checkForErrorTask", 2048, this, 10, nullptr);
+	xTaskCreate(receiverTask, "stateReceiverTask", 3072, this, 10, nullptr);
+}
+
+void State::SetError(ErrorCode error)
+{
+	changed(myErrors.Set(error));
+}
+
+void State::ClearError(ErrorCode error)
+{
+	changed(myErrors.Clear(error));
+}
+
+ErrorCode State::ResetErrors()
+{
+	FaultChange change = myErrors.Reset();
+	changed(change);
+	return change.before & ~change.after;
+}
+
+void State::changed(const FaultChange &change)
+{
+	uint32_t before = static_cast<uint32_t>(change.before);
+	uint32_t after = static_cast<uint32_t>(change.after);
+	uint32_t bits = before ^ after;
+
+	if (bits & POWER_CYCLE_LATCHED)
+	{
+		// only ever grows until the next power cycle, so the latest snapshot is always the right one to keep
+		rtcLatched = static_cast<uint32_t>(myErrors.Get()) & POWER_CYCLE_LATCHED;
+		rtcLatchedCheck = ~rtcLatched;
+	}
+
+	for (uint8_t bit = 0; bits != 0; bit++, bits >>= 1)
+	{
+		if (bits & 1)
+		{
+			ErrorJournal::GetInstance()->Record(bit, (after >> bit) & 1, change.after);
+		}
+	}
 }
 
 void State::receiverTask(void *arg)
 {
 	State *state = static_cast<State *>(arg);
-	TempController *tempController = TempController::GetInstance();
+	EventBus *bus = EventBus::GetInstance();
 	Event event;
 
 	while (true)
 	{
-		if (xQueueReceive(state->myEventQueue, &event, portMAX_DELAY) == pdTRUE)
+		if (!bus->Receive(Subscriber::CONTROLLER, event, portMAX_DELAY))
 		{
-			switch (event.type)
+			continue;
+		}
+
+		if (const DoorEvent *door = std::get_if<DoorEvent>(&event))
+		{
+			// the interlock owns DOOR_OPEN, it has usually tripped from the switch's interrupt already
+			if (door->open)
 			{
-			case EventType::DOOR_OPEN:
-				state->SetError(ErrorCode::DOOR_OPEN);
-				break;
-			case EventType::DOOR_CLOSED:
-				state->ClearError(ErrorCode::DOOR_OPEN);
-				break;
-			case EventType::ENABLE:
-				state->SetEnabled(true);
-				break;
-			case EventType::DISABLE:
-				state->SetEnabled(false);
-				break;
-			case EventType::SET_TEMP:
+				Interlock::GetInstance()->Trip(InterlockCause::DOOR, esp_timer_get_time());
+			}
+			else
 			{
-				SetTempEvent *setTempEvent = static_cast<SetTempEvent *>(&event);
-				tempController->SetTemp(setTempEvent->temperature);
-				break;
+				Interlock::GetInstance()->Release(InterlockCause::DOOR);
 			}
-			break;
-			default:
-				break;
+		}
+		else if (const EnableEvent *enable = std::get_if<EnableEvent>(&event))
+		{
+			state->SetEnabled(enable->enabled);
+		}
+		else if (const SetTempEvent *setTemp = std::get_if<SetTempEvent>(&event))
+		{
+			TempController *tempController = TempController::GetInstance();
+			if (tempController != nullptr)
+			{
+				tempController->SetTargetTemp(setTemp->temperature);
 			}
 		}
+
+		// Modbus reads see the change now rather than after the next control tick
+		TempController *tempController = TempController::GetInstance();
+		if (tempController != nullptr)
+		{
+			tempController->PublishRegisterImage();
+		}
 	}
 }
 
 void State::checkForErrorTask(void *arg)
 {
 	State *state = static_cast<State *>(arg);
+
+	// app_main creates the interlock and GPIOManager right after us
+	vTaskDelay(500 / portTICK_PERIOD_MS);
 	GPIOManager *gpio = GPIOManager::GetInstance();
+	Interlock *interlock = Interlock::GetInstance();
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::ERROR_CHECK, 500, 1500, true);
+
 	while (true)
 	{
-		if (state->HasError())
+		supervisor->CheckIn(SupervisedTask::ERROR_CHECK);
+
+		if (state->HasError() || interlock->IsTripped())
 		{
 			gpio->setEmergencyRelay(true);
 		}
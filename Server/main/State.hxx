@@ -1,29 +1,6 @@
 #pragma once
 
-#include "Errors.hxx"
-
-enum class EventType
-{
-	NONE,
-	DOOR_OPEN,
-	DOOR_CLOSED,
-	SET_TEMP,
-	ENABLE,
-	DISABLE
-};
-
-struct Event
-{
-	EventType type;
-	Event(EventType eventType) : type(eventType) {}
-	Event() : type(EventType::NONE) {}
-};
-
-struct SetTempEvent : public Event
-{
-	SetTempEvent(float temp) : Event(EventType::SET_TEMP), temperature(temp) {}
-	float temperature;
-};
+#include "FaultSet.hxx"
 
 class State
 {
@@ -39,29 +16,34 @@ public:
 		return myInstance;
 	}
 
-	void SetError(ErrorCode error)
-	{
-		myErrorCode |= error;
-	}
+	// The condition behind error is present, or has gone. A latched error stays set after ClearError()
+	// until ResetErrors() or a power cycle, see FaultPolicy. All three add an entry to the ErrorJournal for
+	// every bit they change, and are safe from any task.
+	void SetError(ErrorCode error);
+	void ClearError(ErrorCode error);
 
-	void ClearError(ErrorCode error)
-	{
-		myErrorCode &= ~error;
-	}
+	// the operator reset, clears the errors latched until reset whose condition has gone
+	ErrorCode ResetErrors();
 
 	bool HasError()
 	{
-		return myErrorCode != ErrorCode::NO_ERROR;
+		return myErrors.Get() != ErrorCode::NO_ERROR;
 	}
 
 	bool IsErrorSet(ErrorCode error)
 	{
-		return (myErrorCode & error) == error;
+		return (myErrors.Get() & error) == error;
 	}
 
 	ErrorCode GetError()
 	{
-		return myErrorCode;
+		return myErrors.Get();
+	}
+
+	// the errors whose condition is present right now
+	ErrorCode GetConditions()
+	{
+		return myErrors.GetConditions();
 	}
 
 	bool IsEnabled()
@@ -74,18 +56,13 @@ public:
 		myIsEnabled = enabled;
 	}
 
-	void QueueEvent(Event event)
-	{
-		assert(myEventQueue != nullptr);
-		xQueueSend(myEventQueue, &event, portMAX_DELAY);
-	}
-
 private:
-	QueueHandle_t myEventQueue = nullptr;
 	static State *myInstance;
 	bool myIsEnabled = false;
-	ErrorCode myErrorCode = ErrorCode::NO_ERROR;
+	FaultSet myErrors;
+
+	void changed(const FaultChange &change);
 
 	static void checkForErrorTask(void *arg);
 	static void receiverTask(void *pvParameter);
-};
\ No newline at end of file
+};
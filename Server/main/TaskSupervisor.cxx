@@ -0,0 +1,247 @@
+#include "TaskSupervisor.hxx"
+#include "Interlock.hxx"
+#include "hardware.h"
+
+#include <esp_log.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+
+static const char *SUPERVISORTAG = "TaskSupervisor";
+
+TaskSupervisor *TaskSupervisor::myInstance = nullptr;
+
+static uint16_t saturate16(uint32_t value)
+{
+	return value > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(value);
+}
+
+TaskSupervisor::TaskSupervisor()
+{
+	myInstance = this;
+	xTaskCreate(&supervisorTask, "taskSupervisor", 3072, this, configMAX_PRIORITIES - 2, NULL);
+}
+
+void TaskSupervisor::Register(SupervisedTask task, uint32_t periodMs, uint32_t deadlineMs, bool critical)
+{
+	Supervised &supervised = myTasks[static_cast<size_t>(task)];
+
+	taskENTER_CRITICAL(&myLock);
+	supervised.registered = true;
+	supervised.started = false;
+	supervised.critical = critical;
+	supervised.periodMs = periodMs;
+	supervised.deadlineMs = deadlineMs;
+	supervised.lastUs = esp_timer_get_time();
+	supervised.gapMisses = 0;
+	taskEXIT_CRITICAL(&myLock);
+}
+
+bool TaskSupervisor::miss(size_t index, uint16_t count)
+{
+	Supervised &supervised = myTasks[index];
+	supervised.misses += count;
+	supervised.consecutive += count;
+
+	uint16_t bit = 1u << index;
+	if (supervised.critical && supervised.consecutive >= TASK_MISSES_TO_STALL && (myStalled & bit) == 0)
+	{
+		myStalled |= bit;
+		return true;
+	}
+	return false;
+}
+
+void TaskSupervisor::CheckIn(SupervisedTask task)
+{
+	size_t index = static_cast<size_t>(task);
+	Supervised &supervised = myTasks[index];
+	int64_t now = esp_timer_get_time();
+	bool changed = false;
+
+	taskENTER_CRITICAL(&myLock);
+	if (!supervised.registered)
+	{
+		taskEXIT_CRITICAL(&myLock);
+		return;
+	}
+
+	uint32_t interval = static_cast<uint32_t>(now - supervised.lastUs);
+	supervised.lastUs = now;
+
+	if (supervised.started)
+	{
+		supervised.lastIntervalUs = interval;
+		if (interval > supervised.maxIntervalUs)
+		{
+			supervised.maxIntervalUs = interval;
+		}
+
+		int32_t error = static_cast<int32_t>(interval - supervised.periodMs * 1000);
+		supervised.jitter.Record(error < 0 ? -error : error);
+	}
+	supervised.started = true;
+
+	if (interval > supervised.deadlineMs * 1000)
+	{
+		// unless the supervisor already counted this one while the task was quiet
+		if (supervised.gapMisses == 0)
+		{
+			changed = miss(index, 1);
+		}
+	}
+	else
+	{
+		supervised.consecutive = 0;
+		uint16_t bit = 1u << index;
+		if (myStalled & bit)
+		{
+			myStalled &= ~bit;
+			changed = true;
+		}
+	}
+	supervised.gapMisses = 0;
+	uint16_t stalled = myStalled;
+	taskEXIT_CRITICAL(&myLock);
+
+	if (changed)
+	{
+		ESP_LOGW(SUPERVISORTAG, "%s %s", GetName(task), (stalled & (1u << index)) ? "stalled" : "recovered");
+		if (stalled != 0)
+		{
+			Interlock::GetInstance()->Trip(InterlockCause::TASK_STALL, now);
+		}
+		else
+		{
+			Interlock::GetInstance()->Release(InterlockCause::TASK_STALL);
+		}
+	}
+}
+
+void TaskSupervisor::check()
+{
+	int64_t now = esp_timer_get_time();
+	uint16_t newlyStalled = 0;
+
+	taskENTER_CRITICAL(&myLock);
+	for (size_t i = 0; i < static_cast<size_t>(SupervisedTask::COUNT); i++)
+	{
+		Supervised &supervised = myTasks[i];
+		if (!supervised.registered || supervised.deadlineMs == 0)
+		{
+			continue;
+		}
+
+		// a miss for every whole deadline the task has been quiet
+		uint16_t missed = saturate16(static_cast<uint32_t>((now - supervised.lastUs) / (supervised.deadlineMs * 1000ll)));
+		if (missed > supervised.gapMisses)
+		{
+			if (miss(i, missed - supervised.gapMisses))
+			{
+				newlyStalled |= 1u << i;
+			}
+			supervised.gapMisses = missed;
+		}
+	}
+	taskEXIT_CRITICAL(&myLock);
+
+	for (size_t i = 0; newlyStalled != 0; i++, newlyStalled >>= 1)
+	{
+		if (newlyStalled & 1)
+		{
+			ESP_LOGW(SUPERVISORTAG, "%s stalled", GetName(static_cast<SupervisedTask>(i)));
+			Interlock::GetInstance()->Trip(InterlockCause::TASK_STALL, now);
+		}
+	}
+}
+
+void TaskSupervisor::GetStatus(TaskHealthRegisters &registers)
+{
+	int64_t now = esp_timer_get_time();
+
+	taskENTER_CRITICAL(&myLock);
+	registers.header.TASKS = static_cast<uint16_t>(SupervisedTask::COUNT);
+	registers.header.STALLED = myStalled;
+	registers.header.RESERVED[0] = 0;
+	registers.header.RESERVED[1] = 0;
+
+	for (size_t i = 0; i < static_cast<size_t>(SupervisedTask::COUNT); i++)
+	{
+		const Supervised &supervised = myTasks[i];
+		TaskHealthEntry &entry = registers.entries[i];
+		uint32_t sinceUs = supervised.registered ? static_cast<uint32_t>(now - supervised.lastUs) : 0;
+
+		if (!supervised.registered)
+		{
+			entry.STATE = static_cast<uint16_t>(TaskState::NOT_STARTED);
+		}
+		else if (myStalled & (1u << i))
+		{
+			entry.STATE = static_cast<uint16_t>(TaskState::STALLED);
+		}
+		else if (sinceUs > supervised.deadlineMs * 1000)
+		{
+			entry.STATE = static_cast<uint16_t>(TaskState::LATE);
+		}
+		else if (!supervised.started)
+		{
+			entry.STATE = static_cast<uint16_t>(TaskState::NOT_STARTED);
+		}
+		else
+		{
+			entry.STATE = static_cast<uint16_t>(TaskState::OK);
+		}
+
+		entry.PERIOD_MS = saturate16(supervised.periodMs);
+		entry.DEADLINE_MS = saturate16(supervised.deadlineMs);
+		entry.MISSES = supervised.misses;
+		entry.LAST_INTERVAL_MS = saturate16(supervised.lastIntervalUs / 1000);
+		entry.MAX_INTERVAL_MS = saturate16(supervised.maxIntervalUs / 1000);
+		entry.JITTER_P99_US = saturate16(supervised.jitter.GetPercentile(0.99f));
+		entry.SINCE_LAST_MS = saturate16(sinceUs / 1000);
+	}
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void TaskSupervisor::GetJitter(SupervisedTask task, LatencyHistogram &jitter)
+{
+	taskENTER_CRITICAL(&myLock);
+	jitter = myTasks[static_cast<size_t>(task)].jitter;
+	taskEXIT_CRITICAL(&myLock);
+}
+
+void TaskSupervisor::ClearStats()
+{
+	taskENTER_CRITICAL(&myLock);
+	for (Supervised &supervised : myTasks)
+	{
+		supervised.misses = 0;
+		supervised.lastIntervalUs = 0;
+		supervised.maxIntervalUs = 0;
+		supervised.jitter.Reset();
+	}
+	taskEXIT_CRITICAL(&myLock);
+}
+
+const char *TaskSupervisor::GetName(SupervisedTask task)
+{
+	static const char *names[] = {"pid", "heat rate", "thermocouple", "error check", "history", "link supervisor", "status overlay", "current"};
+	static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(SupervisedTask::COUNT), "a SupervisedTask without a name");
+
+	return names[static_cast<size_t>(task)];
+}
+
+void TaskSupervisor::supervisorTask(void *pvParameter)
+{
+	TaskSupervisor *instance = static_cast<TaskSupervisor *>(pvParameter);
+	TickType_t lastWake = xTaskGetTickCount();
+
+	// fails harmlessly if the task watchdog is turned off in menuconfig
+	esp_task_wdt_add(nullptr);
+
+	while (42)
+	{
+		vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(TASK_SUPERVISOR_PERIOD_MS));
+		instance->check();
+		esp_task_wdt_reset();
+	}
+}
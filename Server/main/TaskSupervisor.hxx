@@ -0,0 +1,69 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modbus/LinkStats.hxx"
+#include "modbus/TaskHealth.hxx"
+
+// Watches the periodic tasks, see modbus/TaskHealth.hxx. A task registers its period and deadline once and
+// calls CheckIn() every cycle. The supervisor task itself is on the ESP-IDF task watchdog, so a stall there
+// resets the chip.
+class TaskSupervisor
+{
+public:
+	TaskSupervisor();
+
+	static TaskSupervisor *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new TaskSupervisor();
+		}
+		return myInstance;
+	}
+
+	// from the task, just before its loop. A critical task that misses TASK_MISSES_TO_STALL deadlines in a
+	// row trips the interlock.
+	void Register(SupervisedTask task, uint32_t periodMs, uint32_t deadlineMs, bool critical);
+
+	void CheckIn(SupervisedTask task);
+
+	void GetStatus(TaskHealthRegisters &registers);
+
+	// distance of each interval from the period, microseconds
+	void GetJitter(SupervisedTask task, LatencyHistogram &jitter);
+
+	// the miss counts, intervals and jitter, not whether a task is stalled
+	void ClearStats();
+
+	static const char *GetName(SupervisedTask task);
+
+private:
+	static TaskSupervisor *myInstance;
+	static void supervisorTask(void *pvParameter);
+
+	void check();
+	// caller holds myLock, returns true if the task's stalled state changed
+	bool miss(size_t index, uint16_t count);
+
+	struct Supervised
+	{
+		bool registered;
+		bool started; // checked in at least once, the first check-in has no interval to measure
+		bool critical;
+		uint32_t periodMs;
+		uint32_t deadlineMs;
+		int64_t lastUs;
+		uint32_t lastIntervalUs;
+		uint32_t maxIntervalUs;
+		uint16_t misses;
+		uint16_t consecutive; // misses since the last check-in that was on time
+		uint16_t gapMisses;	  // misses the supervisor has counted for the current silence
+		LatencyHistogram jitter;
+	};
+
+	portMUX_TYPE myLock = portMUX_INITIALIZER_UNLOCKED;
+	Supervised myTasks[static_cast<size_t>(SupervisedTask::COUNT)] = {};
+	uint16_t myStalled = 0; // a bit per task
+};
@@ -0,0 +1,116 @@
+#include "TelemetryLink.hxx"
+#include "LinkSupervisor.hxx"
+#include "Server.hxx"
+#include "State.hxx"
+#include "TempController.hxx"
+#include "hardware.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char *TELEMETRYTAG = "TelemetryLink";
+
+TelemetryLink::TelemetryLink(std::shared_ptr<PL::Uart> aUart) : myUart(aUart)
+{
+}
+
+void TelemetryLink::Run(uint16_t periodMs, uint16_t timeoutMs)
+{
+	const TickType_t period = pdMS_TO_TICKS(periodMs < LINK_TELEMETRY_MIN_PERIOD_MS ? LINK_TELEMETRY_MIN_PERIOD_MS : periodMs);
+	const TickType_t timeout = pdMS_TO_TICKS(timeoutMs);
+	uint32_t startFrames = myDecoder.GetFrames();
+	uint32_t startErrors = myDecoder.GetErrors();
+
+	ESP_LOGI(TELEMETRYTAG, "Streaming telemetry every %u ms", periodMs);
+
+	TickType_t lastHeard = xTaskGetTickCount();
+	TickType_t lastSent = 0;
+	uint8_t buffer[64];
+
+	while (xTaskGetTickCount() - lastHeard < timeout)
+	{
+		if (lastSent == 0 || xTaskGetTickCount() - lastSent >= period)
+		{
+			lastSent = xTaskGetTickCount();
+			sendTelemetry();
+		}
+
+		size_t readable = myUart->GetReadableSize();
+		if (readable == 0)
+		{
+			vTaskDelay(pdMS_TO_TICKS(LINK_TELEMETRY_POLL_MS));
+			continue;
+		}
+
+		size_t size = readable < sizeof(buffer) ? readable : sizeof(buffer);
+		if (myUart->Read(buffer, size) != ESP_OK)
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < size; i++)
+		{
+			if (myDecoder.Push(buffer[i]))
+			{
+				lastHeard = xTaskGetTickCount();
+				LinkSupervisor::GetInstance()->Alive();
+				handleFrame();
+			}
+		}
+	}
+
+	ESP_LOGW(TELEMETRYTAG, "Frontend went quiet, back to RTU (%lu frames, %lu bad)",
+			 myDecoder.GetFrames() - startFrames, myDecoder.GetErrors() - startErrors);
+}
+
+void TelemetryLink::sendTelemetry()
+{
+	TempController *controller = TempController::GetInstance();
+	State *state = State::GetInstance();
+
+	TelemetryPacket packet = {
+		.sequence = mySequence++,
+		.timeMs = static_cast<uint32_t>(esp_timer_get_time() / 1000),
+		.tempDc = static_cast<int16_t>(controller->GetCurrentTemp() * 10.0f),
+		.targetDc = static_cast<int16_t>(controller->GetTargetTemp() * 10.0f),
+		.duty = static_cast<uint16_t>(controller->GetPwmDutyCycle()),
+		.errorCode = static_cast<uint16_t>(state->GetError()),
+		.flags = static_cast<uint8_t>((state->IsEnabled() ? TELEMETRY_ENABLED : 0) | (state->HasError() ? TELEMETRY_ERROR : 0)),
+	};
+
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	send(frame, EncodeFrame(PacketType::TELEMETRY, packet, frame, sizeof(frame)));
+}
+
+void TelemetryLink::handleFrame()
+{
+	if (myDecoder.GetType() != PacketType::COMMAND)
+	{
+		// keepalives only need to refresh lastHeard
+		return;
+	}
+
+	CommandPacket command;
+	if (!myDecoder.Get(command))
+	{
+		return;
+	}
+
+	CommandAckPacket ack = {
+		.sequence = command.sequence,
+		.status = Server::GetInstance()->ApplyCommand(command),
+	};
+
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	send(frame, EncodeFrame(PacketType::COMMAND_ACK, ack, frame, sizeof(frame)));
+}
+
+void TelemetryLink::send(const uint8_t *frame, size_t size)
+{
+	if (size > 0)
+	{
+		myUart->Write(frame, size);
+	}
+}
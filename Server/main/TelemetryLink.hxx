@@ -0,0 +1,27 @@
+#pragma once
+
+#include "telemetry/Telemetry.hxx"
+
+#include <memory>
+#include <pl_uart.h>
+
+// Server end of the telemetry link mode (see telemetry/Telemetry.hxx). Takes over the UART from the Modbus
+// server while it runs.
+class TelemetryLink
+{
+public:
+	TelemetryLink(std::shared_ptr<PL::Uart> aUart);
+
+	// Streams telemetry every periodMs and applies commands until nothing valid has arrived from the
+	// Frontend for timeoutMs, then returns so the caller can go back to RTU.
+	void Run(uint16_t periodMs, uint16_t timeoutMs);
+
+private:
+	std::shared_ptr<PL::Uart> myUart;
+	FrameDecoder myDecoder;
+	uint16_t mySequence = 0;
+
+	void sendTelemetry();
+	void handleFrame();
+	void send(const uint8_t *frame, size_t size);
+};
@@ -6,10 +6,14 @@
 #include "sdkconfig.h"
 #include <algorithm>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <stdio.h>
 
+#include "CurrentMonitor.hxx"
 #include "GPIO.hxx"
+#include "Interlock.hxx"
 #include "State.hxx"
+#include "TaskSupervisor.hxx"
 #include "TempController.hxx"
 
 #include "TempDevice.hxx"
@@ -17,6 +21,8 @@
 
 const char *TCTAG = "TempController";
 
+static const ErrorCode THERMAL_MODEL_FAULTS[] = {ErrorCode::HEATING_UNCOMMANDED, ErrorCode::HEATING_FAILED, ErrorCode::SENSOR_DETACHED};
+
 bool isInRange(int value, int min, int max)
 {
 	return value > min && value < max;
@@ -37,6 +43,8 @@ TempController::TempController(TempDevice *aTempDevice, SPIBusManager *aBusManag
 	myRelayState = new bool(false);
 
 	initPID();
+	fillConfigValues(myConfig, mySetTemp, myConfigResult.values);
+	PublishRegisterImage();
 
 	xTaskCreate(&pidTask, "pid_task", 2048 * 2, this, 6, NULL);
 	xTaskCreate(&heatRateTask, "heatRateTask", 2048 * 2, this, 7, NULL);
@@ -69,8 +77,11 @@ void TempController::pidTask(void *pvParameter)
 	TempDevice *thermocouple = instance->myTempDevice;
 	GPIOManager *gpio = GPIOManager::GetInstance();
 	State *state = State::GetInstance();
+	Interlock *interlock = Interlock::GetInstance();
 	const int loopDelayMs = 250;
 	TempResult result;
+	int64_t lastSampledUs = 0;
+	float appliedDuty = 0; // what the heater got since the last tick
 
 	if (instance == nullptr)
 	{
@@ -78,8 +89,13 @@ void TempController::pidTask(void *pvParameter)
 		abort();
 	}
 
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::PID, loopDelayMs, 2 * loopDelayMs, true);
+
 	while (42)
 	{
+		supervisor->CheckIn(SupervisedTask::PID);
+
 		if (gpio == nullptr)
 		{
 			ESP_LOGE(TCTAG, "GPIOManager instance is null");
@@ -87,20 +103,31 @@ void TempController::pidTask(void *pvParameter)
 			continue;
 		}
 
+		// a config that arrived during the last tick takes effect here, all of it before the PID runs again
+		instance->applyStagedConfig();
+
 		result = thermocouple->GetResult();
+		int64_t sampledUs = esp_timer_get_time();
 
 		float highLimit = std::min<float>((float)*instance->myInternalSetTemp + 50, MAX_TEMP);
 
+		// the interlock cuts the heater here and now, and sets TEMP_RANGE_HIGH / THERMOCOUPLE_ERROR for us
 		if (result.thermocouple_c > highLimit)
 		{
-			state->SetError(ErrorCode::TEMP_RANGE_HIGH);
+			interlock->Trip(InterlockCause::OVER_TEMP, sampledUs);
 		}
 		else
 		{
-			if (state->IsErrorSet(ErrorCode::TEMP_RANGE_HIGH))
-			{
-				state->ClearError(ErrorCode::TEMP_RANGE_HIGH);
-			}
+			interlock->Release(InterlockCause::OVER_TEMP);
+		}
+
+		if (result.fault != TempFault::NONE)
+		{
+			interlock->Trip(InterlockCause::THERMOCOUPLE_FAULT, sampledUs);
+		}
+		else
+		{
+			interlock->Release(InterlockCause::THERMOCOUPLE_FAULT);
 		}
 
 		if (result.thermocouple_c < MIN_TEMP)
@@ -115,6 +142,31 @@ void TempController::pidTask(void *pvParameter)
 			}
 		}
 
+		// a reading we can't trust, or an open door letting the heat out, says nothing about the heater
+		if (result.fault == TempFault::NONE && result.thermocouple_c >= MIN_TEMP && !gpio->isDoorOpen())
+		{
+			float dt = lastSampledUs != 0 ? (sampledUs - lastSampledUs) / 1000000.0f : 0;
+			ErrorCode faults = instance->myThermalMonitor.Update(result.thermocouple_c, appliedDuty, dt);
+			lastSampledUs = sampledUs;
+
+			for (ErrorCode fault : THERMAL_MODEL_FAULTS)
+			{
+				if ((faults & fault) == fault)
+				{
+					state->SetError(fault);
+				}
+				else
+				{
+					state->ClearError(fault);
+				}
+			}
+		}
+		else
+		{
+			instance->myThermalMonitor.Reset();
+			lastSampledUs = 0;
+		}
+
 		*instance->myCurrentTemp = result.thermocouple_c;
 
 		if (!state->HasError() && state->IsEnabled())
@@ -144,18 +196,170 @@ void TempController::pidTask(void *pvParameter)
 			}
 		}
 
+		// the soft PWM doesn't start a cycle while disabled or tripped
+		bool heating = state->IsEnabled() && !interlock->IsTripped();
+		appliedDuty = heating ? static_cast<float>(instance->SSR_CURRENT_PWM) / instance->myConfig.SSR_FULL_PWM : 0;
+
+		instance->PublishRegisterImage();
+
 		vTaskDelay(loopDelayMs / portTICK_PERIOD_MS);
 	}
 }
 
+void TempController::PublishRegisterImage()
+{
+	State *state = State::GetInstance();
+	ServerRegisters image = {};
+
+	image.coils.ENABLE = state->IsEnabled();
+	image.discreteInputs.ERROR = state->HasError();
+
+	taskENTER_CRITICAL(&myConfigLock);
+	fillConfigValues(myConfig, mySetTemp, reinterpret_cast<uint16_t *>(&image.holding));
+	image.configResult = myConfigResult;
+	taskEXIT_CRITICAL(&myConfigLock);
+
+	image.inputs.HEATER_PWM_DUTY_CYCLE = SSR_CURRENT_PWM;
+	image.inputs.CURRENT_TEMP = *myCurrentTemp;
+	image.inputs.ERROR_CODE = static_cast<uint16_t>(state->GetError());
+
+	taskENTER_CRITICAL(&myRegisterImageLock);
+	myRegisterImage.Publish(image);
+	taskEXIT_CRITICAL(&myRegisterImageLock);
+}
+
+// In HoldingRegisters order, the heater reduced value is served as a percentage of full power
+void TempController::fillConfigValues(const Config &config, double targetTemp, uint16_t *values)
+{
+	HoldingRegisters &registers = *reinterpret_cast<HoldingRegisters *>(values);
+
+	registers.HEATER_REDUCE_PWM_UNDER = config.SSR_REDUCED_PWM_UNDER;
+	registers.HEATER_REDUCED_PWM_VALUE = config.SSR_REDUCED_PWM_VALUE * 100 / config.SSR_FULL_PWM;
+	registers.HEATER_PERIOD = config.PWM_PERIOD_MS;
+	registers.P = config.P;
+	registers.I = config.I;
+	registers.D = config.D;
+	registers.TARGET_TEMP = targetTemp;
+	registers.PID_WINDOW = config.SSR_BANG_BANG_WINDOW;
+}
+
+TempController::Config TempController::GetLatestConfig(double &targetTemp)
+{
+	taskENTER_CRITICAL(&myConfigLock);
+	Config config = myConfigStaged ? myStagedConfig : myConfig;
+	targetTemp = myConfigStaged ? myStagedTargetTemp : mySetTemp;
+	taskEXIT_CRITICAL(&myConfigLock);
+
+	return config;
+}
+
+bool TempController::IsValidConfig(const Config &config, double targetTemp)
+{
+	if (config.P < 0 || config.I < 0 || config.D < 0)
+	{
+		return false;
+	}
+
+	if (config.PWM_PERIOD_MS < CONFIG_MIN_PWM_PERIOD_MS || config.PWM_PERIOD_MS > CONFIG_MAX_PWM_PERIOD_MS)
+	{
+		return false;
+	}
+
+	if (config.SSR_REDUCED_PWM_VALUE < config.SSR_OFF_PWM || config.SSR_REDUCED_PWM_VALUE > config.SSR_FULL_PWM)
+	{
+		return false;
+	}
+
+	if (config.SSR_REDUCED_PWM_UNDER < 0 || config.SSR_REDUCED_PWM_UNDER > MAX_TEMP)
+	{
+		return false;
+	}
+
+	if (config.SSR_BANG_BANG_WINDOW < 0 || config.SSR_BANG_BANG_WINDOW > CONFIG_MAX_BANG_BANG_WINDOW)
+	{
+		return false;
+	}
+
+	return targetTemp >= 0 && targetTemp <= MAX_TEMP;
+}
+
+bool TempController::StageConfig(const Config &config, double targetTemp, uint16_t transactionId)
+{
+	bool valid = IsValidConfig(config, targetTemp);
+
+	taskENTER_CRITICAL(&myConfigLock);
+	myConfigResult.TRANSACTION_ID = transactionId;
+	if (valid)
+	{
+		myStagedConfig = config;
+		myStagedTargetTemp = targetTemp;
+		myConfigStaged = true;
+		myConfigResult.STATUS = static_cast<uint16_t>(ConfigStatus::PENDING);
+	}
+	else
+	{
+		// values keeps describing the config that is still running
+		myConfigResult.STATUS = static_cast<uint16_t>(ConfigStatus::REJECTED);
+	}
+	taskEXIT_CRITICAL(&myConfigLock);
+
+	if (!valid)
+	{
+		ESP_LOGW(TCTAG, "Config transaction %u rejected, a value is out of range", transactionId);
+	}
+
+	PublishRegisterImage();
+	return valid;
+}
+
+void TempController::applyStagedConfig()
+{
+	taskENTER_CRITICAL(&myConfigLock);
+	bool staged = myConfigStaged;
+	int oldPeriodMs = myConfig.PWM_PERIOD_MS;
+	if (staged)
+	{
+		myConfig = myStagedConfig;
+		mySetTemp = myStagedTargetTemp;
+		myConfigStaged = false;
+		myConfigResult.STATUS = static_cast<uint16_t>(ConfigStatus::APPLIED);
+		fillConfigValues(myConfig, mySetTemp, myConfigResult.values);
+	}
+	taskEXIT_CRITICAL(&myConfigLock);
+
+	if (!staged)
+	{
+		return;
+	}
+
+	if (myConfig.PWM_PERIOD_MS != oldPeriodMs)
+	{
+		// AutoPIDRelay has no way to change its pulse width, a new one starts over with an empty integral.
+		// Only pidTask runs it, so it can be swapped here.
+		delete myAutoPIDRelay;
+		createPIDRelay();
+	}
+	else
+	{
+		myAutoPIDRelay->setGains(myConfig.P, myConfig.I, myConfig.D);
+		myAutoPIDRelay->setBangBang(myConfig.SSR_BANG_BANG_WINDOW);
+	}
+
+	ESP_LOGI(TCTAG, "Config transaction %u applied", myConfigResult.TRANSACTION_ID);
+}
+
 void TempController::initPID()
 {
-	myAutoPIDRelay = new AutoPIDRelay(myCurrentTemp, myInternalSetTemp, myRelayState, myConfig.PWM_PERIOD_MS, myConfig.P, myConfig.D, myConfig.I);
+	createPIDRelay();
+	initSSR();
+}
+
+void TempController::createPIDRelay()
+{
+	myAutoPIDRelay = new AutoPIDRelay(myCurrentTemp, myInternalSetTemp, myRelayState, myConfig.PWM_PERIOD_MS, myConfig.P, myConfig.I, myConfig.D);
 	myAutoPIDRelay->setBangBang(myConfig.SSR_BANG_BANG_WINDOW);
 	myAutoPIDRelay->setTimeStep(1000);
 	myAutoPIDRelay->setOutputRange(myConfig.SSR_OFF_PWM, myConfig.SSR_FULL_PWM);
-
-	initSSR();
 }
 
 void TempController::initSSR()
@@ -168,7 +372,7 @@ void TempController::initSSR()
 		.intr_type = GPIO_INTR_DISABLE};
 
 	gpio_config(&io_conf);
-	gpio_set_level(HEATER_SSR_PIN, 0);
+	switchSSR(false);
 	mySoftPwmTimer = xTimerCreate(
 		"SoftPWM_Timer",
 		pdMS_TO_TICKS(myConfig.PWM_PERIOD_MS),
@@ -200,7 +404,7 @@ void TempController::setSSRDutyCycle(int duty)
 		SSR_CURRENT_PWM = myConfig.SSR_OFF_PWM;
 
 		// Immediately turn off SSR for safety
-		gpio_set_level(HEATER_SSR_PIN, 0);
+		switchSSR(false);
 		return;
 	}
 	SSR_CURRENT_PWM = duty;
@@ -214,6 +418,12 @@ void TempController::setSSRDutyCycle(int duty)
 	ESP_LOGD(TCTAG, "SSR duty cycle set to %d/%d", duty, myConfig.SSR_FULL_PWM);
 }
 
+void TempController::switchSSR(bool on)
+{
+	gpio_set_level(HEATER_SSR_PIN, on ? 1 : 0);
+	CurrentMonitor::SsrSwitched(on);
+}
+
 void TempController::softPwmTimerCallback(TimerHandle_t xTimer)
 {
 	TempController *instance = static_cast<TempController *>(pvTimerGetTimerID(xTimer));
@@ -234,22 +444,29 @@ void TempController::updateSoftPwm()
 
 	uint32_t currentTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
 
+	// pidTask can apply a new config while the timer task is in here
+	taskENTER_CRITICAL(&myConfigLock);
+	uint32_t periodMs = myConfig.PWM_PERIOD_MS;
+	int fullPwm = myConfig.SSR_FULL_PWM;
+	taskEXIT_CRITICAL(&myConfigLock);
+
 	// At the start of each PWM cycle
-	if (currentTime - cycleStartTime >= myConfig.PWM_PERIOD_MS && state->IsEnabled())
+	if (currentTime - cycleStartTime >= periodMs && state->IsEnabled() && !Interlock::GetInstance()->IsTripped())
 	{
 		cycleStartTime = currentTime;
 		currentDuty = SSR_CURRENT_PWM;
 
 		// Calculate on-time based on duty cycle (0-1023)
-		int onTimeMs = (currentDuty * myConfig.PWM_PERIOD_MS) / myConfig.SSR_FULL_PWM;
+		uint32_t onTimeMs = (currentDuty * periodMs) / fullPwm;
 
 		if (onTimeMs > 0)
 		{
-			// Turn on the SSR
-			gpio_set_level(HEATER_SSR_PIN, 1);
+			// Turn on the SSR, through the interlock in case it tripped since the check above. If it did the
+			// off time still gets scheduled, and the cycle after sees the trip
+			Interlock::GetInstance()->SwitchHeaterOn();
 
 			// If not full duty cycle, schedule the off time
-			if (onTimeMs < myConfig.PWM_PERIOD_MS)
+			if (onTimeMs < periodMs)
 			{
 				// Schedule timer to fire after on-time for turn-off
 				xTimerChangePeriod(mySoftPwmTimer, pdMS_TO_TICKS(onTimeMs), 0);
@@ -259,8 +476,8 @@ void TempController::updateSoftPwm()
 		else
 		{
 			// Zero duty cycle - keep SSR off
-			gpio_set_level(HEATER_SSR_PIN, 0);
-			xTimerChangePeriod(mySoftPwmTimer, pdMS_TO_TICKS(myConfig.PWM_PERIOD_MS - (currentTime - cycleStartTime)), 0);
+			switchSSR(false);
+			xTimerChangePeriod(mySoftPwmTimer, pdMS_TO_TICKS(periodMs - (currentTime - cycleStartTime)), 0);
 
 			return;
 		}
@@ -268,10 +485,10 @@ void TempController::updateSoftPwm()
 	else
 	{
 		// This is the off-time portion of the cycle
-		gpio_set_level(HEATER_SSR_PIN, 0);
+		switchSSR(false);
 
 		// Reset timer to full period for next cycle
-		xTimerChangePeriod(mySoftPwmTimer, pdMS_TO_TICKS(myConfig.PWM_PERIOD_MS - (currentTime - cycleStartTime)), 0);
+		xTimerChangePeriod(mySoftPwmTimer, pdMS_TO_TICKS(periodMs - (currentTime - cycleStartTime)), 0);
 	}
 }
 
@@ -285,8 +502,14 @@ void TempController::heatRateTask(void *pvParam)
 	float iterationTempIncrease = 0;
 	float heatingRate = 0;
 
+	// a stalled ramp only holds the setpoint where it is, so this one doesn't cut the heater
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::HEAT_RATE, static_cast<uint32_t>(HEATING_RATE_TASK_PERIOD_MS), static_cast<uint32_t>(2 * HEATING_RATE_TASK_PERIOD_MS), false);
+
 	while (42)
 	{
+		supervisor->CheckIn(SupervisedTask::HEAT_RATE);
+
 		if (instance == nullptr)
 		{
 			ESP_LOGE(TCTAG, "instance is null");
@@ -17,7 +17,10 @@
 
 #include "SPIBus.hxx"
 #include "TempDevice.hxx"
+#include "ThermalMonitor.hxx"
+#include "hardware.h"
 #include "modbus/Proto.hxx"
+#include "modbus/RegisterImage.hxx"
 
 class TempController
 {
@@ -69,13 +72,16 @@ public:
 		return *myInternalSetTemp;
 	}
 
-	void SetConfig(Config config)
-	{
-		myConfig = config;
+	// the staged config and target if there is one waiting for the next control tick, otherwise the running ones
+	Config GetLatestConfig(double &targetTemp);
 
-		// todo Save it
-		// todo set the pid params
-	}
+	// Checks a whole config, and the target temp that goes with it, against the limits in hardware.h
+	static bool IsValidConfig(const Config &config, double targetTemp);
+
+	// Stages config and targetTemp to be applied together at the start of the next control tick. Returns false
+	// and stages nothing if any of it is out of range. The outcome is published in the register image's
+	// configResult under transactionId, 0 for a plain holding register write.
+	bool StageConfig(const Config &config, double targetTemp, uint16_t transactionId);
 
 	float GetTargetTemp()
 	{
@@ -84,7 +90,20 @@ public:
 
 	void SetTargetTemp(double temp)
 	{
+		taskENTER_CRITICAL(&myConfigLock);
 		mySetTemp = temp;
+		myStagedTargetTemp = temp;
+		taskEXIT_CRITICAL(&myConfigLock);
+	}
+
+	// Lowers the PID's internal setpoint to temp if it's above it. The heating rate task only ever ramps that
+	// up, so anything bringing the target down quickly has to call this as well.
+	void CapInternalSetTemp(double temp)
+	{
+		if (*myInternalSetTemp > temp)
+		{
+			*myInternalSetTemp = temp;
+		}
 	}
 
 	float GetCurrentTemp()
@@ -104,7 +123,25 @@ public:
 
 	void SetHeatingRate(float rate)
 	{
+		// a staged config was copied before this, it mustn't put the old rate back
+		taskENTER_CRITICAL(&myConfigLock);
 		myConfig.HEATING_RATE_PER_SECOND = rate;
+		myStagedConfig.HEATING_RATE_PER_SECOND = rate;
+		taskEXIT_CRITICAL(&myConfigLock);
+	}
+
+	// Builds the registers the Modbus areas serve from the current state and makes them the latest image.
+	// Called every control loop tick, and straight after a Modbus write so the next read sees it.
+	void PublishRegisterImage();
+
+	const RegisterImage<ServerRegisters> &GetRegisterImage()
+	{
+		return myRegisterImage;
+	}
+
+	void GetThermalStatus(ThermalMonitorStatus &status)
+	{
+		myThermalMonitor.GetStatus(status);
 	}
 
 private:
@@ -133,7 +170,23 @@ private:
 
 	void initSSR();
 	void initPID();
+	void createPIDRelay(); // from myConfig
+	void applyStagedConfig();
+	static void fillConfigValues(const Config &config, double targetTemp, uint16_t *values);
 	void setSSRDutyCycle(int duty);
+	// drives HEATER_SSR_PIN and lets the CurrentMonitor know
+	void switchSSR(bool on);
 
 	AutoPIDRelay *myAutoPIDRelay = nullptr;
+	ThermalMonitor myThermalMonitor; // only pidTask updates it
+
+	// written by the Modbus tasks, taken by pidTask at the top of a tick
+	Config myStagedConfig;
+	double myStagedTargetTemp = 0;
+	bool myConfigStaged = false;
+	ConfigResult myConfigResult = {};
+	portMUX_TYPE myConfigLock = portMUX_INITIALIZER_UNLOCKED;
+
+	RegisterImage<ServerRegisters> myRegisterImage;
+	portMUX_TYPE myRegisterImageLock = portMUX_INITIALIZER_UNLOCKED; // PublishRegisterImage() has more than one caller
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "TempHistory.hxx"
+#include "TaskSupervisor.hxx"
+#include "TempController.hxx"
+#include "hardware.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+
+static const char *HISTORYTAG = "TempHistory";
+
+TempHistory *TempHistory::myInstance = nullptr;
+
+TempHistory::TempHistory()
+{
+	myInstance = this;
+
+	myMutex = xSemaphoreCreateMutex();
+	if (myMutex == nullptr)
+	{
+		ESP_LOGE(HISTORYTAG, "Failed to create history mutex");
+		assert(false);
+	}
+
+	xTaskCreate(&samplerTask, "historyTask", 2048, this, 5, NULL);
+}
+
+void TempHistory::addSample(float tempC, int duty)
+{
+	HistorySample sample = {
+		.SEQUENCE = myNextSequence,
+		.TIME_DS = static_cast<uint16_t>(esp_timer_get_time() / 100000),
+		.TEMP_DC = static_cast<int16_t>(tempC * 10.0f),
+		.DUTY = static_cast<uint16_t>(duty),
+	};
+
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	mySamples[myNextSequence % HISTORY_CAPACITY] = sample;
+	myNextSequence++;
+	xSemaphoreGive(myMutex);
+}
+
+void TempHistory::CopyTo(HistoryRegisters &registers)
+{
+	xSemaphoreTake(myMutex, portMAX_DELAY);
+	registers.header.NEXT_SEQUENCE = myNextSequence;
+	memcpy(registers.samples, mySamples, sizeof(mySamples));
+	xSemaphoreGive(myMutex);
+
+	registers.header.CAPACITY = HISTORY_CAPACITY;
+	registers.header.SAMPLE_PERIOD_MS = HISTORY_SAMPLE_PERIOD_MS;
+	registers.header.RESERVED = 0;
+}
+
+void TempHistory::samplerTask(void *pvParameter)
+{
+	TempHistory *instance = static_cast<TempHistory *>(pvParameter);
+	TickType_t lastWake = xTaskGetTickCount();
+
+	TaskSupervisor *supervisor = TaskSupervisor::GetInstance();
+	supervisor->Register(SupervisedTask::HISTORY, HISTORY_SAMPLE_PERIOD_MS, 2 * HISTORY_SAMPLE_PERIOD_MS, false);
+
+	while (42)
+	{
+		supervisor->CheckIn(SupervisedTask::HISTORY);
+
+		// fixed rate rather than fixed delay so the timestamps don't drift
+		vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(HISTORY_SAMPLE_PERIOD_MS));
+
+		TempController *controller = TempController::GetInstance();
+		if (controller == nullptr)
+		{
+			continue;
+		}
+
+		instance->addSample(controller->GetCurrentTemp(), controller->GetPwmDutyCycle());
+	}
+}
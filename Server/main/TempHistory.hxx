@@ -0,0 +1,42 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "modbus/History.hxx"
+
+// Bounded FIFO of timestamped temperature samples taken at a fixed rate, served to the Frontend
+// through the history window described in modbus/History.hxx.
+class TempHistory
+{
+public:
+	TempHistory();
+
+	static TempHistory *GetInstance()
+	{
+		if (myInstance == nullptr)
+		{
+			myInstance = new TempHistory();
+		}
+		return myInstance;
+	}
+
+	// snapshot of the whole ring in register layout
+	void CopyTo(HistoryRegisters &registers);
+
+	uint16_t GetNextSequence()
+	{
+		return myNextSequence;
+	}
+
+private:
+	static TempHistory *myInstance;
+
+	SemaphoreHandle_t myMutex;
+	HistorySample mySamples[HISTORY_CAPACITY] = {};
+	uint16_t myNextSequence = 0;
+
+	void addSample(float tempC, int duty);
+	static void samplerTask(void *pvParameter);
+};
@@ -0,0 +1,81 @@
+#include "ThermalMonitor.hxx"
+#include "hardware.h"
+
+#include <algorithm>
+
+static constexpr float LAG_S = THERMAL_MODEL_LAG_MS / 1000.0f;
+
+float ThermalMonitor::accumulate(float sum, float residual, float dt, float windowS)
+{
+	float keep = std::max(0.0f, 1.0f - dt / windowS);
+	return std::max(sum * keep + residual, 0.0f);
+}
+
+ErrorCode ThermalMonitor::Update(float temperature, float duty, float dt)
+{
+	if (!myStarted || dt <= 0)
+	{
+		myStarted = true;
+		myLastTemperature = temperature;
+		return ErrorCode::NO_ERROR;
+	}
+
+	float change = temperature - myLastTemperature;
+	float loss = THERMAL_MODEL_LOSS_PER_SECOND * (myLastTemperature - THERMAL_MODEL_AMBIENT_C) * dt;
+	float offChange = -loss;
+	float leastChange = HEATING_FAILED_MIN_FRACTION * THERMAL_MODEL_FULL_POWER_RATE * duty * dt - loss;
+	myLastTemperature = temperature;
+
+	myZeroDutyS = duty <= 0 ? myZeroDutyS + dt : 0;
+	myFullDutyS = duty >= HEATING_FAILED_MIN_DUTY ? myFullDutyS + dt : 0;
+
+	if (myZeroDutyS >= LAG_S)
+	{
+		myUncommanded = accumulate(myUncommanded, change - offChange, dt, UNCOMMANDED_HEATING_WINDOW_MS / 1000.0f);
+	}
+	else
+	{
+		myUncommanded = 0;
+	}
+
+	if (myFullDutyS >= LAG_S)
+	{
+		myShortfall = accumulate(myShortfall, leastChange - change, dt, HEATING_FAILED_WINDOW_MS / 1000.0f);
+	}
+	else
+	{
+		myShortfall = 0;
+	}
+
+	// whatever the duty, nothing cools faster than with the heater off
+	myDrop = accumulate(myDrop, offChange - change, dt, SENSOR_DETACHED_WINDOW_MS / 1000.0f);
+
+	ErrorCode faults = ErrorCode::NO_ERROR;
+	if (myUncommanded >= UNCOMMANDED_HEATING_RISE_C)
+	{
+		faults |= ErrorCode::HEATING_UNCOMMANDED;
+	}
+	if (myDrop >= SENSOR_DETACHED_DROP_C)
+	{
+		faults |= ErrorCode::SENSOR_DETACHED;
+	}
+	else if (myShortfall >= HEATING_FAILED_SHORTFALL_C && myDrop < myShortfall / 4)
+	{
+		// a detached sensor falls short too. A dead heater leaves the furnace cooling about as the model says,
+		// so only blame the heater if it isn't falling well beyond that.
+		faults |= ErrorCode::HEATING_FAILED;
+	}
+	return faults;
+}
+
+void ThermalMonitor::Reset()
+{
+	*this = ThermalMonitor();
+}
+
+void ThermalMonitor::GetStatus(ThermalMonitorStatus &status)
+{
+	status.uncommandedHeating = myUncommanded / UNCOMMANDED_HEATING_RISE_C;
+	status.heatingFailed = myShortfall / HEATING_FAILED_SHORTFALL_C;
+	status.sensorDetached = myDrop / SENSOR_DETACHED_DROP_C;
+}
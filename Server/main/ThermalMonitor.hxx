@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Errors.hxx"
+
+#include <cstdint>
+
+// evidence for each fault as a fraction of its threshold, 1 or more means the fault is present
+struct ThermalMonitorStatus
+{
+	float uncommandedHeating;
+	float heatingFailed;
+	float sensorDetached;
+};
+
+// Checks the thermocouple against what a first order thermal model says the furnace should be doing:
+//   dT/dt = THERMAL_MODEL_FULL_POWER_RATE * duty - THERMAL_MODEL_LOSS_PER_SECOND * (T - THERMAL_MODEL_AMBIENT_C)
+// Every sample adds the difference between the actual and the predicted change to a leaky sum per fault,
+// which forgets over that fault's window. Noise cancels out in the sum, a welded SSR, a dead element or a
+// thermocouple that fell out of the load doesn't.
+// - HEATING_UNCOMMANDED, rising faster than it can with the heater off
+// - HEATING_FAILED, rising slower than HEATING_FAILED_MIN_FRACTION of the model at (near) full duty
+// - SENSOR_DETACHED, falling faster than it could even with the heater off
+// The duty conditions only count once the duty has been in them for THERMAL_MODEL_LAG_MS, so the heat still
+// in the element after a change isn't taken for a fault.
+class ThermalMonitor
+{
+public:
+	// temperature is a fresh sample, duty (0 to 1) what was applied since the last one, dt seconds since it.
+	// Returns the faults whose evidence is over its threshold.
+	ErrorCode Update(float temperature, float duty, float dt);
+
+	// forgets everything, the next sample starts afresh
+	void Reset();
+
+	void GetStatus(ThermalMonitorStatus &status);
+
+private:
+	// S = S * (1 - dt / window) + residual, never below 0 so evidence the other way can't be banked against a
+	// fault that comes later
+	static float accumulate(float sum, float residual, float dt, float windowS);
+
+	bool myStarted = false;
+	float myLastTemperature = 0;
+	float myZeroDutyS = 0; // how long the duty has been off
+	float myFullDutyS = 0; // how long the duty has been at or above HEATING_FAILED_MIN_DUTY
+
+	float myUncommanded = 0; // degrees risen above the heater off prediction
+	float myShortfall = 0;	 // degrees short of the least the heater should manage
+	float myDrop = 0;		 // degrees fallen below the heater off prediction
+};
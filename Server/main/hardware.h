@@ -2,6 +2,7 @@
 
 #include "driver/uart.h"
 #include "pl_uart_types.h"
+#include <cstddef>
 #include <cstdint>
 #include <soc/gpio_num.h>
 
@@ -14,18 +15,60 @@ static constexpr bool EMERGENCY_RELAY_ON = false; // emergency relay is shutting
 static constexpr gpio_num_t DOOR_SWITCH_PIN = GPIO_NUM_5;
 static constexpr gpio_num_t ENABLE_SWITCH_PIN = GPIO_NUM_16;
 static constexpr gpio_num_t CURRENT_SENSOR_PIN = GPIO_NUM_34;
+static constexpr bool CURRENT_SENSOR_FITTED = false; // a current transformer, biased to mid rail, on CURRENT_SENSOR_PIN. Leave false if the pin is floating, it would trip the interlock
 
 static constexpr gpio_num_t MAX31856_SPI3_CLK = GPIO_NUM_23;
 static constexpr gpio_num_t MAX31856_SPI3_MOSI = GPIO_NUM_19;
 static constexpr gpio_num_t MAX31856_SPI3_MISO = GPIO_NUM_18;
 static constexpr gpio_num_t MAX31856_SPI3_CS = GPIO_NUM_27;
+static constexpr gpio_num_t MAX31856_FAULT_PIN = GPIO_NUM_NC; // the MAX31856 FAULT output trips the interlock straight from its interrupt, GPIO_NUM_NC if it isn't wired
 
-static constexpr uint32_t DEBOUNCE_DELAY_MS = 50; // debounce delay in milliseconds
+static constexpr uint32_t DEBOUNCE_DELAY_MS = 50;		   // debounce delay in milliseconds, a switch must be quiet this long before its new level counts
+static constexpr uint32_t DEBOUNCE_SAMPLE_PERIOD_MS = 10; // how often the debounce sampler looks for settled switches, at least a tick
+
+static constexpr float CURRENT_SENSOR_AMPS_PER_VOLT = 30.0f; // RMS amps per RMS volt across the burden
+static constexpr float CURRENT_ON_THRESHOLD_A = 1.0f;		  // RMS current that counts as the heater drawing power
+static constexpr uint32_t CURRENT_SAMPLES_PER_HALF_CYCLE = 200; // ADC DMA samples per half mains cycle, 24 kHz at 60 Hz. The ADC won't go below 20 kHz
+static constexpr uint32_t CURRENT_SSR_SETTLE_MS = 10;			  // a zero crossing SSR switches within half a cycle, a half cycle starting sooner after a switch is skipped
+static constexpr uint16_t CURRENT_FAULT_HALF_CYCLES = 6;		  // checked half cycles that disagree with the SSR before the interlock trips, one that agrees in the same SSR state starts again. Needs on and off times over CURRENT_SSR_SETTLE_MS plus a half cycle to see anything
+static constexpr uint32_t CURRENT_MONITOR_DEADLINE_MS = 500;	  // longest the current monitor may go without a frame, a flash erase stalls the ADC's DMA and this task for a few hundred ms
+static constexpr float MAINS_VOLTAGE_RMS = 240.0f;				  // across the element, for the apparent power
+
+static constexpr float HEATER_ELEMENT_POWER_W = 5000.0f;	  // at MAINS_VOLTAGE_RMS, the energy meter goes by this and the SSR on time when there's no current sensor
+static constexpr uint32_t ENERGY_METER_PERIOD_MS = 1000;	  // how often the delivered energy is added up
+static constexpr uint32_t ENERGY_SEGMENT_MIN_S = 60;		  // a setpoint change within this long of its segment starting stays in it, so nudging the setpoint doesn't use up segments
+static constexpr uint32_t ENERGY_SAVE_PERIOD_S = 600;		  // the counters are written to NVS this often while they're changing
+static constexpr uint32_t ENERGY_SAVE_MIN_INTERVAL_S = 60;	  // and never more often than this, the end of a melt included, to spare the flash
+
+static constexpr uint32_t CONSOLE_TASK_STACK_SIZE = 8192; // the console commands copy their statistics onto the stack to print them, a few hundred bytes each
+
+static constexpr size_t EVENT_QUEUE_DEPTH = 16; // events each event bus subscriber can fall behind by before its events are dropped
 
 static constexpr uart_port_t MODBUS_UART_PORT = UART_NUM_1;
 // static constexpr uart_port_t MODBUS_UART_PORT = UART_NUM_0;
 static constexpr gpio_num_t MODBUS_TX = GPIO_NUM_13;
 static constexpr gpio_num_t MODBUS_RX = GPIO_NUM_14;
+static constexpr int MODBUS_BAUD_RATE = 115200;
+static constexpr uint8_t MODBUS_UNIT_ID = 1;
+static constexpr bool MODBUS_RS485 = false;				 // half duplex RS-485 transceiver on the Modbus UART instead of a TTL link, for long cable runs
+static constexpr gpio_num_t MODBUS_DE_PIN = GPIO_NUM_25; // transceiver DE, driven by the UART's RTS when MODBUS_RS485 is set. Tie /RE low, collision detection reads back what's sent
+static constexpr size_t TRAFFIC_RECORDER_SIZE = 16384;	 // RAM kept for the last RTU traffic, 'traffic dump' prints it. 0 to leave the recorder out
+
+static constexpr uint16_t MODBUS_TCP_PORT = 502;
+static constexpr size_t MODBUS_TCP_MAX_CLIENTS = 2;		// each client holds a socket and a request buffer, keep this small
+static constexpr uint32_t MODBUS_TCP_RETRY_MS = 5000;	// how often to retry starting the TCP server until the network is up
+static constexpr bool MODBUS_TCP_WRITES_ENABLED = false;	// the TCP socket has no authentication, leave this off to keep it read only so nobody on the network can heat the furnace
+
+static constexpr uint32_t LINK_SWITCH_DELAY_MS = 20;		  // time for the link mode write's response to leave the UART before switching to telemetry
+static constexpr uint16_t LINK_TELEMETRY_MIN_PERIOD_MS = 20; // fastest telemetry rate we'll agree to
+static constexpr uint32_t LINK_TELEMETRY_POLL_MS = 5;		  // how often the telemetry link checks for incoming frames
+
+static constexpr uint32_t LINK_SUPERVISOR_PERIOD_MS = 100; // how often the heartbeat deadline is checked and a ramp down stepped
+
+static constexpr uint32_t TASK_SUPERVISOR_PERIOD_MS = 50; // how often the supervisor looks for tasks past their deadline
+static constexpr uint16_t TASK_MISSES_TO_STALL = 3;		 // deadlines a critical task misses in a row before the heater is cut
+
+static constexpr uint32_t HISTORY_SAMPLE_PERIOD_MS = 1000; // how often a temperature sample is pushed into the history FIFO served over modbus
 
 static constexpr int LINE_FREQ = 60;
 static constexpr float HEATING_BANG_BANG_WINDOW = 50;		 // if the temp is outside of this window of the target temp, it will switch from PID to bang-bang to rapidly heat/cool to that point
@@ -34,6 +77,25 @@ static constexpr float STARTUP_HEATING_RATE_PER_SECOND = 0.5f;
 static constexpr float STARTUP_HEATING_RATE_UNDER_TEMP = 500.0f; // below this temperature, the startup heating rate is 0.5 degrees per second to slowly warm up the crucible
 static constexpr float HEATING_RATE_TASK_PERIOD_MS = 1000.0f;	 // how often to calculate if we need to set the next internal target according to our heating rate schedule. For furnaces with a large mass, this should be multiple seconds so that the PID can accelerate properly when the target temp increments.
 
+// the thermal model the ThermalMonitor holds the thermocouple against, tune to your furnace from a heat up and cool down log
+static constexpr float THERMAL_MODEL_FULL_POWER_RATE = 2.0f;	  // degrees per second the load heats at full duty, ignoring losses
+static constexpr float THERMAL_MODEL_LOSS_PER_SECOND = 0.002f;   // fraction of the difference to ambient lost per second
+static constexpr float THERMAL_MODEL_AMBIENT_C = 25.0f;
+static constexpr uint32_t THERMAL_MODEL_LAG_MS = 60000;		  // after the heater switches off or to full, the heat on its way from the element is ignored for this long
+static constexpr uint32_t UNCOMMANDED_HEATING_WINDOW_MS = 60000; // heating with the heater off, a welded SSR
+static constexpr float UNCOMMANDED_HEATING_RISE_C = 15.0f;		  // degrees above the heater off prediction, within about a window
+static constexpr uint32_t HEATING_FAILED_WINDOW_MS = 120000;	  // not heating at full duty, a dead element or tripped breaker
+static constexpr float HEATING_FAILED_MIN_DUTY = 0.9f;			  // duty that counts as full
+static constexpr float HEATING_FAILED_MIN_FRACTION = 0.5f;		  // of the model's heating, anything less is a failed heater rather than a model that's a bit off
+static constexpr float HEATING_FAILED_SHORTFALL_C = 40.0f;		  // degrees below that
+static constexpr uint32_t SENSOR_DETACHED_WINDOW_MS = 60000;	  // cooling faster than the furnace can, the thermocouple is out of the load
+static constexpr float SENSOR_DETACHED_DROP_C = 100.0f;		  // degrees below the heater off prediction
+
+// limits a config transaction is validated against, a set with anything outside them is rejected as a whole
+static constexpr int CONFIG_MIN_PWM_PERIOD_MS = 1000 / LINE_FREQ; // a zero crossing SSR can't switch faster than one line cycle
+static constexpr int CONFIG_MAX_PWM_PERIOD_MS = 10000;
+static constexpr int CONFIG_MAX_BANG_BANG_WINDOW = 500;
+
 #define SIMULATED_TEMP_DEVICE 1
 
 #if SIMULATED_TEMP_DEVICE
@@ -10,15 +10,25 @@
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_system.h>
+#include <nvs_flash.h>
 
 #include "GPIO.hxx"
 #include "TempController.hxx"
 
 #include "Console.hxx"
+#include "CurrentMonitor.hxx"
+#include "EnergyMeter.hxx"
+#include "ErrorJournal.hxx"
+#include "EventBus.hxx"
+#include "FileStore.hxx"
+#include "Interlock.hxx"
+#include "LinkSupervisor.hxx"
 #include "SPIBus.hxx"
 #include "Server.hxx"
 #include "State.hxx"
+#include "TaskSupervisor.hxx"
 #include "TempDevice.hxx"
+#include "TempHistory.hxx"
 #include "hardware.h"
 #include "sdkconfig.h"
 #include "uart/Uart.hxx"
@@ -27,9 +37,25 @@
 
 extern "C" void app_main(void)
 {
+	// the energy counters live in NVS
+	esp_err_t nvsErr = nvs_flash_init();
+	if (nvsErr == ESP_ERR_NVS_NO_FREE_PAGES || nvsErr == ESP_ERR_NVS_NEW_VERSION_FOUND)
+	{
+		ESP_ERROR_CHECK(nvs_flash_erase());
+		nvsErr = nvs_flash_init();
+	}
+	ESP_ERROR_CHECK(nvsErr);
 
-	GPIOManager::GetInstance();
+	ErrorJournal::GetInstance();
+	EventBus::GetInstance();
 	State::GetInstance();
+	Interlock::GetInstance();
+	TaskSupervisor::GetInstance();
+	GPIOManager::GetInstance();
+	if (CURRENT_SENSOR_FITTED)
+	{
+		CurrentMonitor::GetInstance();
+	}
 	SPIBusManager *spi3Manager = new SPIBusManager(SPI3_HOST);
 	// TempDevice *thermocouple = new MAX31856TempDevice(spi3Manager, MAX31856_SPI3_CS);
 	//  thermocouple->SetType(TempType::TCTYPE_K);
@@ -41,8 +67,12 @@ extern "C" void app_main(void)
 	static_cast<SimulatedTempDevice *>(simulatedThermocouple)->SetTemp(25.0);
 	// TempController controller(thermocouple, spi3Manager);
 	TempController controller(simulatedThermocouple, spi3Manager);
+	TempHistory::GetInstance();
+	EnergyMeter::GetInstance();
+	FileStore::GetInstance();
 	UARTManager::GetInstance();
 	Server::GetInstance();
+	LinkSupervisor::GetInstance();
 	Console::GetInstance();
 	vTaskDelay(portMAX_DELAY);
 }
\ No newline at end of file
@@ -2,50 +2,100 @@
 
 #include <cstdint>
 
-enum class ErrorCode : uint8_t
+// A bit each, FaultSet keeps them in the lower 16 bits of its word and the ERROR_CODE input register is 16
+// bits, so there's room for 16.
+enum class ErrorCode : uint32_t
 {
 	NO_ERROR = 0x00,
 	THERMOCOUPLE_ERROR = 0x01,
 	TEMP_RANGE_HIGH = 0x02,
 	TEMP_RANGE_LOW = 0x04,
-	ESTOP = 0x02,
-	NO_CURRENT = 0x04,
 	DOOR_OPEN = 0x08,
+	TASK_STALLED = 0x10, // a critical task stopped keeping its deadlines
+	ESTOP = 0x20,
+	NO_CURRENT = 0x40,
+	HEATING_UNCOMMANDED = 0x80, // the ThermalMonitor saw the furnace heat with the heater off
+	HEATING_FAILED = 0x100,		// or not heat at full duty
+	SENSOR_DETACHED = 0x200,	// or cool faster than it can, the thermocouple isn't in the load
+	SSR_WELDED = 0x400,			// heater current with the SSR off
 };
 
+static constexpr uint32_t ERROR_CODE_BITS = 16;
+
+// What it takes for a fault to stop being reported once its condition has gone
+enum class FaultPolicy : uint8_t
+{
+	SELF_CLEARING,			   // nothing, it goes with the condition
+	LATCHED_UNTIL_RESET,	   // an operator reset, from the console or the FAULT_RESET coil
+	LATCHED_UNTIL_POWER_CYCLE, // a power cycle, it survives a warm reset too
+};
+
+constexpr FaultPolicy GetFaultPolicy(ErrorCode fault)
+{
+	switch (fault)
+	{
+	case ErrorCode::THERMOCOUPLE_ERROR: // an intermittent connector shouldn't get to turn the heater back on by itself
+	case ErrorCode::ESTOP:
+	case ErrorCode::NO_CURRENT:
+	case ErrorCode::SSR_WELDED:
+	case ErrorCode::HEATING_UNCOMMANDED:
+	case ErrorCode::HEATING_FAILED:
+	case ErrorCode::SENSOR_DETACHED:
+		return FaultPolicy::LATCHED_UNTIL_RESET;
+	case ErrorCode::TASK_STALLED: // the firmware can't be trusted until it has restarted
+		return FaultPolicy::LATCHED_UNTIL_POWER_CYCLE;
+	default:
+		return FaultPolicy::SELF_CLEARING;
+	}
+}
+
+// the ErrorCode bits with policy
+constexpr uint32_t FaultPolicyMask(FaultPolicy policy)
+{
+	uint32_t mask = 0;
+	for (uint32_t bit = 0; bit < ERROR_CODE_BITS; bit++)
+	{
+		if (GetFaultPolicy(static_cast<ErrorCode>(1u << bit)) == policy)
+		{
+			mask |= 1u << bit;
+		}
+	}
+	return mask;
+}
+
 inline ErrorCode operator|(ErrorCode lhs, ErrorCode rhs)
 {
-	return static_cast<ErrorCode>(static_cast<uint8_t>(lhs) | static_cast<uint8_t>(rhs));
+	return static_cast<ErrorCode>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
 }
 
 inline ErrorCode operator&(ErrorCode lhs, ErrorCode rhs)
 {
-	return static_cast<ErrorCode>(static_cast<uint8_t>(lhs) & static_cast<uint8_t>(rhs));
+	return static_cast<ErrorCode>(static_cast<uint32_t>(lhs) & static_cast<uint32_t>(rhs));
 }
 
 inline ErrorCode &operator|=(ErrorCode &lhs, ErrorCode rhs)
 {
-	lhs = static_cast<ErrorCode>(static_cast<uint8_t>(lhs) | static_cast<uint8_t>(rhs));
+	lhs = static_cast<ErrorCode>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
 	return lhs;
 }
 
 inline bool operator==(ErrorCode lhs, ErrorCode rhs)
 {
-	return static_cast<uint8_t>(lhs) == static_cast<uint8_t>(rhs);
+	return static_cast<uint32_t>(lhs) == static_cast<uint32_t>(rhs);
 }
 
 inline bool operator!=(ErrorCode lhs, ErrorCode rhs)
 {
-	return static_cast<uint8_t>(lhs) != static_cast<uint8_t>(rhs);
+	return static_cast<uint32_t>(lhs) != static_cast<uint32_t>(rhs);
 }
 
 inline ErrorCode operator~(ErrorCode code)
 {
-	return static_cast<ErrorCode>(~static_cast<uint8_t>(code));
+	return static_cast<ErrorCode>(~static_cast<uint32_t>(code));
 }
 
 inline ErrorCode &operator&=(ErrorCode &lhs, ErrorCode rhs)
 {
-	lhs = static_cast<ErrorCode>(static_cast<uint8_t>(lhs) & static_cast<uint8_t>(rhs));
+	lhs = static_cast<ErrorCode>(static_cast<uint32_t>(lhs) & static_cast<uint32_t>(rhs));
 	return lhs;
-}
\ No newline at end of file
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Errors.hxx"
+
+#include <atomic>
+#include <cstdint>
+
+struct FaultChange
+{
+	ErrorCode before; // faults reported before the change
+	ErrorCode after;
+};
+
+// Lock-free set of ErrorCode faults. One 32 bit word holds the faults being reported in its lower half and
+// which of their conditions are present right now in its upper half, so every change is a single atomic
+// read-modify-write and Get() is a single load, a consistent snapshot from any task or ISR. A fault is
+// reported from Set() until its condition is cleared and, depending on its FaultPolicy, it's been reset.
+class FaultSet
+{
+public:
+	// the conditions are present
+	FaultChange Set(ErrorCode faults)
+	{
+		uint32_t bits = static_cast<uint32_t>(faults) & REPORTED;
+		uint32_t before = myWord.fetch_or(bits | bits << ERROR_CODE_BITS, std::memory_order_acq_rel);
+		return {reported(before), reported(before | bits)};
+	}
+
+	// the conditions have gone, self clearing faults go with them
+	FaultChange Clear(ErrorCode faults)
+	{
+		uint32_t bits = static_cast<uint32_t>(faults) & REPORTED;
+		uint32_t clear = bits << ERROR_CODE_BITS | (bits & SELF_CLEARING);
+		uint32_t before = myWord.fetch_and(~clear, std::memory_order_acq_rel);
+		return {reported(before), reported(before & ~clear)};
+	}
+
+	// An operator reset, faults latched until reset stop being reported if their condition has gone
+	FaultChange Reset()
+	{
+		uint32_t before = myWord.load(std::memory_order_acquire);
+		uint32_t after;
+		do
+		{
+			uint32_t gone = ~(before >> ERROR_CODE_BITS) & REPORTED;
+			after = before & ~(gone & LATCHED_UNTIL_RESET);
+		} while (!myWord.compare_exchange_weak(before, after, std::memory_order_acq_rel, std::memory_order_acquire));
+
+		return {reported(before), reported(after)};
+	}
+
+	// reports faults without their conditions, for putting back power cycle latched ones after a warm reset
+	FaultChange Restore(ErrorCode faults)
+	{
+		uint32_t bits = static_cast<uint32_t>(faults) & REPORTED;
+		uint32_t before = myWord.fetch_or(bits, std::memory_order_acq_rel);
+		return {reported(before), reported(before | bits)};
+	}
+
+	ErrorCode Get() const
+	{
+		return reported(myWord.load(std::memory_order_acquire));
+	}
+
+	// the faults whose condition is present right now, latched ones that have gone aren't in it
+	ErrorCode GetConditions() const
+	{
+		return static_cast<ErrorCode>(myWord.load(std::memory_order_acquire) >> ERROR_CODE_BITS);
+	}
+
+private:
+	static constexpr uint32_t REPORTED = (1u << ERROR_CODE_BITS) - 1;
+	static constexpr uint32_t SELF_CLEARING = FaultPolicyMask(FaultPolicy::SELF_CLEARING);
+	static constexpr uint32_t LATCHED_UNTIL_RESET = FaultPolicyMask(FaultPolicy::LATCHED_UNTIL_RESET);
+
+	static_assert(ERROR_CODE_BITS * 2 == 32, "the faults and their conditions share one word");
+
+	static ErrorCode reported(uint32_t word)
+	{
+		return static_cast<ErrorCode>(word & REPORTED);
+	}
+
+	std::atomic<uint32_t> myWord{0};
+};
@@ -0,0 +1,144 @@
+#include "BusMonitor.hxx"
+
+#include <string.h>
+
+static constexpr uint8_t BROADCAST_UNIT = 0;
+
+void BusMonitor::Received(const uint8_t *data, size_t length, int64_t nowUs)
+{
+	if (myLength > 0 && nowUs - myLastByteUs > myFrameTimeoutUs)
+	{
+		cutShort();
+	}
+	myLastByteUs = nowUs;
+
+	while (length > 0)
+	{
+		size_t take = length < RTU_MAX_FRAME - myLength ? length : RTU_MAX_FRAME - myLength;
+		memcpy(myFrame + myLength, data, take);
+		myLength += take;
+		data += take;
+		length -= take;
+
+		while (myLength > 0)
+		{
+			size_t frameLength = myExpectForeignResponse ? ResponseFrameLength(myFrame, myLength) : RequestFrameLength(myFrame, myLength);
+
+			// not enough yet, or a function we can't delimit which has to wait for the response or the timeout
+			if (frameLength == 0 || (frameLength == SIZE_MAX && myLength < RTU_MAX_FRAME))
+			{
+				break;
+			}
+
+			if (frameLength > RTU_MAX_FRAME)
+			{
+				cutShort();
+				break;
+			}
+
+			if (frameLength > myLength)
+			{
+				break;
+			}
+
+			endFrame(myFrame, frameLength);
+			myLength -= frameLength;
+			memmove(myFrame, myFrame + frameLength, myLength);
+		}
+	}
+}
+
+void BusMonitor::Sent(const uint8_t *data, size_t length, int64_t nowUs)
+{
+	// whatever is left over is the request pl_modbus understood and we couldn't delimit
+	if (myLength > 0)
+	{
+		endFrame(myFrame, myLength);
+		myLength = 0;
+	}
+
+	RtuFrameInfo info;
+	if (!myPending || !ParseRtuFrame(data, length, false, info))
+	{
+		return;
+	}
+
+	myPending = false;
+	if (info.IsException())
+	{
+		myCounters.BUS_EXCEPTION_ERRORS++;
+	}
+
+	myFunctions.Record(static_cast<ModbusFunction>(myPendingFunction), info.IsException() ? TransactionResult::EXCEPTION : TransactionResult::OK,
+					   static_cast<uint32_t>(nowUs - myPendingUs));
+}
+
+void BusMonitor::Clear()
+{
+	myCounters = {};
+	myFunctions.Reset();
+}
+
+void BusMonitor::Resync()
+{
+	myLength = 0;
+	myPending = false;
+	myExpectForeignResponse = false;
+}
+
+void BusMonitor::endFrame(const uint8_t *frame, size_t length)
+{
+	unanswered();
+
+	if (!CheckModbusCrc(frame, length))
+	{
+		myCounters.BUS_COMMUNICATION_ERRORS++;
+		myExpectForeignResponse = false;
+		return;
+	}
+
+	myCounters.BUS_MESSAGES++;
+
+	if (myExpectForeignResponse)
+	{
+		myExpectForeignResponse = false;
+		return;
+	}
+
+	uint8_t unit = frame[0];
+	if (unit == BROADCAST_UNIT)
+	{
+		// never answered, by anyone
+		myCounters.SERVER_MESSAGES++;
+		myCounters.SERVER_NO_RESPONSE++;
+	}
+	else if (unit == myUnit)
+	{
+		myCounters.SERVER_MESSAGES++;
+		myPending = true;
+		myPendingFunction = frame[1];
+		myPendingUs = myLastByteUs;
+	}
+	else
+	{
+		myExpectForeignResponse = true;
+	}
+}
+
+void BusMonitor::cutShort()
+{
+	unanswered();
+	myCounters.BUS_COMMUNICATION_ERRORS++;
+	myLength = 0;
+	myExpectForeignResponse = false;
+}
+
+// a request for this unit is followed by something other than our response
+void BusMonitor::unanswered()
+{
+	if (myPending)
+	{
+		myPending = false;
+		myCounters.SERVER_NO_RESPONSE++;
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Diagnostics.hxx"
+#include "LinkStats.hxx"
+#include "Rtu.hxx"
+
+#include <cstddef>
+#include <cstdint>
+
+// Server side view of the serial line. Fed every byte the server reads and every response it writes, it
+// splits the traffic into frames, keeps the Diagnostics (function 8) counters and, per function code, how
+// many requests were answered normally or with an exception and how long the server took to answer.
+// On a shared bus the other units' requests and responses are counted as bus messages and otherwise
+// ignored. Not thread safe on its own, the owner wraps it in whatever lock suits the context.
+class BusMonitor
+{
+public:
+	// frameTimeoutUs is how long a partial frame may wait for the rest of its bytes before it is thrown
+	// away as cut short. It has to cover the gaps between the chunks the UART hands over, not just the
+	// 3.5 character time of the line itself.
+	BusMonitor(uint8_t unit, uint32_t frameTimeoutUs) : myUnit(unit), myFrameTimeoutUs(frameTimeoutUs) {}
+
+	void Received(const uint8_t *data, size_t length, int64_t nowUs);
+
+	// a response going out, nowUs is when the write started
+	void Sent(const uint8_t *data, size_t length, int64_t nowUs);
+
+	const DiagnosticsCounters &GetCounters() const
+	{
+		return myCounters;
+	}
+
+	// per function code, TransactionResult::OK or EXCEPTION, latency is the time from the last byte of the
+	// request to the start of the response
+	const LinkStats &GetFunctions() const
+	{
+		return myFunctions;
+	}
+
+	void Clear();
+
+	// forgets a partial frame and a request waiting for its response without counting them, for when the
+	// line was used for something other than Modbus in between
+	void Resync();
+
+private:
+	uint8_t myUnit;
+	uint32_t myFrameTimeoutUs;
+
+	DiagnosticsCounters myCounters = {};
+	LinkStats myFunctions;
+
+	uint8_t myFrame[RTU_MAX_FRAME];
+	size_t myLength = 0;
+	int64_t myLastByteUs = 0;
+	bool myExpectForeignResponse = false; // the last frame was another unit's request, the next is its response
+
+	// the request for this unit waiting for its response
+	bool myPending = false;
+	uint8_t myPendingFunction = 0;
+	int64_t myPendingUs = 0;
+
+	void endFrame(const uint8_t *frame, size_t length);
+	void cutShort();
+	void unanswered();
+};
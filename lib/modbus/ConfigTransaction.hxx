@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// Atomic configuration writes. The client writes the whole configuration, the holding register block in
+// the same order, followed by a transaction id into the staging window in one function 16 write. The Server
+// validates the set as a whole and answers with an exception if any of it is out of range, otherwise it
+// applies all of it at the start of the next control tick so the PID never runs on half of an old config
+// and half of a new one.
+// pl_modbus can't serve Read/Write Multiple Registers (function 23), so the outcome and the effective values
+// are served as input registers straight after the status registers. The client's regular status poll picks
+// them up by reading a few more registers in the same request instead of doing a separate read back.
+
+static constexpr uint16_t CONFIG_REGISTER_COUNT = 8;
+
+static constexpr uint16_t CONFIG_STAGING_ADDRESS = 0x180; // holding registers
+static constexpr uint16_t CONFIG_RESULT_ADDRESS = 3;	  // input registers, right after InputRegisters
+
+// in the staging window, leaves that register as it is
+static constexpr uint16_t CONFIG_UNCHANGED = 0xFFFF;
+
+enum class ConfigStatus : uint16_t
+{
+	NONE,	  // nothing has been staged since the Server booted
+	PENDING,  // validated, waiting for the next control tick
+	APPLIED,  // values holds what the controller is running with
+	REJECTED, // out of range, nothing was changed
+};
+
+struct ConfigStaging
+{
+	uint16_t values[CONFIG_REGISTER_COUNT];
+	uint16_t TRANSACTION_ID; // echoed in ConfigResult so the client knows which write the result is for
+
+	static constexpr uint16_t COUNT = CONFIG_REGISTER_COUNT + 1;
+};
+
+struct ConfigResult
+{
+	uint16_t TRANSACTION_ID;
+	uint16_t STATUS; // ConfigStatus
+	uint16_t values[CONFIG_REGISTER_COUNT];
+
+	static constexpr uint16_t COUNT = CONFIG_REGISTER_COUNT + 2;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+// Serial line diagnostics as defined for the Diagnostics function (8). pl_modbus doesn't serve function 8,
+// so the counters its sub-functions return are served as input registers at DIAGNOSTICS_ADDRESS instead,
+// one register per sub-function in sub-function order, and the Clear Counters sub-function is a write of
+// its number to the holding register there. The counters are 16 bits and wrap, as on a real function 8.
+
+static constexpr uint16_t DIAGNOSTICS_ADDRESS = 0x2C0; // input registers for the counters, holding register for a command
+
+enum class DiagnosticsSubFunction : uint16_t
+{
+	CLEAR_COUNTERS = 0x0A,
+	BUS_MESSAGE_COUNT = 0x0B,
+	BUS_COMMUNICATION_ERROR_COUNT = 0x0C,
+	BUS_EXCEPTION_ERROR_COUNT = 0x0D,
+	SERVER_MESSAGE_COUNT = 0x0E,
+	SERVER_NO_RESPONSE_COUNT = 0x0F,
+	SERVER_NAK_COUNT = 0x10,
+	SERVER_BUSY_COUNT = 0x11,
+	BUS_CHARACTER_OVERRUN_COUNT = 0x12,
+};
+
+struct DiagnosticsCounters
+{
+	uint16_t BUS_MESSAGES;			   // frames seen on the line with a good CRC, for any unit
+	uint16_t BUS_COMMUNICATION_ERRORS; // CRC errors and frames cut short
+	uint16_t BUS_EXCEPTION_ERRORS;	   // exception responses this server sent
+	uint16_t SERVER_MESSAGES;		   // requests for this unit, broadcasts included
+	uint16_t SERVER_NO_RESPONSE;	   // requests for this unit that got no response, broadcasts included
+	uint16_t SERVER_NAK;			   // never sent, always 0
+	uint16_t SERVER_BUSY;			   // never sent, always 0
+	uint16_t BUS_CHARACTER_OVERRUNS;   // the UART driver doesn't report them, always 0
+
+	static constexpr uint16_t COUNT = 8;
+};
+
+// register n of DiagnosticsCounters holds what sub-function FIRST_COUNTER + n returns
+static constexpr uint16_t DIAGNOSTICS_FIRST_COUNTER = static_cast<uint16_t>(DiagnosticsSubFunction::BUS_MESSAGE_COUNT);
+
+struct DiagnosticsCommand
+{
+	uint16_t SUB_FUNCTION; // DiagnosticsSubFunction, only CLEAR_COUNTERS is accepted
+
+	static constexpr uint16_t COUNT = 1;
+};
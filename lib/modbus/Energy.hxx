@@ -0,0 +1,61 @@
+#pragma once
+
+#include "FileRecords.hxx"
+
+#include <cstdint>
+
+// Energy delivered to the heater, served by the Server as input registers starting at ENERGY_ADDRESS. It comes
+// from the measured current when the sensor is fitted, otherwise from the SSR on time at the element's rated
+// power. A melt runs from enabling the furnace to disabling it, and each setpoint it's held at is a segment.
+// The counters are kept in NVS, so they survive a power cycle up to the last save.
+// The charge mass is a holding register at the same address, energy per kg is worked out from it.
+
+static constexpr uint16_t ENERGY_ADDRESS = 0x540; // holding registers for the charge, input registers for the counters
+
+enum class EnergySource : uint16_t
+{
+	SSR_ON_TIME,	  // on time times HEATER_ELEMENT_POWER_W
+	MEASURED_CURRENT, // apparent energy from the current sensor
+};
+
+struct EnergySettings
+{
+	uint16_t CHARGE_G_HI; // metal in the running melt, or the last one if none is running, grams. 0 if unknown
+	uint16_t CHARGE_G_LO; // the next melt starts with the same charge
+
+	static constexpr uint16_t COUNT = 2;
+};
+
+struct EnergyHeader
+{
+	uint16_t SOURCE; // EnergySource
+	uint16_t LIFETIME_WH_HI;
+	uint16_t LIFETIME_WH_LO;
+	uint16_t MELTS;		  // started since the counters were first kept
+	uint16_t MELT_ACTIVE; // 1 while a melt is running, the melt registers are the last one's otherwise
+	uint16_t MELT_WH_HI;
+	uint16_t MELT_WH_LO;
+	uint16_t MELT_CHARGE_G_HI;
+	uint16_t MELT_CHARGE_G_LO;
+	uint16_t MELT_WH_PER_KG; // 0 without a charge. Saturating
+	uint16_t SEGMENTS;		 // in the melt, the last one takes everything past PROGRAM_MAX_SEGMENTS
+	uint16_t SAVES;			 // NVS writes since boot
+
+	static constexpr uint16_t COUNT = 12;
+};
+
+struct EnergySegment
+{
+	uint16_t WH_HI;
+	uint16_t WH_LO;
+
+	static constexpr uint16_t COUNT = 2;
+};
+
+struct EnergyRegisters
+{
+	EnergyHeader header;
+	EnergySegment segments[PROGRAM_MAX_SEGMENTS]; // of the melt, in order, 0 past SEGMENTS
+
+	static constexpr uint16_t COUNT = EnergyHeader::COUNT + PROGRAM_MAX_SEGMENTS * EnergySegment::COUNT;
+};
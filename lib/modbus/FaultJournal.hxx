@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+// Fault journal, served by the Server as input registers starting at FAULT_JOURNAL_ADDRESS. Every time an
+// ErrorCode bit sets or clears the Server adds an entry, so a fault that comes and goes between two polls
+// still shows up, with when it happened and what the furnace was doing. It's laid out like the temperature
+// history in History.hxx: entry n lives in slot n % FAULT_JOURNAL_CAPACITY and carries its SEQUENCE.
+// The journal lives in RTC memory and survives a warm reset, BOOT tells entries from earlier boots apart.
+
+static constexpr uint16_t FAULT_JOURNAL_ADDRESS = 0x340;
+static constexpr uint16_t FAULT_JOURNAL_CAPACITY = 32;
+
+static constexpr uint16_t FAULT_JOURNAL_SET = 0x8000; // in EVENT, the error was set rather than cleared
+
+struct FaultJournalHeader
+{
+	uint16_t NEXT_SEQUENCE; // sequence the next entry will get, the newest one is NEXT_SEQUENCE - 1
+	uint16_t CAPACITY;
+	uint16_t BOOT;			// boots the journal has survived, entries made since this boot carry this value
+	uint16_t RESET_REASON; // esp_reset_reason() of this boot
+
+	static constexpr uint16_t COUNT = 4;
+};
+
+struct FaultJournalEntry
+{
+	uint16_t SEQUENCE;
+	uint16_t EVENT;	 // number of the ErrorCode bit that changed, ored with FAULT_JOURNAL_SET when it was set
+	uint16_t ERROR;	 // the whole ErrorCode after the change
+	uint16_t BOOT;	 // FaultJournalHeader::BOOT at the time
+	uint16_t TIME_MS_HI; // milliseconds since that boot
+	uint16_t TIME_MS_LO;
+	int16_t TEMP_DC; // tenths of a degree C
+	uint16_t DUTY;	 // heater duty, same scale as HEATER_PWM_DUTY_CYCLE
+
+	static constexpr uint16_t COUNT = 8;
+};
+
+struct FaultJournalRegisters
+{
+	FaultJournalHeader header;
+	FaultJournalEntry entries[FAULT_JOURNAL_CAPACITY];
+
+	static constexpr uint16_t COUNT = FaultJournalHeader::COUNT + FAULT_JOURNAL_CAPACITY * FaultJournalEntry::COUNT;
+};
+
+static constexpr uint16_t FAULT_JOURNAL_ENTRIES_ADDRESS = FAULT_JOURNAL_ADDRESS + FaultJournalHeader::COUNT;
@@ -0,0 +1,114 @@
+#include "FileRecords.hxx"
+#include "Rtu.hxx"
+
+#include <string.h>
+
+uint16_t FileMaxLength(FileId file)
+{
+	switch (file)
+	{
+	case FileId::PROGRAM:
+		return ProgramFile::COUNT;
+	case FileId::GAIN_SCHEDULE:
+		return GainScheduleFile::COUNT;
+	case FileId::HISTORY:
+		return HistoryRegisters::COUNT;
+	default:
+		return 0;
+	}
+}
+
+bool IsWritableFile(FileId file)
+{
+	return file == FileId::PROGRAM || file == FileId::GAIN_SCHEDULE;
+}
+
+uint16_t FileCrc(const uint16_t *content, uint16_t length)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (uint16_t i = 0; i < length; i++)
+	{
+		uint8_t bytes[2];
+		PutBe16(bytes, content[i]);
+		crc = ModbusCrc16(bytes, sizeof(bytes), crc);
+	}
+
+	return crc;
+}
+
+bool IsWellFormedFile(FileId file, const uint16_t *content, uint16_t length)
+{
+	switch (file)
+	{
+	case FileId::PROGRAM:
+	{
+		// a header with no segments is a valid, empty program
+		if (length < ProgramFile::HEADER_COUNT)
+		{
+			return false;
+		}
+
+		uint16_t segments = content[0];
+		return segments <= PROGRAM_MAX_SEGMENTS && length == ProgramFile::HEADER_COUNT + segments * ProgramSegment::COUNT;
+	}
+	case FileId::GAIN_SCHEDULE:
+	{
+		if (length < GainScheduleFile::HEADER_COUNT)
+		{
+			return false;
+		}
+
+		uint16_t entries = content[0];
+		if (entries > GAIN_SCHEDULE_MAX_ENTRIES || length != GainScheduleFile::HEADER_COUNT + entries * GainScheduleEntry::COUNT)
+		{
+			return false;
+		}
+
+		const GainScheduleEntry *entry = reinterpret_cast<const GainScheduleEntry *>(content + GainScheduleFile::HEADER_COUNT);
+		for (uint16_t i = 1; i < entries; i++)
+		{
+			if (entry[i].UP_TO_TEMP <= entry[i - 1].UP_TO_TEMP)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool FileUpload::Write(const FileRecordHeader &header, const uint16_t *data)
+{
+	FileId file = static_cast<FileId>(header.FILE);
+	if (!IsWritableFile(file))
+	{
+		return false;
+	}
+
+	if (header.RECORD == 0)
+	{
+		myFile = header.FILE;
+		myLength = 0;
+	}
+
+	if (header.FILE != myFile || header.RECORD > myLength || header.RECORD + header.LENGTH > FileMaxLength(file))
+	{
+		return false;
+	}
+
+	memcpy(&myContent[header.RECORD], data, header.LENGTH * sizeof(uint16_t));
+	if (header.RECORD + header.LENGTH > myLength)
+	{
+		myLength = header.RECORD + header.LENGTH;
+	}
+
+	return true;
+}
+
+bool FileUpload::Matches(FileId file, const FileCommit &commit) const
+{
+	return myFile == static_cast<uint16_t>(file) && commit.LENGTH == myLength && FileCrc(myContent, myLength) == commit.CRC;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "History.hxx"
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk transfers of things far larger than the holding register block, modelled on Read/Write File Record
+// (functions 20 and 21): a file number, a record number (register offset into the file) and a record length.
+// pl_modbus only serves the basic functions, so the same requests are carried by ordinary ones:
+//  - every file is served read only as input registers at FileReadAddress(), a FileInfo followed by the
+//    content, so a download is one function 4 read per FILE_READ_MAX_LENGTH registers.
+//  - uploads go through the holding register window at FILE_WRITE_ADDRESS, a FileRecordHeader followed by up
+//    to FILE_RECORD_MAX_LENGTH registers of data, one function 16 write per record. A final COMMIT record
+//    carries a FileCommit. The Server checks the length, CRC, base version and content, then swaps the whole
+//    file in at once and bumps its version. Anything wrong is answered with an exception and the live file
+//    is left as it was.
+
+enum class FileId : uint16_t
+{
+	PROGRAM = 1,	   // ramp/soak program, ProgramFile
+	GAIN_SCHEDULE = 2, // PID gains by temperature band, GainScheduleFile
+	HISTORY = 3,	   // read only export of the temperature history, HistoryRegisters
+};
+
+static constexpr uint16_t FILE_COUNT = 3;
+
+enum class FileOperation : uint16_t
+{
+	WRITE = 1,	// data goes at RECORD, an upload starts with a write to record 0
+	COMMIT = 2, // data is a FileCommit
+};
+
+// the first registers of every file's read window
+struct FileInfo
+{
+	uint16_t VERSION; // bumped by every commit, 0 for a file that was never written
+	uint16_t LENGTH;  // content length in registers
+	uint16_t CRC;	  // FileCrc() of the content
+	uint16_t RESERVED;
+
+	static constexpr uint16_t COUNT = 4;
+};
+
+struct FileRecordHeader
+{
+	uint16_t FILE; // FileId
+	uint16_t RECORD;
+	uint16_t LENGTH; // registers of data following the header
+	uint16_t OPERATION;
+
+	static constexpr uint16_t COUNT = 4;
+};
+
+// a function 16 write carries at most 123 registers, a read 125
+static constexpr uint16_t FILE_RECORD_MAX_LENGTH = 123 - FileRecordHeader::COUNT;
+static constexpr uint16_t FILE_READ_MAX_LENGTH = 125;
+
+struct FileRecordWindow
+{
+	FileRecordHeader header;
+	uint16_t data[FILE_RECORD_MAX_LENGTH];
+};
+
+struct FileCommit
+{
+	uint16_t LENGTH;
+	uint16_t CRC;
+	uint16_t BASE_VERSION; // the version the upload was made from, the commit fails if someone got there first
+
+	static constexpr uint16_t COUNT = 3;
+};
+
+static constexpr uint16_t FILE_ANY_VERSION = 0xFFFF; // as BASE_VERSION, commit whatever the current version is
+
+static constexpr uint16_t FILE_WRITE_ADDRESS = 0x200; // holding registers
+static constexpr uint16_t FILE_READ_ADDRESS = 0x1000; // input registers, one FILE_READ_STRIDE window per file
+static constexpr uint16_t FILE_READ_STRIDE = 0x400;
+
+constexpr uint16_t FileReadAddress(FileId file)
+{
+	return FILE_READ_ADDRESS + (static_cast<uint16_t>(file) - 1) * FILE_READ_STRIDE;
+}
+
+struct ProgramSegment
+{
+	uint16_t TARGET_TEMP;	 // degrees C
+	uint16_t RATE_PER_HOUR; // degrees C per hour on the way there, 0 for as fast as the heating rate allows
+	uint16_t SOAK_MINUTES;	 // held at TARGET_TEMP before the next segment
+
+	static constexpr uint16_t COUNT = 3;
+};
+
+static constexpr uint16_t PROGRAM_MAX_SEGMENTS = 32;
+
+struct ProgramFile
+{
+	uint16_t SEGMENT_COUNT;
+	uint16_t RESERVED;
+	ProgramSegment segments[PROGRAM_MAX_SEGMENTS];
+
+	static constexpr uint16_t HEADER_COUNT = 2;
+	static constexpr uint16_t COUNT = HEADER_COUNT + PROGRAM_MAX_SEGMENTS * ProgramSegment::COUNT;
+};
+
+struct GainScheduleEntry
+{
+	uint16_t UP_TO_TEMP; // these gains apply below this temperature, entries in increasing order
+	uint16_t P;
+	uint16_t I;
+	uint16_t D;
+
+	static constexpr uint16_t COUNT = 4;
+};
+
+static constexpr uint16_t GAIN_SCHEDULE_MAX_ENTRIES = 16;
+
+struct GainScheduleFile
+{
+	uint16_t ENTRY_COUNT;
+	uint16_t RESERVED;
+	GainScheduleEntry entries[GAIN_SCHEDULE_MAX_ENTRIES];
+
+	static constexpr uint16_t HEADER_COUNT = 2;
+	static constexpr uint16_t COUNT = HEADER_COUNT + GAIN_SCHEDULE_MAX_ENTRIES * GainScheduleEntry::COUNT;
+};
+
+static constexpr uint16_t FILE_MAX_WRITABLE_LENGTH = ProgramFile::COUNT > GainScheduleFile::COUNT ? ProgramFile::COUNT : GainScheduleFile::COUNT;
+static constexpr uint16_t FILE_MAX_LENGTH = HistoryRegisters::COUNT > FILE_MAX_WRITABLE_LENGTH ? HistoryRegisters::COUNT : FILE_MAX_WRITABLE_LENGTH;
+
+static_assert(FileInfo::COUNT + FILE_MAX_LENGTH <= FILE_READ_STRIDE, "a file's read window overlaps the next one");
+
+// largest content a file can have, 0 for an unknown file
+uint16_t FileMaxLength(FileId file);
+
+bool IsWritableFile(FileId file);
+
+// CRC-16/MODBUS over the content registers, each high byte first as on the wire
+uint16_t FileCrc(const uint16_t *content, uint16_t length);
+
+// Content that passes the structural checks, lengths and counts agreeing. Range checks that depend on the
+// hardware are left to the Server.
+bool IsWellFormedFile(FileId file, const uint16_t *content, uint16_t length);
+
+// Assembles an upload record by record on the Server. Not thread safe on its own, the owner wraps it in
+// whatever lock suits the context.
+class FileUpload
+{
+public:
+	// Takes a WRITE record. Returns false if it's for another file than the upload in progress, doesn't fit,
+	// or would leave a gap. Rewriting records already taken is fine, a client retrying a lost response does.
+	bool Write(const FileRecordHeader &header, const uint16_t *data);
+
+	// true if the upload in progress is for file and matches the commit's length and CRC
+	bool Matches(FileId file, const FileCommit &commit) const;
+
+	const uint16_t *GetContent() const
+	{
+		return myContent;
+	}
+
+	void Reset()
+	{
+		myFile = 0;
+		myLength = 0;
+	}
+
+private:
+	uint16_t myContent[FILE_MAX_WRITABLE_LENGTH] = {};
+	uint16_t myFile = 0; // FileId of the upload in progress, 0 for none
+	uint16_t myLength = 0;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+// Modbus function codes as they appear on the wire. Shared by the client and server side instrumentation.
+enum class ModbusFunction : uint8_t
+{
+	READ_COILS = 0x01,
+	READ_DISCRETE_INPUTS = 0x02,
+	READ_HOLDING_REGISTERS = 0x03,
+	READ_INPUT_REGISTERS = 0x04,
+	WRITE_SINGLE_COIL = 0x05,
+	WRITE_SINGLE_REGISTER = 0x06,
+	DIAGNOSTICS = 0x08,
+	WRITE_MULTIPLE_COILS = 0x0F,
+	WRITE_MULTIPLE_REGISTERS = 0x10,
+	READ_FILE_RECORD = 0x14,
+	WRITE_FILE_RECORD = 0x15,
+	READ_WRITE_MULTIPLE_REGISTERS = 0x17,
+	READ_FIFO_QUEUE = 0x18,
+};
+
+static constexpr uint8_t MODBUS_EXCEPTION_FLAG = 0x80;
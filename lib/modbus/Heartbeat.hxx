@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Link supervision. The client writes HeartbeatRegisters to HEARTBEAT_ADDRESS every PERIOD_MS, the whole
+// block each time so a Server that rebooted picks the settings straight back up. If nothing arrives for
+// DEADLINE_MS the Server applies POLICY. Supervision starts with the first heartbeat, so a client that never
+// sends one leaves the Server running as it always did.
+// How the heartbeats are arriving is served as HeartbeatStatus input registers at the same address.
+
+static constexpr uint16_t HEARTBEAT_ADDRESS = 0x280; // holding registers for the heartbeat, input registers for its status
+
+enum class LinkLossPolicy : uint16_t
+{
+	HOLD,	   // keep controlling to the last setpoint
+	RAMP_DOWN, // bring the setpoint down at RAMP_DOWN_PER_MINUTE until the link comes back
+	SHUT_OFF,  // disable heating, it stays off until someone enables it again
+};
+
+enum class LinkState : uint16_t
+{
+	UNSUPERVISED, // no heartbeat yet, or DEADLINE_MS is 0
+	OK,
+	LOST,
+};
+
+struct HeartbeatRegisters
+{
+	uint16_t COUNTER;	  // incremented by the client for every heartbeat, gaps show heartbeats that never arrived
+	uint16_t PERIOD_MS;	  // how often the client sends one, jitter is measured against it
+	uint16_t DEADLINE_MS; // 0 turns supervision off
+	uint16_t POLICY;	  // LinkLossPolicy
+	uint16_t RAMP_DOWN_PER_MINUTE;
+
+	static constexpr uint16_t COUNT = 5;
+};
+
+struct HeartbeatStatus
+{
+	uint16_t STATE;	 // LinkState
+	uint16_t MISSES; // deadlines missed since boot
+	uint16_t LAST_INTERVAL_MS;
+	uint16_t P99_INTERVAL_MS;
+	uint16_t MAX_INTERVAL_MS;
+	uint16_t JITTER_MS; // mean distance of an interval from PERIOD_MS
+	uint16_t SINCE_LAST_MS;
+	uint16_t SKIPPED; // heartbeats missing from the COUNTER sequence
+
+	static constexpr uint16_t COUNT = 8;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+// Heater current and power, served by the Server as input registers starting at HEATER_POWER_ADDRESS. The
+// current transformer is sampled continuously and its true RMS worked out every half mains cycle. Everything
+// is 0, FITTED included, on a Server without the sensor.
+
+static constexpr uint16_t HEATER_POWER_ADDRESS = 0x500;
+
+struct HeaterPowerRegisters
+{
+	uint16_t FITTED;				// 1 if the current sensor is fitted and sampling
+	uint16_t CURRENT_CA;			// RMS over the last second, hundredths of an amp
+	uint16_t APPARENT_POWER_VA;		// over the last second, at MAINS_VOLTAGE_RMS
+	uint16_t HALF_CYCLE_CURRENT_CA; // RMS over the last half cycle
+	uint16_t SSR_ON;				// what the SSR was commanded to during it
+	uint16_t SKIPPED;				// half cycles the SSR switched in, or too soon after, so weren't checked. Saturating
+	uint16_t OVERRUNS;				// half cycles dropped because the task hadn't finished with both buffers. Saturating
+	uint16_t KERNEL_P99_US;			// 99th percentile time to work out one half cycle's RMS
+
+	static constexpr uint16_t COUNT = 8;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// Temperature history, served by the Server as input registers starting at HISTORY_ADDRESS.
+// The header is followed by a ring of HISTORY_CAPACITY samples where sample n always lives in slot
+// n % HISTORY_CAPACITY, so a client reads any window of the ring directly, no cursor write needed, and
+// checks each slot's SEQUENCE to know it got the sample it asked for and not a newer one that replaced it.
+// The capacity is a power of two so the 16 bit sequence wraps cleanly onto the slots.
+
+static constexpr uint16_t HISTORY_ADDRESS = 0x100;
+static constexpr uint16_t HISTORY_CAPACITY = 128;
+
+struct HistoryHeader
+{
+	uint16_t NEXT_SEQUENCE; // sequence the next sample will get, the newest one is NEXT_SEQUENCE - 1
+	uint16_t CAPACITY;
+	uint16_t SAMPLE_PERIOD_MS;
+	uint16_t RESERVED;
+
+	static constexpr uint16_t COUNT = 4;
+};
+
+struct HistorySample
+{
+	uint16_t SEQUENCE;
+	uint16_t TIME_DS; // tenths of a second since the Server booted, wraps every ~109 minutes
+	int16_t TEMP_DC;  // tenths of a degree C
+	uint16_t DUTY;	  // heater duty, same scale as HEATER_PWM_DUTY_CYCLE
+
+	static constexpr uint16_t COUNT = 4;
+};
+
+struct HistoryRegisters
+{
+	HistoryHeader header;
+	HistorySample samples[HISTORY_CAPACITY];
+
+	static constexpr uint16_t COUNT = HistoryHeader::COUNT + HISTORY_CAPACITY * HistorySample::COUNT;
+};
+
+static constexpr uint16_t HISTORY_SAMPLES_ADDRESS = HISTORY_ADDRESS + HistoryHeader::COUNT;
+
+// the most registers a single read may return is 125
+static constexpr uint16_t HISTORY_SAMPLES_PER_READ = 125 / HistorySample::COUNT;
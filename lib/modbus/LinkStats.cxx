@@ -0,0 +1,198 @@
+#include "LinkStats.hxx"
+
+size_t LatencyHistogram::BucketFor(uint32_t us)
+{
+	if (us < 4)
+	{
+		return us;
+	}
+
+	uint32_t octave = 31 - __builtin_clz(us);
+	size_t bucket = (octave - 1) * 4 + ((us >> (octave - 2)) & 3);
+
+	return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+}
+
+uint32_t LatencyHistogram::BucketLowerBound(size_t bucket)
+{
+	if (bucket < 4)
+	{
+		return bucket;
+	}
+
+	uint32_t octave = bucket / 4 + 1;
+	return (4 + bucket % 4) << (octave - 2);
+}
+
+void LatencyHistogram::Record(uint32_t us)
+{
+	myBuckets[BucketFor(us)]++;
+	myCount++;
+	mySum += us;
+
+	if (us < myMin)
+	{
+		myMin = us;
+	}
+
+	if (us > myMax)
+	{
+		myMax = us;
+	}
+}
+
+void LatencyHistogram::Reset()
+{
+	myBuckets.fill(0);
+	myCount = 0;
+	myMin = UINT32_MAX;
+	myMax = 0;
+	mySum = 0;
+}
+
+uint32_t LatencyHistogram::GetPercentile(float fraction) const
+{
+	if (myCount == 0)
+	{
+		return 0;
+	}
+
+	uint32_t target = static_cast<uint32_t>(fraction * myCount + 0.5f);
+	if (target == 0)
+	{
+		target = 1;
+	}
+
+	uint32_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; i++)
+	{
+		seen += myBuckets[i];
+		if (seen >= target)
+		{
+			if (i + 1 >= BUCKET_COUNT)
+			{
+				return myMax;
+			}
+
+			// the bucket's upper bound can overshoot what we actually saw
+			uint32_t upper = BucketLowerBound(i + 1) - 1;
+			return upper < myMax ? upper : myMax;
+		}
+	}
+
+	return myMax;
+}
+
+FunctionStats *LinkStats::findOrAdd(ModbusFunction function)
+{
+	uint8_t code = static_cast<uint8_t>(function);
+
+	for (size_t i = 0; i < myFunctionCount; i++)
+	{
+		if (myFunctions[i].functionCode == code)
+		{
+			return &myFunctions[i];
+		}
+	}
+
+	if (myFunctionCount >= MAX_TRACKED_FUNCTIONS)
+	{
+		return nullptr;
+	}
+
+	FunctionStats *stats = &myFunctions[myFunctionCount++];
+	stats->functionCode = code;
+	return stats;
+}
+
+void LinkStats::apply(FunctionStats &stats, TransactionResult result, uint32_t latencyUs)
+{
+	stats.requests++;
+
+	switch (result)
+	{
+	case TransactionResult::OK:
+		stats.latency.Record(latencyUs);
+		break;
+	case TransactionResult::TIMEOUT:
+		stats.timeouts++;
+		break;
+	case TransactionResult::CRC_ERROR:
+		stats.crcErrors++;
+		break;
+	case TransactionResult::EXCEPTION:
+		stats.exceptions++;
+		stats.latency.Record(latencyUs);
+		break;
+	case TransactionResult::FAILURE:
+	default:
+		stats.failures++;
+		break;
+	}
+}
+
+void LinkStats::Record(ModbusFunction function, TransactionResult result, uint32_t latencyUs)
+{
+	FunctionStats *stats = findOrAdd(function);
+	if (stats != nullptr)
+	{
+		apply(*stats, result, latencyUs);
+	}
+	apply(myTotals, result, latencyUs);
+
+	// an exception is still a working link, the server heard us and answered
+	bool answered = result == TransactionResult::OK || result == TransactionResult::EXCEPTION;
+	uint32_t sample = answered ? 65536 : 0;
+	mySuccessEwma = mySuccessEwma - (mySuccessEwma >> 4) + (sample >> 4);
+
+	if (answered)
+	{
+		if (myLatencyEwmaUs == 0)
+		{
+			myLatencyEwmaUs = latencyUs;
+		}
+		else
+		{
+			myLatencyEwmaUs = myLatencyEwmaUs - (myLatencyEwmaUs >> 4) + (latencyUs >> 4);
+		}
+	}
+}
+
+void LinkStats::Reset()
+{
+	for (size_t i = 0; i < myFunctionCount; i++)
+	{
+		myFunctions[i] = FunctionStats();
+	}
+	myFunctionCount = 0;
+	myTotals = FunctionStats();
+	mySuccessEwma = 65536;
+	myLatencyEwmaUs = 0;
+}
+
+const FunctionStats *LinkStats::GetFunction(ModbusFunction function) const
+{
+	uint8_t code = static_cast<uint8_t>(function);
+
+	for (size_t i = 0; i < myFunctionCount; i++)
+	{
+		if (myFunctions[i].functionCode == code)
+		{
+			return &myFunctions[i];
+		}
+	}
+
+	return nullptr;
+}
+
+uint8_t LinkStats::GetQuality() const
+{
+	uint64_t quality = static_cast<uint64_t>(mySuccessEwma) * 100 / 65536;
+
+	if (myLatencyEwmaUs > myLatencyBudgetUs)
+	{
+		quality = quality * myLatencyBudgetUs / myLatencyEwmaUs;
+	}
+
+	return static_cast<uint8_t>(quality > 100 ? 100 : quality);
+}
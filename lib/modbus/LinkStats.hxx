@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Functions.hxx"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class TransactionResult : uint8_t
+{
+	OK,
+	TIMEOUT,
+	CRC_ERROR, // CRC mismatch or otherwise malformed response
+	EXCEPTION, // the server answered with an exception response
+	FAILURE,   // anything else (uart error, no client, ...)
+};
+
+// Log-linear latency histogram in microseconds: 4 sub-buckets per power of two, so any percentile is
+// accurate to within 25% while the whole thing stays a few hundred bytes with no allocation.
+class LatencyHistogram
+{
+public:
+	static constexpr size_t BUCKET_COUNT = 88; // tops out at ~8 seconds, anything slower lands in the last bucket
+
+	void Record(uint32_t us);
+	void Reset();
+
+	uint32_t GetCount() const
+	{
+		return myCount;
+	}
+
+	uint32_t GetMin() const
+	{
+		return myCount ? myMin : 0;
+	}
+
+	uint32_t GetMax() const
+	{
+		return myMax;
+	}
+
+	uint32_t GetMean() const
+	{
+		return myCount ? static_cast<uint32_t>(mySum / myCount) : 0;
+	}
+
+	// fraction is 0.0 - 1.0, ie 0.99 for p99. Returns the upper bound of the bucket the percentile falls in.
+	uint32_t GetPercentile(float fraction) const;
+
+	static size_t BucketFor(uint32_t us);
+	static uint32_t BucketLowerBound(size_t bucket);
+
+private:
+	std::array<uint32_t, BUCKET_COUNT> myBuckets{};
+	uint32_t myCount = 0;
+	uint32_t myMin = UINT32_MAX;
+	uint32_t myMax = 0;
+	uint64_t mySum = 0;
+};
+
+struct FunctionStats
+{
+	uint8_t functionCode = 0;
+	uint32_t requests = 0;
+	uint32_t timeouts = 0;
+	uint32_t crcErrors = 0;
+	uint32_t exceptions = 0;
+	uint32_t failures = 0;
+	LatencyHistogram latency; // only answered transactions, a timeout would just measure the timeout
+};
+
+class LinkStats
+{
+public:
+	static constexpr size_t MAX_TRACKED_FUNCTIONS = 10;
+
+	// latencyBudgetUs is the round trip we consider healthy, slower links lose quality score proportionally
+	LinkStats(uint32_t latencyBudgetUs = 20000) : myLatencyBudgetUs(latencyBudgetUs) {}
+
+	void Record(ModbusFunction function, TransactionResult result, uint32_t latencyUs);
+	void Reset();
+
+	const FunctionStats *GetFunction(ModbusFunction function) const;
+
+	size_t GetFunctionCount() const
+	{
+		return myFunctionCount;
+	}
+
+	const FunctionStats &GetFunctionAt(size_t index) const
+	{
+		return myFunctions[index];
+	}
+
+	const FunctionStats &GetTotals() const
+	{
+		return myTotals;
+	}
+
+	// 0 - 100. Recent success ratio scaled down by how far the recent mean latency exceeds the budget.
+	uint8_t GetQuality() const;
+
+	// exponentially weighted mean of answered transactions, 0 until there has been one
+	uint32_t GetLatencyEwmaUs() const
+	{
+		return myLatencyEwmaUs;
+	}
+
+private:
+	uint32_t myLatencyBudgetUs;
+
+	std::array<FunctionStats, MAX_TRACKED_FUNCTIONS> myFunctions;
+	size_t myFunctionCount = 0;
+	FunctionStats myTotals;
+
+	// exponentially weighted, alpha = 1/16. Success is Q16 (65536 == 100%).
+	uint32_t mySuccessEwma = 65536;
+	uint32_t myLatencyEwmaUs = 0;
+
+	FunctionStats *findOrAdd(ModbusFunction function);
+	static void apply(FunctionStats &stats, TransactionResult result, uint32_t latencyUs);
+};
@@ -0,0 +1,102 @@
+#include "PollScheduler.hxx"
+
+bool PollScheduler::AddUnit(uint8_t unit)
+{
+	if (myUnitCount >= MAX_UNITS || Find(unit) != myUnitCount)
+	{
+		return false;
+	}
+
+	myUnits[myUnitCount++] = {.id = unit};
+	return true;
+}
+
+size_t PollScheduler::Find(uint8_t unit) const
+{
+	for (size_t i = 0; i < myUnitCount; i++)
+	{
+		if (myUnits[i].id == unit)
+		{
+			return i;
+		}
+	}
+	return myUnitCount;
+}
+
+bool PollScheduler::Next(uint32_t nowMs, size_t &index, uint32_t &waitMs) const
+{
+	int32_t mostOverdue = INT32_MIN;
+
+	for (size_t i = 0; i < myUnitCount; i++)
+	{
+		const Unit &unit = myUnits[i];
+		if (!unit.polled)
+		{
+			index = i;
+			waitMs = 0;
+			return true;
+		}
+
+		int32_t overdue = static_cast<int32_t>(nowMs - unit.lastPollMs - GetPeriodMs(i));
+
+		// ties go to the foreground unit
+		if (overdue > mostOverdue || (overdue == mostOverdue && i == myForeground))
+		{
+			mostOverdue = overdue;
+			index = i;
+		}
+	}
+
+	if (myUnitCount == 0)
+	{
+		waitMs = myBackgroundPeriodMs;
+		return false;
+	}
+
+	waitMs = mostOverdue < 0 ? -mostOverdue : 0;
+	return mostOverdue >= 0;
+}
+
+void PollScheduler::Polled(size_t index, uint32_t nowMs, bool success, bool alarm)
+{
+	Unit &unit = myUnits[index];
+	unit.lastPollMs = nowMs;
+	unit.polled = true;
+
+	// not answering is as much a reason to keep an eye on it as an alarm
+	unit.alarm = alarm || !success;
+
+	if (!success)
+	{
+		return;
+	}
+
+	if (unit.succeeded)
+	{
+		uint32_t interval = nowMs - unit.lastSuccessMs;
+		unit.refreshEwmaMs = unit.refreshEwmaMs == 0 ? interval : unit.refreshEwmaMs - unit.refreshEwmaMs / 4 + interval / 4;
+	}
+	unit.lastSuccessMs = nowMs;
+	unit.succeeded = true;
+}
+
+void PollScheduler::PollWithin(size_t index, uint32_t nowMs, uint32_t delayMs)
+{
+	Unit &unit = myUnits[index];
+	uint32_t period = GetPeriodMs(index);
+	if (!unit.polled || delayMs >= period)
+	{
+		return;
+	}
+
+	uint32_t sinceLast = nowMs - unit.lastPollMs;
+	if (sinceLast < period - delayMs)
+	{
+		unit.lastPollMs = nowMs - (period - delayMs);
+	}
+}
+
+uint32_t PollScheduler::GetPeriodMs(size_t index) const
+{
+	return index == myForeground || myUnits[index].alarm ? myForegroundPeriodMs : myBackgroundPeriodMs;
+}
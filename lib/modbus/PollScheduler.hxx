@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Decides which unit on a shared bus gets its status polled next. The foreground unit (the one on screen) is
+// polled every foregroundPeriodMs and the rest every backgroundPeriodMs. A background unit that raised an
+// alarm or stopped answering is brought up to the foreground rate until a poll comes back clear, so trouble
+// on a furnace nobody is looking at still shows up within one foreground period.
+// Times are milliseconds from any free running clock, differences are taken so it may wrap. Not thread safe
+// on its own, the owner wraps it in whatever lock suits the context.
+class PollScheduler
+{
+public:
+	static constexpr size_t MAX_UNITS = 8;
+
+	PollScheduler(uint32_t foregroundPeriodMs, uint32_t backgroundPeriodMs)
+		: myForegroundPeriodMs(foregroundPeriodMs), myBackgroundPeriodMs(backgroundPeriodMs) {}
+
+	// false when the unit is already there or there's no room, the first unit added is the foreground one.
+	// A new unit is due straight away.
+	bool AddUnit(uint8_t unit);
+
+	size_t GetUnitCount() const
+	{
+		return myUnitCount;
+	}
+
+	uint8_t GetUnitAt(size_t index) const
+	{
+		return myUnits[index].id;
+	}
+
+	// index of the unit, or GetUnitCount() if it isn't one of ours
+	size_t Find(uint8_t unit) const;
+
+	void SetForeground(size_t index)
+	{
+		myForeground = index;
+	}
+
+	size_t GetForeground() const
+	{
+		return myForeground;
+	}
+
+	// The unit most overdue for a poll, true if one is due now. Otherwise waitMs is how long until one is.
+	bool Next(uint32_t nowMs, size_t &index, uint32_t &waitMs) const;
+
+	// A poll of the unit finished. alarm keeps it at the foreground rate until a poll comes back clear.
+	void Polled(size_t index, uint32_t nowMs, bool success, bool alarm);
+
+	// makes the unit due in delayMs if that's sooner than it would have been
+	void PollWithin(size_t index, uint32_t nowMs, uint32_t delayMs);
+
+	// how often the unit is polled now, foreground or background rate
+	uint32_t GetPeriodMs(size_t index) const;
+
+	// mean time between successful polls, 0 until there have been two
+	uint32_t GetRefreshIntervalMs(size_t index) const
+	{
+		return myUnits[index].refreshEwmaMs;
+	}
+
+	bool IsAlarmed(size_t index) const
+	{
+		return myUnits[index].alarm;
+	}
+
+private:
+	struct Unit
+	{
+		uint8_t id = 0;
+		uint32_t lastPollMs = 0;
+		uint32_t lastSuccessMs = 0;
+		uint32_t refreshEwmaMs = 0; // alpha = 1/4, the rate changes as soon as the furnace on screen does
+		bool polled = false;
+		bool succeeded = false;
+		bool alarm = false;
+	};
+
+	uint32_t myForegroundPeriodMs;
+	uint32_t myBackgroundPeriodMs;
+	std::array<Unit, MAX_UNITS> myUnits{};
+	size_t myUnitCount = 0;
+	size_t myForeground = 0;
+};
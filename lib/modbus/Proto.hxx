@@ -1,15 +1,17 @@
 #pragma once
 
-#include "hardware.h"
-#include <array>
-#include <pl_modbus.h>
-#include <pl_uart.h>
-#include <utility>
+#include "ConfigTransaction.hxx"
+
+#include <cstdint>
+
+// Register layout served by the Server. Plain structs with no ESP-IDF dependencies so the host tools can
+// use them too.
 
 #pragma pack(push, 1)
 struct Coils
 {
 	uint8_t ENABLE : 1;
+	uint8_t FAULT_RESET : 1; // writing 1 is the operator reset for latched errors, see FaultPolicy. Always reads 0.
 };
 #pragma pack(pop)
 
@@ -34,6 +36,8 @@ struct HoldingRegisters
 	static constexpr uint16_t COUNT = 8;
 };
 
+static_assert(HoldingRegisters::COUNT == CONFIG_REGISTER_COUNT, "a config transaction stages the whole holding register block");
+
 struct InputRegisters
 {
 	uint16_t HEATER_PWM_DUTY_CYCLE;
@@ -41,3 +45,24 @@ struct InputRegisters
 	uint16_t ERROR_CODE;
 	static constexpr uint16_t COUNT = 3;
 };
+
+static_assert(CONFIG_RESULT_ADDRESS == InputRegisters::COUNT, "the config result follows the status registers");
+
+// The input register area at 0, the status followed by the outcome of the last config transaction
+struct StatusRegisters
+{
+	InputRegisters inputs;
+	ConfigResult config;
+
+	static constexpr uint16_t COUNT = InputRegisters::COUNT + ConfigResult::COUNT;
+};
+
+// Everything the Server's Modbus areas serve, published once per control loop tick so OnRead() is a copy
+struct ServerRegisters
+{
+	Coils coils;
+	DiscreteInputs discreteInputs;
+	HoldingRegisters holding;
+	InputRegisters inputs;
+	ConfigResult configResult;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Double buffered snapshot of whatever the Modbus areas serve. One writer (the control loop) builds the
+// next image in the buffer nobody is pointed at and flips to it, readers copy out of the current one.
+// Each buffer carries a sequence count, odd while it's being written, so a reader that got overtaken by
+// two publishes in a row notices and copies again instead of returning a torn image. Neither side ever
+// blocks, which keeps the Modbus task's response time independent of what the controller is doing.
+//
+// Publish() must not be called from two tasks at once, wrap it in a lock if it has more than one caller.
+template <typename Image>
+class RegisterImage
+{
+public:
+	void Publish(const Image &image)
+	{
+		uint32_t next = 1 - myCurrent.load(std::memory_order_relaxed);
+
+		mySequence[next].fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		myImages[next] = image;
+		std::atomic_thread_fence(std::memory_order_release);
+		mySequence[next].fetch_add(1, std::memory_order_relaxed);
+
+		myCurrent.store(next, std::memory_order_release);
+		myPublished.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Read(Image &image) const
+	{
+		while (true)
+		{
+			uint32_t current = myCurrent.load(std::memory_order_acquire);
+			uint32_t before = mySequence[current].load(std::memory_order_acquire);
+
+			if (before & 1)
+			{
+				continue;
+			}
+
+			image = myImages[current];
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (mySequence[current].load(std::memory_order_relaxed) == before)
+			{
+				return;
+			}
+		}
+	}
+
+	// how many images have been published, 0 means Read() returns a default constructed image
+	uint32_t GetPublished() const
+	{
+		return myPublished.load(std::memory_order_relaxed);
+	}
+
+private:
+	Image myImages[2] = {};
+	std::atomic<uint32_t> mySequence[2] = {};
+	std::atomic<uint32_t> myCurrent = 0;
+	std::atomic<uint32_t> myPublished = 0;
+};
@@ -0,0 +1,186 @@
+#include "Rtu.hxx"
+
+uint16_t ModbusCrc16(const uint8_t *data, size_t length, uint16_t crc)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		}
+	}
+
+	return crc;
+}
+
+size_t AppendModbusCrc(uint8_t *frame, size_t length)
+{
+	uint16_t crc = ModbusCrc16(frame, length);
+	frame[length] = crc & 0xFF;
+	frame[length + 1] = crc >> 8;
+	return length + 2;
+}
+
+bool CheckModbusCrc(const uint8_t *frame, size_t length)
+{
+	if (length < 4)
+	{
+		return false;
+	}
+
+	uint16_t crc = frame[length - 2] | (frame[length - 1] << 8);
+	return ModbusCrc16(frame, length - 2) == crc;
+}
+
+size_t BuildReadRequest(uint8_t unit, ModbusFunction function, uint16_t address, uint16_t count, uint8_t *out)
+{
+	out[0] = unit;
+	out[1] = static_cast<uint8_t>(function);
+	PutBe16(out + 2, address);
+	PutBe16(out + 4, count);
+	return AppendModbusCrc(out, 6);
+}
+
+size_t BuildWriteSingleRequest(uint8_t unit, ModbusFunction function, uint16_t address, uint16_t value, uint8_t *out)
+{
+	out[0] = unit;
+	out[1] = static_cast<uint8_t>(function);
+	PutBe16(out + 2, address);
+	PutBe16(out + 4, value);
+	return AppendModbusCrc(out, 6);
+}
+
+size_t BuildWriteMultipleRegistersRequest(uint8_t unit, uint16_t address, uint16_t count, const uint16_t *values, uint8_t *out)
+{
+	out[0] = unit;
+	out[1] = static_cast<uint8_t>(ModbusFunction::WRITE_MULTIPLE_REGISTERS);
+	PutBe16(out + 2, address);
+	PutBe16(out + 4, count);
+	out[6] = count * 2;
+	for (uint16_t i = 0; i < count; i++)
+	{
+		PutBe16(out + 7 + i * 2, values[i]);
+	}
+	return AppendModbusCrc(out, 7 + count * 2);
+}
+
+size_t RequestFrameLength(const uint8_t *data, size_t available)
+{
+	if (available < 2)
+	{
+		return 0;
+	}
+
+	switch (static_cast<ModbusFunction>(data[1]))
+	{
+	case ModbusFunction::READ_COILS:
+	case ModbusFunction::READ_DISCRETE_INPUTS:
+	case ModbusFunction::READ_HOLDING_REGISTERS:
+	case ModbusFunction::READ_INPUT_REGISTERS:
+	case ModbusFunction::WRITE_SINGLE_COIL:
+	case ModbusFunction::WRITE_SINGLE_REGISTER:
+	case ModbusFunction::DIAGNOSTICS:
+		return 8;
+	case ModbusFunction::WRITE_MULTIPLE_COILS:
+	case ModbusFunction::WRITE_MULTIPLE_REGISTERS:
+		return available < 7 ? 0 : 9 + data[6];
+	case ModbusFunction::READ_WRITE_MULTIPLE_REGISTERS:
+		return available < 11 ? 0 : 13 + data[10];
+	case ModbusFunction::READ_FILE_RECORD:
+	case ModbusFunction::WRITE_FILE_RECORD:
+		return available < 3 ? 0 : 5 + data[2];
+	case ModbusFunction::READ_FIFO_QUEUE:
+		return 6;
+	default:
+		return SIZE_MAX;
+	}
+}
+
+size_t ResponseFrameLength(const uint8_t *data, size_t available)
+{
+	if (available < 2)
+	{
+		return 0;
+	}
+
+	if (data[1] & MODBUS_EXCEPTION_FLAG)
+	{
+		return 5;
+	}
+
+	switch (static_cast<ModbusFunction>(data[1]))
+	{
+	case ModbusFunction::READ_COILS:
+	case ModbusFunction::READ_DISCRETE_INPUTS:
+	case ModbusFunction::READ_HOLDING_REGISTERS:
+	case ModbusFunction::READ_INPUT_REGISTERS:
+	case ModbusFunction::READ_WRITE_MULTIPLE_REGISTERS:
+	case ModbusFunction::READ_FILE_RECORD:
+	case ModbusFunction::WRITE_FILE_RECORD:
+		return available < 3 ? 0 : 5 + data[2];
+	case ModbusFunction::WRITE_SINGLE_COIL:
+	case ModbusFunction::WRITE_SINGLE_REGISTER:
+	case ModbusFunction::WRITE_MULTIPLE_COILS:
+	case ModbusFunction::WRITE_MULTIPLE_REGISTERS:
+	case ModbusFunction::DIAGNOSTICS:
+		return 8;
+	case ModbusFunction::READ_FIFO_QUEUE:
+		return available < 4 ? 0 : 6 + GetBe16(data + 2);
+	default:
+		return SIZE_MAX;
+	}
+}
+
+bool ParseRtuFrame(const uint8_t *frame, size_t length, bool isRequest, RtuFrameInfo &info)
+{
+	if (length < 4)
+	{
+		return false;
+	}
+
+	info = RtuFrameInfo();
+	info.unit = frame[0];
+	info.function = frame[1];
+
+	if (info.IsException())
+	{
+		info.exceptionCode = frame[2];
+		return true;
+	}
+
+	switch (static_cast<ModbusFunction>(info.function))
+	{
+	case ModbusFunction::READ_COILS:
+	case ModbusFunction::READ_DISCRETE_INPUTS:
+	case ModbusFunction::READ_HOLDING_REGISTERS:
+	case ModbusFunction::READ_INPUT_REGISTERS:
+		if (isRequest && length >= 8)
+		{
+			info.address = GetBe16(frame + 2);
+			info.count = GetBe16(frame + 4);
+		}
+		break;
+	case ModbusFunction::WRITE_SINGLE_COIL:
+	case ModbusFunction::WRITE_SINGLE_REGISTER:
+		if (length >= 8)
+		{
+			info.address = GetBe16(frame + 2);
+			info.count = 1;
+		}
+		break;
+	case ModbusFunction::WRITE_MULTIPLE_COILS:
+	case ModbusFunction::WRITE_MULTIPLE_REGISTERS:
+	case ModbusFunction::READ_WRITE_MULTIPLE_REGISTERS:
+		if (length >= 8)
+		{
+			info.address = GetBe16(frame + 2);
+			info.count = GetBe16(frame + 4);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return true;
+}
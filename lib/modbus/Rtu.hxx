@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Functions.hxx"
+
+#include <cstddef>
+#include <cstdint>
+
+// Modbus RTU framing helpers that don't depend on pl_modbus, for the host tools and for anything on the
+// devices that needs to look at frames on the wire. Multi-byte fields are big endian as on the wire.
+
+static constexpr size_t RTU_MAX_FRAME = 256;
+
+inline uint16_t GetBe16(const uint8_t *data)
+{
+	return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+inline void PutBe16(uint8_t *data, uint16_t value)
+{
+	data[0] = value >> 8;
+	data[1] = value & 0xFF;
+}
+
+// CRC-16/MODBUS (poly 0xA001 reflected, init 0xFFFF), sent low byte first. Pass the previous result as crc
+// to carry on over more data.
+uint16_t ModbusCrc16(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF);
+
+// appends the CRC to a frame of length bytes, returns the new length
+size_t AppendModbusCrc(uint8_t *frame, size_t length);
+
+// length includes the CRC
+bool CheckModbusCrc(const uint8_t *frame, size_t length);
+
+// Read requests for functions 1-4
+size_t BuildReadRequest(uint8_t unit, ModbusFunction function, uint16_t address, uint16_t count, uint8_t *out);
+
+// Function 5 or 6. For a coil pass 0xFF00 for on and 0 for off.
+size_t BuildWriteSingleRequest(uint8_t unit, ModbusFunction function, uint16_t address, uint16_t value, uint8_t *out);
+
+size_t BuildWriteMultipleRegistersRequest(uint8_t unit, uint16_t address, uint16_t count, const uint16_t *values, uint8_t *out);
+
+// The fixed parts of a request or response frame, whatever the function. Which fields mean anything
+// depends on the function, address and count are zero where the frame doesn't carry them.
+struct RtuFrameInfo
+{
+	uint8_t unit = 0;
+	uint8_t function = 0; // including MODBUS_EXCEPTION_FLAG on an exception response
+	uint16_t address = 0;
+	uint16_t count = 0;
+	uint8_t exceptionCode = 0;
+
+	bool IsException() const
+	{
+		return (function & MODBUS_EXCEPTION_FLAG) != 0;
+	}
+};
+
+// Length of the complete request frame at the start of data, 0 when more bytes are needed to tell, or
+// SIZE_MAX when the function isn't one we know how to delimit.
+size_t RequestFrameLength(const uint8_t *data, size_t available);
+
+// Same for the response to a request with the given function.
+size_t ResponseFrameLength(const uint8_t *data, size_t available);
+
+// Fills info from a complete request (isRequest) or response frame. Returns false if it's too short.
+bool ParseRtuFrame(const uint8_t *frame, size_t length, bool isRequest, RtuFrameInfo &info);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// Task supervision, served by the Server as input registers starting at TASK_HEALTH_ADDRESS. Each periodic
+// task checks in every cycle. Going longer than its deadline between check-ins is a miss, and a critical task
+// that keeps missing puts the furnace in its safe state (heater off, emergency relay off). The TASK_STALLED
+// error that goes with it is latched until a power cycle, kept through a warm reset too, so a task that
+// recovers doesn't bring the heating back.
+
+static constexpr uint16_t TASK_HEALTH_ADDRESS = 0x480;
+
+// entry n of TaskHealthRegisters is task n
+enum class SupervisedTask : uint16_t
+{
+	PID,
+	HEAT_RATE,
+	THERMOCOUPLE,
+	ERROR_CHECK,
+	HISTORY,
+	LINK_SUPERVISOR,
+	STATUS_OVERLAY,
+	CURRENT,
+	COUNT,
+};
+
+enum class TaskState : uint16_t
+{
+	NOT_STARTED, // hasn't checked in yet, or isn't running in this build
+	OK,
+	LATE,	 // past its deadline right now
+	STALLED, // missing enough deadlines in a row to have tripped the safe state, OK again once it recovers
+};
+
+struct TaskHealthHeader
+{
+	uint16_t TASKS;	  // entries that follow
+	uint16_t STALLED; // a bit per task stalled right now. A bit that has cleared again leaves TASK_STALLED latched until a power cycle
+	uint16_t RESERVED[2];
+
+	static constexpr uint16_t COUNT = 4;
+};
+
+struct TaskHealthEntry
+{
+	uint16_t STATE; // TaskState
+	uint16_t PERIOD_MS;
+	uint16_t DEADLINE_MS;
+	uint16_t MISSES; // deadlines missed since boot
+	uint16_t LAST_INTERVAL_MS;
+	uint16_t MAX_INTERVAL_MS;
+	uint16_t JITTER_P99_US; // 99th percentile distance of an interval from PERIOD_MS, saturating
+	uint16_t SINCE_LAST_MS;
+
+	static constexpr uint16_t COUNT = 8;
+};
+
+struct TaskHealthRegisters
+{
+	TaskHealthHeader header;
+	TaskHealthEntry entries[static_cast<uint16_t>(SupervisedTask::COUNT)];
+
+	static constexpr uint16_t COUNT = TaskHealthHeader::COUNT + static_cast<uint16_t>(SupervisedTask::COUNT) * TaskHealthEntry::COUNT;
+};
@@ -0,0 +1,380 @@
+#include "TrafficRecorder.hxx"
+
+#include <string.h>
+
+static constexpr size_t TRAFFIC_MAX_VARINT = 10;
+
+static size_t putVarint(uint8_t *out, uint64_t value)
+{
+	size_t length = 0;
+	while (value >= 0x80)
+	{
+		out[length++] = static_cast<uint8_t>(value | 0x80);
+		value >>= 7;
+	}
+	out[length++] = static_cast<uint8_t>(value);
+	return length;
+}
+
+static void putLe16(uint8_t *out, uint16_t value)
+{
+	out[0] = value & 0xFF;
+	out[1] = value >> 8;
+}
+
+static void putLe32(uint8_t *out, uint32_t value)
+{
+	putLe16(out, value & 0xFFFF);
+	putLe16(out + 2, value >> 16);
+}
+
+static uint16_t getLe16(const uint8_t *data)
+{
+	return static_cast<uint16_t>(data[0] | data[1] << 8);
+}
+
+static uint32_t getLe32(const uint8_t *data)
+{
+	return getLe16(data) | static_cast<uint32_t>(getLe16(data + 2)) << 16;
+}
+
+TrafficRecorder::TrafficRecorder(TrafficRole role, uint8_t unit, size_t capacity, uint32_t mergeGapUs)
+	: myRole(role), myUnit(unit), myCapacity(capacity), myMergeGapUs(mergeGapUs), myRing(new uint8_t[capacity])
+{
+}
+
+void TrafficRecorder::Record(bool written, const uint8_t *data, size_t length, int64_t nowUs)
+{
+	if (myHaveLast && written == myLastWritten && nowUs - myLastChunkUs <= myMergeGapUs && myLastLength + length <= TRAFFIC_MAX_RECORD &&
+		makeRoom(length, true))
+	{
+		putBytes(data, length);
+		myLastLength += length;
+		myLastChunkUs = nowUs;
+
+		int64_t span = nowUs - myLastStartUs;
+		poke16(myLastFields, span > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(span));
+		poke16(myLastFields + 2, myLastLength);
+		return;
+	}
+
+	while (length > 0)
+	{
+		size_t take = length < TRAFFIC_MAX_RECORD ? length : TRAFFIC_MAX_RECORD;
+		append(written, data, take, nowUs);
+		data += take;
+		length -= take;
+	}
+}
+
+size_t TrafficRecorder::Export(uint8_t *out, size_t size) const
+{
+	size_t used = static_cast<size_t>(myHead - myTail);
+	if (size < TrafficDumpHeader::SIZE + used)
+	{
+		return 0;
+	}
+
+	memcpy(out, TRAFFIC_MAGIC, sizeof(TRAFFIC_MAGIC));
+	out[4] = TRAFFIC_VERSION;
+	out[5] = static_cast<uint8_t>(myRole);
+	out[6] = myUnit;
+	out[7] = 0;
+	putLe32(out + 8, static_cast<uint32_t>(myTailUs));
+	putLe32(out + 12, static_cast<uint32_t>(static_cast<uint64_t>(myTailUs) >> 32));
+	putLe32(out + 16, static_cast<uint32_t>(used));
+	putLe32(out + 20, myDropped);
+	putLe32(out + 24, myRecorded);
+
+	for (size_t i = 0; i < used; i++)
+	{
+		out[TrafficDumpHeader::SIZE + i] = at(myTail + i);
+	}
+
+	return TrafficDumpHeader::SIZE + used;
+}
+
+void TrafficRecorder::Clear()
+{
+	myHead = 0;
+	myTail = 0;
+	myTailUs = 0;
+	myHaveLast = false;
+	myDropped = 0;
+	myRecorded = 0;
+}
+
+void TrafficRecorder::putBytes(const uint8_t *data, size_t length)
+{
+	// at most two copies, either side of the end of the ring
+	size_t index = static_cast<size_t>(myHead % myCapacity);
+	size_t first = length < myCapacity - index ? length : myCapacity - index;
+	memcpy(&myRing[index], data, first);
+	memcpy(&myRing[0], data + first, length - first);
+	myHead += length;
+}
+
+uint8_t TrafficRecorder::at(uint64_t offset) const
+{
+	return myRing[offset % myCapacity];
+}
+
+void TrafficRecorder::poke16(uint64_t offset, uint16_t value)
+{
+	myRing[offset % myCapacity] = value & 0xFF;
+	myRing[(offset + 1) % myCapacity] = value >> 8;
+}
+
+// size of the record at offset, and its start relative to the one before
+size_t TrafficRecorder::recordSize(uint64_t offset, uint64_t &startDelta) const
+{
+	size_t size = 1;
+	startDelta = 0;
+
+	for (int shift = 0;; shift += 7)
+	{
+		uint8_t byte = at(offset + size++);
+		startDelta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			break;
+		}
+	}
+
+	uint16_t length = at(offset + size + 2) | at(offset + size + 3) << 8;
+	return size + 4 + length;
+}
+
+void TrafficRecorder::dropOldest()
+{
+	uint64_t startDelta;
+	if (myHaveLast && myTail == myLastRecord)
+	{
+		myHaveLast = false;
+	}
+	myTail += recordSize(myTail, startDelta);
+	myDropped++;
+
+	// the next record's start is relative to the one just dropped
+	if (myTail < myHead)
+	{
+		recordSize(myTail, startDelta);
+		myTailUs += static_cast<int64_t>(startDelta);
+	}
+}
+
+// Drops the oldest records until needed more bytes fit. With keepLast the newest record, which a merge is
+// about to extend, stays and it returns false if that isn't enough.
+bool TrafficRecorder::makeRoom(size_t needed, bool keepLast)
+{
+	if (needed > myCapacity)
+	{
+		return false;
+	}
+
+	while (myHead - myTail + needed > myCapacity)
+	{
+		if (keepLast && myTail == myLastRecord)
+		{
+			return false;
+		}
+		dropOldest();
+	}
+	return true;
+}
+
+void TrafficRecorder::append(bool written, const uint8_t *data, size_t length, int64_t nowUs)
+{
+	myRecorded++;
+
+	bool empty = myHead == myTail;
+	int64_t delta = empty || nowUs < myLastStartUs ? 0 : nowUs - myLastStartUs;
+
+	uint8_t header[1 + TRAFFIC_MAX_VARINT + 4];
+	header[0] = written ? TRAFFIC_WRITTEN : 0;
+	size_t fields = 1 + putVarint(header + 1, static_cast<uint64_t>(delta));
+	putLe16(header + fields, 0);
+	putLe16(header + fields + 2, static_cast<uint16_t>(length));
+
+	if (!makeRoom(fields + 4 + length, false))
+	{
+		myDropped++;
+		return;
+	}
+
+	// dropping records may have emptied the ring
+	if (myHead == myTail)
+	{
+		myTailUs = nowUs;
+	}
+
+	myLastRecord = myHead;
+	myLastFields = myHead + fields;
+	putBytes(header, fields + 4);
+	putBytes(data, length);
+
+	myHaveLast = true;
+	myLastWritten = written;
+	myLastStartUs = nowUs;
+	myLastChunkUs = nowUs;
+	myLastLength = static_cast<uint16_t>(length);
+}
+
+bool TrafficReader::Open(const uint8_t *data, size_t size)
+{
+	if (size < TrafficDumpHeader::SIZE || memcmp(data, TRAFFIC_MAGIC, sizeof(TRAFFIC_MAGIC)) != 0 || data[4] != TRAFFIC_VERSION)
+	{
+		return false;
+	}
+
+	myHeader.role = static_cast<TrafficRole>(data[5]);
+	myHeader.unit = data[6];
+	myHeader.startUs = static_cast<int64_t>(getLe32(data + 8) | static_cast<uint64_t>(getLe32(data + 12)) << 32);
+	myHeader.length = getLe32(data + 16);
+	myHeader.dropped = getLe32(data + 20);
+	myHeader.recorded = getLe32(data + 24);
+
+	if (size - TrafficDumpHeader::SIZE < myHeader.length)
+	{
+		return false;
+	}
+
+	myData = data + TrafficDumpHeader::SIZE;
+	mySize = myHeader.length;
+	myOffset = 0;
+	myTimeUs = myHeader.startUs;
+	myFirst = true;
+	return true;
+}
+
+bool TrafficReader::Next(TrafficChunk &chunk)
+{
+	size_t offset = myOffset;
+	if (offset >= mySize)
+	{
+		return false;
+	}
+
+	uint8_t flags = myData[offset++];
+
+	uint64_t delta = 0;
+	for (int shift = 0;; shift += 7)
+	{
+		if (offset >= mySize || shift > 63)
+		{
+			return false;
+		}
+		uint8_t byte = myData[offset++];
+		delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			break;
+		}
+	}
+
+	if (mySize - offset < 4)
+	{
+		return false;
+	}
+	uint16_t span = getLe16(myData + offset);
+	uint16_t length = getLe16(myData + offset + 2);
+	offset += 4;
+
+	if (mySize - offset < length)
+	{
+		return false;
+	}
+
+	if (!myFirst)
+	{
+		myTimeUs += static_cast<int64_t>(delta);
+	}
+	myFirst = false;
+
+	chunk.written = (flags & TRAFFIC_WRITTEN) != 0;
+	chunk.startUs = myTimeUs;
+	chunk.spanUs = span;
+	chunk.data = myData + offset;
+	chunk.length = length;
+
+	myOffset = offset + length;
+	return true;
+}
+
+static const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t TrafficBase64Encode(const uint8_t *data, size_t length, char *out)
+{
+	size_t written = 0;
+
+	for (size_t i = 0; i < length; i += 3)
+	{
+		uint32_t group = data[i] << 16;
+		if (i + 1 < length)
+		{
+			group |= data[i + 1] << 8;
+		}
+		if (i + 2 < length)
+		{
+			group |= data[i + 2];
+		}
+
+		out[written++] = BASE64_ALPHABET[(group >> 18) & 0x3F];
+		out[written++] = BASE64_ALPHABET[(group >> 12) & 0x3F];
+		out[written++] = i + 1 < length ? BASE64_ALPHABET[(group >> 6) & 0x3F] : '=';
+		out[written++] = i + 2 < length ? BASE64_ALPHABET[group & 0x3F] : '=';
+	}
+
+	return written;
+}
+
+static int base64Value(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+	{
+		return c - 'A';
+	}
+	if (c >= 'a' && c <= 'z')
+	{
+		return c - 'a' + 26;
+	}
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0' + 52;
+	}
+	if (c == '+')
+	{
+		return 62;
+	}
+	if (c == '/')
+	{
+		return 63;
+	}
+	return -1;
+}
+
+size_t TrafficBase64Decode(const char *text, size_t length, uint8_t *out)
+{
+	size_t written = 0;
+	uint32_t group = 0;
+	int bits = 0;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		int value = base64Value(text[i]);
+		if (value < 0)
+		{
+			continue;
+		}
+
+		group = group << 6 | value;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			out[written++] = static_cast<uint8_t>(group >> bits);
+		}
+	}
+
+	return written;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Flight recorder for the serial link. Every chunk LinkUart reads or writes goes into a RAM ring with a
+// timestamp, the oldest records making room for new ones, so whatever led up to a problem is still there
+// when someone asks for a dump. Chunks of the same direction arriving less than mergeGapUs apart are
+// appended to the record before, so a frame the UART hands over in pieces costs one record header.
+// Recording is a memcpy and a few varint bytes, cheap enough to leave on.
+//
+// An export is a TrafficDumpHeader followed by the records oldest first, little endian throughout:
+//   u8 flags (TRAFFIC_WRITTEN)
+//   varint start, microseconds after the previous record's start, ignored for the first record
+//   u16 span, microseconds from the start to the last merged chunk, saturating
+//   u16 length, then length bytes of data
+// Host/traffic_tool decodes it, see there for what it can do with one.
+// Not thread safe on its own, the owner wraps it in whatever lock suits the context.
+
+static constexpr uint8_t TRAFFIC_MAGIC[4] = {'M', 'B', 'T', 'R'};
+static constexpr uint8_t TRAFFIC_VERSION = 1;
+static constexpr uint8_t TRAFFIC_WRITTEN = 0x01; // flags, sent by the recording end rather than received
+
+static constexpr size_t TRAFFIC_MAX_RECORD = 512; // two maximum size frames, longer chunks are split
+
+enum class TrafficRole : uint8_t
+{
+	SERVER, // reads are requests, writes are responses
+	CLIENT, // writes are requests, reads are responses
+};
+
+struct TrafficDumpHeader
+{
+	TrafficRole role;
+	uint8_t unit;		// the Server's unit id, 0 for a client
+	int64_t startUs;	// esp_timer time of the first record
+	uint32_t length;	// bytes of records following the header
+	uint32_t dropped;	// records the ring overwrote since it was cleared
+	uint32_t recorded; // records since it was cleared, dropped ones included
+
+	static constexpr size_t SIZE = 4 + 4 + 8 + 4 + 4 + 4;
+};
+
+struct TrafficChunk
+{
+	bool written;
+	int64_t startUs;
+	uint32_t spanUs;
+	const uint8_t *data;
+	uint16_t length;
+};
+
+class TrafficRecorder
+{
+public:
+	TrafficRecorder(TrafficRole role, uint8_t unit, size_t capacity, uint32_t mergeGapUs);
+
+	void Record(bool written, const uint8_t *data, size_t length, int64_t nowUs);
+
+	// bytes Export() needs
+	size_t GetExportSize() const
+	{
+		return TrafficDumpHeader::SIZE + static_cast<size_t>(myHead - myTail);
+	}
+
+	// header and records, returns the bytes written or 0 if size is too small
+	size_t Export(uint8_t *out, size_t size) const;
+
+	void Clear();
+
+	size_t GetCapacity() const
+	{
+		return myCapacity;
+	}
+
+	size_t GetUsed() const
+	{
+		return static_cast<size_t>(myHead - myTail);
+	}
+
+	uint32_t GetDropped() const
+	{
+		return myDropped;
+	}
+
+	uint32_t GetRecorded() const
+	{
+		return myRecorded;
+	}
+
+private:
+	TrafficRole myRole;
+	uint8_t myUnit;
+	size_t myCapacity;
+	uint32_t myMergeGapUs;
+	std::unique_ptr<uint8_t[]> myRing;
+
+	// offsets grow without wrapping, the ring index is the offset modulo myCapacity. 64 bits so they don't
+	// wrap either, a size_t would after 4 GiB on the ESP32 and the index would jump unless myCapacity
+	// divided 2^32
+	uint64_t myHead = 0;
+	uint64_t myTail = 0;
+	int64_t myTailUs = 0; // start of the oldest record
+
+	// the newest record, which merging appends to
+	uint64_t myLastRecord = 0; // offset of its flags
+	uint64_t myLastFields = 0; // offset of its span and length
+	bool myHaveLast = false;
+	bool myLastWritten = false;
+	int64_t myLastStartUs = 0;
+	int64_t myLastChunkUs = 0;
+	uint16_t myLastLength = 0;
+
+	uint32_t myDropped = 0;
+	uint32_t myRecorded = 0;
+
+	void putBytes(const uint8_t *data, size_t length);
+	uint8_t at(uint64_t offset) const;
+	void poke16(uint64_t offset, uint16_t value);
+	size_t recordSize(uint64_t offset, uint64_t &startDelta) const;
+	void dropOldest();
+	bool makeRoom(size_t needed, bool keepLast);
+	void append(bool written, const uint8_t *data, size_t length, int64_t nowUs);
+};
+
+// Reads an export back, the host side of the above.
+class TrafficReader
+{
+public:
+	// false if it isn't an export this version understands or it's cut short
+	bool Open(const uint8_t *data, size_t size);
+
+	const TrafficDumpHeader &GetHeader() const
+	{
+		return myHeader;
+	}
+
+	// the next record, false at the end or on a record that runs past it
+	bool Next(TrafficChunk &chunk);
+
+private:
+	TrafficDumpHeader myHeader = {};
+	const uint8_t *myData = nullptr;
+	size_t mySize = 0;
+	size_t myOffset = 0;
+	int64_t myTimeUs = 0;
+	bool myFirst = true;
+};
+
+// Standard base64 with padding, for getting an export through a text console. Returns the characters
+// written to out, which needs room for 4 * ((length + 2) / 3).
+size_t TrafficBase64Encode(const uint8_t *data, size_t length, char *out);
+
+// Skips anything that isn't a base64 character, so line breaks and indentation don't matter. Returns the
+// bytes written to out, which needs room for 3 * (length / 4).
+size_t TrafficBase64Decode(const char *text, size_t length, uint8_t *out);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Pending writes to a block of registers (or coils), last value wins. The owner drains it in runs of
+// adjacent dirty registers so one function 16 write covers everything that changed next to each other.
+// Not thread safe on its own, the owner wraps it in whatever lock suits the context.
+template <size_t Count>
+class WriteCoalescer
+{
+	static_assert(Count <= 32, "dirty bits are kept in a uint32_t");
+
+public:
+	struct Run
+	{
+		uint16_t start = 0;
+		uint16_t count = 0;
+		std::array<uint16_t, Count> values{};
+	};
+
+	void Set(uint16_t index, uint16_t value)
+	{
+		if (index >= Count)
+		{
+			return;
+		}
+
+		uint32_t bit = 1u << index;
+		if (myDirty & bit)
+		{
+			myCoalesced++;
+		}
+
+		myValues[index] = value;
+		myDirty |= bit;
+		mySubmitted++;
+	}
+
+	bool HasPending() const
+	{
+		return myDirty != 0;
+	}
+
+	// Takes the lowest run of adjacent dirty entries and marks them clean. A Set() that lands while the
+	// run is on the wire dirties the entry again, so the newer value goes out on the next flush.
+	bool TakeRun(Run &run)
+	{
+		if (myDirty == 0)
+		{
+			return false;
+		}
+
+		uint16_t start = __builtin_ctz(myDirty);
+		uint16_t count = 0;
+
+		while (start + count < Count && (myDirty & (1u << (start + count))))
+		{
+			run.values[count] = myValues[start + count];
+			myDirty &= ~(1u << (start + count));
+			count++;
+		}
+
+		run.start = start;
+		run.count = count;
+		return true;
+	}
+
+	bool IsDirty(uint16_t index) const
+	{
+		return index < Count && (myDirty & (1u << index));
+	}
+
+	// how many Set() calls there were, and how many of those replaced a value that never went out
+	uint32_t GetSubmitted() const
+	{
+		return mySubmitted;
+	}
+
+	uint32_t GetCoalesced() const
+	{
+		return myCoalesced;
+	}
+
+private:
+	std::array<uint16_t, Count> myValues{};
+	uint32_t myDirty = 0;
+	uint32_t mySubmitted = 0;
+	uint32_t myCoalesced = 0;
+};
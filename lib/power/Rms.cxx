@@ -0,0 +1,72 @@
+#include "Rms.hxx"
+
+#include <algorithm>
+#include <cmath>
+
+// 4 lanes of 1024 / 4 samples each keep every lane's squares, at most 4095^2 * 256, inside 32 bits. The 64
+// bit adds, which take several instructions on a 32 bit core, only happen once a block.
+static constexpr size_t BLOCK = 1024;
+
+void RmsAccumulate(const uint16_t *samples, size_t count, RmsSums &sums)
+{
+	sums.count += count;
+
+	while (count > 0)
+	{
+		size_t block = std::min(count, BLOCK);
+		uint32_t sum = 0;
+		uint32_t squares0 = 0;
+		uint32_t squares1 = 0;
+		uint32_t squares2 = 0;
+		uint32_t squares3 = 0;
+
+		// separate lanes so no multiply waits on the one before it
+		size_t i = 0;
+		for (; i + 4 <= block; i += 4)
+		{
+			uint32_t a = samples[i] & RMS_SAMPLE_MASK;
+			uint32_t b = samples[i + 1] & RMS_SAMPLE_MASK;
+			uint32_t c = samples[i + 2] & RMS_SAMPLE_MASK;
+			uint32_t d = samples[i + 3] & RMS_SAMPLE_MASK;
+			sum += a + b + c + d;
+			squares0 += a * a;
+			squares1 += b * b;
+			squares2 += c * c;
+			squares3 += d * d;
+		}
+		for (; i < block; i++)
+		{
+			uint32_t a = samples[i] & RMS_SAMPLE_MASK;
+			sum += a;
+			squares0 += a * a;
+		}
+
+		sums.sum += sum;
+		sums.sumSquares += static_cast<uint64_t>(squares0) + squares1 + squares2 + squares3;
+		samples += block;
+		count -= block;
+	}
+}
+
+float RmsAroundBias(const RmsSums &sums, uint32_t biasQ4)
+{
+	if (sums.count == 0)
+	{
+		return 0;
+	}
+
+	// sum((16x - b)^2) = 256 sum(x^2) - 32 b sum(x) + n b^2, exact in 64 bits for 2^20 samples
+	int64_t bias = biasQ4;
+	int64_t squaresQ8 = static_cast<int64_t>(sums.sumSquares) * 256 - 32 * bias * static_cast<int64_t>(sums.sum) + sums.count * bias * bias;
+	if (squaresQ8 <= 0)
+	{
+		return 0;
+	}
+
+	return sqrtf(static_cast<float>(squaresQ8) / sums.count) / 16;
+}
+
+uint32_t RmsMeanQ4(const RmsSums &sums)
+{
+	return sums.count ? static_cast<uint32_t>((sums.sum * 16 + sums.count / 2) / sums.count) : 0;
+}
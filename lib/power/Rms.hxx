@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// True RMS of ADC samples around a bias, in integer arithmetic so it's cheap on a chip without a fast FPU
+// path for doubles. The samples are the raw words the ADC's DMA writes, the value in the low 12 bits and the
+// channel above them, so a DMA frame can be summed where it lies.
+
+static constexpr uint16_t RMS_SAMPLE_MASK = 0x0FFF;
+
+// Sums of any number of samples, up to 2^20 of them. The RMS around a bias comes from these afterwards, so
+// the bias can be worked out from the same samples.
+struct RmsSums
+{
+	uint32_t count;
+	uint64_t sum;
+	uint64_t sumSquares;
+};
+
+// Adds count samples to sums
+void RmsAccumulate(const uint16_t *samples, size_t count, RmsSums &sums);
+
+// RMS of the summed samples around biasQ4, both in ADC counts, the bias in sixteenths of a count
+float RmsAroundBias(const RmsSums &sums, uint32_t biasQ4);
+
+// mean of the summed samples in sixteenths of a count, the bias to use when they span whole cycles
+uint32_t RmsMeanQ4(const RmsSums &sums);
@@ -0,0 +1,80 @@
+#include "Cobs.hxx"
+
+size_t CobsEncode(const uint8_t *in, size_t length, uint8_t *out)
+{
+	size_t codeIndex = 0;
+	size_t outIndex = 1;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		if (in[i] != 0)
+		{
+			out[outIndex++] = in[i];
+			code++;
+		}
+
+		// a zero, or a full block of 254 non-zero bytes, closes the current block
+		if (in[i] == 0 || code == 0xFF)
+		{
+			out[codeIndex] = code;
+			code = 1;
+			codeIndex = outIndex++;
+
+			// a full block at the very end doesn't need an empty block after it
+			if (in[i] != 0 && i + 1 == length)
+			{
+				return codeIndex;
+			}
+		}
+	}
+
+	out[codeIndex] = code;
+	return outIndex;
+}
+
+size_t CobsDecode(const uint8_t *in, size_t length, uint8_t *out)
+{
+	size_t inIndex = 0;
+	size_t outIndex = 0;
+
+	while (inIndex < length)
+	{
+		uint8_t code = in[inIndex++];
+		if (code == 0 || inIndex + code - 1 > length)
+		{
+			return 0;
+		}
+
+		for (uint8_t i = 1; i < code; i++)
+		{
+			if (in[inIndex] == 0)
+			{
+				return 0;
+			}
+			out[outIndex++] = in[inIndex++];
+		}
+
+		// every block but a full one stands for a zero, except the last which is just the end of the data
+		if (code != 0xFF && inIndex < length)
+		{
+			out[outIndex++] = 0;
+		}
+	}
+
+	return outIndex;
+}
+
+uint16_t Crc16(const uint8_t *data, size_t length, uint16_t crc)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		crc ^= static_cast<uint16_t>(data[i]) << 8;
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+
+	return crc;
+}
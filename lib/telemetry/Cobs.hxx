@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Consistent Overhead Byte Stuffing: removes every 0x00 from a buffer for at most one extra byte per 254,
+// so 0x00 can mark the end of a frame on the wire and a receiver resyncs at the next delimiter after noise.
+
+// worst case encoded size of length bytes, not counting the 0x00 delimiter
+constexpr size_t CobsMaxEncodedSize(size_t length)
+{
+	return length + length / 254 + 1;
+}
+
+// Encodes length bytes from in into out, which must hold CobsMaxEncodedSize(length). Returns the encoded size.
+size_t CobsEncode(const uint8_t *in, size_t length, uint8_t *out);
+
+// Decodes length bytes (without the delimiter) from in into out, which must hold length bytes. Returns the
+// decoded size, or 0 if the input isn't valid COBS.
+size_t CobsDecode(const uint8_t *in, size_t length, uint8_t *out);
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+uint16_t Crc16(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF);
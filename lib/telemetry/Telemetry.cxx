@@ -0,0 +1,72 @@
+#include "Telemetry.hxx"
+
+size_t EncodeFrame(PacketType type, const void *payload, size_t length, uint8_t *out, size_t outSize)
+{
+	if (length > TELEMETRY_MAX_PAYLOAD || outSize < CobsMaxEncodedSize(1 + length + 2) + 1)
+	{
+		return 0;
+	}
+
+	uint8_t raw[1 + TELEMETRY_MAX_PAYLOAD + 2];
+	raw[0] = static_cast<uint8_t>(type);
+	if (length > 0)
+	{
+		memcpy(raw + 1, payload, length);
+	}
+
+	uint16_t crc = Crc16(raw, 1 + length);
+	raw[1 + length] = crc & 0xFF;
+	raw[2 + length] = crc >> 8;
+
+	size_t encoded = CobsEncode(raw, 3 + length, out);
+	out[encoded++] = 0;
+	return encoded;
+}
+
+bool FrameDecoder::Push(uint8_t byte)
+{
+	if (byte != 0)
+	{
+		if (myFill < sizeof(myBuffer))
+		{
+			myBuffer[myFill++] = byte;
+		}
+		else
+		{
+			myOverflow = true;
+		}
+		return false;
+	}
+
+	size_t fill = myFill;
+	bool overflow = myOverflow;
+	myFill = 0;
+	myOverflow = false;
+
+	// back to back delimiters, nothing in between
+	if (fill == 0)
+	{
+		return false;
+	}
+
+	size_t decoded = overflow ? 0 : CobsDecode(myBuffer, fill, myDecoded);
+
+	// at least the type and the crc
+	if (decoded < 3)
+	{
+		myErrors++;
+		return false;
+	}
+
+	uint16_t crc = myDecoded[decoded - 2] | (myDecoded[decoded - 1] << 8);
+	if (Crc16(myDecoded, decoded - 2) != crc)
+	{
+		myErrors++;
+		return false;
+	}
+
+	myType = static_cast<PacketType>(myDecoded[0]);
+	myLength = decoded - 3;
+	myFrames++;
+	return true;
+}
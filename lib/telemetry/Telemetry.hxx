@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Cobs.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Alternate link mode: instead of the Frontend polling over Modbus RTU, the Server streams telemetry packets
+// at a fixed rate and the Frontend sends register writes back as commands, both on the same UART.
+//
+// Every packet goes out as COBS(type | payload | crc16) followed by a 0x00 delimiter. Payloads are packed
+// little endian structs, both ends are ESP32s.
+//
+// The link always starts out as Modbus RTU. The Frontend asks for telemetry by writing LinkModeRegisters at
+// LINK_MODE_ADDRESS, a Server that doesn't know about it answers with an exception and the link just stays
+// RTU. Once switched, either end falls back to RTU on its own when it hasn't heard a valid frame from the
+// other for KEEPALIVE_TIMEOUT_MS, so a reset on either side recovers without any handshake.
+
+static constexpr uint16_t LINK_MODE_ADDRESS = 0x300; // holding registers
+
+enum class LinkMode : uint16_t
+{
+	RTU = 0,
+	TELEMETRY = 1,
+};
+
+struct LinkModeRegisters
+{
+	uint16_t MODE;
+	uint16_t TELEMETRY_PERIOD_MS;
+	uint16_t KEEPALIVE_TIMEOUT_MS;
+
+	static constexpr uint16_t COUNT = 3;
+};
+
+enum class PacketType : uint8_t
+{
+	TELEMETRY = 0x01,	// Server -> Frontend, every TELEMETRY_PERIOD_MS
+	COMMAND = 0x02,		// Frontend -> Server, one register or coil write
+	COMMAND_ACK = 0x03, // Server -> Frontend
+	KEEPALIVE = 0x04,	// Frontend -> Server when there's nothing else to send
+};
+
+enum class CommandTable : uint8_t
+{
+	COIL = 0,
+	HOLDING_REGISTER = 1,
+};
+
+enum TelemetryFlags : uint8_t
+{
+	TELEMETRY_ENABLED = 0x01,
+	TELEMETRY_ERROR = 0x02,
+};
+
+#pragma pack(push, 1)
+struct TelemetryPacket
+{
+	uint16_t sequence;
+	uint32_t timeMs; // Server uptime
+	int16_t tempDc;	 // tenths of a degree C
+	int16_t targetDc;
+	uint16_t duty;
+	uint16_t errorCode;
+	uint8_t flags; // TelemetryFlags
+};
+
+struct CommandPacket
+{
+	uint16_t sequence;
+	uint8_t table; // CommandTable
+	uint16_t address;
+	uint16_t value;
+};
+
+struct CommandAckPacket
+{
+	uint16_t sequence;
+	uint8_t status; // 0 when applied, otherwise the Modbus exception code the same write would have got
+};
+#pragma pack(pop)
+
+static constexpr size_t TELEMETRY_MAX_PAYLOAD = 32;
+static constexpr size_t TELEMETRY_MAX_FRAME = CobsMaxEncodedSize(1 + TELEMETRY_MAX_PAYLOAD + 2) + 1;
+
+// Encodes a whole frame including the trailing delimiter into out. Returns its size, or 0 if it doesn't fit.
+size_t EncodeFrame(PacketType type, const void *payload, size_t length, uint8_t *out, size_t outSize);
+
+template <typename Packet>
+size_t EncodeFrame(PacketType type, const Packet &packet, uint8_t *out, size_t outSize)
+{
+	return EncodeFrame(type, &packet, sizeof(packet), out, outSize);
+}
+
+// Reassembles frames from a byte stream. Push() every received byte, when it returns true a frame with a
+// good CRC is available through GetType()/Get() until the next Push().
+class FrameDecoder
+{
+public:
+	bool Push(uint8_t byte);
+
+	PacketType GetType() const
+	{
+		return myType;
+	}
+
+	size_t GetLength() const
+	{
+		return myLength;
+	}
+
+	template <typename Packet>
+	bool Get(Packet &packet) const
+	{
+		if (myLength != sizeof(packet))
+		{
+			return false;
+		}
+		memcpy(&packet, myDecoded + 1, sizeof(packet));
+		return true;
+	}
+
+	uint32_t GetFrames() const
+	{
+		return myFrames;
+	}
+
+	// bad COBS, too long, too short or a CRC mismatch. Line noise and Modbus traffic end up here.
+	uint32_t GetErrors() const
+	{
+		return myErrors;
+	}
+
+private:
+	uint8_t myBuffer[TELEMETRY_MAX_FRAME];
+	uint8_t myDecoded[TELEMETRY_MAX_FRAME];
+	size_t myFill = 0;
+	bool myOverflow = false;
+	PacketType myType = PacketType::KEEPALIVE;
+	size_t myLength = 0;
+	uint32_t myFrames = 0;
+	uint32_t myErrors = 0;
+};
@@ -0,0 +1,311 @@
+#include "LinkUart.hxx"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <new>
+#include <stdio.h>
+
+static const char *LINKUARTTAG = "LinkUart";
+
+LinkUart::LinkUart(uart_port_t aPort, size_t aRxBufferSize, size_t aTxBufferSize, int aTxPin, int aRxPin, int aRtsPin, int aCtsPin)
+	: PL::Uart(aPort, aRxBufferSize, aTxBufferSize, aTxPin, aRxPin, aRtsPin, aCtsPin), myPort(aPort)
+{
+}
+
+esp_err_t LinkUart::ConfigureFrameTiming(uint8_t rxTimeoutSymbols, int rxFullThreshold)
+{
+	esp_err_t result = uart_set_rx_timeout(myPort, rxTimeoutSymbols);
+	if (result != ESP_OK)
+	{
+		ESP_LOGE(LINKUARTTAG, "Failed to set the RX timeout: %s", esp_err_to_name(result));
+		return result;
+	}
+
+	result = uart_set_rx_full_threshold(myPort, rxFullThreshold);
+	if (result != ESP_OK)
+	{
+		ESP_LOGE(LINKUARTTAG, "Failed to set the RX full threshold: %s", esp_err_to_name(result));
+	}
+
+	return result;
+}
+
+esp_err_t LinkUart::EnableRs485(int dePin)
+{
+	esp_err_t result = uart_set_pin(myPort, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, dePin, UART_PIN_NO_CHANGE);
+	if (result != ESP_OK)
+	{
+		ESP_LOGE(LINKUARTTAG, "Failed to set the DE pin: %s", esp_err_to_name(result));
+		return result;
+	}
+
+	// half duplex mode never enables the clash interrupt, collision detect is half duplex that does
+	result = uart_set_mode(myPort, UART_MODE_RS485_COLLISION_DETECT);
+	if (result != ESP_OK)
+	{
+		ESP_LOGE(LINKUARTTAG, "Failed to switch to RS-485: %s", esp_err_to_name(result));
+		return result;
+	}
+
+	myRs485 = true;
+	ESP_LOGI(LINKUARTTAG, "UART %d in RS-485 half duplex, DE on GPIO %d", myPort, dePin);
+	return ESP_OK;
+}
+
+void LinkUart::GetTurnaround(LatencyHistogram &copy)
+{
+	taskENTER_CRITICAL(&myTimingLock);
+	copy = myTurnaround;
+	taskEXIT_CRITICAL(&myTimingLock);
+}
+
+void LinkUart::GetTxDrain(LatencyHistogram &copy)
+{
+	taskENTER_CRITICAL(&myTimingLock);
+	copy = myTxDrain;
+	taskEXIT_CRITICAL(&myTimingLock);
+}
+
+void LinkUart::ResetTurnaround()
+{
+	taskENTER_CRITICAL(&myTimingLock);
+	myTurnaround.Reset();
+	myTxDrain.Reset();
+	myCollisions = 0;
+	taskEXIT_CRITICAL(&myTimingLock);
+}
+
+void LinkUart::EnableBusMonitor(uint8_t unit, uint32_t frameTimeoutUs)
+{
+	myBusMonitorMutex = xSemaphoreCreateMutex();
+	if (myBusMonitorMutex == nullptr)
+	{
+		ESP_LOGE(LINKUARTTAG, "Failed to create bus monitor mutex");
+		return;
+	}
+
+	myBusMonitor = std::make_unique<BusMonitor>(unit, frameTimeoutUs);
+}
+
+bool LinkUart::GetBusMonitor(BusMonitor &copy)
+{
+	if (!myBusMonitor)
+	{
+		return false;
+	}
+
+	xSemaphoreTake(myBusMonitorMutex, portMAX_DELAY);
+	copy = *myBusMonitor;
+	xSemaphoreGive(myBusMonitorMutex);
+
+	return true;
+}
+
+void LinkUart::GetBusCounters(DiagnosticsCounters &counters)
+{
+	if (!myBusMonitor)
+	{
+		counters = {};
+		return;
+	}
+
+	xSemaphoreTake(myBusMonitorMutex, portMAX_DELAY);
+	counters = myBusMonitor->GetCounters();
+	xSemaphoreGive(myBusMonitorMutex);
+}
+
+void LinkUart::ClearBusMonitor()
+{
+	if (!myBusMonitor)
+	{
+		return;
+	}
+
+	xSemaphoreTake(myBusMonitorMutex, portMAX_DELAY);
+	myBusMonitor->Clear();
+	xSemaphoreGive(myBusMonitorMutex);
+}
+
+void LinkUart::EnableTrafficRecorder(TrafficRole role, uint8_t unit, size_t capacity, uint32_t mergeGapUs)
+{
+	myTrafficMutex = xSemaphoreCreateMutex();
+	if (myTrafficMutex == nullptr)
+	{
+		ESP_LOGE(LINKUARTTAG, "Failed to create traffic recorder mutex");
+		return;
+	}
+
+	myTrafficRecorder = std::make_unique<TrafficRecorder>(role, unit, capacity, mergeGapUs);
+}
+
+bool LinkUart::PrintTrafficDump()
+{
+	if (!myTrafficRecorder)
+	{
+		return false;
+	}
+
+	// copied out in one go so the recording carries on while the dump is printed
+	xSemaphoreTake(myTrafficMutex, portMAX_DELAY);
+	size_t size = myTrafficRecorder->GetExportSize();
+	std::unique_ptr<uint8_t[]> copy(new (std::nothrow) uint8_t[size]);
+	if (copy)
+	{
+		myTrafficRecorder->Export(copy.get(), size);
+	}
+	uint32_t recorded = myTrafficRecorder->GetRecorded();
+	uint32_t dropped = myTrafficRecorder->GetDropped();
+	size_t capacity = myTrafficRecorder->GetCapacity();
+	xSemaphoreGive(myTrafficMutex);
+
+	if (!copy)
+	{
+		ESP_LOGE(LINKUARTTAG, "No memory for a %u byte traffic dump", size);
+		return false;
+	}
+
+	printf("%u of %u bytes, %lu records, %lu overwritten\n%s\n", size, capacity, recorded, dropped, TRAFFIC_DUMP_BEGIN);
+
+	// 57 bytes make one 76 character line
+	char line[77];
+	for (size_t offset = 0; offset < size; offset += 57)
+	{
+		size_t length = TrafficBase64Encode(copy.get() + offset, size - offset < 57 ? size - offset : 57, line);
+		line[length] = '\0';
+		printf("%s\n", line);
+	}
+	printf("%s\n", TRAFFIC_DUMP_END);
+
+	return true;
+}
+
+void LinkUart::ClearTrafficRecorder()
+{
+	if (!myTrafficRecorder)
+	{
+		return;
+	}
+
+	xSemaphoreTake(myTrafficMutex, portMAX_DELAY);
+	myTrafficRecorder->Clear();
+	xSemaphoreGive(myTrafficMutex);
+}
+
+void LinkUart::PauseMonitoring(bool paused)
+{
+	if (myTrafficRecorder)
+	{
+		xSemaphoreTake(myTrafficMutex, portMAX_DELAY);
+		myTrafficPaused = paused;
+		xSemaphoreGive(myTrafficMutex);
+	}
+
+	if (!myBusMonitor)
+	{
+		return;
+	}
+
+	xSemaphoreTake(myBusMonitorMutex, portMAX_DELAY);
+	myBusMonitorPaused = paused;
+	myBusMonitor->Resync();
+	xSemaphoreGive(myBusMonitorMutex);
+}
+
+void LinkUart::record(const void *data, size_t size, int64_t nowUs, bool written)
+{
+	if (!myTrafficRecorder)
+	{
+		return;
+	}
+
+	xSemaphoreTake(myTrafficMutex, portMAX_DELAY);
+	if (!myTrafficPaused)
+	{
+		myTrafficRecorder->Record(written, static_cast<const uint8_t *>(data), size, nowUs);
+	}
+	xSemaphoreGive(myTrafficMutex);
+}
+
+void LinkUart::feedBusMonitor(const void *data, size_t size, int64_t nowUs, bool received)
+{
+	if (!myBusMonitor)
+	{
+		return;
+	}
+
+	xSemaphoreTake(myBusMonitorMutex, portMAX_DELAY);
+	if (!myBusMonitorPaused)
+	{
+		if (received)
+		{
+			myBusMonitor->Received(static_cast<const uint8_t *>(data), size, nowUs);
+		}
+		else
+		{
+			myBusMonitor->Sent(static_cast<const uint8_t *>(data), size, nowUs);
+		}
+	}
+	xSemaphoreGive(myBusMonitorMutex);
+}
+
+esp_err_t LinkUart::Read(void *dest, size_t size)
+{
+	esp_err_t result = PL::Uart::Read(dest, size);
+	if (result == ESP_OK && size > 0)
+	{
+		myLastReadUs = esp_timer_get_time();
+		myAnswered = false;
+
+		feedBusMonitor(dest, size, myLastReadUs, true);
+		record(dest, size, myLastReadUs, false);
+	}
+	return result;
+}
+
+esp_err_t LinkUart::Write(const void *src, size_t size)
+{
+	if (!myAnswered)
+	{
+		uint32_t turnaround = static_cast<uint32_t>(esp_timer_get_time() - myLastReadUs);
+		taskENTER_CRITICAL(&myTimingLock);
+		myTurnaround.Record(turnaround);
+		taskEXIT_CRITICAL(&myTimingLock);
+		myAnswered = true;
+	}
+
+	int64_t start = esp_timer_get_time();
+	feedBusMonitor(src, size, start, false);
+	record(src, size, start, true);
+
+	esp_err_t result = PL::Uart::Write(src, size);
+	if (result != ESP_OK || !myRs485)
+	{
+		return result;
+	}
+
+	// Write() only queues the bytes, wait until they are on the wire to know whether anyone talked over us
+	result = uart_wait_tx_done(myPort, pdMS_TO_TICKS(RS485_TX_DONE_TIMEOUT_MS));
+	if (result != ESP_OK)
+	{
+		return result;
+	}
+	uint32_t drain = static_cast<uint32_t>(esp_timer_get_time() - start);
+
+	// the receiver was listening to us the whole time, drop the echo before it's taken for the next frame
+	bool collision = false;
+	uart_get_collision_flag(myPort, &collision);
+	uart_flush_input(myPort);
+
+	taskENTER_CRITICAL(&myTimingLock);
+	myTxDrain.Record(drain);
+	uint32_t collisions = collision ? ++myCollisions : myCollisions;
+	taskEXIT_CRITICAL(&myTimingLock);
+
+	if (collision)
+	{
+		ESP_LOGW(LINKUARTTAG, "Collision on the RS-485 bus (%lu so far)", collisions);
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "modbus/BusMonitor.hxx"
+#include "modbus/LinkStats.hxx"
+#include "modbus/TrafficRecorder.hxx"
+
+#include <driver/uart.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <memory>
+#include <pl_uart.h>
+
+// Idle time, in character times, after which the hardware hands received bytes over. Between the 1.5
+// character inter-character limit and the 3.5 character inter-frame gap of Modbus RTU, same as esp-modbus.
+static constexpr uint8_t RTU_RX_TIMEOUT_SYMBOLS = 3;
+// Long frames are handed over in chunks of this many bytes while they arrive, rather than 120 at a time
+static constexpr int RTU_RX_FULL_THRESHOLD = 64;
+static constexpr size_t RTU_RX_BUFFER_SIZE = 512; // room for two maximum size frames
+static constexpr size_t RTU_TX_BUFFER_SIZE = 512;
+static constexpr uint32_t RS485_TX_DONE_TIMEOUT_MS = 500; // a maximum size frame at 9600 baud is ~300 ms
+
+static constexpr const char *TRAFFIC_DUMP_BEGIN = "-----BEGIN MODBUS TRAFFIC-----";
+static constexpr const char *TRAFFIC_DUMP_END = "-----END MODBUS TRAFFIC-----";
+
+// PL::Uart for the Modbus link. Lets the hardware find the end of a frame: the RX idle timeout fires a
+// couple of character times after the line goes quiet and hands whatever is in the FIFO to the driver,
+// instead of the bytes sitting there until the FIFO fills or the driver's default 10 symbol timeout.
+// Also timestamps traffic, so the time from the last byte of a request being read to the first byte of
+// the reply being written (the turnaround) can be measured.
+class LinkUart : public PL::Uart
+{
+public:
+	LinkUart(uart_port_t aPort, size_t aRxBufferSize, size_t aTxBufferSize, int aTxPin, int aRxPin, int aRtsPin = UART_PIN_NO_CHANGE, int aCtsPin = UART_PIN_NO_CHANGE);
+
+	using PL::Uart::Read;
+	using PL::Uart::Write;
+	esp_err_t Read(void *dest, size_t size) override;
+	esp_err_t Write(const void *src, size_t size) override;
+
+	// call after Initialize(). rxTimeoutSymbols must stay under 3.5 so a frame ends before the next could
+	// start, and over 1.5 so a slow sender's inter-character gap doesn't split one.
+	esp_err_t ConfigureFrameTiming(uint8_t rxTimeoutSymbols, int rxFullThreshold);
+
+	// Switches to RS-485 half duplex: the UART drives the transceiver's DE from RTS on dePin for exactly as
+	// long as it is transmitting, and flags a collision if what it reads back while sending differs from what
+	// it sent. That needs the receiver on while sending, so /RE must be tied low, not to DE, or nothing is
+	// read back and no collision is ever seen. The echo is dropped after each write. Call after Initialize().
+	esp_err_t EnableRs485(int dePin);
+
+	bool IsRs485() const
+	{
+		return myRs485;
+	}
+
+	// writes that found someone else driving the bus, they fail with ESP_FAIL
+	uint32_t GetCollisions()
+	{
+		taskENTER_CRITICAL(&myTimingLock);
+		uint32_t collisions = myCollisions;
+		taskEXIT_CRITICAL(&myTimingLock);
+		return collisions;
+	}
+
+	// RS-485 only: from the start of a write until the last bit is out and DE is released, so the bus is
+	// free for the reply. Wire time plus whatever the driver adds.
+	void GetTxDrain(LatencyHistogram &copy);
+
+	// Server end only: feeds everything read and written through a BusMonitor for unit, see
+	// modbus/BusMonitor.hxx. Call before the Modbus server is enabled.
+	void EnableBusMonitor(uint8_t unit, uint32_t frameTimeoutUs);
+
+	// copy of the monitor so far, false if it was never enabled
+	bool GetBusMonitor(BusMonitor &copy);
+
+	// just the counters, cheap enough for an OnRead(). All zero if the monitor was never enabled.
+	void GetBusCounters(DiagnosticsCounters &counters);
+
+	void ClearBusMonitor();
+
+	// Keeps the last capacity bytes or so of traffic in RAM, see modbus/TrafficRecorder.hxx. Either end,
+	// call before the link is used.
+	void EnableTrafficRecorder(TrafficRole role, uint8_t unit, size_t capacity, uint32_t mergeGapUs);
+
+	// Prints the recording to stdout as base64 between TRAFFIC_DUMP_BEGIN and TRAFFIC_DUMP_END lines, for
+	// Host/traffic_tool. False if the recorder was never enabled or there's no memory for the copy.
+	bool PrintTrafficDump();
+
+	void ClearTrafficRecorder();
+
+	// while paused the traffic isn't Modbus (telemetry mode) and isn't fed to the monitor or the recorder
+	void PauseMonitoring(bool paused);
+
+	uart_port_t GetPort() const
+	{
+		return myPort;
+	}
+
+	// read to write, in microseconds. Only meaningful on the server end, where every write answers a read.
+	void GetTurnaround(LatencyHistogram &copy);
+
+	void ResetTurnaround();
+
+private:
+	uart_port_t myPort;
+	int64_t myLastReadUs = 0;
+	bool myAnswered = true;
+	bool myRs485 = false;
+
+	// written by whichever task is writing, read by the console's
+	portMUX_TYPE myTimingLock = portMUX_INITIALIZER_UNLOCKED;
+	LatencyHistogram myTurnaround;
+	uint32_t myCollisions = 0;
+	LatencyHistogram myTxDrain;
+
+	std::unique_ptr<BusMonitor> myBusMonitor;
+	SemaphoreHandle_t myBusMonitorMutex = nullptr;
+	bool myBusMonitorPaused = false;
+
+	std::unique_ptr<TrafficRecorder> myTrafficRecorder;
+	SemaphoreHandle_t myTrafficMutex = nullptr;
+	bool myTrafficPaused = false;
+
+	void feedBusMonitor(const void *data, size_t size, int64_t nowUs, bool received);
+	void record(const void *data, size_t size, int64_t nowUs, bool written);
+};
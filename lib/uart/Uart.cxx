@@ -10,9 +10,10 @@ UARTManager *UARTManager::myInstance = nullptr;
 
 UARTManager::UARTManager(uart_port_t aPort)
 {
-	myUart = std::make_shared<PL::Uart>(aPort);
+	myUart = std::make_shared<LinkUart>(aPort, RTU_RX_BUFFER_SIZE, RTU_TX_BUFFER_SIZE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
 
 	myUart->Initialize();
+	myUart->ConfigureFrameTiming(RTU_RX_TIMEOUT_SYMBOLS, RTU_RX_FULL_THRESHOLD);
 	myUart->SetBaudRate(115200);
 	myUart->SetDataBits(8);
 	myUart->SetParity(PL::UartParity::even);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "LinkUart.hxx"
+
 #include <pl_uart.h>
 
 class UARTManager
@@ -16,7 +18,7 @@ public:
 		return myInstance;
 	}
 
-	std::shared_ptr<PL::Uart> GetUart()
+	std::shared_ptr<LinkUart> GetUart()
 	{
 		return myUart;
 	}
@@ -24,5 +26,5 @@ public:
 private:
 	static UARTManager *myInstance;
 
-	std::shared_ptr<PL::Uart> myUart;
+	std::shared_ptr<LinkUart> myUart;
 };
\ No newline at end of file